@@ -0,0 +1,45 @@
+#version 400
+#extension GL_ARB_viewport_array : require
+
+// One invocation per cascade
+layout(triangles, invocations = 4) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+// shadow_data uniform buffer
+layout(std140) uniform shadow_data
+{
+    uniform vec4 _CascadeDistancesSqr;
+    uniform mat4x4 _WorldToShadow[4];
+    uniform mat4x4 _CascadeViewProjection[4];
+};
+
+flat in uint cascadeMask[];
+
+#ifdef ALPHA_TEST_ON
+    in vec2 vertexTexcoord[];
+    out vec2 texcoord;
+#endif
+
+void main()
+{
+    // Only output the triangle to cascades the caster is inside
+    if((cascadeMask[0] & (1u << gl_InvocationID)) == 0u)
+    {
+        return;
+    }
+    
+    // Each cascade has its own viewport in the shadow map
+    for(int i = 0; i < 3; ++i)
+    {
+        gl_Position = _CascadeViewProjection[gl_InvocationID] * gl_in[i].gl_Position;
+        gl_ViewportIndex = gl_InvocationID;
+
+#ifdef ALPHA_TEST_ON
+        texcoord = vertexTexcoord[i];
+#endif
+        
+        EmitVertex();
+    }
+    
+    EndPrimitive();
+}
@@ -0,0 +1,28 @@
+#version 400
+
+layout(location = 0) in vec4 _position;
+
+// Per-instance attributes
+layout(location = 4) in mat4x4 _ModelToWorld;
+layout(location = 8) in uint _CascadeMask;
+
+// World space positions are sent to the geometry shader,
+// which transforms them for each cascade
+flat out uint cascadeMask;
+
+#ifdef ALPHA_TEST_ON
+    // Use the main texture and texcoord for alpha testing
+    layout(location = 3) in vec2 _texcoord;
+    out vec2 vertexTexcoord;
+#endif
+
+void main()
+{
+    gl_Position = _ModelToWorld * _position;
+    cascadeMask = _CascadeMask;
+
+#ifdef ALPHA_TEST_ON
+    // Texcoord only needed for alpha test texture lookups
+    vertexTexcoord = _texcoord;
+#endif
+}
@@ -9,13 +9,11 @@ layout(std140) uniform camera_data
     uniform mat4x4 _ClipToWorld;
 };
 
-layout(std140) uniform per_object_data
-{
-    uniform mat4x4 _ModelToWorldPerInstance[256];
-};
-
 layout(location = 0) in vec4 _position;
 
+// Per-instance attributes
+layout(location = 4) in mat4x4 _ModelToWorld;
+
 #ifdef ALPHA_TEST_ON
     // Use the main texture and texcoord for alpha testing
     layout(location = 3) in vec2 _texcoord;
@@ -24,7 +22,6 @@ layout(location = 0) in vec4 _position;
 
 void main()
 {
-    mat4x4 _ModelToWorld = _ModelToWorldPerInstance[gl_InstanceID];
     gl_Position = _ViewProjectionMatrix * (_ModelToWorld * _position);
     
 #ifdef ALPHA_TEST_ON
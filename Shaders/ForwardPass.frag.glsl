@@ -75,9 +75,12 @@ vec3 BlinnPhongLight(vec4 surface, vec3 worldNormal, vec3 viewDirection)
  */
 vec3 UnpackNormalMap(vec4 packedNormal)
 {
-    // Normal map rgb contains tangent space normal
-    // encoded in [-1 - 1] range.
-    vec3 tangentNormal = packedNormal.rgb * 2.0 - 1.0;
+    // Normal map rg contains the tangent space normal x and y
+    // encoded in [-1 - 1] range. Compressed normal maps only
+    // store x and y, so z is reconstructed from the unit length.
+    vec3 tangentNormal;
+    tangentNormal.xy = packedNormal.rg * 2.0 - 1.0;
+    tangentNormal.z = sqrt(max(0.0, 1.0 - dot(tangentNormal.xy, tangentNormal.xy)));
     
     // Construct world space normal from the world space
     // (tangent, normal, bitangent) basis sent from the vertex shader.
@@ -17,18 +17,20 @@ layout(std140) uniform camera_data
     uniform mat4x4 _ClipToWorld;
 };
 
-// Per-object uniform buffer.
-layout(std140) uniform per_object_data
-{
-    uniform mat4x4 _ModelToWorldPerInstance[256];
-};
-
 // Vertex attributes
 layout(location = 0) in vec4 _position;
-layout(location = 1) in vec3 _normal;
+#ifdef COMPRESSED_VERTICES
+    // Octahedral encoded normal
+    layout(location = 1) in vec2 _packedNormal;
+#else
+    layout(location = 1) in vec3 _normal;
+#endif
 layout(location = 2) in vec4 _tangent;
 layout(location = 3) in vec2 _texcoord;
 
+// Per-instance attributes
+layout(location = 4) in mat4x4 _ModelToWorld;
+
 #ifdef SPECULAR_ON
     // Direction to the camera, normalized.
     out vec3 viewDir;
@@ -52,9 +54,27 @@ layout(location = 3) in vec2 _texcoord;
 
 out vec2 texcoord;
 
+#ifdef COMPRESSED_VERTICES
+/*
+ * Unfolds a normal stored on an octahedron.
+ * The lower half is folded over the diagonals when encoded.
+ */
+vec3 DecodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += (normal.x >= 0.0) ? -fold : fold;
+    normal.y += (normal.y >= 0.0) ? -fold : fold;
+    return normalize(normal);
+}
+#endif
+
 void main()
 {
-    mat4x4 _ModelToWorld = _ModelToWorldPerInstance[gl_InstanceID];
+#ifdef COMPRESSED_VERTICES
+    vec3 _normal = DecodeOctahedral(_packedNormal);
+#endif
+    
     gl_Position = _ViewProjectionMatrix * (_ModelToWorld * _position);
     
 #if defined(SPECULAR_ON) || defined(FOG_ON)
@@ -0,0 +1,38 @@
+#version 330
+
+// Must match HiZBuffer::Width and HiZBuffer::Height
+#define HIZ_WIDTH 256
+#define HIZ_HEIGHT 128
+
+// Scene depth texture
+uniform sampler2D _MainTexture;
+
+// Output color
+// Contains (max depth, min depth, 0, 0)
+out vec4 fragColor;
+
+void main()
+{
+    // Find the range of scene depth texels covered by this texel
+    ivec2 depthSize = textureSize(_MainTexture, 0);
+    vec2 scale = vec2(depthSize) / vec2(HIZ_WIDTH, HIZ_HEIGHT);
+    vec2 texel = floor(gl_FragCoord.xy);
+    ivec2 start = ivec2(floor(texel * scale));
+    ivec2 end = min(ivec2(ceil((texel + 1.0) * scale)), depthSize);
+    
+    // Keep the furthest depth, so anything behind it is definitely hidden,
+    // and the nearest depth, for fitting the shadow cascades to the view
+    float maxDepth = 0.0;
+    float minDepth = 1.0;
+    for(int y = start.y; y < end.y; ++y)
+    {
+        for(int x = start.x; x < end.x; ++x)
+        {
+            float depth = texelFetch(_MainTexture, ivec2(x, y), 0).r;
+            maxDepth = max(maxDepth, depth);
+            minDepth = min(minDepth, depth);
+        }
+    }
+    
+    fragColor = vec4(maxDepth, minDepth, 0.0, 0.0);
+}
@@ -4,6 +4,13 @@
 // 17x17 PCF can touch up to 3x3=9 leaf nodes
 #define PCF_MAX_LOOKUPS 9
 
+// Set in the tile table for tiles that are not resident, must match VoxelPagePool
+#define NON_RESIDENT_TILE 2147483648u
+
+// The words in the tile table for each tile, must match VoxelPagePool.
+// Stores (entry, depth offset, depth scale)
+#define TILE_TABLE_WORDS 3
+
 // Camera uniform buffer
 layout(std140) uniform camera_data
 {
@@ -18,7 +25,8 @@ layout(std140) uniform voxel_data
 {
     uniform mat4x4 _WorldToVoxel;
     uniform uint _VoxelTreeHeight;
-    uniform uint _TileSubdivisions;
+    uniform uint _TileCountX;
+    uniform uint _TileCountY;
     
     // The total number of voxels in the PCF kernel
     uniform uint _PCFSampleCount;
@@ -60,22 +68,24 @@ struct LeafNodeQuery
 
 /*
  * Get the voxel-space coordinate corresponding to a world-space position.
- * The computed coordinate can be used to look up a voxel in the tree.
+ * The depth is relative to the whole scene, and is converted to the depth
+ * within a tile when the tile is looked up.
  */
-uvec3 getVoxelCoord(vec4 worldSpacePosition)
+vec3 getVoxelCoord(vec4 worldSpacePosition)
 {
     // worldSpacePosition.w must be 1
-    return uvec3((_WorldToVoxel * worldSpacePosition).xyz);
+    return (_WorldToVoxel * worldSpacePosition).xyz;
 }
 
 /*
- * Computes the child index at a given depth for the specified coord.
+ * Computes the child index at a given depth for the specified coord,
+ * in a tile with the given tree height.
  * Must be consistent with the cpp builder code.
  */
-uint getChildIndex(uint depth, uvec3 coord)
+uint getChildIndex(uint treeHeight, uint depth, uvec3 coord)
 {
     // The last inner node before the leaf nodes is treated differently.
-    if(depth == _VoxelTreeHeight - 3u)
+    if(depth == treeHeight - 3u)
     {
         // Nodes are in a vertical stack.
         // Recover directly from the last z coord bits.
@@ -83,9 +93,9 @@ uint getChildIndex(uint depth, uvec3 coord)
     }
     
     // Get the 0/1 index for each axis
-    uint childIndexX = (coord.x >> (_VoxelTreeHeight - 1u - depth)) & 1u;
-    uint childIndexY = (coord.y >> (_VoxelTreeHeight - 1u - depth)) & 1u;
-    uint childIndexZ = (coord.z >> (_VoxelTreeHeight - 1u - depth)) & 1u;
+    uint childIndexX = (coord.x >> (treeHeight - 1u - depth)) & 1u;
+    uint childIndexY = (coord.y >> (treeHeight - 1u - depth)) & 1u;
+    uint childIndexZ = (coord.z >> (treeHeight - 1u - depth)) & 1u;
     
     // Combine them
     return (childIndexX << 2) | (childIndexY << 1) | childIndexZ;
@@ -122,21 +132,77 @@ uint getVoxelLeafIndex(uvec3 coord)
     return (xIndex << 3) | yIndex;
 }
 
-LeafNodeQuery getLeafNode(uvec3 coord)
+LeafNodeQuery getLeafNode(uvec2 xy, float voxelZ)
 {
     // Compute which tile the coord is in
-    uint tileX = coord.x >> _VoxelTreeHeight;
-    uint tileY = coord.y >> _VoxelTreeHeight;
-    uint tileIndex = (tileX * _TileSubdivisions) + tileY;
+    uint tileX = xy.x >> _VoxelTreeHeight;
+    uint tileY = xy.y >> _VoxelTreeHeight;
+    
+    // Positions outside the tree have no static geometry over them
+    if(tileX >= _TileCountX || tileY >= _TileCountY)
+    {
+        LeafNodeQuery q;
+        q.treeDepthReached = 0u;
+        q.highBits = 4294967295u;
+        q.lowBits = 4294967295u;
+        return q;
+    }
+    
+    uint tileIndex = (tileX * _TileCountY) + tileY;
+    int tableIndex = int(tileIndex) * TILE_TABLE_WORDS;
+    
+    // Each tile covers the depth of the geometry over it.
+    // Positions in front of it are unshadowed, and those behind it
+    // have the state of the deepest voxel.
+    uint tileEntry = texelFetch(_VoxelData, tableIndex).r;
+    float depthOffset = uintBitsToFloat(texelFetch(_VoxelData, tableIndex + 1).r);
+    float depthScale = uintBitsToFloat(texelFetch(_VoxelData, tableIndex + 2).r);
+    float tileZ = (voxelZ - depthOffset) * depthScale;
+    if(tileZ < 0.0)
+    {
+        LeafNodeQuery q;
+        q.treeDepthReached = 0u;
+        q.highBits = 4294967295u;
+        q.lowBits = 4294967295u;
+        return q;
+    }
+    
+    uint maxZ = (1u << _VoxelTreeHeight) - 1u;
+    uvec3 coord = uvec3(xy, min(uint(tileZ), maxZ));
     
-    // Get the memory address of the first node to visit
-    int memAddress = int(texelFetch(_VoxelData, int(tileIndex)).r);
+    // Tiles that are not resident store the child mask of their root node,
+    // with the height of the tile above it.
+    // Mixed children are treated as unshadowed until the tile is loaded.
+    if(tileEntry >= NON_RESIDENT_TILE)
+    {
+        uint coarseHeight = (tileEntry >> 16) & 31u;
+        uvec3 coarseCoord = coord >> (_VoxelTreeHeight - coarseHeight);
+        uint childState = (tileEntry >> (getChildIndex(coarseHeight, 0u, coarseCoord) * 2u)) & 3u;
+        uint unshadowed = childState == 0u ? 0u : 1u;
+        
+        LeafNodeQuery q;
+        q.treeDepthReached = 0u;
+        q.highBits = 4294967295u * unshadowed;
+        q.lowBits = 4294967295u * unshadowed;
+        return q;
+    }
+    
+    // Pointers in the tile are relative to its start.
+    // The first word points to the root node, and the second is the tile's height.
+    int tileAddress = int(tileEntry);
+    int memAddress = tileAddress + int(texelFetch(_VoxelData, tileAddress).r);
+    uint tileHeight = texelFetch(_VoxelData, tileAddress + 1).r;
+    
+    // Tiles built at a lower resolution have fewer levels,
+    // and each of their voxels covers several full resolution ones
+    uint lodShift = _VoxelTreeHeight - tileHeight;
+    uvec3 tileCoord = coord >> lodShift;
 
     // Traverse inner nodes
-    for(uint depth = 0u; depth <= _VoxelTreeHeight - 3u; ++depth)
+    for(uint depth = 0u; depth <= tileHeight - 3u; ++depth)
     {
         // Fetch the node's child mask
-        uint childIndex = getChildIndex(depth, coord);
+        uint childIndex = getChildIndex(tileHeight, depth, tileCoord);
         uint childMask = texelFetch(_VoxelData, memAddress).r >> 16;
         uint childState = (childMask >> (childIndex * 2u)) & 3u;
         
@@ -154,14 +220,29 @@ LeafNodeQuery getLeafNode(uvec3 coord)
         // Retrieve the child node memory location
         int childPtrIndex = getChildPointerIndex(childMask, childIndex);
         int childPtr = memAddress + 1 + childPtrIndex;
-        memAddress = int(texelFetch(_VoxelData, childPtr).r);
+        memAddress = tileAddress + int(texelFetch(_VoxelData, childPtr).r);
     }
     
     // We have reached a leaf node.
     LeafNodeQuery q;
-    q.treeDepthReached = _VoxelTreeHeight;
+    q.treeDepthReached = tileHeight;
     q.highBits = texelFetch(_VoxelData, memAddress).r;
     q.lowBits = texelFetch(_VoxelData, memAddress + 1).r;
+    
+    // The leaf of a lower resolution tile does not line up with the full
+    // resolution leaf masks, so it is returned as the state of the one voxel.
+    // PCF then filters between the voxels found by each lookup.
+    if(lodShift > 0u)
+    {
+        uint leafIndex = getVoxelLeafIndex(tileCoord);
+        uint shadowing = leafIndex > 31u
+            ? (q.lowBits >> (leafIndex - 32u)) & 1u
+            : (q.highBits >> leafIndex) & 1u;
+        
+        q.highBits = 4294967295u * shadowing;
+        q.lowBits = 4294967295u * shadowing;
+    }
+    
     return q;
 }
 
@@ -169,15 +250,17 @@ LeafNodeQuery getLeafNode(uvec3 coord)
  * Get the shadow attenuation for the voxel with the given coordinate.
  * Also performs PCF filtering, if enabled.
  */
-VoxelQuery sampleShadowTree(uvec3 coord)
+VoxelQuery sampleShadowTree(vec3 coord)
 {
-    // Get the location of the coord within its leaf
-    uint leafIndex = getVoxelLeafIndex(coord);
+    // Get the location of the coord within its leaf.
+    // Negative coords wrap to large values, so they are outside the tree.
+    uvec2 xy = uvec2(ivec2(floor(coord.xy)));
+    uint leafIndex = getVoxelLeafIndex(uvec3(xy, 0u));
     
 #if !defined(SHADOW_PCF_FILTER)
     
     // Get the leaf node
-    LeafNodeQuery leaf = getLeafNode(coord);
+    LeafNodeQuery leaf = getLeafNode(xy, coord.z);
     
     // Get the shadowing state of the voxel
     uint shadowing = leafIndex > 31u
@@ -207,10 +290,10 @@ VoxelQuery sampleShadowTree(uvec3 coord)
         uvec2 bitmask = lookup.zw;
         
         // Get the leaf coord
-        uvec3 pcfCoord = uvec3(coord.xy + offset - uvec2(20u), coord.z);
+        uvec2 pcfCoord = xy + offset - uvec2(20u);
         
         // Query the shadow tree
-        LeafNodeQuery leaf = getLeafNode(pcfCoord);
+        LeafNodeQuery leaf = getLeafNode(pcfCoord, coord.z);
         unshadowed += bitCount(leaf.highBits & bitmask.x);
         unshadowed += bitCount(leaf.lowBits & bitmask.y);
         treeDepthSum = leaf.treeDepthReached;
@@ -236,7 +319,7 @@ void main()
     worldPos /= worldPos.w;
     
     // Get the coordinate for the voxel tree
-    uvec3 voxelCoord = getVoxelCoord(worldPos);
+    vec3 voxelCoord = getVoxelCoord(worldPos);
     
     // Sample the shadow tree
     VoxelQuery result = sampleShadowTree(voxelCoord);
@@ -0,0 +1,201 @@
+#include "AssetLoader.hpp"
+
+#include <cstdio>
+
+AssetLoader::AssetLoader()
+    : compressTextures_(true),
+    pendingAssets_(0),
+    loadTimer_(),
+    loadedMeshes_(),
+    loadedTextures_(),
+    loadedMutex_(),
+    assetLoaded_()
+{
+    workers_ = new WorkerPool();
+}
+
+AssetLoader::~AssetLoader()
+{
+    // Stopping the workers finishes their jobs, so nothing else
+    // is added to the queues
+    delete workers_;
+    
+    while(!loadedMeshes_.empty())
+    {
+        delete loadedMeshes_.front();
+        loadedMeshes_.pop();
+    }
+    
+    while(!loadedTextures_.empty())
+    {
+        delete loadedTextures_.front();
+        loadedTextures_.pop();
+    }
+}
+
+Mesh* AssetLoader::loadMesh(const string &fileName)
+{
+    LoadedMesh* item = new LoadedMesh();
+    item->mesh = new Mesh();
+    item->loaded = false;
+    assetRequested();
+    
+    workers_->run([this, item, fileName]()
+    {
+        // Simplifying is the slowest part, so it is done here too,
+        // along with encoding so uploading is a single copy
+        MeshData data;
+        item->loaded = data.load(fileName.c_str());
+        if(item->loaded)
+        {
+            data.createLODs();
+            data.optimize();
+            item->encoded = data.encode();
+        }
+        
+        lock_guard<mutex> lock(loadedMutex_);
+        loadedMeshes_.push(item);
+        assetLoaded_.notify_one();
+    });
+    
+    return item->mesh;
+}
+
+Texture* AssetLoader::loadTexture(const string &fileName, bool normalMap)
+{
+    LoadedTexture* item = new LoadedTexture();
+    item->texture = normalMap ? Texture::solidColor(128, 128, 255, 255) : Texture::solidColor(128, 128, 128, 255);
+    item->isCompressed = false;
+    item->loaded = false;
+    assetRequested();
+    
+    bool compress = compressTextures_;
+    workers_->run([this, item, fileName, normalMap, compress]()
+    {
+        // Use the compressed texture cache, compressing the texture into it if needed.
+        // Decoding is only needed if that fails.
+        if(compress)
+        {
+            item->isCompressed = item->compressed.load(fileName.c_str(), normalMap);
+            item->loaded = item->isCompressed;
+        }
+        
+        if(!item->loaded)
+        {
+            item->loaded = Texture::decode(fileName.c_str(), &item->image);
+        }
+        
+        lock_guard<mutex> lock(loadedMutex_);
+        loadedTextures_.push(item);
+        assetLoaded_.notify_one();
+    });
+    
+    return item->texture;
+}
+
+bool AssetLoader::update(int maxMilliseconds)
+{
+    QElapsedTimer timer;
+    timer.start();
+    
+    bool meshesUploaded = false;
+    bool uploaded = true;
+    while(uploaded && timer.elapsed() < maxMilliseconds)
+    {
+        uploaded = uploadNext(&meshesUploaded);
+    }
+    
+    return meshesUploaded;
+}
+
+bool AssetLoader::finish()
+{
+    bool meshesUploaded = false;
+    while(isLoading())
+    {
+        // Sleep until a worker finishes an asset
+        {
+            unique_lock<mutex> lock(loadedMutex_);
+            while(loadedMeshes_.empty() && loadedTextures_.empty())
+            {
+                assetLoaded_.wait(lock);
+            }
+        }
+        
+        // Upload everything finished so far
+        bool uploaded = true;
+        while(uploaded)
+        {
+            uploaded = uploadNext(&meshesUploaded);
+        }
+    }
+    
+    return meshesUploaded;
+}
+
+void AssetLoader::assetRequested()
+{
+    if(pendingAssets_ == 0)
+    {
+        loadTimer_.start();
+    }
+    
+    pendingAssets_ ++;
+}
+
+bool AssetLoader::uploadNext(bool* meshUploaded)
+{
+    LoadedMesh* mesh = NULL;
+    LoadedTexture* texture = NULL;
+    
+    // Meshes are uploaded first, as the scene can't be seen without them
+    {
+        lock_guard<mutex> lock(loadedMutex_);
+        if(!loadedMeshes_.empty())
+        {
+            mesh = loadedMeshes_.front();
+            loadedMeshes_.pop();
+        }
+        else if(!loadedTextures_.empty())
+        {
+            texture = loadedTextures_.front();
+            loadedTextures_.pop();
+        }
+    }
+    
+    if(mesh != NULL)
+    {
+        if(mesh->loaded)
+        {
+            mesh->mesh->upload(mesh->encoded);
+            *meshUploaded = true;
+        }
+        
+        delete mesh;
+    }
+    else if(texture != NULL)
+    {
+        if(texture->loaded && texture->isCompressed)
+        {
+            texture->texture->upload(texture->compressed);
+        }
+        else if(texture->loaded)
+        {
+            texture->texture->upload(texture->image);
+        }
+        
+        delete texture;
+    }
+    else
+    {
+        return false;
+    }
+    
+    pendingAssets_ --;
+    if(pendingAssets_ == 0)
+    {
+        printf("Assets loaded in %lld ms using %d threads \n", loadTimer_.elapsed(), workers_->threadCount());
+    }
+    
+    return true;
+}
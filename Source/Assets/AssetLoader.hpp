@@ -0,0 +1,95 @@
+#pragma once
+
+#define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
+#include <QGLWidget> // Links OpenGL Headers
+
+#include <string>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+#include <QImage>
+#include <QElapsedTimer>
+
+using namespace std;
+
+#include "CompressedTexture.hpp"
+#include "Mesh.hpp"
+#include "MeshData.hpp"
+#include "Texture.hpp"
+#include "WorkerPool.hpp"
+
+// Loads meshes and textures on worker threads.
+// Assets are returned straight away as placeholders, and filled in on the
+// render thread by update() once their files have been read and decoded.
+// Assets that fail to load keep their placeholder.
+class AssetLoader
+{
+public:
+    AssetLoader();
+    ~AssetLoader();
+    
+    // Returns an empty mesh, which is uploaded once the file is read
+    // and its levels of detail are created.
+    Mesh* loadMesh(const string &fileName);
+    
+    // Returns a single texel texture, which is replaced by the image once decoded.
+    // Normal maps start flat, other textures start grey.
+    Texture* loadTexture(const string &fileName, bool normalMap);
+
+    // Loads textures block compressed, from the compressed texture cache.
+    // Only affects textures requested afterwards.
+    void setCompressTextures(bool compress) { compressTextures_ = compress; }
+    
+    // True while any requested asset is not yet uploaded
+    bool isLoading() const { return pendingAssets_ > 0; }
+    
+    // Uploads assets that have finished loading, stopping once the time is used.
+    // At least one asset is uploaded if any are ready.
+    // Returns true if any meshes were uploaded, as their bounds will have changed.
+    bool update(int maxMilliseconds);
+    
+    // Waits for every requested asset and uploads it.
+    // Returns true if any meshes were uploaded.
+    bool finish();
+
+private:
+    struct LoadedMesh
+    {
+        Mesh* mesh;
+        EncodedMesh encoded;
+        bool loaded;
+    };
+    
+    struct LoadedTexture
+    {
+        Texture* texture;
+        QImage image;
+        CompressedTexture compressed;
+        bool isCompressed;
+        bool loaded;
+    };
+
+    bool compressTextures_;
+    
+    // Requested assets that are not yet uploaded.
+    // Only used on the render thread.
+    int pendingAssets_;
+    QElapsedTimer loadTimer_;
+    
+    // Assets finished by the workers, waiting to be uploaded
+    queue<LoadedMesh*> loadedMeshes_;
+    queue<LoadedTexture*> loadedTextures_;
+    mutex loadedMutex_;
+    condition_variable assetLoaded_;
+    
+    // Threads reading and decoding the files
+    WorkerPool* workers_;
+    
+    // Starts timing when the first of a set of assets is requested
+    void assetRequested();
+    
+    // Uploads the next finished asset, if there is one.
+    // Sets meshUploaded if it was a mesh.
+    bool uploadNext(bool* meshUploaded);
+};
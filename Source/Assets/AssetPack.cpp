@@ -0,0 +1,316 @@
+#include "AssetPack.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CompressedTexture.hpp"
+#include "Platform.hpp"
+
+static const char PackMagic[4] = { 'V', 'S', 'P', 'K' };
+
+AssetPack::AssetPack()
+    : data_(NULL),
+    size_(0),
+    header_(NULL)
+{
+
+}
+
+AssetPack::~AssetPack()
+{
+    close();
+}
+
+bool AssetPack::open(const string &fileName)
+{
+    close();
+    
+    int file = ::open(fileName.c_str(), O_RDONLY);
+    if(file < 0)
+    {
+        printf("Failed to open asset pack %s \n", fileName.c_str());
+        return false;
+    }
+    
+    struct stat fileStat;
+    if(fstat(file, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(Header))
+    {
+        printf("Asset pack %s is too small \n", fileName.c_str());
+        ::close(file);
+        return false;
+    }
+    
+    // The mapping stays valid after the file is closed
+    void* map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if(map == MAP_FAILED)
+    {
+        printf("Failed to map asset pack %s \n", fileName.c_str());
+        return false;
+    }
+    
+    data_ = (const unsigned char*)map;
+    size_ = fileStat.st_size;
+    header_ = (const Header*)data_;
+    
+    // Check everything the tables point to is inside the file, and that every
+    // element indexes a vertex, so a broken pack can't be read past its end
+    bool valid = memcmp(header_->magic, PackMagic, sizeof(PackMagic)) == 0
+        && header_->version == Version
+        && isValid(header_->strings, 1)
+        && isValid(header_->meshes, sizeof(MeshEntry))
+        && isValid(header_->cameras, sizeof(CameraRecord))
+        && isValid(header_->lights, sizeof(LightRecord))
+        && isValid(header_->meshInstances, sizeof(MeshInstanceRecord))
+        && isValid(header_->animations, sizeof(AnimationRecord));
+    
+    // Names must be terminated within the strings table
+    valid = valid && (header_->strings.count == 0 || data_[header_->strings.offset + header_->strings.count - 1] == '\0');
+    
+    const MeshEntry* meshes = getTable<MeshEntry>(header_->meshes);
+    for(uint32_t i = 0; valid && i < header_->meshes.count; ++i)
+    {
+        // The vertices must be in a format this build draws,
+        // and the blobs must be the size the layout gives
+        const MeshLayout &layout = meshes[i].layout;
+        valid = MeshLayout::isDrawable(layout.vertexFormat)
+            && (layout.elementSize == sizeof(uint16_t) || layout.elementSize == sizeof(uint32_t))
+            && layout.verticesCount > 0 && layout.elementsCount >= 0
+            && isValid(meshes[i].vertices, 1) && isValid(meshes[i].elements, 1)
+            && isValid(meshes[i].lods, sizeof(MeshLOD))
+            && meshes[i].vertices.count == (uint64_t)layout.verticesCount * MeshLayout::vertexStride(layout.vertexFormat)
+            && meshes[i].elements.count == (uint64_t)layout.elementsCount * layout.elementSize
+            && meshes[i].lods.count > 0
+            && meshes[i].name < header_->strings.count;
+        
+        // Each level must be inside the elements
+        const MeshLOD* lods = valid ? getTable<MeshLOD>(meshes[i].lods) : NULL;
+        for(uint32_t j = 0; valid && j < meshes[i].lods.count; ++j)
+        {
+            valid = lods[j].offset >= 0 && lods[j].count >= 0
+                && (int64_t)lods[j].offset + lods[j].count <= layout.elementsCount;
+        }
+        
+        // Each element must index one of the mesh's vertices
+        if(valid && layout.elementSize == sizeof(uint16_t))
+        {
+            const uint16_t* elements = getTable<uint16_t>(meshes[i].elements);
+            for(int j = 0; valid && j < layout.elementsCount; ++j)
+            {
+                valid = elements[j] < layout.verticesCount;
+            }
+        }
+        else if(valid)
+        {
+            const uint32_t* elements = getTable<uint32_t>(meshes[i].elements);
+            for(int j = 0; valid && j < layout.elementsCount; ++j)
+            {
+                valid = elements[j] < (uint32_t)layout.verticesCount;
+            }
+        }
+    }
+    
+    const MeshInstanceRecord* instances = getTable<MeshInstanceRecord>(header_->meshInstances);
+    for(uint32_t i = 0; valid && i < header_->meshInstances.count; ++i)
+    {
+        valid = instances[i].meshName < header_->strings.count
+            && instances[i].textureName < header_->strings.count
+            && instances[i].normalMapName < header_->strings.count;
+    }
+    
+    const AnimationRecord* animations = getTable<AnimationRecord>(header_->animations);
+    for(uint32_t i = 0; valid && i < header_->animations.count; ++i)
+    {
+        valid = animations[i].meshInstance < header_->meshInstances.count;
+    }
+    
+    if(!valid)
+    {
+        printf("Asset pack %s is not valid \n", fileName.c_str());
+        close();
+        return false;
+    }
+    
+    return true;
+}
+
+void AssetPack::close()
+{
+    if(data_ != NULL)
+    {
+        munmap((void*)data_, size_);
+    }
+    
+    data_ = NULL;
+    size_ = 0;
+    header_ = NULL;
+}
+
+SceneRecords AssetPack::records() const
+{
+    SceneRecords records;
+    records.strings = getTable<char>(header_->strings);
+    records.stringsSize = header_->strings.count;
+    records.cameras = getTable<CameraRecord>(header_->cameras);
+    records.camerasCount = header_->cameras.count;
+    records.lights = getTable<LightRecord>(header_->lights);
+    records.lightsCount = header_->lights.count;
+    records.meshInstances = getTable<MeshInstanceRecord>(header_->meshInstances);
+    records.meshInstancesCount = header_->meshInstances.count;
+    records.animations = getTable<AnimationRecord>(header_->animations);
+    records.animationsCount = header_->animations.count;
+    return records;
+}
+
+Mesh* AssetPack::createMesh(const string &name) const
+{
+    const MeshEntry* meshes = getTable<MeshEntry>(header_->meshes);
+    for(uint32_t i = 0; i < header_->meshes.count; ++i)
+    {
+        const MeshEntry &mesh = meshes[i];
+        if(name != getString(mesh.name))
+        {
+            continue;
+        }
+        
+        // Upload straight from the mapped file
+        return new Mesh(mesh.layout, getTable<unsigned char>(mesh.vertices), getTable<unsigned char>(mesh.elements),
+                        getTable<MeshLOD>(mesh.lods), mesh.lods.count);
+    }
+    
+    return NULL;
+}
+
+bool AssetPack::write(const string &fileName, const SceneRecords &records,
+                      const vector<string> &meshNames, const vector<EncodedMesh> &meshes)
+{
+    // The header is filled in once everything else is placed
+    vector<unsigned char> file(sizeof(Header), 0);
+    Header header;
+    memcpy(header.magic, PackMagic, sizeof(PackMagic));
+    header.version = Version;
+    
+    // Mesh names are added after the scene's names
+    vector<char> strings(records.strings, records.strings + records.stringsSize);
+    vector<MeshEntry> entries(meshes.size());
+    for(unsigned int i = 0; i < meshes.size(); ++i)
+    {
+        const EncodedMesh &mesh = meshes[i];
+        entries[i].name = (uint32_t)strings.size();
+        strings.insert(strings.end(), meshNames[i].begin(), meshNames[i].end());
+        strings.push_back('\0');
+        
+        entries[i].layout = mesh.layout;
+        entries[i].vertices = append(&file, &mesh.vertices[0], 1, mesh.vertices.size());
+        entries[i].elements = append(&file, mesh.elements.empty() ? NULL : &mesh.elements[0], 1, mesh.elements.size());
+        entries[i].lods = append(&file, &mesh.lods[0], sizeof(MeshLOD), mesh.lods.size());
+    }
+    
+    header.meshes = append(&file, entries.empty() ? NULL : &entries[0], sizeof(MeshEntry), entries.size());
+    header.strings = append(&file, strings.empty() ? NULL : &strings[0], 1, strings.size());
+    header.cameras = append(&file, records.cameras, sizeof(CameraRecord), records.camerasCount);
+    header.lights = append(&file, records.lights, sizeof(LightRecord), records.lightsCount);
+    header.meshInstances = append(&file, records.meshInstances, sizeof(MeshInstanceRecord), records.meshInstancesCount);
+    header.animations = append(&file, records.animations, sizeof(AnimationRecord), records.animationsCount);
+    memcpy(&file[0], &header, sizeof(Header));
+    
+    FILE* output = fopen(fileName.c_str(), "wb");
+    if(output == NULL)
+    {
+        printf("Failed to create asset pack %s \n", fileName.c_str());
+        return false;
+    }
+    
+    bool written = fwrite(&file[0], 1, file.size(), output) == file.size();
+    written = (fclose(output) == 0) && written;
+    if(!written)
+    {
+        printf("Failed to write asset pack %s \n", fileName.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+bool AssetPack::convert(const string &sceneFileName, const string &packFileName)
+{
+    string scenePath = SCENES_DIRECTORY + sceneFileName;
+    string packPath = SCENES_DIRECTORY + packFileName;
+    
+    SceneFile scene;
+    if(!scene.load(scenePath))
+    {
+        return false;
+    }
+    
+    // Load every mesh the scene uses, including the simplified levels,
+    // and encode them as they are uploaded
+    vector<string> meshNames = scene.meshNames();
+    vector<EncodedMesh> meshes(meshNames.size());
+    for(unsigned int i = 0; i < meshNames.size(); ++i)
+    {
+        string meshPath = MESHES_DIRECTORY + meshNames[i];
+        MeshData data;
+        if(!data.load(meshPath.c_str()))
+        {
+            return false;
+        }
+        
+        data.createLODs();
+        data.optimize();
+        meshes[i] = data.encode();
+    }
+    
+    if(!write(packPath, scene.records(), meshNames, meshes))
+    {
+        return false;
+    }
+    
+    // Textures are not stored in the pack, but compressing them now
+    // fills the texture cache, so they load without decoding
+    for(int normalMaps = 0; normalMaps < 2; ++normalMaps)
+    {
+        vector<string> textureNames = scene.textureNames(normalMaps != 0);
+        for(unsigned int i = 0; i < textureNames.size(); ++i)
+        {
+            string texturePath = TEXTURES_DIRECTORY + textureNames[i];
+            CompressedTexture texture;
+            texture.load(texturePath.c_str(), normalMaps != 0);
+        }
+    }
+    
+    printf("Converted scene %s to asset pack %s \n", sceneFileName.c_str(), packFileName.c_str());
+    return true;
+}
+
+bool AssetPack::isValid(const Table &table, size_t itemSize) const
+{
+    // Written as subtractions so large counts can't overflow
+    return table.offset <= size_
+        && table.count <= (size_ - table.offset) / itemSize;
+}
+
+const char* AssetPack::getString(uint32_t offset) const
+{
+    return getTable<char>(header_->strings) + offset;
+}
+
+AssetPack::Table AssetPack::append(vector<unsigned char>* file, const void* data, size_t itemSize, size_t count)
+{
+    // Pad to the alignment
+    size_t offset = ((file->size() + Alignment - 1) / Alignment) * Alignment;
+    file->resize(offset + (itemSize * count), 0);
+    if(count > 0)
+    {
+        memcpy(&(*file)[offset], data, itemSize * count);
+    }
+    
+    Table table;
+    table.offset = (uint32_t)offset;
+    table.count = (uint32_t)count;
+    return table;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "Mesh.hpp"
+#include "MeshData.hpp"
+#include "SceneFile.hpp"
+
+// A binary file holding a scene and the meshes it uses.
+// Meshes are stored encoded as they are uploaded, with their layout and bounds,
+// and the scene objects are stored as flat tables of records. The file is
+// mapped into memory, so loading needs no parsing or copies.
+// Packs are written by the converter and read on the same platform,
+// so values are stored in its byte order.
+class AssetPack
+{
+public:
+    AssetPack();
+    ~AssetPack();
+    
+    // Maps the pack into memory and checks its tables
+    bool open(const string &fileName);
+    void close();
+    bool isOpen() const { return data_ != NULL; }
+    
+    // The scene tables, pointing into the mapped file
+    SceneRecords records() const;
+    
+    // Uploads the mesh with the given name straight from the mapped file.
+    // Returns NULL if the pack doesn't contain the mesh.
+    Mesh* createMesh(const string &name) const;
+    
+    // Writes the scene and its encoded meshes to a pack.
+    // Each mesh must contain all of its levels of detail.
+    static bool write(const string &fileName, const SceneRecords &records,
+                      const vector<string> &meshNames, const vector<EncodedMesh> &meshes);
+    
+    // Converts a text scene, and the text meshes it uses, to a pack
+    static bool convert(const string &sceneFileName, const string &packFileName);
+
+private:
+    const static uint32_t Version = 3;
+    
+    // Every table and blob starts on this boundary
+    const static int Alignment = 16;
+    
+    // A range of the file holding count items
+    struct Table
+    {
+        uint32_t offset;
+        uint32_t count;
+    };
+    
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        Table strings;
+        Table meshes;
+        Table cameras;
+        Table lights;
+        Table meshInstances;
+        Table animations;
+    };
+    
+    // Vertices and elements are byte blobs in the layout's formats
+    struct MeshEntry
+    {
+        uint32_t name;
+        MeshLayout layout;
+        Table vertices;
+        Table elements;
+        Table lods;
+    };
+    
+    const unsigned char* data_;
+    size_t size_;
+    const Header* header_;
+    
+    // Checks the table is inside the file
+    bool isValid(const Table &table, size_t itemSize) const;
+    
+    template<typename T> const T* getTable(const Table &table) const
+    {
+        return (const T*)(data_ + table.offset);
+    }
+    
+    // Null terminated name at an offset in the strings table
+    const char* getString(uint32_t offset) const;
+    
+    // Adds data to the end of the file being written, returning its table
+    static Table append(vector<unsigned char>* file, const void* data, size_t itemSize, size_t count);
+};
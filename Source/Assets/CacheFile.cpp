@@ -0,0 +1,47 @@
+#include "CacheFile.hpp"
+
+CacheFile::CacheFile(const string &fileName)
+    : fileName_(fileName),
+    temporaryName_(fileName + ".tmp"),
+    file_(NULL),
+    written_(false)
+{
+    file_ = fopen(temporaryName_.c_str(), "wb");
+    written_ = file_ != NULL;
+}
+
+CacheFile::~CacheFile()
+{
+    if(file_ != NULL)
+    {
+        fclose(file_);
+        remove(temporaryName_.c_str());
+    }
+}
+
+void CacheFile::write(const void* data, size_t size)
+{
+    if(written_ && size > 0)
+    {
+        written_ = fwrite(data, 1, size, file_) == size;
+    }
+}
+
+bool CacheFile::finish()
+{
+    if(file_ == NULL)
+    {
+        return false;
+    }
+    
+    bool written = (fclose(file_) == 0) && written_;
+    file_ = NULL;
+    
+    if(!written || rename(temporaryName_.c_str(), fileName_.c_str()) != 0)
+    {
+        remove(temporaryName_.c_str());
+        return false;
+    }
+    
+    return true;
+}
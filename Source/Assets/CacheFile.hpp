@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+// Writes a cache file under a temporary name, and renames it over the
+// cache file once it is complete, so a partly written file is never read.
+class CacheFile
+{
+public:
+    CacheFile(const string &fileName);
+    
+    // Removes the temporary file if finish was not called
+    ~CacheFile();
+    
+    // Appends the bytes. Once a write fails, the rest are skipped.
+    void write(const void* data, size_t size);
+    
+    // Closes the file and moves it into place.
+    // Returns false, and removes the temporary file, if any write failed.
+    bool finish();
+
+private:
+    string fileName_;
+    string temporaryName_;
+    FILE* file_;
+    bool written_;
+};
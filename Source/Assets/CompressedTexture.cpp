@@ -0,0 +1,179 @@
+#include "CompressedTexture.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+
+#include <QImage>
+
+#include "CacheFile.hpp"
+#include "Hash.hpp"
+#include "Platform.hpp"
+
+static const char CacheMagic[4] = { 'V', 'S', 'T', 'X' };
+
+GLenum CompressedTexture::glFormat() const
+{
+    switch(format)
+    {
+        case BF_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BF_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BF_BC5: return GL_COMPRESSED_RG_RGTC2;
+    }
+    
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+bool CompressedTexture::load(const char* fileName, bool normalMap)
+{
+    // The whole file is read, as it is hashed as well as decoded
+    ifstream file(fileName, ios::binary);
+    if(!file.is_open())
+    {
+        printf("Could not open texture file %s \n", fileName);
+        return false;
+    }
+    
+    vector<unsigned char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    
+    // The key covers the source, how it is compressed and the cache version
+    uint32_t settings[2] = { Version, normalMap ? 1u : 0u };
+    uint64_t key = hashBytes(bytes.empty() ? NULL : &bytes[0], bytes.size());
+    key = hashBytes(settings, sizeof(settings), key);
+    
+    char cacheName[32];
+    snprintf(cacheName, sizeof(cacheName), "%016llx.bct", (unsigned long long)key);
+    string cachePath = string(TEXTURE_CACHE_DIRECTORY) + cacheName;
+    
+    if(read(cachePath))
+    {
+        return true;
+    }
+    
+    QImage image;
+    if(bytes.empty() || !image.loadFromData(&bytes[0], (int)bytes.size()))
+    {
+        printf("Could not decode texture file %s \n", fileName);
+        return false;
+    }
+    
+    QImage glImage = QGLWidget::convertToGLFormat(image);
+    compress(glImage.constBits(), glImage.width(), glImage.height(), normalMap);
+    
+    // Failing to cache only means compressing again next time
+    mkdir(TEXTURE_CACHE_DIRECTORY, 0755);
+    if(!write(cachePath))
+    {
+        printf("Could not cache compressed texture %s \n", fileName);
+    }
+    
+    return true;
+}
+
+void CompressedTexture::compress(const unsigned char* texels, int width, int height, bool normalMap)
+{
+    if(normalMap)
+    {
+        format = BF_BC5;
+    }
+    else
+    {
+        format = TextureCompressor::isOpaque(texels, width, height) ? BF_BC1 : BF_BC3;
+    }
+    
+    // Each level is filtered from the uncompressed level above it
+    levels.clear();
+    vector<unsigned char> current;
+    vector<unsigned char> next;
+    while(true)
+    {
+        CompressedTextureLevel level;
+        level.width = width;
+        level.height = height;
+        level.data.resize(TextureCompressor::compressedSize(format, width, height));
+        TextureCompressor::compress(format, texels, width, height, &level.data[0]);
+        levels.push_back(level);
+        
+        if(width == 1 && height == 1)
+        {
+            break;
+        }
+        
+        TextureCompressor::downsample(texels, width, height, normalMap, &next);
+        current.swap(next);
+        texels = &current[0];
+        width = max(width / 2, 1);
+        height = max(height / 2, 1);
+    }
+}
+
+bool CompressedTexture::read(const string &fileName)
+{
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if(file == NULL)
+    {
+        return false;
+    }
+    
+    // Magic, version, format and level count
+    char magic[4];
+    uint32_t header[3];
+    bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+        && fread(header, sizeof(uint32_t), 3, file) == 3
+        && memcmp(magic, CacheMagic, sizeof(magic)) == 0
+        && header[0] == Version
+        && header[1] <= BF_BC5
+        && header[2] > 0 && header[2] <= 32;
+    
+    if(valid)
+    {
+        format = (BlockFormat)header[1];
+        levels.resize(header[2]);
+    }
+    
+    // Each level has its size, then its blocks
+    for(unsigned int i = 0; valid && i < levels.size(); ++i)
+    {
+        uint32_t size[2];
+        valid = fread(size, sizeof(uint32_t), 2, file) == 2
+            && size[0] > 0 && size[0] <= 16384
+            && size[1] > 0 && size[1] <= 16384;
+        
+        if(valid)
+        {
+            levels[i].width = size[0];
+            levels[i].height = size[1];
+            levels[i].data.resize(TextureCompressor::compressedSize(format, size[0], size[1]));
+            valid = fread(&levels[i].data[0], 1, levels[i].data.size(), file) == levels[i].data.size();
+        }
+    }
+    
+    fclose(file);
+    
+    if(!valid)
+    {
+        printf("Ignoring invalid texture cache file %s \n", fileName.c_str());
+        levels.clear();
+    }
+    
+    return valid;
+}
+
+bool CompressedTexture::write(const string &fileName) const
+{
+    CacheFile file(fileName);
+    uint32_t header[3] = { Version, (uint32_t)format, (uint32_t)levels.size() };
+    file.write(CacheMagic, sizeof(CacheMagic));
+    file.write(header, sizeof(header));
+    
+    for(unsigned int i = 0; i < levels.size(); ++i)
+    {
+        uint32_t size[2] = { (uint32_t)levels[i].width, (uint32_t)levels[i].height };
+        file.write(size, sizeof(size));
+        file.write(&levels[i].data[0], levels[i].data.size());
+    }
+    
+    return file.finish();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
+#include <QGLWidget> // Links OpenGL Headers
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "TextureCompressor.hpp"
+
+// A single mip level of compressed blocks
+struct CompressedTextureLevel
+{
+    int width;
+    int height;
+    vector<unsigned char> data;
+};
+
+// A block compressed image with its full mip chain, ready to upload.
+// Images are compressed once and cached on disk, keyed by a hash
+// of the source file, so later loads skip decoding entirely.
+struct CompressedTexture
+{
+    BlockFormat format;
+    vector<CompressedTextureLevel> levels;
+    
+    // The OpenGL internal format of the blocks
+    GLenum glFormat() const;
+    
+    // Loads an image file, from the cache if it was compressed before.
+    // Otherwise the image is compressed and added to the cache.
+    // Normal maps use BC5, keeping only x and y. Other images use
+    // BC1, or BC3 if they have alpha.
+    // Uses no OpenGL calls, so it can be run on any thread.
+    bool load(const char* fileName, bool normalMap);
+    
+    // Compresses RGBA8 texels (in OpenGL row order) and creates the mip chain
+    void compress(const unsigned char* texels, int width, int height, bool normalMap);
+
+private:
+    // Changing the encoder or file layout must change the version,
+    // so older cache files are not used
+    const static uint32_t Version = 1;
+    
+    bool read(const string &fileName);
+    bool write(const string &fileName) const;
+};
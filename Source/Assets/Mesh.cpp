@@ -1,161 +1,185 @@
 #include "Mesh.hpp"
 
-#include <string>
-#include <fstream>
-#include <cstdio>
-
-Mesh::Mesh(vector<Vector3> positions, vector<Vector3> normals, vector<Vector4> tangents, vector<Vector2> texcoords, vector<MeshElementIndex> elements)
-    : positions_(positions),
-    verticesCount_((int)positions.size()),
-    elementsCount_((int)elements.size())
+#include <cstddef>
+#include <assert.h>
+
+#include "GLState.hpp"
+
+Mesh::Mesh()
+    : bounds_(Vector3::zero(), Vector3::zero()),
+    contentHash_(0),
+    verticesCount_(0),
+    elementsType_(GL_UNSIGNED_SHORT),
+    elementSize_(sizeof(GLushort)),
+    lods_()
 {
-    // Create vertex array
-    glGenVertexArrays(1, &vertexArray_);
-    glBindVertexArray(vertexArray_);
-    
-    // Create vertex buffers
-    glGenBuffers(4, vertexBuffers_);
+    createBuffers();
     
-    // Positions buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers_[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vector3) * positions.size(), &positions[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, (void*)0);
-    glEnableVertexAttribArray(0);
-    
-    // Normals buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers_[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vector3) * normals.size(), &normals[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, false, 0, (void*)0);
-    glEnableVertexAttribArray(1);
+    // A single empty level, so levels can still be selected
+    MeshLOD empty;
+    empty.offset = 0;
+    empty.count = 0;
+    empty.error = 0.0;
+    lods_.push_back(empty);
+}
+
+Mesh::Mesh(const MeshLayout &layout, const void* vertices, const void* elements,
+           const MeshLOD* lods, int lodCount)
+    : bounds_(Vector3::zero(), Vector3::zero()),
+    contentHash_(0),
+    verticesCount_(0),
+    elementsType_(GL_UNSIGNED_SHORT),
+    elementSize_(sizeof(GLushort)),
+    lods_()
+{
+    createBuffers();
+    upload(layout, vertices, elements, lods, lodCount);
+}
+
+Mesh::Mesh(const MeshData &data)
+    : bounds_(Vector3::zero(), Vector3::zero()),
+    contentHash_(0),
+    verticesCount_(0),
+    elementsType_(GL_UNSIGNED_SHORT),
+    elementSize_(sizeof(GLushort)),
+    lods_()
+{
+    createBuffers();
+    upload(data.encode());
+}
+
+void Mesh::createBuffers()
+{
+    glGenVertexArrays(1, &vertexArray_);
+    glGenBuffers(1, &vertexBuffer_);
+    glGenBuffers(1, &elementsBuffer_);
+}
+
+void Mesh::upload(const MeshLayout &layout, const void* vertices, const void* elements,
+                  const MeshLOD* lods, int lodCount)
+{
+    assert(MeshLayout::isDrawable(layout.vertexFormat));
+    assert(layout.verticesCount > 0);
+    assert(lodCount > 0);
+    verticesCount_ = layout.verticesCount;
+    bounds_ = Bounds(layout.boundsMin, layout.boundsMax);
+    contentHash_ = layout.contentHash;
+    lods_.assign(lods, lods + lodCount);
     
-    // Tangents buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers_[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vector4) * tangents.size(), &tangents[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 4, GL_FLOAT, false, 0, (void*)0);
-    glEnableVertexAttribArray(2);
+    size_t verticesSize = (size_t)MeshLayout::vertexStride(layout.vertexFormat) * layout.verticesCount;
+    size_t elementsSize = (size_t)layout.elementSize * layout.elementsCount;
     
-    // Texcoords buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers_[3]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vector2) * texcoords.size(), &texcoords[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(3, 2, GL_FLOAT, false, 0, (void*)0);
-    glEnableVertexAttribArray(3);
+    // The attributes are interleaved in a single vertex buffer
+    GLState::bindVertexArray(vertexArray_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, verticesSize, vertices, GL_STATIC_DRAW);
+    setVertexFormat(layout.vertexFormat);
     
-    // Elements buffer
-    glGenBuffers(1, &elementsBuffer_);
+    // Elements buffer, holding every level of detail
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsBuffer_);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(MeshElementIndex) * elements.size(), &elements[0], GL_STATIC_DRAW);
+    elementsType_ = layout.elementSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    elementSize_ = layout.elementSize;
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, elementsSize, elements, GL_STATIC_DRAW);
+}
+
+void Mesh::setVertexFormat(uint32_t vertexFormat)
+{
+    GLsizei stride = MeshLayout::vertexStride(vertexFormat);
+    if(vertexFormat == MVF_Full)
+    {
+        glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)offsetof(MeshVertex, position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)offsetof(MeshVertex, normal));
+        glVertexAttribPointer(2, 4, GL_FLOAT, false, stride, (void*)offsetof(MeshVertex, tangent));
+        glVertexAttribPointer(3, 2, GL_FLOAT, false, stride, (void*)offsetof(MeshVertex, texcoord));
+    }
+    else
+    {
+        // Position (float3), octahedral normal (snorm16x2), tangent (snorm16x4)
+        // then the texcoord, as half floats or floats
+        GLenum texcoordType = vertexFormat == MVF_CompressedHalfTexcoords ? GL_HALF_FLOAT : GL_FLOAT;
+        glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
+        glVertexAttribPointer(1, 2, GL_SHORT, true, stride, (void*)(size_t)MeshLayout::CompressedNormalOffset);
+        glVertexAttribPointer(2, 4, GL_SHORT, true, stride, (void*)(size_t)MeshLayout::CompressedTangentOffset);
+        glVertexAttribPointer(3, 2, texcoordType, false, stride, (void*)(size_t)MeshLayout::CompressedTexcoordOffset);
+    }
+    
+    for(int i = 0; i < 4; ++i)
+    {
+        glEnableVertexAttribArray(i);
+    }
+}
+
+void Mesh::upload(const EncodedMesh &encoded)
+{
+    upload(encoded.layout, &encoded.vertices[0], &encoded.elements[0], &encoded.lods[0], (int)encoded.lods.size());
 }
 
 Mesh::~Mesh()
 {
+    GLState::vertexArrayDeleted(vertexArray_);
     glDeleteVertexArrays(1, &vertexArray_);
-    glDeleteBuffers(4, vertexBuffers_);
+    glDeleteBuffers(1, &vertexBuffer_);
     glDeleteBuffers(1, &elementsBuffer_);
 }
 
+int Mesh::selectLOD(float maxError) const
+{
+    // Levels are ordered by increasing error
+    int level = 0;
+    while(level + 1 < (int)lods_.size() && lods_[level + 1].error <= maxError)
+    {
+        level ++;
+    }
+    
+    return level;
+}
+
 void Mesh::bind()
 {
-    glBindVertexArray(vertexArray_);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsBuffer_);
+    // The elements buffer is part of the vertex array state
+    GLState::bindVertexArray(vertexArray_);
 }
 
-Mesh* Mesh::fullScreenQuad()
+void Mesh::bindInstanceData(GLuint buffer, int offset)
 {
-    // Create attribute lists
-    vector<Vector3> positions;
-    vector<Vector3> normals;
-    vector<Vector4> tangents;
-    vector<Vector2> texcoords;
-    vector<MeshElementIndex> elements;
-    
-    // 4 vertices are needed
-    positions.push_back(Vector3(-1.0, -1.0, 1.0));
-    positions.push_back(Vector3(1.0, -1.0, 1.0));
-    positions.push_back(Vector3(1.0, 1.0, 1.0));
-    positions.push_back(Vector3(-1.0, 1.0, 1.0));
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
     
+    // The localToWorld matrix uses 4 attribute locations, one per column
     for(int i = 0; i < 4; ++i)
     {
-        normals.push_back(Vector3::zero());
-        tangents.push_back(Vector4(0.0, 0.0, 0.0, 0.0));
-        texcoords.push_back(Vector2(0.0, 0.0));
+        GLuint location = InstanceAttributeLocation + i;
+        size_t columnOffset = offset + (i * sizeof(Vector4));
+        glVertexAttribPointer(location, 4, GL_FLOAT, false, sizeof(Matrix4x4), (void*)columnOffset);
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
     }
     
-    // First triangle (lower right)
-    elements.push_back(0);
-    elements.push_back(1);
-    elements.push_back(2);
-    
-    // Second triangle (upper left)
-    elements.push_back(0);
-    elements.push_back(2);
-    elements.push_back(3);
-    
-    // Create mesh
-    return new Mesh(positions, normals, tangents, texcoords, elements);
+    // Masks are only read by passes that bind them
+    glDisableVertexAttribArray(InstanceMaskAttributeLocation);
+}
+
+void Mesh::bindInstanceMasks(GLuint buffer, int offset)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribIPointer(InstanceMaskAttributeLocation, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)(size_t)offset);
+    glVertexAttribDivisor(InstanceMaskAttributeLocation, 1);
+    glEnableVertexAttribArray(InstanceMaskAttributeLocation);
+}
+
+Mesh* Mesh::fullScreenQuad()
+{
+    return new Mesh(MeshData::fullScreenQuad());
 }
 
 Mesh* Mesh::load(const char* fileName)
 {
-    vector<Vector3> positions;
-    vector<Vector3> normals;
-    vector<Vector4> tangents;
-    vector<Vector2> texcoords;
-    vector<MeshElementIndex> elements;
-    
-    ifstream file(fileName);
-    
-    // Read lines from the mesh file
-    while(file.is_open() && !file.fail() && !file.eof())
-    {
-        string type;
-        file >> type;
-        
-        if(type == "vertex")
-        {
-            Vector3 v;
-            file >> v;
-            positions.push_back(v);
-        }
-        else if(type == "normal")
-        {
-            Vector3 n;
-            file >> n;
-            normals.push_back(n);
-        }
-        else if(type == "tangent")
-        {
-            Vector4 t;
-            file >> t;
-            tangents.push_back(t);
-        }
-        else if(type == "texcoord")
-        {
-            Vector2 t;
-            file >> t;
-            texcoords.push_back(t);
-        }
-        else if(type == "triangle")
-        {
-            MeshElementIndex a, b, c;
-            file >> a >> b >> c;
-            elements.push_back(c);
-            elements.push_back(b);
-            elements.push_back(a);
-        }
-        else
-        {
-            printf("Unknown mesh type %s in file %s \n", type.c_str(), fileName);
-            return NULL;
-        }
-    }
-    
-    // Check for errors
-    if(file.fail())
+    MeshData data;
+    if(!data.load(fileName))
     {
-        printf("Error reading mesh file %s \n", fileName);
         return NULL;
     }
     
-    return new Mesh(positions, normals, tangents, texcoords, elements);
+    data.createLODs();
+    data.optimize();
+    return new Mesh(data);
 }
@@ -3,48 +3,106 @@
 #define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
 #include <QGLWidget> // Links OpenGL Headers
 
+#include <cstdint>
 #include <vector>
 
 using namespace std;
 
 #include "Bounds.hpp"
 #include "Matrix4x4.hpp"
+#include "MeshData.hpp"
 #include "Texture.hpp"
 #include "Shader.hpp"
-#include "Vector2.hpp"
-#include "Vector3.hpp"
-
-typedef unsigned short MeshElementIndex;
 
 class Mesh
 {
 public:
-    Mesh(vector<Vector3> positions, vector<Vector3> normals, vector<Vector4> tangents, vector<Vector2> texcoords, vector<MeshElementIndex> elements);
+    // Creates an empty mesh that draws nothing until data is uploaded.
+    // Used as a placeholder while the mesh loads.
+    Mesh();
+    
+    // Uploads encoded vertices and the elements of every level of detail.
+    // They are copied to the buffers as they are and not kept,
+    // so they can be read straight from a mapped file.
+    Mesh(const MeshLayout &layout, const void* vertices, const void* elements,
+         const MeshLOD* lods, int lodCount);
+    Mesh(const MeshData &data);
     ~Mesh();
     
-    // Object space vertex positions
-    const Vector3* vertices() const { return &positions_[0]; }
+    // Replaces the vertices and elements.
+    // Data is given in the same way as the constructor.
+    void upload(const MeshLayout &layout, const void* vertices, const void* elements,
+                const MeshLOD* lods, int lodCount);
+    void upload(const EncodedMesh &encoded);
+    
+    // Object space bounds of all vertices
+    const Bounds &bounds() const { return bounds_; }
+    
+    // A hash of the vertex positions and the elements of every level of detail.
+    // Anything that depends on the shape of the mesh can be cached by it.
+    uint64_t contentHash() const { return contentHash_; }
     
     // Vertex and elements info
     int verticesCount() const { return verticesCount_; }
-    int elementsCount() const { return elementsCount_; }
+    int elementsCount() const { return lods_[0].count; }
     GLuint vertexArray() const { return vertexArray_; }
     GLuint elementsBuffer() const { return elementsBuffer_; }
     
+    // Elements are 16 bit unless the mesh has too many vertices
+    GLenum elementsType() const { return elementsType_; }
+    int elementSize() const { return elementSize_; }
+    
+    // Simplified levels of detail for depth only rendering.
+    // Level 0 is the full mesh, and each level has fewer triangles.
+    // They share the vertex buffer, with the elements of each level
+    // stored one after another in the elements buffer.
+    int lodCount() const { return (int)lods_.size(); }
+    int lodElementsOffset(int level) const { return lods_[level].offset; }
+    int lodElementsCount(int level) const { return lods_[level].count; }
+    
+    // The furthest the surface of the level can be from the full mesh, in object space
+    float lodError(int level) const { return lods_[level].error; }
+    
+    // Finds the simplest level that is within the given object space error
+    int selectLOD(float maxError) const;
+    
     // Attaches the fbo and elements buffer for use.
     void bind();
     
+    // Reads per-instance transforms from the buffer, starting at the offset.
+    // The mesh must be bound first.
+    void bindInstanceData(GLuint buffer, int offset);
+    
+    // Reads a per-instance bitmask from the buffer, starting at the offset.
+    // Must be called after bindInstanceData, which disables the masks.
+    void bindInstanceMasks(GLuint buffer, int offset);
+    
     // Creates a fullscreen quad
     static Mesh* fullScreenQuad();
     
     // Loads a mesh from a file
     static Mesh* load(const char* fileName);
-    
+
 private:
-    vector<Vector3> positions_;
+    // The first of the 4 attribute locations used by the instance transform
+    const static int InstanceAttributeLocation = 4;
+    
+    // The attribute location of the instance mask
+    const static int InstanceMaskAttributeLocation = 8;
+    
+    Bounds bounds_;
+    uint64_t contentHash_;
     int verticesCount_;
-    int elementsCount_;
     GLuint vertexArray_;
-    GLuint vertexBuffers_[4];
+    GLuint vertexBuffer_;
     GLuint elementsBuffer_;
+    GLenum elementsType_;
+    int elementSize_;
+    vector<MeshLOD> lods_;
+    
+    // Creates the vertex array and buffers, without any data
+    void createBuffers();
+    
+    // Sets the attribute layout of the vertex buffer
+    void setVertexFormat(uint32_t vertexFormat);
 };
@@ -0,0 +1,636 @@
+#include "MeshData.hpp"
+
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <math.h>
+
+#include "Bounds.hpp"
+#include "Hash.hpp"
+#include "MeshSimplifier.hpp"
+
+const float MeshData::FirstLODError = 1.0 / 1024.0;
+const float MeshData::LODErrorScale = 4.0;
+const float MeshData::MaxLODTriangleFraction = 0.8;
+
+// Texcoords within this range keep sub texel precision on a 1024 texture as half floats
+static const float HalfTexcoordLimit = 2.0;
+
+// Converts to a 16 bit float, rounding to the nearest
+static uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    
+    // Too small, even for a denormal
+    if(exponent < -10)
+    {
+        return sign;
+    }
+    
+    // Denormals shift the implicit leading bit into the mantissa
+    if(exponent <= 0)
+    {
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = (mantissa >> shift) + ((mantissa >> (shift - 1)) & 1);
+        return sign | (uint16_t)half;
+    }
+    
+    if(exponent >= 31)
+    {
+        return sign | 0x7C00;
+    }
+    
+    // Rounding can carry into the exponent, which is still correct
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    half += (mantissa >> 12) & 1;
+    return sign | (uint16_t)half;
+}
+
+static int16_t floatToSnorm16(float value)
+{
+    value = fmaxf(-1.0f, fminf(value, 1.0f));
+    return (int16_t)lroundf(value * 32767.0f);
+}
+
+// Projects a unit vector onto an octahedron, unfolded into a square
+static void encodeOctahedral(const Vector3 &normal, int16_t encoded[2])
+{
+    float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    if(length <= 0.0f)
+    {
+        encoded[0] = 0;
+        encoded[1] = 0;
+        return;
+    }
+    
+    float x = normal.x / length;
+    float y = normal.y / length;
+    
+    // The lower half is folded over the diagonals
+    if(normal.z < 0.0f)
+    {
+        float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+    
+    encoded[0] = floatToSnorm16(x);
+    encoded[1] = floatToSnorm16(y);
+}
+
+int MeshLayout::vertexStride(uint32_t vertexFormat)
+{
+    switch(vertexFormat)
+    {
+    case MVF_Full:
+        return sizeof(MeshVertex);
+    case MVF_Compressed:
+        return CompressedTexcoordOffset + 2 * sizeof(float);
+    case MVF_CompressedHalfTexcoords:
+        return CompressedTexcoordOffset + 2 * sizeof(uint16_t);
+    default:
+        return 0;
+    }
+}
+
+bool MeshLayout::isDrawable(uint32_t vertexFormat)
+{
+#if COMPRESSED_VERTICES
+    return vertexFormat == MVF_Compressed || vertexFormat == MVF_CompressedHalfTexcoords;
+#else
+    return vertexFormat == MVF_Full;
+#endif
+}
+
+// The score for using a vertex in the next triangle, following
+// Forsyth's "Linear-Speed Vertex Cache Optimisation".
+// Vertices near the front of the cache and with few triangles left score highest.
+static float vertexCacheScore(int cachePosition, int remainingTriangles, int cacheSize)
+{
+    if(remainingTriangles == 0)
+    {
+        return -1.0;
+    }
+    
+    float score = 0.0;
+    if(cachePosition >= 0)
+    {
+        // The last triangle's vertices score a little lower,
+        // so strips don't keep turning back on themselves
+        if(cachePosition < 3)
+        {
+            score = 0.75;
+        }
+        else
+        {
+            float scale = 1.0 - (float)(cachePosition - 3) / (float)(cacheSize - 3);
+            score = powf(scale, 1.5);
+        }
+    }
+    
+    // Finishing vertices with few triangles left stops them being reloaded later
+    score += 2.0 * powf((float)remainingTriangles, -0.5);
+    return score;
+}
+
+bool MeshData::load(const char* fileName)
+{
+    vector<Vector3> positions;
+    vector<Vector3> normals;
+    vector<Vector4> tangents;
+    vector<Vector2> texcoords;
+    elements.clear();
+    
+    ifstream file(fileName);
+    
+    // Read lines from the mesh file
+    while(file.is_open() && !file.fail() && !file.eof())
+    {
+        string type;
+        file >> type;
+        
+        if(type == "vertex")
+        {
+            Vector3 v;
+            file >> v;
+            positions.push_back(v);
+        }
+        else if(type == "normal")
+        {
+            Vector3 n;
+            file >> n;
+            normals.push_back(n);
+        }
+        else if(type == "tangent")
+        {
+            Vector4 t;
+            file >> t;
+            tangents.push_back(t);
+        }
+        else if(type == "texcoord")
+        {
+            Vector2 t;
+            file >> t;
+            texcoords.push_back(t);
+        }
+        else if(type == "triangle")
+        {
+            MeshElementIndex a, b, c;
+            file >> a >> b >> c;
+            elements.push_back(c);
+            elements.push_back(b);
+            elements.push_back(a);
+        }
+        else
+        {
+            printf("Unknown mesh type %s in file %s \n", type.c_str(), fileName);
+            return false;
+        }
+    }
+    
+    // Check for errors
+    if(file.fail())
+    {
+        printf("Error reading mesh file %s \n", fileName);
+        return false;
+    }
+    
+    for(unsigned int i = 0; i < elements.size(); ++i)
+    {
+        if(elements[i] >= positions.size())
+        {
+            printf("Mesh file %s has a triangle using a missing vertex \n", fileName);
+            return false;
+        }
+    }
+    
+    if(positions.empty() || normals.size() != positions.size()
+       || tangents.size() != positions.size() || texcoords.size() != positions.size())
+    {
+        printf("Mesh file %s needs every attribute for each vertex \n", fileName);
+        return false;
+    }
+    
+    // Interleave the attributes
+    vertices.resize(positions.size());
+    for(unsigned int i = 0; i < positions.size(); ++i)
+    {
+        vertices[i].position = positions[i];
+        vertices[i].normal = normals[i];
+        vertices[i].tangent = tangents[i];
+        vertices[i].texcoord = texcoords[i];
+    }
+    
+    MeshLOD full;
+    full.offset = 0;
+    full.count = (int)elements.size();
+    full.error = 0.0;
+    lods.assign(1, full);
+    
+    return true;
+}
+
+void MeshData::createLODs()
+{
+    // Remove any existing levels
+    lods.resize(1);
+    elements.resize(lods[0].count);
+    
+    // Small meshes are cheap enough already
+    if(lods[0].count / 3 < MinLODTriangles)
+    {
+        return;
+    }
+    
+    vector<Vector3> positions(vertices.size());
+    Bounds bounds(vertices[0].position, vertices[0].position);
+    for(unsigned int i = 0; i < vertices.size(); ++i)
+    {
+        positions[i] = vertices[i].position;
+        bounds.expandToCover(positions[i]);
+    }
+    
+    MeshSimplifier simplifier(positions, elements);
+    vector<MeshElementIndex> lodElements;
+    
+    float targetError = bounds.size().magnitude() * FirstLODError;
+    for(int i = 0; i < MaxLODs; ++i)
+    {
+        float error = simplifier.simplify(targetError);
+        targetError *= LODErrorScale;
+        
+        // Only keep levels that remove enough triangles to be worth drawing
+        if(simplifier.trianglesCount() * 3 > lods.back().count * MaxLODTriangleFraction)
+        {
+            continue;
+        }
+        
+        simplifier.getElements(&lodElements);
+        
+        MeshLOD lod;
+        lod.offset = (int)elements.size();
+        lod.count = (int)lodElements.size();
+        lod.error = error;
+        lods.push_back(lod);
+        
+        elements.insert(elements.end(), lodElements.begin(), lodElements.end());
+    }
+}
+
+void MeshData::optimize()
+{
+    for(unsigned int i = 0; i < lods.size(); ++i)
+    {
+        optimizeTriangleOrder(lods[i].offset, lods[i].count);
+    }
+    
+    // Renumber the vertices in the order the full mesh first uses them,
+    // so vertex fetches move through memory in order.
+    // Every level only uses vertices of the full mesh.
+    vector<int> newIndices(vertices.size(), -1);
+    vector<MeshVertex> orderedVertices;
+    orderedVertices.reserve(vertices.size());
+    for(int i = 0; i < lods[0].count; ++i)
+    {
+        MeshElementIndex vertex = elements[lods[0].offset + i];
+        if(newIndices[vertex] < 0)
+        {
+            newIndices[vertex] = (int)orderedVertices.size();
+            orderedVertices.push_back(vertices[vertex]);
+        }
+    }
+    
+    // Unused vertices are kept at the end
+    for(unsigned int i = 0; i < vertices.size(); ++i)
+    {
+        if(newIndices[i] < 0)
+        {
+            newIndices[i] = (int)orderedVertices.size();
+            orderedVertices.push_back(vertices[i]);
+        }
+    }
+    
+    for(unsigned int i = 0; i < elements.size(); ++i)
+    {
+        elements[i] = newIndices[elements[i]];
+    }
+    vertices.swap(orderedVertices);
+}
+
+EncodedMesh MeshData::encode() const
+{
+    EncodedMesh encoded;
+    MeshLayout &layout = encoded.layout;
+    layout.verticesCount = (int)vertices.size();
+    layout.elementsCount = (int)elements.size();
+    encoded.lods = lods;
+    
+    Bounds bounds(Vector3::zero(), Vector3::zero());
+    if(!vertices.empty())
+    {
+        bounds = Bounds(vertices[0].position, vertices[0].position);
+    }
+    for(unsigned int i = 0; i < vertices.size(); ++i)
+    {
+        bounds.expandToCover(vertices[i].position);
+    }
+    layout.boundsMin = bounds.min();
+    layout.boundsMax = bounds.max();
+    
+    // Only the shape is hashed, as that is what caches depend on
+    layout.contentHash = HashSeed;
+    for(unsigned int i = 0; i < vertices.size(); ++i)
+    {
+        layout.contentHash = hashBytes(&vertices[i].position, sizeof(Vector3), layout.contentHash);
+    }
+    
+    layout.contentHash = hashBytes(elements.data(), sizeof(MeshElementIndex) * elements.size(), layout.contentHash);
+    layout.contentHash = hashBytes(lods.data(), sizeof(MeshLOD) * lods.size(), layout.contentHash);
+    
+#if COMPRESSED_VERTICES
+    bool halfTexcoords = true;
+    for(unsigned int i = 0; i < vertices.size() && halfTexcoords; ++i)
+    {
+        halfTexcoords = fabsf(vertices[i].texcoord.x) <= HalfTexcoordLimit
+            && fabsf(vertices[i].texcoord.y) <= HalfTexcoordLimit;
+    }
+    
+    layout.vertexFormat = halfTexcoords ? MVF_CompressedHalfTexcoords : MVF_Compressed;
+    encoded.vertices.resize((size_t)MeshLayout::vertexStride(layout.vertexFormat) * vertices.size());
+    if(!vertices.empty())
+    {
+        encodeCompressedVertices(halfTexcoords, &encoded.vertices[0]);
+    }
+#else
+    layout.vertexFormat = MVF_Full;
+    const unsigned char* vertexBytes = (const unsigned char*)vertices.data();
+    encoded.vertices.assign(vertexBytes, vertexBytes + sizeof(MeshVertex) * vertices.size());
+#endif
+    
+    // Halving the elements size is possible while every index fits in 16 bits
+    if(vertices.size() <= 65536)
+    {
+        vector<uint16_t> shortElements(elements.begin(), elements.end());
+        const unsigned char* elementBytes = (const unsigned char*)shortElements.data();
+        layout.elementSize = sizeof(uint16_t);
+        encoded.elements.assign(elementBytes, elementBytes + sizeof(uint16_t) * shortElements.size());
+    }
+    else
+    {
+        const unsigned char* elementBytes = (const unsigned char*)elements.data();
+        layout.elementSize = sizeof(MeshElementIndex);
+        encoded.elements.assign(elementBytes, elementBytes + sizeof(MeshElementIndex) * elements.size());
+    }
+    
+    return encoded;
+}
+
+void MeshData::encodeCompressedVertices(bool halfTexcoords, unsigned char* output) const
+{
+    // Position (float3), octahedral normal (snorm16x2), tangent (snorm16x4)
+    // then the texcoord, as half floats or floats
+    int stride = MeshLayout::vertexStride(halfTexcoords ? MVF_CompressedHalfTexcoords : MVF_Compressed);
+    for(unsigned int i = 0; i < vertices.size(); ++i, output += stride)
+    {
+        const MeshVertex &vertex = vertices[i];
+        
+        float position[3] = { vertex.position.x, vertex.position.y, vertex.position.z };
+        memcpy(output, position, sizeof(position));
+        
+        int16_t normal[2];
+        encodeOctahedral(vertex.normal, normal);
+        memcpy(output + MeshLayout::CompressedNormalOffset, normal, sizeof(normal));
+        
+        int16_t tangent[4] =
+        {
+            floatToSnorm16(vertex.tangent.x),
+            floatToSnorm16(vertex.tangent.y),
+            floatToSnorm16(vertex.tangent.z),
+            floatToSnorm16(vertex.tangent.w)
+        };
+        memcpy(output + MeshLayout::CompressedTangentOffset, tangent, sizeof(tangent));
+        
+        if(halfTexcoords)
+        {
+            uint16_t texcoord[2] = { floatToHalf(vertex.texcoord.x), floatToHalf(vertex.texcoord.y) };
+            memcpy(output + MeshLayout::CompressedTexcoordOffset, texcoord, sizeof(texcoord));
+        }
+        else
+        {
+            float texcoord[2] = { vertex.texcoord.x, vertex.texcoord.y };
+            memcpy(output + MeshLayout::CompressedTexcoordOffset, texcoord, sizeof(texcoord));
+        }
+    }
+}
+
+void MeshData::optimizeTriangleOrder(int offset, int count)
+{
+    int trianglesCount = count / 3;
+    if(trianglesCount < 2)
+    {
+        return;
+    }
+    
+    MeshElementIndex* triangles = &elements[offset];
+    int verticesCount = (int)vertices.size();
+    
+    // List the triangles using each vertex. Each list is kept packed at the
+    // start of its range, with remainingTriangles giving its length.
+    vector<int> remainingTriangles(verticesCount, 0);
+    for(int i = 0; i < count; ++i)
+    {
+        remainingTriangles[triangles[i]] ++;
+    }
+    
+    vector<int> firstTriangle(verticesCount + 1, 0);
+    for(int v = 0; v < verticesCount; ++v)
+    {
+        firstTriangle[v + 1] = firstTriangle[v] + remainingTriangles[v];
+    }
+    
+    vector<int> vertexTriangles(count);
+    vector<int> listSizes(verticesCount, 0);
+    for(int i = 0; i < count; ++i)
+    {
+        int vertex = triangles[i];
+        vertexTriangles[firstTriangle[vertex] + listSizes[vertex]] = i / 3;
+        listSizes[vertex] ++;
+    }
+    
+    // Initial scores, with nothing in the cache
+    vector<int> cachePositions(verticesCount, -1);
+    vector<float> vertexScores(verticesCount);
+    for(int v = 0; v < verticesCount; ++v)
+    {
+        vertexScores[v] = vertexCacheScore(-1, remainingTriangles[v], VertexCacheSize);
+    }
+    
+    vector<float> triangleScores(trianglesCount, 0.0);
+    vector<bool> added(trianglesCount, false);
+    int bestTriangle = 0;
+    for(int t = 0; t < trianglesCount; ++t)
+    {
+        for(int k = 0; k < 3; ++k)
+        {
+            triangleScores[t] += vertexScores[triangles[(t * 3) + k]];
+        }
+        
+        if(triangleScores[t] > triangleScores[bestTriangle])
+        {
+            bestTriangle = t;
+        }
+    }
+    
+    vector<MeshElementIndex> ordered;
+    ordered.reserve(count);
+    vector<int> cache;
+    vector<int> nextCache;
+    int nextUnadded = 0;
+    
+    while(bestTriangle >= 0)
+    {
+        added[bestTriangle] = true;
+        
+        // Add the triangle, and put its vertices at the front of the cache
+        nextCache.clear();
+        for(int k = 0; k < 3; ++k)
+        {
+            int vertex = triangles[(bestTriangle * 3) + k];
+            ordered.push_back(vertex);
+            
+            // Remove the triangle from the vertex's list
+            int* list = &vertexTriangles[firstTriangle[vertex]];
+            for(int i = 0; i < remainingTriangles[vertex]; ++i)
+            {
+                if(list[i] == bestTriangle)
+                {
+                    list[i] = list[remainingTriangles[vertex] - 1];
+                    break;
+                }
+            }
+            remainingTriangles[vertex] --;
+            
+            if(find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end())
+            {
+                nextCache.push_back(vertex);
+            }
+        }
+        
+        for(unsigned int i = 0; i < cache.size(); ++i)
+        {
+            if(find(nextCache.begin(), nextCache.end(), cache[i]) == nextCache.end())
+            {
+                nextCache.push_back(cache[i]);
+            }
+        }
+        
+        // Rescore the vertices that moved in the cache or were pushed out of it,
+        // updating the scores of their remaining triangles
+        for(unsigned int i = 0; i < nextCache.size(); ++i)
+        {
+            int vertex = nextCache[i];
+            int position = ((int)i < VertexCacheSize) ? (int)i : -1;
+            cachePositions[vertex] = position;
+            
+            float score = vertexCacheScore(position, remainingTriangles[vertex], VertexCacheSize);
+            float change = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+            
+            const int* list = &vertexTriangles[firstTriangle[vertex]];
+            for(int j = 0; j < remainingTriangles[vertex]; ++j)
+            {
+                triangleScores[list[j]] += change;
+            }
+        }
+        
+        if((int)nextCache.size() > VertexCacheSize)
+        {
+            nextCache.resize(VertexCacheSize);
+        }
+        cache.swap(nextCache);
+        
+        // The next triangle is the best one using a cached vertex
+        bestTriangle = -1;
+        float bestScore = -1.0;
+        for(unsigned int i = 0; i < cache.size(); ++i)
+        {
+            int vertex = cache[i];
+            const int* list = &vertexTriangles[firstTriangle[vertex]];
+            for(int j = 0; j < remainingTriangles[vertex]; ++j)
+            {
+                if(triangleScores[list[j]] > bestScore)
+                {
+                    bestScore = triangleScores[list[j]];
+                    bestTriangle = list[j];
+                }
+            }
+        }
+        
+        // Otherwise start again from any triangle that is left
+        if(bestTriangle < 0)
+        {
+            while(nextUnadded < trianglesCount && added[nextUnadded])
+            {
+                nextUnadded ++;
+            }
+            
+            if(nextUnadded < trianglesCount)
+            {
+                bestTriangle = nextUnadded;
+            }
+        }
+    }
+    
+    copy(ordered.begin(), ordered.end(), triangles);
+}
+
+MeshData MeshData::fullScreenQuad()
+{
+    MeshData data;
+    
+    // 4 vertices are needed
+    Vector3 positions[4] =
+    {
+        Vector3(-1.0, -1.0, 1.0),
+        Vector3(1.0, -1.0, 1.0),
+        Vector3(1.0, 1.0, 1.0),
+        Vector3(-1.0, 1.0, 1.0)
+    };
+    
+    for(int i = 0; i < 4; ++i)
+    {
+        MeshVertex vertex;
+        vertex.position = positions[i];
+        vertex.normal = Vector3::zero();
+        vertex.tangent = Vector4(0.0, 0.0, 0.0, 0.0);
+        vertex.texcoord = Vector2(0.0, 0.0);
+        data.vertices.push_back(vertex);
+    }
+    
+    // First triangle (lower right)
+    data.elements.push_back(0);
+    data.elements.push_back(1);
+    data.elements.push_back(2);
+    
+    // Second triangle (upper left)
+    data.elements.push_back(0);
+    data.elements.push_back(2);
+    data.elements.push_back(3);
+    
+    MeshLOD full;
+    full.offset = 0;
+    full.count = (int)data.elements.size();
+    full.error = 0.0;
+    data.lods.push_back(full);
+    
+    return data;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+#include "Vector2.hpp"
+#include "Vector3.hpp"
+#include "Vector4.hpp"
+
+// Encodes vertices in a compressed 28 or 32 byte layout rather than as MeshVertex.
+// Normals are octahedral encoded, tangents are 16 bit and texcoords are half floats
+// when they are small enough. Shaders decode normals using the same define.
+#ifndef COMPRESSED_VERTICES
+#define COMPRESSED_VERTICES 1
+#endif
+
+// Elements are 32 bit, and encoded as 16 bit when a mesh has few enough vertices
+typedef uint32_t MeshElementIndex;
+
+// The layouts vertices can be encoded with
+enum MeshVertexFormat
+{
+    // MeshVertex as it is, 48 bytes
+    MVF_Full = 0,
+    
+    // Octahedral normals, 16 bit tangents and float texcoords, 32 bytes
+    MVF_Compressed = 1,
+    
+    // As MVF_Compressed with half float texcoords, 28 bytes
+    MVF_CompressedHalfTexcoords = 2
+};
+
+// The full precision attributes of a vertex, interleaved.
+// 48 bytes, so vertices stay 16 byte aligned.
+struct MeshVertex
+{
+    Vector3 position;
+    Vector3 normal;
+    Vector4 tangent;
+    Vector2 texcoord;
+};
+
+// A range of the elements drawn for a level of detail
+struct MeshLOD
+{
+    int offset;
+    int count;
+    
+    // The furthest the surface can be from the full mesh, in object space
+    float error;
+};
+
+// How the vertices and elements of an encoded mesh are laid out.
+// Stored as it is in asset packs.
+struct MeshLayout
+{
+    // A hash of the vertex positions and the elements of every level of detail,
+    // found when encoding so loading a pack doesn't read the data
+    uint64_t contentHash;
+    
+    uint32_t vertexFormat;
+    int verticesCount;
+    int elementSize;
+    int elementsCount;
+    
+    // Object space bounds of all vertices
+    Vector3 boundsMin;
+    Vector3 boundsMax;
+    
+    // Offsets of the attributes in the compressed formats, after the position
+    const static int CompressedNormalOffset = 12;
+    const static int CompressedTangentOffset = 16;
+    const static int CompressedTexcoordOffset = 24;
+    
+    // The size of a vertex in the format, or 0 if the format is unknown
+    static int vertexStride(uint32_t vertexFormat);
+    
+    // True if this build's shaders can read vertices in the format
+    static bool isDrawable(uint32_t vertexFormat);
+};
+
+// A mesh encoded as it is uploaded, so uploading is a single copy
+// of each buffer. Levels of detail are stored as in MeshData.
+struct EncodedMesh
+{
+    MeshLayout layout;
+    vector<unsigned char> vertices;
+    vector<unsigned char> elements;
+    vector<MeshLOD> lods;
+};
+
+// The CPU copy of a mesh, before it is encoded and uploaded.
+// The elements of every level of detail are stored one after another,
+// starting with the full mesh.
+struct MeshData
+{
+    vector<MeshVertex> vertices;
+    vector<MeshElementIndex> elements;
+    vector<MeshLOD> lods;
+    
+    // Reads vertices and triangles from a text mesh file.
+    // Only the full mesh is created.
+    bool load(const char* fileName);
+    
+    // Simplifies the full mesh, adding the levels of detail
+    // used for depth only rendering.
+    void createLODs();
+    
+    // Reorders the triangles of each level to make good use of the GPU vertex cache,
+    // then the vertices in the order they are first used.
+    // Should be called after createLODs.
+    void optimize();
+    
+    // Encodes the vertices in the layout this build draws, and the elements
+    // as 16 bit if every index fits, and finds the content hash. Done by the
+    // pack converter and the mesh loading threads, rather than when uploading.
+    EncodedMesh encode() const;
+    
+    // Creates a quad covering clip space
+    static MeshData fullScreenQuad();
+
+private:
+    // Simplification settings.
+    // The error of the first level is a fraction of the bounds size,
+    // and each level allows a larger error than the last.
+    const static int MaxLODs = 4;
+    const static int MinLODTriangles = 64;
+    const static float FirstLODError;
+    const static float LODErrorScale;
+    
+    // Levels that keep more than this fraction of the previous level's triangles are skipped
+    const static float MaxLODTriangleFraction;
+    
+    // The vertex cache modelled when ordering triangles
+    const static int VertexCacheSize = 32;
+    
+    // Orders the triangles of a range of elements
+    void optimizeTriangleOrder(int offset, int count);
+    
+    // Writes the vertices in a compressed format to the output
+    void encodeCompressedVertices(bool halfTexcoords, unsigned char* output) const;
+};
@@ -0,0 +1,374 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <math.h>
+#include <stdint.h>
+
+const float MeshSimplifier::MinNormalDot = 0.2;
+
+// Orders vertex indices by position, so equal positions are next to each other
+struct PositionOrder
+{
+    const vector<Vector3>* positions;
+    
+    bool operator () (int a, int b) const
+    {
+        const Vector3 &pa = (*positions)[a];
+        const Vector3 &pb = (*positions)[b];
+        if(pa.x != pb.x) return pa.x < pb.x;
+        if(pa.y != pb.y) return pa.y < pb.y;
+        return pa.z < pb.z;
+    }
+};
+
+MeshSimplifier::MeshSimplifier(const vector<Vector3> &positions, const vector<MeshElementIndex> &elements)
+    : trianglesCount_(0),
+    maxError_(0.0)
+{
+    // Weld vertices with the same position
+    vector<int> order(positions.size());
+    for(unsigned int i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    
+    PositionOrder positionOrder;
+    positionOrder.positions = &positions;
+    sort(order.begin(), order.end(), positionOrder);
+    
+    vector<int> welded(positions.size());
+    for(unsigned int i = 0; i < order.size(); ++i)
+    {
+        if(i == 0 || positionOrder(order[i - 1], order[i]))
+        {
+            positions_.push_back(positions[order[i]]);
+            originalIndices_.push_back(order[i]);
+        }
+        welded[order[i]] = (int)positions_.size() - 1;
+    }
+    
+    int verticesCount = (int)positions_.size();
+    quadrics_.resize(verticesCount);
+    versions_.resize(verticesCount, 0);
+    locked_.resize(verticesCount, false);
+    vertexTriangles_.resize(verticesCount);
+    
+    // Add the triangles, skipping any that welding has made degenerate
+    vector<uint64_t> edges;
+    for(unsigned int i = 0; i + 2 < elements.size(); i += 3)
+    {
+        int corners[3] = { welded[elements[i]], welded[elements[i + 1]], welded[elements[i + 2]] };
+        if(corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0])
+        {
+            continue;
+        }
+        
+        int triangle = trianglesCount_;
+        for(int j = 0; j < 3; ++j)
+        {
+            triangles_.push_back(corners[j]);
+            vertexTriangles_[corners[j]].push_back(triangle);
+            
+            int a = min(corners[j], corners[(j + 1) % 3]);
+            int b = max(corners[j], corners[(j + 1) % 3]);
+            edges.push_back(((uint64_t)a << 32) | (uint64_t)b);
+        }
+        trianglesCount_ ++;
+        
+        // Each corner starts with the plane of the triangle
+        const Vector3 &p0 = positions_[corners[0]];
+        Vector3 normal = Vector3::cross(positions_[corners[1]] - p0, positions_[corners[2]] - p0);
+        if(normal.magnitude() > 0.0)
+        {
+            normal = normal.normalized();
+            Quadric plane(normal, -Vector3::dot(normal, p0));
+            for(int j = 0; j < 3; ++j)
+            {
+                quadrics_[corners[j]].add(plane);
+            }
+        }
+    }
+    triangleRemoved_.resize(trianglesCount_, false);
+    
+    // Lock vertices on edges that don't have exactly 2 triangles,
+    // so holes and the outlines of open meshes keep their shape
+    sort(edges.begin(), edges.end());
+    for(unsigned int i = 0; i < edges.size(); )
+    {
+        unsigned int end = i;
+        while(end < edges.size() && edges[end] == edges[i])
+        {
+            end ++;
+        }
+        
+        if(end - i != 2)
+        {
+            locked_[(int)(edges[i] >> 32)] = true;
+            locked_[(int)(edges[i] & 0xFFFFFFFF)] = true;
+        }
+        i = end;
+    }
+    
+    for(int i = 0; i < verticesCount; ++i)
+    {
+        addCollapses(i);
+    }
+}
+
+float MeshSimplifier::simplify(float maxError)
+{
+    while(!collapses_.empty())
+    {
+        // Leave the rest for a later call
+        Collapse next = collapses_.top();
+        if(next.error > maxError)
+        {
+            break;
+        }
+        collapses_.pop();
+        
+        // Skip collapses where either vertex has changed since they were added
+        if(next.fromVersion != versions_[next.from] || next.toVersion != versions_[next.to])
+        {
+            continue;
+        }
+        
+        if(!canCollapse(next.from, next.to))
+        {
+            continue;
+        }
+        
+        collapse(next.from, next.to);
+        maxError_ = max(maxError_, next.error);
+    }
+    
+    return maxError_;
+}
+
+void MeshSimplifier::getElements(vector<MeshElementIndex>* elements) const
+{
+    elements->clear();
+    for(unsigned int i = 0; i < triangleRemoved_.size(); ++i)
+    {
+        if(triangleRemoved_[i])
+        {
+            continue;
+        }
+        
+        for(int j = 0; j < 3; ++j)
+        {
+            elements->push_back(originalIndices_[triangles_[i * 3 + j]]);
+        }
+    }
+}
+
+void MeshSimplifier::addCollapses(int vertex)
+{
+    vector<int> neighbours;
+    getNeighbours(vertex, &neighbours);
+    
+    for(unsigned int i = 0; i < neighbours.size(); ++i)
+    {
+        addCollapse(vertex, neighbours[i]);
+        addCollapse(neighbours[i], vertex);
+    }
+}
+
+void MeshSimplifier::addCollapse(int from, int to)
+{
+    if(locked_[from])
+    {
+        return;
+    }
+    
+    // The error of the merged vertex, which stays where the target is
+    Quadric quadric = quadrics_[from];
+    quadric.add(quadrics_[to]);
+    
+    Collapse collapse;
+    collapse.error = (float)sqrt(max(quadric.evaluate(positions_[to]), 0.0));
+    collapse.from = from;
+    collapse.to = to;
+    collapse.fromVersion = versions_[from];
+    collapse.toVersion = versions_[to];
+    collapses_.push(collapse);
+}
+
+void MeshSimplifier::getNeighbours(int vertex, vector<int>* neighbours) const
+{
+    neighbours->clear();
+    
+    const vector<int> &triangles = vertexTriangles_[vertex];
+    for(unsigned int i = 0; i < triangles.size(); ++i)
+    {
+        for(int j = 0; j < 3; ++j)
+        {
+            int corner = triangles_[triangles[i] * 3 + j];
+            if(corner != vertex)
+            {
+                neighbours->push_back(corner);
+            }
+        }
+    }
+    
+    sort(neighbours->begin(), neighbours->end());
+    neighbours->erase(unique(neighbours->begin(), neighbours->end()), neighbours->end());
+}
+
+bool MeshSimplifier::triangleContains(int triangle, int vertex) const
+{
+    return triangles_[triangle * 3] == vertex
+        || triangles_[triangle * 3 + 1] == vertex
+        || triangles_[triangle * 3 + 2] == vertex;
+}
+
+bool MeshSimplifier::canCollapse(int from, int to) const
+{
+    // Each triangle on the edge shares one other vertex between the two.
+    // Any more shared neighbours would join the surface into a non-manifold.
+    vector<int> fromNeighbours;
+    vector<int> toNeighbours;
+    getNeighbours(from, &fromNeighbours);
+    getNeighbours(to, &toNeighbours);
+    
+    vector<int> shared;
+    set_intersection(fromNeighbours.begin(), fromNeighbours.end(),
+                     toNeighbours.begin(), toNeighbours.end(), back_inserter(shared));
+    
+    int edgeTriangles = 0;
+    const vector<int> &triangles = vertexTriangles_[from];
+    for(unsigned int i = 0; i < triangles.size(); ++i)
+    {
+        if(triangleContains(triangles[i], to))
+        {
+            edgeTriangles ++;
+        }
+    }
+    
+    if((int)shared.size() != edgeTriangles)
+    {
+        return false;
+    }
+    
+    // The triangles that move must not fold over or become slivers
+    for(unsigned int i = 0; i < triangles.size(); ++i)
+    {
+        int triangle = triangles[i];
+        if(triangleContains(triangle, to))
+        {
+            continue;
+        }
+        
+        Vector3 corners[3];
+        Vector3 movedCorners[3];
+        for(int j = 0; j < 3; ++j)
+        {
+            int corner = triangles_[triangle * 3 + j];
+            corners[j] = positions_[corner];
+            movedCorners[j] = positions_[corner == from ? to : corner];
+        }
+        
+        Vector3 normal = Vector3::cross(corners[1] - corners[0], corners[2] - corners[0]);
+        Vector3 movedNormal = Vector3::cross(movedCorners[1] - movedCorners[0], movedCorners[2] - movedCorners[0]);
+        if(normal.magnitude() <= 0.0 || movedNormal.magnitude() <= 0.0)
+        {
+            return false;
+        }
+        
+        if(Vector3::dot(normal.normalized(), movedNormal.normalized()) < MinNormalDot)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void MeshSimplifier::collapse(int from, int to)
+{
+    vector<int> &fromTriangles = vertexTriangles_[from];
+    vector<int> &toTriangles = vertexTriangles_[to];
+    
+    for(unsigned int i = 0; i < fromTriangles.size(); ++i)
+    {
+        int triangle = fromTriangles[i];
+        
+        if(triangleContains(triangle, to))
+        {
+            // Triangles on the edge disappear
+            triangleRemoved_[triangle] = true;
+            trianglesCount_ --;
+            
+            for(int j = 0; j < 3; ++j)
+            {
+                int corner = triangles_[triangle * 3 + j];
+                if(corner == from)
+                {
+                    continue;
+                }
+                
+                vector<int> &cornerTriangles = vertexTriangles_[corner];
+                cornerTriangles.erase(find(cornerTriangles.begin(), cornerTriangles.end(), triangle));
+            }
+        }
+        else
+        {
+            // The rest are moved onto the target
+            for(int j = 0; j < 3; ++j)
+            {
+                if(triangles_[triangle * 3 + j] == from)
+                {
+                    triangles_[triangle * 3 + j] = to;
+                }
+            }
+            toTriangles.push_back(triangle);
+        }
+    }
+    
+    fromTriangles.clear();
+    quadrics_[to].add(quadrics_[from]);
+    
+    // Collapses involving either vertex are now out of date
+    versions_[from] ++;
+    versions_[to] ++;
+    addCollapses(to);
+}
+
+MeshSimplifier::Quadric::Quadric()
+    : a2(0.0), ab(0.0), ac(0.0), ad(0.0),
+    b2(0.0), bc(0.0), bd(0.0),
+    c2(0.0), cd(0.0),
+    d2(0.0)
+{
+
+}
+
+MeshSimplifier::Quadric::Quadric(const Vector3 &normal, double d)
+    : a2(normal.x * normal.x), ab(normal.x * normal.y), ac(normal.x * normal.z), ad(normal.x * d),
+    b2(normal.y * normal.y), bc(normal.y * normal.z), bd(normal.y * d),
+    c2(normal.z * normal.z), cd(normal.z * d),
+    d2(d * d)
+{
+
+}
+
+void MeshSimplifier::Quadric::add(const Quadric &other)
+{
+    a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+    b2 += other.b2; bc += other.bc; bd += other.bd;
+    c2 += other.c2; cd += other.cd;
+    d2 += other.d2;
+}
+
+double MeshSimplifier::Quadric::evaluate(const Vector3 &p) const
+{
+    double x = p.x;
+    double y = p.y;
+    double z = p.z;
+    
+    return (a2 * x * x) + (2.0 * ab * x * y) + (2.0 * ac * x * z) + (2.0 * ad * x)
+        + (b2 * y * y) + (2.0 * bc * y * z) + (2.0 * bd * y)
+        + (c2 * z * z) + (2.0 * cd * z)
+        + d2;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+using namespace std;
+
+#include "MeshData.hpp"
+#include "Vector3.hpp"
+
+// Reduces the triangles of a mesh by collapsing edges.
+// Each vertex keeps a quadric error metric, the sum of squared distances
+// to the planes of the original triangles merged into it, so the error of
+// a collapse bounds how far the surface moves from the original mesh.
+// Vertices are only moved onto their neighbours, so the simplified triangles
+// can share the vertex buffers of the original mesh.
+// Vertices at the same position are welded, so seams in the normals and
+// texcoords can be collapsed. The result is only suitable for depth rendering.
+// Open and non-manifold edges are kept, so simplified casters don't leak light.
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const vector<Vector3> &positions, const vector<MeshElementIndex> &elements);
+    
+    int trianglesCount() const { return trianglesCount_; }
+    
+    // Collapses edges until the next one would move the surface by more
+    // than the max error. Can be called again with a larger error to carry
+    // on simplifying. Returns the largest error of all collapses so far.
+    float simplify(float maxError);
+    
+    // Replaces the list with the remaining triangles,
+    // using the original vertex indices.
+    void getElements(vector<MeshElementIndex>* elements) const;
+
+private:
+    // Collapses that would turn a triangle further than this are rejected
+    const static float MinNormalDot;
+    
+    // A symmetric 4x4 matrix summing squared plane distances
+    struct Quadric
+    {
+        double a2, ab, ac, ad;
+        double b2, bc, bd;
+        double c2, cd;
+        double d2;
+        
+        Quadric();
+        Quadric(const Vector3 &normal, double d);
+        
+        void add(const Quadric &other);
+        
+        // The sum of the squared distances from the point to the planes
+        double evaluate(const Vector3 &p) const;
+    };
+    
+    // Moving one vertex onto a neighbour.
+    // The versions detect collapses that are out of date.
+    struct Collapse
+    {
+        float error;
+        int from;
+        int to;
+        int fromVersion;
+        int toVersion;
+        
+        bool operator > (const Collapse &other) const { return error > other.error; }
+    };
+    
+    // Welded vertices, and the original index used for each
+    vector<Vector3> positions_;
+    vector<MeshElementIndex> originalIndices_;
+    vector<Quadric> quadrics_;
+    vector<int> versions_;
+    vector<bool> locked_;
+    vector<vector<int> > vertexTriangles_;
+    
+    // 3 welded vertices per triangle
+    vector<int> triangles_;
+    vector<bool> triangleRemoved_;
+    int trianglesCount_;
+    
+    float maxError_;
+    priority_queue<Collapse, vector<Collapse>, greater<Collapse> > collapses_;
+    
+    // Adds the collapses along every edge of the vertex
+    void addCollapses(int vertex);
+    void addCollapse(int from, int to);
+    
+    void getNeighbours(int vertex, vector<int>* neighbours) const;
+    bool triangleContains(int triangle, int vertex) const;
+    
+    bool canCollapse(int from, int to) const;
+    void collapse(int from, int to);
+};
@@ -3,42 +3,160 @@
 #include <QFile>
 #include <QTextStream>
 
+#include "GLState.hpp"
+#include "MeshData.hpp"
 #include "Platform.hpp"
+#include "ShaderCache.hpp"
 #include "UniformManager.hpp"
 
 Shader::Shader(const string &name, ShaderFeatureList features)
-    : features_(features)
+    : name_(name),
+    features_(features),
+    vertexShader_(0),
+    fragmentShader_(0),
+    geometryShader_(0),
+    cacheKey_(0),
+    cached_(false),
+    linked_(false),
+    valid_(false)
 {
     // Get the fragment and vertex files
-    string vertSource = SHADERS_DIRECTORY + name + ".vert.glsl";
-    string fragSource = SHADERS_DIRECTORY + name + ".frag.glsl";
+    string vertFile = SHADERS_DIRECTORY + name + ".vert.glsl";
+    string fragFile = SHADERS_DIRECTORY + name + ".frag.glsl";
+    string geomFile = SHADERS_DIRECTORY + name + ".geom.glsl";
     
-    // Compile vertex shader
-    if(!compileShader(GL_VERTEX_SHADER, vertSource.c_str(), vertexShader_))
+    // Read the sources, with the feature defines added.
+    // Reading is cheap, and the sources are needed for the cache key.
+    vector<string> sources(2);
+    if(!readSource(vertFile.c_str(), &sources[0]))
     {
-        printf("Failed to compile vertex shader \n");
+        printf("Failed to read vertex shader \n");
     }
     
-    // Compile fragment shader
-    if(!compileShader(GL_FRAGMENT_SHADER, fragSource.c_str(), fragmentShader_))
+    if(!readSource(fragFile.c_str(), &sources[1]))
     {
-        printf("Failed to compile fragment shader \n");
+        printf("Failed to read fragment shader \n");
     }
     
-    // Create program
+    // Read the geometry shader, if the shader has one
+    bool hasGeometryStage = QFile::exists(geomFile.c_str());
+    if(hasGeometryStage)
+    {
+        sources.push_back("");
+        if(!readSource(geomFile.c_str(), &sources[2]))
+        {
+            printf("Failed to read geometry shader \n");
+        }
+    }
+    
+    // Create program, using the cached binary if there is one
     program_ = glCreateProgram();
+    cacheKey_ = ShaderCache::key(sources);
+    cached_ = ShaderCache::load(cacheKey_, program_);
+    if(cached_)
+    {
+        return;
+    }
+    
+    // Start compiling and linking.
+    // Errors are checked in finishLinking, so the driver can work on
+    // this program while the next ones are created.
+    compileShader(GL_VERTEX_SHADER, sources[0], vertexShader_);
+    compileShader(GL_FRAGMENT_SHADER, sources[1], fragmentShader_);
+    if(hasGeometryStage)
+    {
+        compileShader(GL_GEOMETRY_SHADER, sources[2], geometryShader_);
+    }
+    
     glAttachShader(program_, vertexShader_);
     glAttachShader(program_, fragmentShader_);
+    if(geometryShader_ != 0)
+    {
+        glAttachShader(program_, geometryShader_);
+    }
+    
+#if defined(GL_VERSION_4_1)
+    // Needed before linking for the binary to be saved
+    if(ShaderCache::enabled())
+    {
+        glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+#endif
+    
     glLinkProgram(program_);
+}
+
+Shader::~Shader()
+{
+    glDeleteProgram(program_);
+    
+    if(vertexShader_ != 0)
+    {
+        glDeleteShader(vertexShader_);
+    }
     
-    // Check for linking errors
-    if(!checkLinkerErrors(program_))
+    if(fragmentShader_ != 0)
     {
-        printf("Failed to create program \n");
+        glDeleteShader(fragmentShader_);
+    }
+    
+    if(geometryShader_ != 0)
+    {
+        glDeleteShader(geometryShader_);
+    }
+}
+
+bool Shader::hasFeature(ShaderFeature feature) const
+{
+    return (features_ & feature) != 0;
+}
+
+bool Shader::finishLinking()
+{
+    if(linked_)
+    {
+        return valid_;
+    }
+    
+    linked_ = true;
+    valid_ = true;
+    
+    if(!cached_)
+    {
+        // Checking the status waits for the compiler
+        if(!checkShaderErrors(vertexShader_))
+        {
+            printf("Failed to compile vertex shader %s \n", name_.c_str());
+            valid_ = false;
+        }
+        
+        if(!checkShaderErrors(fragmentShader_))
+        {
+            printf("Failed to compile fragment shader %s \n", name_.c_str());
+            valid_ = false;
+        }
+        
+        if(geometryShader_ != 0 && !checkShaderErrors(geometryShader_))
+        {
+            printf("Failed to compile geometry shader %s \n", name_.c_str());
+            valid_ = false;
+        }
+        
+        // Check for linking errors
+        if(!checkLinkerErrors(program_))
+        {
+            printf("Failed to create program %s \n", name_.c_str());
+            valid_ = false;
+        }
+        
+        // Only working programs are cached
+        if(valid_)
+        {
+            ShaderCache::save(cacheKey_, program_);
+        }
     }
     
     // Set uniform block binding
-    setUniformBlockBinding("per_object_data", PerObjectUniformBuffer::BlockID);
     setUniformBlockBinding("scene_data", SceneUniformBuffer::BlockID);
     setUniformBlockBinding("camera_data", CameraUniformBuffer::BlockID);
     setUniformBlockBinding("shadow_data", ShadowUniformBuffer::BlockID);
@@ -50,23 +168,19 @@ Shader::Shader(const string &name, ShaderFeatureList features)
     shadowMapTextureLoc_ = glGetUniformLocation(program_, "_ShadowMapTexture");
     shadowMaskTextureLoc_ = glGetUniformLocation(program_, "_ShadowMask");
     voxelDataTextureLoc_ = glGetUniformLocation(program_, "_VoxelData");
-}
-
-Shader::~Shader()
-{
-    glDeleteProgram(program_);
-    glDeleteShader(vertexShader_);
-    glDeleteShader(fragmentShader_);
-}
-
-bool Shader::hasFeature(ShaderFeature feature) const
-{
-    return (features_ & feature) != 0;
+    
+    return valid_;
 }
 
 void Shader::bind()
 {
-    glUseProgram(program_);
+    // Shaders that were not warmed up are finished on first use
+    if(!linked_)
+    {
+        finishLinking();
+    }
+    
+    GLState::useProgram(program_);
     
     // Set texture locations
     glUniform1i(mainTextureLoc_, 0);
@@ -76,7 +190,7 @@ void Shader::bind()
     glUniform1i(voxelDataTextureLoc_, 4);
 }
 
-bool Shader::compileShader(GLenum type, const char* fileName, GLuint &id)
+bool Shader::readSource(const char* fileName, string* source) const
 {
     QFile sourceFile(fileName);
     if(!sourceFile.open(QIODevice::ReadOnly | QIODevice::Text))
@@ -90,23 +204,19 @@ bool Shader::compileShader(GLenum type, const char* fileName, GLuint &id)
     QByteArray sourceBytes = sourceStream.readAll().toLocal8Bit();
     
     // Add feature #defines to the text
-    string sourceText = (char*)sourceBytes.data();
-    sourceText.insert(sourceText.find("\n"), createFeatureDefines());
+    *source = (char*)sourceBytes.data();
+    source->insert(source->find("\n"), createFeatureDefines());
     
+    return true;
+}
+
+void Shader::compileShader(GLenum type, const string &source, GLuint &id)
+{
     // Create and compile shader
     id = glCreateShader(type);
-    char* sourceChars = (char*)sourceText.c_str();
+    const char* sourceChars = source.c_str();
     glShaderSource(id, 1, &sourceChars, NULL);
     glCompileShader(id);
-    
-    // Check for errors
-    if(!checkShaderErrors(id))
-    {
-        printf("Shader error in %s \n", fileName);
-        return false;
-    }
-    
-    return true;
 }
 
 bool Shader::checkShaderErrors(GLuint shaderID)
@@ -188,5 +298,10 @@ string Shader::createFeatureDefines() const
     // Shadow filtering defines
     if(hasFeature(SF_Shadow_PCF_Filter)) defines += "\n #define SHADOW_PCF_FILTER";
     
+    // Vertex layout defines
+#if COMPRESSED_VERTICES
+    defines += "\n #define COMPRESSED_VERTICES";
+#endif
+    
     return defines;
 }
@@ -3,6 +3,7 @@
 #define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
 #include <QGLWidget> // Links OpenGL Headers
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -48,6 +49,10 @@ typedef unsigned int ShaderFeatureList;
 
 
 // Manages a single variant of a shader.
+// The program is loaded from the shader cache if it was linked before.
+// Otherwise compiling and linking are started when the shader is created,
+// and only checked when it is first used, so a driver that compiles in
+// parallel can compile many shaders at once.
 class Shader
 {
 public:
@@ -58,18 +63,32 @@ public:
     ShaderFeatureList features() const { return features_; }
     bool hasFeature(ShaderFeature feature) const;
     
-    // Program and shader ids
+    // Program and shader ids.
+    // The shader ids are 0 if the program was loaded from the cache.
     GLuint program() const { return program_; }
     GLuint vertexShader() const { return vertexShader_; }
     GLuint fragmentShader() const { return fragmentShader_; }
     
+    // 0 if the shader has no geometry stage
+    GLuint geometryShader() const { return geometryShader_; }
+    
+    // Waits for the program to link, then checks for errors and caches it.
+    // Called by bind, or ahead of time to avoid waiting while rendering.
+    bool finishLinking();
+    
     void bind();
     
 private:
+    string name_;
     ShaderFeatureList features_;
     GLuint program_;
     GLuint vertexShader_;
     GLuint fragmentShader_;
+    GLuint geometryShader_;
+    uint64_t cacheKey_;
+    bool cached_;
+    bool linked_;
+    bool valid_;
     GLint mainTextureLoc_;
     GLint normalMapTextureLoc_;
     GLint shadowMapTextureLoc_;
@@ -77,7 +96,8 @@ private:
     GLint voxelDataTextureLoc_;
     
     // Shader compilation
-    bool compileShader(GLenum type, const char* file, GLuint &id);
+    bool readSource(const char* fileName, string* source) const;
+    void compileShader(GLenum type, const string &source, GLuint &id);
     bool checkShaderErrors(GLuint shaderID);
     bool checkLinkerErrors(GLuint programID);
     
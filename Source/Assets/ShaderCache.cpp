@@ -0,0 +1,209 @@
+#include "ShaderCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "CacheFile.hpp"
+#include "Hash.hpp"
+#include "Platform.hpp"
+
+static const char CacheMagic[4] = { 'V', 'S', 'P', 'B' };
+
+bool ShaderCache::enabled_ = false;
+bool ShaderCache::parallelCompile_ = false;
+uint64_t ShaderCache::driverHash_ = 0;
+
+// Checks the extension list of a core profile context
+static bool hasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint i = 0; i < count; ++i)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if(extension != NULL && strcmp(extension, name) == 0)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void ShaderCache::initialize(bool enabled)
+{
+    // A binary only loads on the driver that created it
+    const GLenum driverStrings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    uint32_t version = Version;
+    driverHash_ = hashBytes(&version, sizeof(version));
+    for(int i = 0; i < 3; ++i)
+    {
+        const char* value = (const char*)glGetString(driverStrings[i]);
+        if(value != NULL)
+        {
+            driverHash_ = hashBytes(value, strlen(value) + 1, driverHash_);
+        }
+    }
+    
+    // Program binaries were added in OpenGL 4.1, and some 4.0 drivers have the extension.
+    // Drivers can also support them with no binary formats, so nothing can be saved.
+    enabled_ = false;
+#if defined(GL_VERSION_4_1)
+    if(enabled)
+    {
+        GLint majorVersion = 0;
+        GLint minorVersion = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+        glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+        
+        if(majorVersion > 4 || (majorVersion == 4 && minorVersion >= 1) || hasExtension("GL_ARB_get_program_binary"))
+        {
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            enabled_ = formats > 0;
+        }
+        
+        if(!enabled_)
+        {
+            printf("Program binaries are not supported, shaders will not be cached \n");
+        }
+    }
+#endif
+    
+    // Let the driver use as many compiler threads as it likes
+    parallelCompile_ = false;
+#if defined(GL_KHR_parallel_shader_compile)
+    if(hasExtension("GL_KHR_parallel_shader_compile"))
+    {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        parallelCompile_ = true;
+    }
+#endif
+#if defined(GL_ARB_parallel_shader_compile)
+    if(!parallelCompile_ && hasExtension("GL_ARB_parallel_shader_compile"))
+    {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        parallelCompile_ = true;
+    }
+#endif
+}
+
+bool ShaderCache::enabled()
+{
+    return enabled_;
+}
+
+bool ShaderCache::parallelCompile()
+{
+    return parallelCompile_;
+}
+
+uint64_t ShaderCache::key(const vector<string> &sources)
+{
+    uint64_t hash = driverHash_;
+    for(unsigned int i = 0; i < sources.size(); ++i)
+    {
+        // The terminator separates the stages
+        hash = hashBytes(sources[i].c_str(), sources[i].size() + 1, hash);
+    }
+    
+    return hash;
+}
+
+bool ShaderCache::load(uint64_t key, GLuint program)
+{
+#if defined(GL_VERSION_4_1)
+    if(!enabled_)
+    {
+        return false;
+    }
+    
+    string name = fileName(key);
+    FILE* file = fopen(name.c_str(), "rb");
+    if(file == NULL)
+    {
+        return false;
+    }
+    
+    // Magic, version, binary format and size, then the binary
+    char magic[4];
+    uint32_t header[3];
+    bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+        && fread(header, sizeof(uint32_t), 3, file) == 3
+        && memcmp(magic, CacheMagic, sizeof(magic)) == 0
+        && header[0] == Version
+        && header[2] > 0 && header[2] <= (64 << 20);
+    
+    vector<unsigned char> binary;
+    if(valid)
+    {
+        binary.resize(header[2]);
+        valid = fread(&binary[0], 1, binary.size(), file) == binary.size();
+    }
+    
+    fclose(file);
+    
+    if(!valid)
+    {
+        printf("Ignoring invalid shader cache file %s \n", name.c_str());
+        return false;
+    }
+    
+    // The driver can still reject a binary, eg after an update that kept its version string
+    glProgramBinary(program, header[1], &binary[0], (GLsizei)binary.size());
+    
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked != 0;
+#else
+    (void)key;
+    (void)program;
+    return false;
+#endif
+}
+
+void ShaderCache::save(uint64_t key, GLuint program)
+{
+#if defined(GL_VERSION_4_1)
+    if(!enabled_)
+    {
+        return;
+    }
+    
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+    {
+        return;
+    }
+    
+    vector<unsigned char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, &binary[0]);
+    
+    mkdir(SHADER_CACHE_DIRECTORY, 0755);
+    string name = fileName(key);
+    CacheFile file(name);
+    uint32_t header[3] = { Version, (uint32_t)format, (uint32_t)length };
+    file.write(CacheMagic, sizeof(CacheMagic));
+    file.write(header, sizeof(header));
+    file.write(&binary[0], length);
+    
+    if(!file.finish())
+    {
+        // Failing to cache only means compiling again next time
+        printf("Could not cache shader program %s \n", name.c_str());
+    }
+#else
+    (void)key;
+    (void)program;
+#endif
+}
+
+string ShaderCache::fileName(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return string(SHADER_CACHE_DIRECTORY) + name;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
+#include <QGLWidget> // Links OpenGL Headers
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Stores linked shader programs on disk, so later launches load them
+// with glProgramBinary instead of compiling GLSL.
+// Programs are keyed by a hash of the driver and the full source of each
+// stage, so changing either one compiles the program again.
+class ShaderCache
+{
+public:
+    // Checks which features the driver supports.
+    // Must be called with a current context, before any shader is created.
+    static void initialize(bool enabled);
+    
+    // True if programs are loaded from and saved to the cache
+    static bool enabled();
+    
+    // True if the driver compiles and links shaders on its own threads,
+    // so compiling many programs before checking any of them is faster
+    static bool parallelCompile();
+    
+    // The cache key for a program with the given stage sources
+    static uint64_t key(const vector<string> &sources);
+    
+    // Loads a cached program binary into the program.
+    // Returns false if there is no valid binary, and the program must be compiled.
+    static bool load(uint64_t key, GLuint program);
+    
+    // Saves a linked program's binary
+    static void save(uint64_t key, GLuint program);
+
+private:
+    // Changing the file layout must change the version,
+    // so older cache files are not used
+    const static uint32_t Version = 1;
+    
+    static bool enabled_;
+    static bool parallelCompile_;
+    static uint64_t driverHash_;
+    
+    static string fileName(uint64_t key);
+};
@@ -54,6 +54,39 @@ Shader* ShaderCollection::getVariant(ShaderFeatureList features)
     return createShader(features);
 }
 
+int ShaderCollection::warmup(const vector<ShaderFeatureList> &featureLists)
+{
+    vector<Shader*> created;
+    for(unsigned int i = 0; i < featureLists.size(); ++i)
+    {
+        // Walk every subset of the supported features in the list
+        ShaderFeatureList features = featureLists[i] & supportedFeatures_;
+        ShaderFeatureList subset = features;
+        while(true)
+        {
+            if(findShader(subset) == NULL)
+            {
+                created.push_back(createShader(subset));
+            }
+            
+            if(subset == 0)
+            {
+                break;
+            }
+            
+            subset = (subset - 1) & features;
+        }
+    }
+    
+    // Wait for the compiles started above
+    for(unsigned int i = 0; i < created.size(); ++i)
+    {
+        created[i]->finishLinking();
+    }
+    
+    return (int)created.size();
+}
+
 Shader* ShaderCollection::findShader(ShaderFeatureList features) const
 {
     for(unsigned int i = 0; i < shaderVariants_.size(); ++i)
@@ -28,6 +28,14 @@ public:
     // Finding and loading variants
     Shader* getVariant(ShaderFeatureList features);
     
+    // Creates every variant that can be used to draw the given feature lists,
+    // so toggling features or drawing new objects never waits for a compile.
+    // Any combination of the supported features can be enabled, so each
+    // subset of each list is created. All variants are created before any
+    // is checked, so a driver that compiles in parallel compiles them at once.
+    // Returns the number of new variants.
+    int warmup(const vector<ShaderFeatureList> &featureLists);
+    
 private:
     string shaderName_;
     ShaderFeatureList supportedFeatures_;
@@ -3,6 +3,9 @@
 #include <QImage>
 #include <cstdio>
 
+#include "CompressedTexture.hpp"
+#include "GLState.hpp"
+
 Texture::Texture(GLuint id, int width, int height, GLint internalFormat, GLenum format)
     : id_(id),
     width_(width),
@@ -15,25 +18,26 @@ Texture::Texture(GLuint id, int width, int height, GLint internalFormat, GLenum
 
 Texture::~Texture()
 {
+    GLState::textureDeleted(id_);
     glDeleteTextures(1, &id_);
 }
 
 void Texture::setWrapMode(GLint horizontal, GLint vertical)
 {
-    glBindTexture(GL_TEXTURE_2D, id_);
+    GLState::bindTexture(GL_TEXTURE_2D, id_);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, horizontal);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, vertical);
 }
 
 void Texture::setMinFilter(GLint filter)
 {
-    glBindTexture(GL_TEXTURE_2D, id_);
+    GLState::bindTexture(GL_TEXTURE_2D, id_);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
 }
 
 void Texture::setMagFilter(GLint filter)
 {
-    glBindTexture(GL_TEXTURE_2D, id_);
+    GLState::bindTexture(GL_TEXTURE_2D, id_);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
 }
 
@@ -46,7 +50,7 @@ void Texture::setResolution(int width, int height)
     }
     
     // Resize the texture
-    glBindTexture(GL_TEXTURE_2D, id_);
+    GLState::bindTexture(GL_TEXTURE_2D, id_);
     glTexImage2D(GL_TEXTURE_2D, 0, internalFormat_, width, height, 0, format_, GL_UNSIGNED_BYTE, (void*)0);
     
     // Store the new resolution
@@ -56,51 +60,113 @@ void Texture::setResolution(int width, int height)
 
 void Texture::setCompareMode(GLenum mode, GLenum func)
 {
-    glBindTexture(GL_TEXTURE_2D, id_);
+    GLState::bindTexture(GL_TEXTURE_2D, id_);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, mode);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, func);
 }
 
 void Texture::generateMipmaps()
 {
-    glBindTexture(GL_TEXTURE_2D, id_);
+    GLState::bindTexture(GL_TEXTURE_2D, id_);
     glGenerateMipmap(GL_TEXTURE_2D);
 }
 
 void Texture::bind(GLenum target)
 {
-    glActiveTexture(target);
-    glBindTexture(GL_TEXTURE_2D, id_);
+    GLState::bindTexture(target, GL_TEXTURE_2D, id_);
+}
+
+void Texture::upload(const QImage &image)
+{
+    width_ = image.width();
+    height_ = image.height();
+    
+    GLState::bindTexture(GL_TEXTURE_2D, id_);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 internalFormat_,
+                 width_,
+                 height_,
+                 0,
+                 format_,
+                 GL_UNSIGNED_BYTE,
+                 image.constBits());
+    
+    setMinFilter(GL_LINEAR_MIPMAP_LINEAR);
+    setMagFilter(GL_LINEAR);
+    generateMipmaps();
+}
+
+void Texture::upload(const CompressedTexture &texture)
+{
+    internalFormat_ = texture.glFormat();
+    width_ = texture.levels[0].width;
+    height_ = texture.levels[0].height;
+    
+    // The mip chain is uploaded as it is, rather than generated
+    GLState::bindTexture(GL_TEXTURE_2D, id_);
+    for(unsigned int i = 0; i < texture.levels.size(); ++i)
+    {
+        const CompressedTextureLevel &level = texture.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D,
+                               i,
+                               internalFormat_,
+                               level.width,
+                               level.height,
+                               0,
+                               (GLsizei)level.data.size(),
+                               &level.data[0]);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+    
+    setMinFilter(GL_LINEAR_MIPMAP_LINEAR);
+    setMagFilter(GL_LINEAR);
+}
+
+bool Texture::decode(const char* fileName, QImage* image)
+{
+    QImage file;
+    if(!file.load(QString(fileName)))
+    {
+        printf("Could not open texture file %s \n", fileName);
+        return false;
+    }
+    
+    *image = QGLWidget::convertToGLFormat(file);
+    return true;
 }
 
 Texture* Texture::load(const char* fileName)
 {
     QImage image;
-    if(!image.load(QString(fileName)))
+    if(!decode(fileName, &image))
     {
-        printf("Could not open texture file %s \n", fileName);
         return NULL;
     }
     
     GLuint id;
     glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
     
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGBA8,
-                 image.width(),
-                 image.height(),
-                 0,
-                 GL_RGBA,
-                 GL_UNSIGNED_BYTE,
-                 QGLWidget::convertToGLFormat(image).bits());
+    Texture* texture = new Texture(id, 0, 0, GL_RGBA8, GL_RGBA);
+    texture->setWrapMode(GL_REPEAT, GL_REPEAT);
+    texture->upload(image);
+    
+    return texture;
+}
+
+Texture* Texture::solidColor(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha)
+{
+    GLubyte texel[4] = { red, green, blue, alpha };
+    
+    GLuint id;
+    glGenTextures(1, &id);
+    GLState::bindTexture(GL_TEXTURE_2D, id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
     
-    Texture* texture = new Texture(id, image.width(), image.height(), GL_RGBA8, GL_RGBA);
+    Texture* texture = new Texture(id, 1, 1, GL_RGBA8, GL_RGBA);
     texture->setWrapMode(GL_REPEAT, GL_REPEAT);
-    texture->setMinFilter(GL_LINEAR_MIPMAP_LINEAR);
-    texture->setMagFilter(GL_LINEAR);
-    texture->generateMipmaps();
+    texture->setMinFilter(GL_NEAREST);
+    texture->setMagFilter(GL_NEAREST);
     
     return texture;
 }
@@ -109,7 +175,7 @@ Texture* Texture::depth(int width, int height)
 {
     GLuint texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    GLState::bindTexture(GL_TEXTURE_2D, texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
     
     return new Texture(texture, width, height, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT);
@@ -119,8 +185,18 @@ Texture* Texture::singleChannel(int width, int height)
 {
     GLuint texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    GLState::bindTexture(GL_TEXTURE_2D, texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
     
     return new Texture(texture, width, height, GL_RED, GL_RED);
 }
+
+Texture* Texture::twoChannelFloat(int width, int height)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    GLState::bindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, 0);
+    
+    return new Texture(texture, width, height, GL_RG32F, GL_RG);
+}
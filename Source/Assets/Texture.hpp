@@ -5,6 +5,9 @@
 
 using namespace std;
 
+class QImage;
+struct CompressedTexture;
+
 class Texture
 {
 public:
@@ -33,15 +36,32 @@ public:
     // Binds the texture to the specified target
     void bind(GLenum target);
     
+    // Replaces the contents with an image already converted by decode,
+    // and generates mipmaps with linear filtering.
+    void upload(const QImage &image);
+    
+    // Replaces the contents with block compressed data and its mip chain.
+    void upload(const CompressedTexture &texture);
+    
+    // Reads an image file and converts it to the layout OpenGL expects.
+    // Uses no OpenGL calls, so it can be run on any thread.
+    static bool decode(const char* fileName, QImage* image);
+    
     // Loads a texture from a file.
     static Texture* load(const char* fileName);
     
+    // Creates a repeating texture with a single texel of the given colour.
+    static Texture* solidColor(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha);
+    
     // Creates a depth texture.
     static Texture* depth(int width, int height);
     
     // Creates a texture with a single colour channel.
     static Texture* singleChannel(int width, int height);
     
+    // Creates a texture with two 32 bit float channels.
+    static Texture* twoChannelFloat(int width, int height);
+    
 private:
     GLuint id_;
     int width_;
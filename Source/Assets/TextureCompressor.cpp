@@ -0,0 +1,383 @@
+#include "TextureCompressor.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <math.h>
+
+// Packs an RGB colour in 0-255 into 5:6:5 bits
+static int packColor(const float color[3])
+{
+    int r = (int)(max(0.0f, min(color[0], 255.0f)) * (31.0f / 255.0f) + 0.5f);
+    int g = (int)(max(0.0f, min(color[1], 255.0f)) * (63.0f / 255.0f) + 0.5f);
+    int b = (int)(max(0.0f, min(color[2], 255.0f)) * (31.0f / 255.0f) + 0.5f);
+    return (r << 11) | (g << 5) | b;
+}
+
+// Expands a 5:6:5 colour to 0-255, as the GPU does
+static void unpackColor(int packed, float color[3])
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (float)((r << 3) | (r >> 2));
+    color[1] = (float)((g << 2) | (g >> 4));
+    color[2] = (float)((b << 3) | (b >> 2));
+}
+
+// Picks the closest of the 4 palette colours for each texel.
+// Returns the total squared error.
+static float fitColorIndices(const unsigned char* block, int color0, int color1, uint32_t* indices)
+{
+    float palette[4][3];
+    unpackColor(color0, palette[0]);
+    unpackColor(color1, palette[1]);
+    for(int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    
+    float error = 0.0;
+    *indices = 0;
+    for(int i = 0; i < 16; ++i)
+    {
+        const unsigned char* texel = block + (i * 4);
+        float bestError = 1e30f;
+        uint32_t bestIndex = 0;
+        for(uint32_t p = 0; p < 4; ++p)
+        {
+            float dr = texel[0] - palette[p][0];
+            float dg = texel[1] - palette[p][1];
+            float db = texel[2] - palette[p][2];
+            float texelError = (dr * dr) + (dg * dg) + (db * db);
+            if(texelError < bestError)
+            {
+                bestError = texelError;
+                bestIndex = p;
+            }
+        }
+        
+        *indices |= bestIndex << (i * 2);
+        error += bestError;
+    }
+    
+    return error;
+}
+
+int TextureCompressor::blockBytes(BlockFormat format)
+{
+    return (format == BF_BC1) ? 8 : 16;
+}
+
+size_t TextureCompressor::compressedSize(BlockFormat format, int width, int height)
+{
+    size_t blocksX = (width + 3) / 4;
+    size_t blocksY = (height + 3) / 4;
+    return blocksX * blocksY * blockBytes(format);
+}
+
+void TextureCompressor::compress(BlockFormat format, const unsigned char* texels, int width, int height, unsigned char* output)
+{
+    unsigned char block[16 * 4];
+    
+    for(int blockY = 0; blockY < height; blockY += 4)
+    {
+        for(int blockX = 0; blockX < width; blockX += 4)
+        {
+            // Gather the block, repeating the edges of the image
+            for(int y = 0; y < 4; ++y)
+            {
+                for(int x = 0; x < 4; ++x)
+                {
+                    int sourceX = min(blockX + x, width - 1);
+                    int sourceY = min(blockY + y, height - 1);
+                    const unsigned char* texel = texels + (((size_t)sourceY * width + sourceX) * 4);
+                    copy(texel, texel + 4, block + (((y * 4) + x) * 4));
+                }
+            }
+            
+            switch(format)
+            {
+                case BF_BC1:
+                    encodeColorBlock(block, output);
+                    break;
+                
+                case BF_BC3:
+                    encodeChannelBlock(block, 3, output);
+                    encodeColorBlock(block, output + 8);
+                    break;
+                
+                case BF_BC5:
+                    encodeChannelBlock(block, 0, output);
+                    encodeChannelBlock(block, 1, output + 8);
+                    break;
+            }
+            
+            output += blockBytes(format);
+        }
+    }
+}
+
+void TextureCompressor::downsample(const unsigned char* texels, int width, int height, bool normalMap, vector<unsigned char>* output)
+{
+    int outputWidth = max(width / 2, 1);
+    int outputHeight = max(height / 2, 1);
+    output->resize((size_t)outputWidth * outputHeight * 4);
+    
+    for(int y = 0; y < outputHeight; ++y)
+    {
+        for(int x = 0; x < outputWidth; ++x)
+        {
+            // Odd sizes repeat the last row or column
+            int x0 = min(x * 2, width - 1);
+            int x1 = min((x * 2) + 1, width - 1);
+            int y0 = min(y * 2, height - 1);
+            int y1 = min((y * 2) + 1, height - 1);
+            
+            unsigned char* result = &(*output)[((size_t)y * outputWidth + x) * 4];
+            for(int c = 0; c < 4; ++c)
+            {
+                int sum = texels[((size_t)y0 * width + x0) * 4 + c] + texels[((size_t)y0 * width + x1) * 4 + c]
+                    + texels[((size_t)y1 * width + x0) * 4 + c] + texels[((size_t)y1 * width + x1) * 4 + c];
+                result[c] = (unsigned char)((sum + 2) / 4);
+            }
+            
+            // Averaged normals are shorter than unit length
+            if(normalMap)
+            {
+                float normal[3];
+                for(int c = 0; c < 3; ++c)
+                {
+                    normal[c] = (result[c] / 255.0f) * 2.0f - 1.0f;
+                }
+                
+                float length = sqrtf((normal[0] * normal[0]) + (normal[1] * normal[1]) + (normal[2] * normal[2]));
+                if(length > 0.0f)
+                {
+                    for(int c = 0; c < 3; ++c)
+                    {
+                        result[c] = (unsigned char)(((normal[c] / length) * 0.5f + 0.5f) * 255.0f + 0.5f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool TextureCompressor::isOpaque(const unsigned char* texels, int width, int height)
+{
+    size_t count = (size_t)width * height;
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(texels[(i * 4) + 3] != 255)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void TextureCompressor::encodeColorBlock(const unsigned char* block, unsigned char* output)
+{
+    // Find the mean and covariance of the colours
+    float mean[3] = { 0.0, 0.0, 0.0 };
+    for(int i = 0; i < 16; ++i)
+    {
+        for(int c = 0; c < 3; ++c)
+        {
+            mean[c] += block[(i * 4) + c] / 16.0f;
+        }
+    }
+    
+    float covariance[3][3] = { { 0.0 } };
+    for(int i = 0; i < 16; ++i)
+    {
+        float d[3];
+        for(int c = 0; c < 3; ++c)
+        {
+            d[c] = block[(i * 4) + c] - mean[c];
+        }
+        
+        for(int a = 0; a < 3; ++a)
+        {
+            for(int b = 0; b < 3; ++b)
+            {
+                covariance[a][b] += d[a] * d[b];
+            }
+        }
+    }
+    
+    // The colours are spread along the principal axis,
+    // found with a few power iterations
+    float axis[3] = { 1.0, 1.0, 1.0 };
+    for(int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[3];
+        float largest = 0.0;
+        for(int a = 0; a < 3; ++a)
+        {
+            next[a] = (covariance[a][0] * axis[0]) + (covariance[a][1] * axis[1]) + (covariance[a][2] * axis[2]);
+            largest = max(largest, fabsf(next[a]));
+        }
+        
+        // Solid blocks have no spread
+        if(largest < 1e-6f)
+        {
+            break;
+        }
+        
+        for(int a = 0; a < 3; ++a)
+        {
+            axis[a] = next[a] / largest;
+        }
+    }
+    
+    // Start with the texels furthest along the axis as the endpoints
+    int minTexel = 0;
+    int maxTexel = 0;
+    float minDot = 1e30f;
+    float maxDot = -1e30f;
+    for(int i = 0; i < 16; ++i)
+    {
+        const unsigned char* texel = block + (i * 4);
+        float dot = (texel[0] * axis[0]) + (texel[1] * axis[1]) + (texel[2] * axis[2]);
+        if(dot < minDot)
+        {
+            minDot = dot;
+            minTexel = i;
+        }
+        if(dot > maxDot)
+        {
+            maxDot = dot;
+            maxTexel = i;
+        }
+    }
+    
+    float endpoint0[3];
+    float endpoint1[3];
+    for(int c = 0; c < 3; ++c)
+    {
+        endpoint0[c] = block[(maxTexel * 4) + c];
+        endpoint1[c] = block[(minTexel * 4) + c];
+    }
+    
+    int color0 = packColor(endpoint0);
+    int color1 = packColor(endpoint1);
+    uint32_t indices;
+    float error = fitColorIndices(block, color0, color1, &indices);
+    
+    // Refit the endpoints to the chosen indices with least squares,
+    // keeping them if the error is lower
+    const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0, ab = 0.0, bb = 0.0;
+    float ax[3] = { 0.0, 0.0, 0.0 };
+    float bx[3] = { 0.0, 0.0, 0.0 };
+    for(int i = 0; i < 16; ++i)
+    {
+        float w0 = weights[(indices >> (i * 2)) & 3];
+        float w1 = 1.0f - w0;
+        aa += w0 * w0;
+        ab += w0 * w1;
+        bb += w1 * w1;
+        for(int c = 0; c < 3; ++c)
+        {
+            ax[c] += w0 * block[(i * 4) + c];
+            bx[c] += w1 * block[(i * 4) + c];
+        }
+    }
+    
+    float determinant = (aa * bb) - (ab * ab);
+    if(fabsf(determinant) > 1e-6f)
+    {
+        for(int c = 0; c < 3; ++c)
+        {
+            endpoint0[c] = ((bb * ax[c]) - (ab * bx[c])) / determinant;
+            endpoint1[c] = ((aa * bx[c]) - (ab * ax[c])) / determinant;
+        }
+        
+        int refined0 = packColor(endpoint0);
+        int refined1 = packColor(endpoint1);
+        uint32_t refinedIndices;
+        float refinedError = fitColorIndices(block, refined0, refined1, &refinedIndices);
+        if(refinedError < error)
+        {
+            color0 = refined0;
+            color1 = refined1;
+            indices = refinedIndices;
+        }
+    }
+    
+    // The 4 colour mode needs the first endpoint to be larger.
+    // Swapping them swaps indices 0 and 1, and 2 and 3.
+    if(color0 < color1)
+    {
+        swap(color0, color1);
+        indices ^= 0x55555555;
+    }
+    else if(color0 == color1)
+    {
+        indices = 0;
+    }
+    
+    output[0] = color0 & 0xFF;
+    output[1] = color0 >> 8;
+    output[2] = color1 & 0xFF;
+    output[3] = color1 >> 8;
+    for(int i = 0; i < 4; ++i)
+    {
+        output[4 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+}
+
+void TextureCompressor::encodeChannelBlock(const unsigned char* block, int channel, unsigned char* output)
+{
+    int low = 255;
+    int high = 0;
+    for(int i = 0; i < 16; ++i)
+    {
+        int value = block[(i * 4) + channel];
+        low = min(low, value);
+        high = max(high, value);
+    }
+    
+    // The first endpoint is larger, which selects the 8 value mode
+    output[0] = (unsigned char)high;
+    output[1] = (unsigned char)low;
+    
+    uint64_t indices = 0;
+    if(high > low)
+    {
+        // Values 2-7 are spaced evenly from high to low
+        float palette[8];
+        palette[0] = high;
+        palette[1] = low;
+        for(int p = 2; p < 8; ++p)
+        {
+            palette[p] = (((8 - p) * high) + ((p - 1) * low)) / 7.0f;
+        }
+        
+        for(int i = 0; i < 16; ++i)
+        {
+            float value = block[(i * 4) + channel];
+            float bestError = 1e30f;
+            uint64_t bestIndex = 0;
+            for(int p = 0; p < 8; ++p)
+            {
+                float valueError = fabsf(value - palette[p]);
+                if(valueError < bestError)
+                {
+                    bestError = valueError;
+                    bestIndex = p;
+                }
+            }
+            
+            indices |= bestIndex << (i * 3);
+        }
+    }
+    
+    for(int i = 0; i < 6; ++i)
+    {
+        output[2 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+}
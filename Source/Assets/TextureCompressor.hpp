@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// GPU block compression formats.
+// Each encodes a 4x4 block of texels in a fixed number of bytes.
+enum BlockFormat
+{
+    BF_BC1 = 0, // RGB, 8 bytes
+    BF_BC3 = 1, // RGB + alpha, 16 bytes
+    BF_BC5 = 2  // Two channels (red and green), 16 bytes
+};
+
+// Encodes RGBA8 images into block compressed formats.
+// Uses no OpenGL calls, so it can be run on any thread.
+class TextureCompressor
+{
+public:
+    // The size of a single 4x4 block
+    static int blockBytes(BlockFormat format);
+    
+    // The size of a compressed image
+    static size_t compressedSize(BlockFormat format, int width, int height);
+    
+    // Compresses RGBA8 texels into output, which must hold compressedSize bytes.
+    // Images that are not a multiple of 4 in size repeat their edge texels.
+    static void compress(BlockFormat format, const unsigned char* texels, int width, int height, unsigned char* output);
+    
+    // Halves the size of RGBA8 texels with a box filter, for the next mip level.
+    // Normal map texels are renormalized after filtering.
+    static void downsample(const unsigned char* texels, int width, int height, bool normalMap, vector<unsigned char>* output);
+    
+    // True if every texel has full alpha, so BC1 can be used
+    static bool isOpaque(const unsigned char* texels, int width, int height);
+
+private:
+    // Encodes the RGB of a block of 16 RGBA8 texels.
+    // The colour block is the same in BC1 and BC3.
+    static void encodeColorBlock(const unsigned char* block, unsigned char* output);
+    
+    // Encodes a single channel of a block of 16 RGBA8 texels.
+    // Used for BC3 alpha and each of the BC5 channels.
+    static void encodeChannelBlock(const unsigned char* block, int channel, unsigned char* output);
+};
@@ -0,0 +1,91 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threadCount)
+    : threads_(),
+    jobs_(),
+    jobsMutex_(),
+    jobsChanged_(),
+    jobsFinished_(),
+    runningJobs_(0),
+    stopping_(false)
+{
+    // The core count is 0 if it can't be found
+    if(threadCount <= 0)
+    {
+        threadCount = max((int)thread::hardware_concurrency(), 1);
+    }
+    
+    for(int i = 0; i < threadCount; ++i)
+    {
+        threads_.push_back(thread(&WorkerPool::work, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(jobsMutex_);
+        stopping_ = true;
+    }
+    jobsChanged_.notify_all();
+    
+    for(unsigned int i = 0; i < threads_.size(); ++i)
+    {
+        threads_[i].join();
+    }
+}
+
+void WorkerPool::run(const function<void()> &job)
+{
+    {
+        lock_guard<mutex> lock(jobsMutex_);
+        jobs_.push(job);
+    }
+    jobsChanged_.notify_one();
+}
+
+void WorkerPool::wait()
+{
+    unique_lock<mutex> lock(jobsMutex_);
+    while(!jobs_.empty() || runningJobs_ > 0)
+    {
+        jobsFinished_.wait(lock);
+    }
+}
+
+void WorkerPool::work()
+{
+    while(true)
+    {
+        function<void()> job;
+        
+        {
+            // Sleep until there is a job, or the pool is stopping
+            unique_lock<mutex> lock(jobsMutex_);
+            while(jobs_.empty() && !stopping_)
+            {
+                jobsChanged_.wait(lock);
+            }
+            
+            // Queued jobs are finished before stopping
+            if(jobs_.empty())
+            {
+                return;
+            }
+            
+            job = jobs_.front();
+            jobs_.pop();
+            runningJobs_ ++;
+        }
+        
+        job();
+        
+        {
+            lock_guard<mutex> lock(jobsMutex_);
+            runningJobs_ --;
+        }
+        jobsFinished_.notify_all();
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// A fixed set of threads that run queued jobs in order.
+class WorkerPool
+{
+public:
+    // Uses a thread per core when the count is 0
+    WorkerPool(int threadCount = 0);
+    
+    // Finishes the jobs already queued, then stops the threads
+    ~WorkerPool();
+    
+    int threadCount() const { return (int)threads_.size(); }
+    
+    // Queues a job to run on the next free thread
+    void run(const function<void()> &job);
+    
+    // Blocks until every queued job has finished
+    void wait();
+
+private:
+    vector<thread> threads_;
+    queue<function<void()> > jobs_;
+    mutex jobsMutex_;
+    condition_variable jobsChanged_;
+    condition_variable jobsFinished_;
+    int runningJobs_;
+    bool stopping_;
+    
+    // Runs on each thread, until stopped
+    void work();
+};
@@ -0,0 +1,361 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+Benchmark::Benchmark(RendererWidget* renderer, const CameraPath* path, const vector<BenchmarkConfiguration> &configurations,
+                     const string &outputPath, const string &summaryPath)
+    : renderer_(renderer),
+    path_(path),
+    outputPath_(outputPath),
+    summaryPath_(summaryPath),
+    output_(outputPath.c_str()),
+    configurations_(configurations),
+    results_(configurations.size()),
+    currentConfiguration_(0),
+    frame_(0),
+    updates_(0),
+    pendingFrames_(),
+    finished_(false)
+{
+    if(!output_.is_open() || configurations_.empty())
+    {
+        printf("Failed to start benchmark, writing to %s \n", outputPath.c_str());
+        finished_ = true;
+        return;
+    }
+    
+    // Write the CSV header
+    output_ << "method,cascades,shadow_resolution,pcf_filter_size,tree_resolution,frame,path_time,";
+    output_ << "cpu_frame_ms,gpu_frame_ms,gpu_shadow_rendering_ms,gpu_shadow_sampling_ms,draw_calls,state_changes,gl_state_changes,gl_state_filtered,visible_instances,occluded_instances\n";
+    
+    startConfiguration(0);
+}
+
+vector<BenchmarkConfiguration> Benchmark::createConfigurations(const Settings &settings, const RendererSettings &rendererSettings)
+{
+    // Methods, cascades and PCF sizes cover every option by default
+    vector<string> methodNames = settings.getList("sweep.method");
+    if(methodNames.empty())
+    {
+        methodNames = { "shadowmap", "voxeltree", "combined" };
+    }
+    
+    vector<int> cascades = settings.getIntList("sweep.cascades");
+    if(cascades.empty())
+    {
+        cascades = { 1, 2, 3, 4 };
+    }
+    
+    vector<int> pcfFilterSizes = settings.getIntList("sweep.pcf");
+    if(pcfFilterSizes.empty())
+    {
+        pcfFilterSizes = { 0, 9, 17 };
+    }
+    
+    // Resolutions default to the current settings
+    vector<int> shadowMapResolutions = settings.getIntList("sweep.shadow_resolution");
+    if(shadowMapResolutions.empty())
+    {
+        shadowMapResolutions.push_back(rendererSettings.shadowMapResolution);
+    }
+    
+    vector<int> treeResolutions = settings.getIntList("sweep.tree_resolution");
+    if(treeResolutions.empty())
+    {
+        treeResolutions.push_back(rendererSettings.treeResolution);
+    }
+    
+    vector<BenchmarkConfiguration> configurations;
+    for(unsigned int m = 0; m < methodNames.size(); ++m)
+    {
+        ShadowMaskMethod method;
+        if(!Settings::parseShadowMethod(methodNames[m], &method))
+        {
+            printf("Unknown shadow method %s in sweep \n", methodNames[m].c_str());
+            continue;
+        }
+        
+        for(unsigned int t = 0; t < treeResolutions.size(); ++t)
+        {
+            for(unsigned int r = 0; r < shadowMapResolutions.size(); ++r)
+            {
+                for(unsigned int c = 0; c < cascades.size(); ++c)
+                {
+                    for(unsigned int p = 0; p < pcfFilterSizes.size(); ++p)
+                    {
+                        // Skip values the renderer does not support
+                        bool validCascades = cascades[c] >= 1 && cascades[c] <= 4;
+                        bool validPCF = pcfFilterSizes[p] == 0 || pcfFilterSizes[p] == 9 || pcfFilterSizes[p] == 17;
+                        bool validResolutions = shadowMapResolutions[r] > 0 && treeResolutions[t] >= 8;
+                        if(!validCascades || !validPCF || !validResolutions)
+                        {
+                            continue;
+                        }
+                        
+                        BenchmarkConfiguration configuration;
+                        configuration.method = method;
+                        configuration.cascades = cascades[c];
+                        configuration.shadowMapResolution = shadowMapResolutions[r];
+                        configuration.pcfFilterSize = pcfFilterSizes[p];
+                        configuration.treeResolution = treeResolutions[t];
+                        
+                        // Clear settings that have no effect on the method
+                        if(method == SMM_ShadowMap)
+                        {
+                            configuration.pcfFilterSize = 0;
+                            configuration.treeResolution = 0;
+                        }
+                        else if(method == SMM_VoxelTree)
+                        {
+                            configuration.cascades = 0;
+                            configuration.shadowMapResolution = 0;
+                        }
+                        
+                        // Only measure each distinct configuration once
+                        bool duplicate = false;
+                        for(unsigned int i = 0; i < configurations.size(); ++i)
+                        {
+                            const BenchmarkConfiguration &other = configurations[i];
+                            duplicate |= (other.method == configuration.method &&
+                                          other.cascades == configuration.cascades &&
+                                          other.shadowMapResolution == configuration.shadowMapResolution &&
+                                          other.pcfFilterSize == configuration.pcfFilterSize &&
+                                          other.treeResolution == configuration.treeResolution);
+                        }
+                        
+                        if(!duplicate)
+                        {
+                            configurations.push_back(configuration);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    return configurations;
+}
+
+void Benchmark::update()
+{
+    if(finished_)
+    {
+        return;
+    }
+
+    // The timings in the stats are for the frame positioned two updates ago
+    int update = updates_++;
+    if(!pendingFrames_.empty() && pendingFrames_.front().update == update - 2)
+    {
+        recordFrame(pendingFrames_.front());
+        pendingFrames_.pop_front();
+    }
+
+    Camera* camera = renderer_->camera();
+    int frame = frame_++;
+
+    // Warm up at the start of the path so shader compilation
+    // and texture allocation are not included in the timings
+    if(frame < WarmupFrames)
+    {
+        if(path_ != NULL)
+        {
+            path_->apply(0.0, camera);
+        }
+        return;
+    }
+
+    // Restart animations so every configuration sees the same scene
+    int measuredFrame = frame - WarmupFrames;
+    if(measuredFrame == 0)
+    {
+        renderer_->scene()->resetAnimations();
+    }
+
+    // Follow the path using a fixed clock
+    float time = measuredFrame * (1.0 / 60.0);
+    if(time <= duration())
+    {
+        if(path_ != NULL)
+        {
+            path_->apply(time, camera);
+        }
+        
+        PendingFrame pending;
+        pending.update = update;
+        pending.frame = measuredFrame;
+        pending.time = time;
+        pendingFrames_.push_back(pending);
+        return;
+    }
+
+    // Keep rendering at the end of the path until every measured frame is recorded
+    if(!pendingFrames_.empty())
+    {
+        return;
+    }
+
+    // Move on to the next configuration
+    if(currentConfiguration_ + 1 < (int)configurations_.size())
+    {
+        startConfiguration(currentConfiguration_ + 1);
+        return;
+    }
+
+    output_.close();
+    writeSummary();
+    finished_ = true;
+    printf("Benchmark finished, results written to %s and %s \n", outputPath_.c_str(), summaryPath_.c_str());
+}
+
+float Benchmark::duration() const
+{
+    if(path_ == NULL)
+    {
+        return (StaticFrames - 1) * (1.0 / 60.0);
+    }
+    
+    return path_->duration();
+}
+
+void Benchmark::startConfiguration(int index)
+{
+    currentConfiguration_ = index;
+    frame_ = 0;
+
+    // Apply the settings to the renderer
+    const BenchmarkConfiguration &configuration = configurations_[index];
+    renderer_->setShadowRenderMethod(configuration.method);
+
+    if(configuration.cascades > 0)
+    {
+        renderer_->setShadowMapCascades(configuration.cascades);
+    }
+    
+    if(configuration.shadowMapResolution > 0)
+    {
+        renderer_->setShadowMapResolution(configuration.shadowMapResolution);
+    }
+    
+    if(configuration.method != SMM_ShadowMap)
+    {
+        renderer_->setVoxelPCFFilterSize(configuration.pcfFilterSize);
+    }
+    
+    // Rebuild the tree before measuring if the resolution changes
+    if(configuration.treeResolution > 0 && configuration.treeResolution != renderer_->settings().treeResolution)
+    {
+        printf("Building %d voxel tree \n", configuration.treeResolution);
+        renderer_->setTreeResolution(configuration.treeResolution);
+        renderer_->precomputeTree();
+    }
+    
+    results_[index].shadowRenderingTime = 0.0;
+    results_[index].maxShadowRenderingTime = 0.0;
+    results_[index].shadowSamplingTime = 0.0;
+    results_[index].treeSizeMB = renderer_->voxelTree()->sizeMB();
+    
+    printf("Benchmarking configuration %d / %d \n", index + 1, (int)configurations_.size());
+}
+
+void Benchmark::recordFrame(const PendingFrame &frame)
+{
+    const char* methodNames[] = { "ShadowMap", "VoxelTree", "Combined" };
+    const BenchmarkConfiguration &configuration = configurations_[currentConfiguration_];
+    const RendererStats* stats = renderer_->stats();
+
+    output_ << methodNames[configuration.method] << ",";
+    output_ << configuration.cascades << ",";
+    output_ << configuration.shadowMapResolution << ",";
+    output_ << configuration.pcfFilterSize << ",";
+    output_ << configuration.treeResolution << ",";
+    output_ << frame.frame << ",";
+    output_ << frame.time << ",";
+    output_ << stats->lastFrameTime() << ",";
+    output_ << stats->lastGPUFrameTime() << ",";
+    output_ << stats->lastShadowRenderingTime() << ",";
+    output_ << stats->lastShadowSamplingTime() << ",";
+    output_ << stats->lastDrawCalls() << ",";
+    output_ << stats->lastStateChanges() << ",";
+    output_ << stats->lastIssuedGLStateChanges() << ",";
+    output_ << stats->lastFilteredGLStateChanges() << ",";
+    output_ << stats->lastVisibleInstances() << ",";
+    output_ << stats->lastOccludedInstances() << "\n";
+    
+    // Add to the totals for the summary
+    ConfigurationResults &results = results_[currentConfiguration_];
+    results.cpuFrameTimes.push_back(stats->lastFrameTime());
+    results.gpuFrameTimes.push_back(stats->lastGPUFrameTime());
+    results.shadowRenderingTime += stats->lastShadowRenderingTime();
+    results.maxShadowRenderingTime = max(results.maxShadowRenderingTime, stats->lastShadowRenderingTime());
+    results.shadowSamplingTime += stats->lastShadowSamplingTime();
+}
+
+void Benchmark::writeSummary()
+{
+    const char* methodNames[] = { "ShadowMap", "VoxelTree", "Combined" };
+    
+    ofstream summary(summaryPath_.c_str());
+    if(!summary.is_open())
+    {
+        printf("Failed to write benchmark summary %s \n", summaryPath_.c_str());
+        return;
+    }
+    
+    summary << "method,cascades,shadow_resolution,pcf_filter_size,tree_resolution,tree_size_mb,frames,";
+    summary << "cpu_mean_ms,cpu_p95_ms,gpu_mean_ms,gpu_p95_ms,gpu_shadow_rendering_mean_ms,gpu_shadow_rendering_max_ms,gpu_shadow_sampling_mean_ms\n";
+    
+    printf("\n%-10s %8s %10s %4s %8s | %9s %9s | %9s %9s | %9s %9s %9s \n",
+           "Method", "Cascades", "Shadow Res", "PCF", "Tree Res", "CPU Mean", "CPU P95", "GPU Mean", "GPU P95", "Rendering", "Rend Max", "Sampling");
+    
+    for(unsigned int i = 0; i < configurations_.size(); ++i)
+    {
+        const BenchmarkConfiguration &configuration = configurations_[i];
+        const ConfigurationResults &results = results_[i];
+        
+        // Compute the averages
+        double frames = max((int)results.cpuFrameTimes.size(), 1);
+        double cpuMean = 0.0;
+        double gpuMean = 0.0;
+        for(unsigned int f = 0; f < results.cpuFrameTimes.size(); ++f)
+        {
+            cpuMean += results.cpuFrameTimes[f] / frames;
+            gpuMean += results.gpuFrameTimes[f] / frames;
+        }
+        
+        double cpuP95 = percentile(results.cpuFrameTimes, 0.95);
+        double gpuP95 = percentile(results.gpuFrameTimes, 0.95);
+        double renderingMean = results.shadowRenderingTime / frames;
+        double samplingMean = results.shadowSamplingTime / frames;
+        
+        summary << methodNames[configuration.method] << ",";
+        summary << configuration.cascades << ",";
+        summary << configuration.shadowMapResolution << ",";
+        summary << configuration.pcfFilterSize << ",";
+        summary << configuration.treeResolution << ",";
+        summary << results.treeSizeMB << ",";
+        summary << results.cpuFrameTimes.size() << ",";
+        summary << cpuMean << "," << cpuP95 << ",";
+        summary << gpuMean << "," << gpuP95 << ",";
+        summary << renderingMean << "," << results.maxShadowRenderingTime << "," << samplingMean << "\n";
+        
+        printf("%-10s %8d %10d %4d %8d | %9.2f %9.2f | %9.2f %9.2f | %9.2f %9.2f %9.2f \n",
+               methodNames[configuration.method], configuration.cascades, configuration.shadowMapResolution,
+               configuration.pcfFilterSize, configuration.treeResolution,
+               cpuMean, cpuP95, gpuMean, gpuP95, renderingMean, results.maxShadowRenderingTime, samplingMean);
+    }
+}
+
+double Benchmark::percentile(vector<double> values, double fraction)
+{
+    if(values.empty())
+    {
+        return 0.0;
+    }
+    
+    // Partially sort to find the value at the percentile
+    size_t index = min((size_t)(fraction * values.size()), values.size() - 1);
+    nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+
+using namespace std;
+
+#include "RendererWidget.hpp"
+#include "CameraPath.hpp"
+#include "Settings.hpp"
+
+// A single combination of settings to be measured
+struct BenchmarkConfiguration
+{
+    ShadowMaskMethod method;
+
+    // Zero when the setting has no effect on the method
+    int cascades;
+    int shadowMapResolution;
+    int pcfFilterSize;
+    int treeResolution;
+};
+
+// Replays a camera path once for every configuration and writes
+// the timings for each frame to a CSV file, followed by a summary
+// table with one row per configuration.
+class Benchmark
+{
+public:
+    // Without a path the camera stays still for StaticFrames frames.
+    Benchmark(RendererWidget* renderer, const CameraPath* path, const vector<BenchmarkConfiguration> &configurations,
+              const string &outputPath, const string &summaryPath);
+    
+    // Creates the configurations to measure from the sweep section.
+    // Each sweep.* key is a comma separated list of values, and every
+    // combination is measured. Unset keys use the renderer settings,
+    // except for methods, cascades and PCF sizes which default to all values.
+    static vector<BenchmarkConfiguration> createConfigurations(const Settings &settings, const RendererSettings &rendererSettings);
+    
+    // True once every configuration has been measured
+    bool finished() const { return finished_; }
+
+    // Called once before each frame is rendered.
+    // Positions the camera using a fixed clock and records the
+    // timings of earlier frames as they become available.
+    void update();
+
+private:
+
+    // A measured frame waiting for its GPU queries to complete
+    struct PendingFrame
+    {
+        int update;
+        int frame;
+        float time;
+    };
+    
+    // The recorded times of every measured frame in a configuration
+    struct ConfigurationResults
+    {
+        vector<double> cpuFrameTimes;
+        vector<double> gpuFrameTimes;
+        double shadowRenderingTime;
+        double maxShadowRenderingTime;
+        double shadowSamplingTime;
+        size_t treeSizeMB;
+    };
+    
+    // Frames rendered before measuring each configuration
+    const static int WarmupFrames = 60;
+    
+    // Frames measured when there is no camera path
+    const static int StaticFrames = 600;
+    
+    RendererWidget* renderer_;
+    const CameraPath* path_;
+
+    string outputPath_;
+    string summaryPath_;
+    ofstream output_;
+
+    vector<BenchmarkConfiguration> configurations_;
+    vector<ConfigurationResults> results_;
+    int currentConfiguration_;
+
+    // Frames rendered with the current configuration, including warmup
+    int frame_;
+
+    // Total calls to update()
+    int updates_;
+
+    deque<PendingFrame> pendingFrames_;
+    bool finished_;
+
+    float duration() const;
+    void startConfiguration(int index);
+    void recordFrame(const PendingFrame &frame);
+    void writeSummary();
+    
+    // Returns the given percentile of the values
+    static double percentile(vector<double> values, double fraction);
+};
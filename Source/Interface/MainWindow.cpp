@@ -3,10 +3,10 @@
 #include <QVariant>
 #include <QScrollArea>
 
-MainWindow::MainWindow(bool fullScreen, const QGLFormat &format, int voxelResolution)
+MainWindow::MainWindow(bool fullScreen, const QGLFormat &format, const RendererSettings &settings)
 {
     // Create main renderer
-    rendererWidget_ = new RendererWidget(format, voxelResolution);
+    rendererWidget_ = new RendererWidget(format, settings);
     
     // Create groups
     statsGroupBox_ = new QGroupBox("Stats");
@@ -31,26 +31,28 @@ MainWindow::MainWindow(bool fullScreen, const QGLFormat &format, int voxelResolu
     frameRateLabel_ = createStatsLabel();
     shadowRenderingTimeLabel_ = createStatsLabel();
     shadowSamplingTimeLabel_ = createStatsLabel();
+    drawCallsLabel_ = createStatsLabel();
+    instancesLabel_ = createStatsLabel();
     treeResolutionLabel_ = createStatsLabel();
     treeTilesLabel_ = createStatsLabel();
     originalSizeLabel_ = createStatsLabel();
     treeSizeLabel_ = createStatsLabel();
     
     // Create shading feature toggles
-    createFeatureToggle(SF_Texture, "Diffuse Textures");
-    createFeatureToggle(SF_Specular, "Specular Highlights");
-    createFeatureToggle(SF_NormalMap, "Normal Mapping");
-    createFeatureToggle(SF_Cutout, "Cutout Transparency");
-    createFeatureToggle(SF_Fog, "Fog");
+    createFeatureToggle(SF_Texture, "Diffuse Textures")->setChecked(settings.enabledFeatures & SF_Texture);
+    createFeatureToggle(SF_Specular, "Specular Highlights")->setChecked(settings.enabledFeatures & SF_Specular);
+    createFeatureToggle(SF_NormalMap, "Normal Mapping")->setChecked(settings.enabledFeatures & SF_NormalMap);
+    createFeatureToggle(SF_Cutout, "Cutout Transparency")->setChecked(settings.enabledFeatures & SF_Cutout);
+    createFeatureToggle(SF_Fog, "Fog")->setChecked(settings.enabledFeatures & SF_Fog);
     
     // Create shadow method toggles
-    createShadowMethodRadio(SMM_ShadowMap, "Shadow Mapping");    createShadowMethodRadio(SMM_VoxelTree, "Voxel Tree");
-    createShadowMethodRadio(SMM_Combined, "Combined")->setChecked(true); // Default
-;
+    createShadowMethodRadio(SMM_ShadowMap, "Shadow Mapping");
+    createShadowMethodRadio(SMM_VoxelTree, "Voxel Tree");
+    createShadowMethodRadio(SMM_Combined, "Combined");
 
     // Create overlay radios
     // Must match RendererWidget::createOverlays()
-    createOverlayRadio(-1, "No Overlay")->setChecked(true); // Default = No Overlay
+    createOverlayRadio(-1, "No Overlay");
     createOverlayRadio(0, "Shadow Map");
     createOverlayRadio(1, "Scene Depth");
     createOverlayRadio(2, "Shadow Mask");
@@ -61,19 +63,26 @@ MainWindow::MainWindow(bool fullScreen, const QGLFormat &format, int voxelResolu
     createShadowResolutionRadio(512);
     createShadowResolutionRadio(1024);
     createShadowResolutionRadio(2048);
-    createShadowResolutionRadio(4096)->setChecked(true); // Default = 4096
+    createShadowResolutionRadio(4096);
     
     // Create shadow cascades radios
     createShadowCascadesRadio(1);
-    createShadowCascadesRadio(2)->setChecked(true); // Default = 2
+    createShadowCascadesRadio(2);
     createShadowCascadesRadio(3);
     createShadowCascadesRadio(4);
     
     // Create voxel pcf kernel size radios
     createVoxelPCFFilterSizeRadio(0);
-    createVoxelPCFFilterSizeRadio(9)->setChecked(true); // Default = 9x9 PCF
+    createVoxelPCFFilterSizeRadio(9);
     createVoxelPCFFilterSizeRadio(17);
     
+    // Check the radios matching the startup settings
+    checkRadio(shadowMethodRadios_, "method", settings.shadowMethod);
+    checkRadio(overlayRadios_, "overlay", settings.overlay);
+    checkRadio(shadowResolutionRadios_, "resolution", settings.shadowMapResolution);
+    checkRadio(shadowCascadesRadios_, "cascades", settings.shadowMapCascades);
+    checkRadio(voxelPCFFilterSizeRadios_, "kernelSize", settings.voxelPCFFilterSize);
+    
     // Add widgets to side panel
     QBoxLayout* sidePanelLayout = new QBoxLayout(QBoxLayout::TopToBottom);
     sidePanelLayout->addWidget(statsGroupBox_);
@@ -115,6 +124,20 @@ MainWindow::MainWindow(bool fullScreen, const QGLFormat &format, int voxelResolu
     }
 }
 
+void MainWindow::checkRadio(QGroupBox* group, const char* property, int value)
+{
+    // Check the radio button in the group with the matching property value
+    QObjectList radios = group->children();
+    for(int i = 1; i < radios.size(); ++i)
+    {
+        QRadioButton* radio = (QRadioButton*)radios[i];
+        if(radio->property(property).toInt() == value)
+        {
+            radio->setChecked(true);
+        }
+    }
+}
+
 QLabel* MainWindow::createStatsLabel()
 {
     QLabel* label = new QLabel();
@@ -12,7 +12,7 @@
 class MainWindow : public QWidget
 {
 public:
-    MainWindow(bool fullScreen, const QGLFormat &format, int voxelResolution);
+    MainWindow(bool fullScreen, const QGLFormat &format, const RendererSettings &settings);
 
     // Renderer and side panel
     RendererWidget* rendererWidget() const { return rendererWidget_; }
@@ -23,6 +23,8 @@ public:
     QLabel* frameRateLabel() const { return frameRateLabel_; }
     QLabel* shadowRenderingTimeLabel() const { return shadowRenderingTimeLabel_; }
     QLabel* shadowSamplingTimeLabel() const { return shadowSamplingTimeLabel_; }
+    QLabel* drawCallsLabel() const { return drawCallsLabel_; }
+    QLabel* instancesLabel() const { return instancesLabel_; }
     QLabel* treeResolutionLabel() const { return treeResolutionLabel_; }
     QLabel* treeTilesLabel() const { return treeTilesLabel_; }
     QLabel* originalSizeLabel() const { return originalSizeLabel_; }
@@ -50,6 +52,8 @@ private:
     QLabel* frameRateLabel_;
     QLabel* shadowRenderingTimeLabel_;
     QLabel* shadowSamplingTimeLabel_;
+    QLabel* drawCallsLabel_;
+    QLabel* instancesLabel_;
     QLabel* treeResolutionLabel_;
     QLabel* treeTilesLabel_;
     QLabel* originalSizeLabel_;
@@ -63,6 +67,9 @@ private:
     QGroupBox* shadowCascadesRadios_;
     QGroupBox* voxelPCFFilterSizeRadios_;
     
+    // Checks the radio button in a group with the given property value
+    void checkRadio(QGroupBox* group, const char* property, int value);
+    
     QLabel* createStatsLabel();
     QCheckBox* createFeatureToggle(ShaderFeature feature, const char* label);
     QRadioButton* createShadowMethodRadio(ShadowMaskMethod method, const char* label);
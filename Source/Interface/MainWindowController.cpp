@@ -1,10 +1,17 @@
 #include "MainWindowController.hpp"
 
+#include <QApplication>
+
 MainWindowController::MainWindowController(MainWindow* window)
     : window_(window),
     inputManager_(),
     mouseDragging_(false),
-    mousePosition_(Vector2(0, 0))
+    mousePosition_(Vector2(0, 0)),
+    benchmark_(NULL),
+    recordedPath_(NULL),
+    recordingFile_(),
+    recordingTime_(0.0),
+    nextKeyframeTime_(0.0)
 {
     // Shader feature toggle signals
     for(int i = 1; i < window_->shaderFeatureToggles().size(); ++i)
@@ -43,11 +50,39 @@ MainWindowController::MainWindowController(MainWindow* window)
     }
 }
 
+MainWindowController::~MainWindowController()
+{
+    delete benchmark_;
+    delete recordedPath_;
+}
+
+void MainWindowController::startBenchmark(const CameraPath* path, const vector<BenchmarkConfiguration> &configurations,
+                                          const string &outputPath, const string &summaryPath)
+{
+    delete benchmark_;
+    benchmark_ = new Benchmark(window_->rendererWidget(), path, configurations, outputPath, summaryPath);
+}
+
+void MainWindowController::startRecording(const string &pathFile)
+{
+    delete recordedPath_;
+    recordedPath_ = new CameraPath();
+    recordingFile_ = pathFile;
+    recordingTime_ = 0.0;
+    nextKeyframeTime_ = 0.0;
+}
+
 bool MainWindowController::eventFilter(QObject* obj, QEvent* event)
 {
     if(event->type() == QEvent::Paint)
     {
         update((1.0 / 60.0));
+        
+        // Benchmarks and recordings advance exactly once per rendered frame
+        if(obj == window_->rendererWidget())
+        {
+            updateFrame((1.0 / 60.0));
+        }
     }
     else if(event->type() == QEvent::MouseButtonPress && obj == window_->rendererWidget())
     {
@@ -146,13 +181,52 @@ void MainWindowController::voxelPCFFilterSizeToggled()
 
 void MainWindowController::update(float deltaTime)
 {
-    // Move the camera with user input
-    applyCameraMovement(deltaTime);
+    // Move the camera with user input.
+    // The benchmark has full control of the camera.
+    if(benchmark_ == NULL)
+    {
+        applyCameraMovement(deltaTime);
+    }
     
     // Update the statistics ui
     updateStatsUI();
 }
 
+void MainWindowController::updateFrame(float deltaTime)
+{
+    if(benchmark_ != NULL)
+    {
+        benchmark_->update();
+        
+        // Exit once all configurations have been measured
+        if(benchmark_->finished())
+        {
+            QApplication::quit();
+        }
+    }
+    
+    if(recordedPath_ != NULL)
+    {
+        recordCameraPath(deltaTime);
+    }
+}
+
+void MainWindowController::recordCameraPath(float deltaTime)
+{
+    // Keyframes are spaced evenly, the spline smooths between them
+    if(recordingTime_ >= nextKeyframeTime_)
+    {
+        Camera* camera = window_->rendererWidget()->camera();
+        recordedPath_->addKeyframe(recordingTime_, camera->position(), camera->rotation());
+        nextKeyframeTime_ = recordingTime_ + 0.25;
+        
+        // Save after every keyframe so the recording survives closing the window
+        recordedPath_->saveToFile(recordingFile_);
+    }
+    
+    recordingTime_ += deltaTime;
+}
+
 void MainWindowController::applyCameraMovement(float deltaTime)
 {
     Camera* camera = window_->rendererWidget()->camera();
@@ -180,31 +254,46 @@ void MainWindowController::updateStatsUI()
     int frameRate = stats->currentFrameRate();
     int frameTime = stats->currentFrameTime();
     double shadowRenderingTime = stats->currentShadowRenderingTime();
+    double maxShadowRenderingTime = stats->currentMaxShadowRenderingTime();
     double shadowSamplingTime = stats->currentShadowSamplingTime();
+    int drawCalls = stats->lastDrawCalls();
+    int stateChanges = stats->lastStateChanges();
+    int issuedGLStateChanges = stats->lastIssuedGLStateChanges();
+    int filteredGLStateChanges = stats->lastFilteredGLStateChanges();
+    int visibleInstances = stats->lastVisibleInstances();
+    int occludedInstances = stats->lastOccludedInstances();
     
     // Get the voxel tree stats
     const VoxelTree* tree = window_->rendererWidget()->voxelTree();
-    int resolution = tree->resolution() / 1024;
+    int resolutionX = tree->resolutionX() / 1024;
+    int resolutionY = tree->resolutionY() / 1024;
     int totalTiles = tree->totalTiles();
     int completedTiles = tree->completedTiles();
+    int residentTiles = tree->residentTiles();
     size_t originalSizeMB = tree->originalSizeMB();
     size_t treeSizeMB = tree->sizeMB();
+    size_t residentSizeMB = tree->residentSizeMB();
     
     // Create the text for each label
     QString resolutionText = QString("%1 x %2").arg(resX).arg(resY);
     QString frameRateText = QString("Frame Rate: %1 FPS (%2 ms)").arg(frameRate).arg(frameTime);
-    QString shadowRenderingText = QString("Shadow Rendering: %1 ms").arg(shadowRenderingTime, 0, 'f', 1);
+    QString shadowRenderingText = QString("Shadow Rendering: %1 ms (%2 ms Max)").arg(shadowRenderingTime, 0, 'f', 1).arg(maxShadowRenderingTime, 0, 'f', 1);
     QString shadowSamplingText = QString("Shadow Sampling: %1 ms").arg(shadowSamplingTime, 0, 'f', 1);
-    QString treeResolutionText = QString("Resolution: %1K x %1K").arg(resolution);
-    QString tilesText = QString("Tiles: %1 / %2").arg(completedTiles).arg(totalTiles);
+    QString drawCallsText = QString("Draw Calls: %1 (%2 State Changes, %3 GL / %4 Filtered)").arg(drawCalls).arg(stateChanges)
+        .arg(issuedGLStateChanges).arg(filteredGLStateChanges);
+    QString instancesText = QString("Visible Instances: %1 (%2 Occluded)").arg(visibleInstances).arg(occludedInstances);
+    QString treeResolutionText = QString("Resolution: %1K x %2K").arg(resolutionX).arg(resolutionY);
+    QString tilesText = QString("Tiles: %1 / %2 (%3 Resident)").arg(completedTiles).arg(totalTiles).arg(residentTiles);
     QString originalSizeText = QString("Original Size: %1 MB").arg(originalSizeMB);
-    QString treeSizeText = QString("Tree Size: %1 MB").arg(treeSizeMB);
+    QString treeSizeText = QString("Tree Size: %1 MB (%2 MB Resident)").arg(treeSizeMB).arg(residentSizeMB);
     
     // Update the stats labels
     window_->resolutionLabel()->setText(resolutionText);
     window_->frameRateLabel()->setText(frameRateText);
     window_->shadowRenderingTimeLabel()->setText(shadowRenderingText);
     window_->shadowSamplingTimeLabel()->setText(shadowSamplingText);
+    window_->drawCallsLabel()->setText(drawCallsText);
+    window_->instancesLabel()->setText(instancesText);
     window_->treeResolutionLabel()->setText(treeResolutionText);
     window_->treeTilesLabel()->setText(tilesText);
     window_->originalSizeLabel()->setText(originalSizeText);
@@ -3,7 +3,13 @@
 #include <QEvent>
 #include <QKeyEvent>
 
+#include <string>
+
+using namespace std;
+
 #include "MainWindow.hpp"
+#include "Benchmark.hpp"
+#include "CameraPath.hpp"
 #include "Input.hpp"
 #include "Vector2.hpp"
 
@@ -13,6 +19,16 @@ class MainWindowController : public QObject
 
 public:
     MainWindowController(MainWindow* window);
+    ~MainWindowController();
+    
+    // Replays the camera path for every configuration, writes the frame
+    // times and a summary table and then quits the application.
+    // The camera is not moved if the path is NULL.
+    void startBenchmark(const CameraPath* path, const vector<BenchmarkConfiguration> &configurations,
+                        const string &outputPath, const string &summaryPath);
+    
+    // Records the camera movement to a camera path file
+    void startRecording(const string &pathFile);
     
 protected:
     
@@ -36,8 +52,19 @@ private:
     bool mouseDragging_;
     Vector2 mousePosition_;
     
+    // The running benchmark, or NULL
+    Benchmark* benchmark_;
+    
+    // The camera path being recorded, or NULL
+    CameraPath* recordedPath_;
+    string recordingFile_;
+    float recordingTime_;
+    float nextKeyframeTime_;
+    
     // Called each frame
     void update(float deltaTime);
+    void updateFrame(float deltaTime);
+    void recordCameraPath(float deltaTime);
     void applyCameraMovement(float deltaTime);
     void updateStatsUI();
     
@@ -0,0 +1,476 @@
+#include "Settings.hpp"
+
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+
+Settings::Settings()
+    : values_()
+{
+
+}
+
+bool Settings::loadFromFile(const string &fileName)
+{
+    ifstream file(fileName.c_str());
+    if(!file.is_open())
+    {
+        printf("Failed to open config file %s \n", fileName.c_str());
+        return false;
+    }
+    
+    string section;
+    string line;
+    int lineNumber = 0;
+    while(getline(file, line))
+    {
+        lineNumber ++;
+        
+        // Skip comments and blank lines
+        line = trim(line);
+        if(line.empty() || line[0] == '#' || line[0] == ';')
+        {
+            continue;
+        }
+        
+        // Section headers prefix the following names
+        if(line[0] == '[')
+        {
+            size_t end = line.find(']');
+            if(end == string::npos)
+            {
+                printf("Invalid section in %s line %d \n", fileName.c_str(), lineNumber);
+                return false;
+            }
+            
+            section = trim(line.substr(1, end - 1));
+            continue;
+        }
+        
+        // name = value
+        size_t separator = line.find('=');
+        if(separator == string::npos)
+        {
+            printf("Expected name = value in %s line %d \n", fileName.c_str(), lineNumber);
+            return false;
+        }
+        
+        string name = trim(line.substr(0, separator));
+        string value = trim(line.substr(separator + 1));
+        set(section.empty() ? name : section + "." + name, value);
+    }
+    
+    printf("Loaded config file %s \n", fileName.c_str());
+    return true;
+}
+
+bool Settings::parseArguments(int argc, char* argv[])
+{
+    // Load the config file first
+    for(int i = 1; i < argc - 1; ++i)
+    {
+        if(string(argv[i]) == "-config" && !loadFromFile(argv[i + 1]))
+        {
+            return false;
+        }
+    }
+    
+    for(int i = 1; i < argc; ++i)
+    {
+        string argument(argv[i]);
+        bool hasValue = (i + 1 < argc);
+        
+        if(argument == "-config" && hasValue)
+        {
+            // Already loaded
+            i++;
+        }
+        else if(argument.compare(0, 2, "--") == 0 && argument.find('=') != string::npos)
+        {
+            // --section.name=value
+            size_t separator = argument.find('=');
+            set(argument.substr(2, separator - 2), argument.substr(separator + 1));
+        }
+        else if(argument == "-fullscreen")
+        {
+            set("window.fullscreen", "true");
+        }
+        else if(argument == "-precompute")
+        {
+            set("tree.precompute", "true");
+        }
+        else if(argument == "-benchmark" && hasValue)
+        {
+            set("benchmark.path", argv[++i]);
+        }
+        else if(argument == "-benchmark-output" && hasValue)
+        {
+            set("benchmark.output", argv[++i]);
+        }
+        else if(argument == "-math-benchmark")
+        {
+            set("benchmark.math", "true");
+        }
+        else if(argument == "-record" && hasValue)
+        {
+            set("benchmark.record", argv[++i]);
+        }
+        else if(argument == "-pack" && hasValue)
+        {
+            set("scene.pack_output", argv[++i]);
+        }
+        else if(parseSize(argument) > 0)
+        {
+            // A tree resolution, eg 64k
+            set("tree.resolution", argument);
+        }
+        else
+        {
+            printf("Unknown argument %s \n", argument.c_str());
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void Settings::set(const string &key, const string &value)
+{
+    values_[key] = value;
+}
+
+bool Settings::contains(const string &key) const
+{
+    return values_.find(key) != values_.end();
+}
+
+bool Settings::containsSection(const string &section) const
+{
+    string prefix = section + ".";
+    auto it = values_.lower_bound(prefix);
+    return it != values_.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+}
+
+string Settings::getString(const string &key, const string &defaultValue) const
+{
+    auto it = values_.find(key);
+    if(it == values_.end())
+    {
+        return defaultValue;
+    }
+    
+    return it->second;
+}
+
+int Settings::getInt(const string &key, int defaultValue) const
+{
+    if(!contains(key))
+    {
+        return defaultValue;
+    }
+    
+    int value = parseSize(getString(key, ""));
+    if(value < 0)
+    {
+        printf("Invalid value for %s, using %d \n", key.c_str(), defaultValue);
+        return defaultValue;
+    }
+    
+    return value;
+}
+
+float Settings::getFloat(const string &key, float defaultValue) const
+{
+    if(!contains(key))
+    {
+        return defaultValue;
+    }
+    
+    string value = getString(key, "");
+    char* end;
+    float result = strtof(value.c_str(), &end);
+    if(value.empty() || *end != '\0')
+    {
+        printf("Invalid value for %s, using %f \n", key.c_str(), defaultValue);
+        return defaultValue;
+    }
+    
+    return result;
+}
+
+bool Settings::getBool(const string &key, bool defaultValue) const
+{
+    if(!contains(key))
+    {
+        return defaultValue;
+    }
+    
+    string value = getString(key, "");
+    if(value == "true" || value == "1" || value == "yes" || value == "on")
+    {
+        return true;
+    }
+    if(value == "false" || value == "0" || value == "no" || value == "off")
+    {
+        return false;
+    }
+    
+    printf("Invalid value for %s, using %s \n", key.c_str(), defaultValue ? "true" : "false");
+    return defaultValue;
+}
+
+vector<string> Settings::getList(const string &key) const
+{
+    vector<string> items;
+    string value = getString(key, "");
+    
+    size_t start = 0;
+    while(start <= value.size())
+    {
+        size_t end = value.find(',', start);
+        if(end == string::npos)
+        {
+            end = value.size();
+        }
+        
+        string item = trim(value.substr(start, end - start));
+        if(!item.empty())
+        {
+            items.push_back(item);
+        }
+        
+        start = end + 1;
+    }
+    
+    return items;
+}
+
+vector<int> Settings::getIntList(const string &key) const
+{
+    vector<int> values;
+    vector<string> items = getList(key);
+    for(unsigned int i = 0; i < items.size(); ++i)
+    {
+        int value = parseSize(items[i]);
+        if(value < 0)
+        {
+            printf("Invalid value %s in %s \n", items[i].c_str(), key.c_str());
+            continue;
+        }
+        
+        values.push_back(value);
+    }
+    
+    return values;
+}
+
+RendererSettings Settings::rendererSettings() const
+{
+    RendererSettings settings;
+    settings.sceneFile = getString("scene.file", settings.sceneFile);
+    settings.compressTextures = getBool("scene.compress_textures", settings.compressTextures);
+    settings.shaderCache = getBool("shaders.cache", settings.shaderCache);
+    
+    // Shadow settings
+    string method = getString("shadow.method", "");
+    if(!method.empty() && !parseShadowMethod(method, &settings.shadowMethod))
+    {
+        printf("Unknown shadow method %s \n", method.c_str());
+    }
+    
+    settings.shadowMapResolution = getInt("shadow.resolution", settings.shadowMapResolution);
+    settings.shadowMapCascades = getInt("shadow.cascades", settings.shadowMapCascades);
+    settings.shadowDistance = getFloat("shadow.distance", settings.shadowDistance);
+    settings.cascadeSplitLinearWeight = getFloat("shadow.split_linear_weight", settings.cascadeSplitLinearWeight);
+    settings.staggerCascadeUpdates = getBool("shadow.stagger_updates", settings.staggerCascadeUpdates);
+    settings.layeredCascades = getBool("shadow.layered", settings.layeredCascades);
+    settings.fitCascadesToSurfaces = getBool("shadow.fit_to_surfaces", settings.fitCascadesToSurfaces);
+    settings.simplifiedCasters = getBool("shadow.simplified_casters", settings.simplifiedCasters);
+    settings.voxelPCFFilterSize = getInt("voxel.pcf", settings.voxelPCFFilterSize);
+    
+    // Keep values in the ranges supported by the renderer
+    if(settings.shadowMapResolution < 1 || settings.shadowMapResolution > 16384)
+    {
+        printf("Shadow map resolution must be between 1 and 16K \n");
+        settings.shadowMapResolution = RendererSettings().shadowMapResolution;
+    }
+    if(settings.shadowMapCascades < 1 || settings.shadowMapCascades > 4)
+    {
+        printf("Shadow cascades must be between 1 and 4 \n");
+        settings.shadowMapCascades = RendererSettings().shadowMapCascades;
+    }
+    if(settings.shadowDistance <= 0.0)
+    {
+        printf("Shadow distance must be positive \n");
+        settings.shadowDistance = RendererSettings().shadowDistance;
+    }
+    if(settings.cascadeSplitLinearWeight < 0.0 || settings.cascadeSplitLinearWeight > 1.0)
+    {
+        printf("Cascade split linear weight must be between 0 and 1 \n");
+        settings.cascadeSplitLinearWeight = RendererSettings().cascadeSplitLinearWeight;
+    }
+    if(settings.voxelPCFFilterSize != 0 && settings.voxelPCFFilterSize != 9 && settings.voxelPCFFilterSize != 17)
+    {
+        printf("Voxel PCF must be 0, 9 or 17 \n");
+        settings.voxelPCFFilterSize = RendererSettings().voxelPCFFilterSize;
+    }
+    
+    // Shader feature toggles
+    const char* featureNames[] = { "texture", "normalmap", "specular", "cutout", "fog" };
+    ShaderFeature features[] = { SF_Texture, SF_NormalMap, SF_Specular, SF_Cutout, SF_Fog };
+    for(int i = 0; i < 5; ++i)
+    {
+        string key = string("features.") + featureNames[i];
+        if(getBool(key, true))
+        {
+            settings.enabledFeatures |= features[i];
+        }
+        else
+        {
+            settings.enabledFeatures &= ~features[i];
+        }
+    }
+    
+    // Debug overlay
+    string overlay = getString("debug.overlay", "");
+    if(!overlay.empty())
+    {
+        int index = parseOverlay(overlay);
+        if(index == -2)
+        {
+            printf("Unknown overlay %s \n", overlay.c_str());
+        }
+        else
+        {
+            settings.overlay = index;
+        }
+    }
+    
+    settings.occlusionCulling = getBool("culling.occlusion", settings.occlusionCulling);
+    
+    // Voxel tree construction
+    settings.treeResolution = getInt("tree.resolution", settings.treeResolution);
+    settings.maxTileResolution = getInt("tree.max_tile_resolution", settings.maxTileResolution);
+    settings.concurrentTileBuilds = getInt("tree.concurrent_builds", settings.concurrentTileBuilds);
+    settings.precomputeTree = getBool("tree.precompute", settings.precomputeTree);
+    settings.treeBakeDistance = getFloat("tree.bake_distance", settings.treeBakeDistance);
+    settings.treeCache = getBool("tree.cache", settings.treeCache);
+    settings.treeDetailDistance = getFloat("tree.detail_distance", settings.treeDetailDistance);
+    settings.minTileResolution = getInt("tree.min_tile_resolution", settings.minTileResolution);
+    settings.treePoolSizeMB = getInt("tree.gpu_pool_mb", settings.treePoolSizeMB);
+    settings.treeResidentDistance = getFloat("tree.resident_distance", settings.treeResidentDistance);
+    
+    if(settings.treeResolution < 8 || settings.maxTileResolution < 8 || settings.maxTileResolution > 16384)
+    {
+        printf("Tree and tile resolutions must be at least 8, and tiles no more than 16K \n");
+        settings.treeResolution = RendererSettings().treeResolution;
+        settings.maxTileResolution = RendererSettings().maxTileResolution;
+    }
+    if(settings.concurrentTileBuilds < 1)
+    {
+        settings.concurrentTileBuilds = 1;
+    }
+    if(settings.treeBakeDistance < 0.0)
+    {
+        printf("Tree bake distance can't be negative \n");
+        settings.treeBakeDistance = RendererSettings().treeBakeDistance;
+    }
+    if(settings.treeDetailDistance < 0.0 || settings.minTileResolution < 8)
+    {
+        printf("Tree detail distance can't be negative, and tiles must be at least 8 \n");
+        settings.treeDetailDistance = RendererSettings().treeDetailDistance;
+        settings.minTileResolution = RendererSettings().minTileResolution;
+    }
+    if(settings.treePoolSizeMB < 1)
+    {
+        printf("The tree GPU pool must be at least 1 MB \n");
+        settings.treePoolSizeMB = RendererSettings().treePoolSizeMB;
+    }
+    if(settings.treeResidentDistance < 0.0)
+    {
+        printf("Tree resident distance can't be negative \n");
+        settings.treeResidentDistance = RendererSettings().treeResidentDistance;
+    }
+    
+    return settings;
+}
+
+int Settings::parseSize(const string &value)
+{
+    if(value.empty())
+    {
+        return -1;
+    }
+    
+    // Optional k suffix
+    string digits = value;
+    int multiplier = 1;
+    char last = value[value.size() - 1];
+    if(last == 'k' || last == 'K')
+    {
+        digits = value.substr(0, value.size() - 1);
+        multiplier = 1024;
+    }
+    
+    if(digits.empty() || digits.find_first_not_of("0123456789") != string::npos)
+    {
+        return -1;
+    }
+    
+    long result = strtol(digits.c_str(), NULL, 10) * multiplier;
+    if(result > 0x7FFFFFFF)
+    {
+        return -1;
+    }
+    
+    return (int)result;
+}
+
+bool Settings::parseShadowMethod(const string &value, ShadowMaskMethod* method)
+{
+    if(value == "shadowmap")
+    {
+        *method = SMM_ShadowMap;
+    }
+    else if(value == "voxeltree")
+    {
+        *method = SMM_VoxelTree;
+    }
+    else if(value == "combined")
+    {
+        *method = SMM_Combined;
+    }
+    else
+    {
+        return false;
+    }
+    
+    return true;
+}
+
+int Settings::parseOverlay(const string &value)
+{
+    // Must match RendererWidget::createOverlays()
+    const char* names[] = { "none", "shadowmap", "depth", "mask", "cascades", "voxeldepth" };
+    for(int i = 0; i < 6; ++i)
+    {
+        if(value == names[i])
+        {
+            return i - 1;
+        }
+    }
+    
+    return -2;
+}
+
+string Settings::trim(const string &value)
+{
+    size_t start = value.find_first_not_of(" \t\r\n");
+    if(start == string::npos)
+    {
+        return "";
+    }
+    
+    size_t end = value.find_last_not_of(" \t\r\n");
+    return value.substr(start, end - start + 1);
+}
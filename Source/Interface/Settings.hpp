@@ -0,0 +1,68 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "RendererSettings.hpp"
+
+// Key / value settings read from .ini files and the command line.
+// Keys are written as section.name, eg shadow.method.
+class Settings
+{
+public:
+    Settings();
+    
+    // Reads "name = value" lines from an .ini file.
+    // Names following a [section] header are prefixed with the section.
+    bool loadFromFile(const string &fileName);
+    
+    // Reads settings from the command line. A config file given with
+    // -config is loaded first so that other arguments override it.
+    // Accepts --section.name=value as well as the older flags
+    // (-fullscreen, -precompute, -benchmark <path>, 64k etc).
+    bool parseArguments(int argc, char* argv[]);
+    
+    // Sets the value of a single setting
+    void set(const string &key, const string &value);
+    
+    // True if the key has been set
+    bool contains(const string &key) const;
+    
+    // True if any key starts with the prefix
+    bool containsSection(const string &section) const;
+    
+    // Typed getters. The default value is returned if the key is not set.
+    string getString(const string &key, const string &defaultValue) const;
+    int getInt(const string &key, int defaultValue) const;
+    float getFloat(const string &key, float defaultValue) const;
+    bool getBool(const string &key, bool defaultValue) const;
+    
+    // Splits a comma separated value into its items
+    vector<string> getList(const string &key) const;
+    
+    // Splits a comma separated list of sizes (see parseSize).
+    // Invalid items are skipped.
+    vector<int> getIntList(const string &key) const;
+    
+    // Creates renderer settings from the shadow, voxel, features, tree and scene sections
+    RendererSettings rendererSettings() const;
+    
+    // Parses an integer with an optional k (x1024) suffix, eg 96k.
+    // Returns -1 if the value is not valid.
+    static int parseSize(const string &value);
+    
+    // Parses a shadow method name (shadowmap, voxeltree or combined)
+    static bool parseShadowMethod(const string &value, ShadowMaskMethod* method);
+    
+    // Parses an overlay name (none, shadowmap, depth, mask, cascades or voxeldepth).
+    // Returns the overlay index, -1 for none, or -2 if not valid.
+    static int parseOverlay(const string &value);
+
+private:
+    map<string, string> values_;
+    
+    static string trim(const string &value);
+};
@@ -35,6 +35,33 @@ void Bounds::expandToCover(const Vector3 &point)
     max_.z = std::max(max_.z, point.z);
 }
 
+void Bounds::expandToCover(const Bounds &bounds)
+{
+    expandToCover(bounds.min_);
+    expandToCover(bounds.max_);
+}
+
+Bounds Bounds::transformed(const Matrix4x4 &transform) const
+{
+    Vector3 centre = this->centre();
+    Vector3 extents = size() * 0.5;
+    
+    // Transform the centre as a point
+    Vector3 newCentre = (transform * Vector4(centre, 1.0)).vec3();
+    
+    // Each new extent is the sum of the old extents projected onto that axis
+    float newExtents[3];
+    for(int row = 0; row < 3; ++row)
+    {
+        newExtents[row] = (fabs(transform.get(row, 0)) * extents.x)
+                        + (fabs(transform.get(row, 1)) * extents.y)
+                        + (fabs(transform.get(row, 2)) * extents.z);
+    }
+    
+    Vector3 newExtentsVector(newExtents[0], newExtents[1], newExtents[2]);
+    return Bounds(newCentre - newExtentsVector, newCentre + newExtentsVector);
+}
+
 Bounds Bounds::cover(const Vector4* points, int count)
 {
     assert(count > 0);
@@ -50,3 +77,10 @@ Bounds Bounds::cover(const Vector4* points, int count)
     
     return b;
 }
+
+Bounds Bounds::cover(const Vector3* points, int count, const Matrix4x4 &transform)
+{
+    Bounds b(Vector3::zero(), Vector3::zero());
+    transform.transformBounds(points, count, b.min_, b.max_);
+    return b;
+}
@@ -2,6 +2,7 @@
 
 #include "Vector3.hpp"
 #include "Vector4.hpp"
+#include "Matrix4x4.hpp"
 
 class Bounds
 {
@@ -19,9 +20,18 @@ public:
     // Expands the bounds to contain the given point
     void expandToCover(const Vector3 &point);
     
+    // Expands the bounds to contain other bounds
+    void expandToCover(const Bounds &bounds);
+    
+    // Returns bounds covering these bounds after being transformed
+    Bounds transformed(const Matrix4x4 &transform) const;
+    
     // Creates a Bounds instance covering the given points
     static Bounds cover(const Vector4* points, int count);
     
+    // Creates a Bounds instance covering the given points after being transformed
+    static Bounds cover(const Vector3* points, int count, const Matrix4x4 &transform);
+    
 private:
     Vector3 min_;
     Vector3 max_;
@@ -0,0 +1,98 @@
+#include "Frustum.hpp"
+
+#include <math.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+Frustum::Frustum(const Matrix4x4 &viewProjection)
+{
+    // Gribb / Hartmann plane extraction.
+    // Each plane is the last row plus or minus one of the other rows.
+    float signs[6] = { 1.0, -1.0, 1.0, -1.0, 1.0, -1.0 };
+    for(int i = 0; i < 6; ++i)
+    {
+        int row = i / 2;
+        planeX_[i] = viewProjection.get(3, 0) + (signs[i] * viewProjection.get(row, 0));
+        planeY_[i] = viewProjection.get(3, 1) + (signs[i] * viewProjection.get(row, 1));
+        planeZ_[i] = viewProjection.get(3, 2) + (signs[i] * viewProjection.get(row, 2));
+        planeW_[i] = viewProjection.get(3, 3) + (signs[i] * viewProjection.get(row, 3));
+    }
+    
+    // The padding planes never reject anything
+    for(int i = 6; i < 8; ++i)
+    {
+        planeX_[i] = 0.0;
+        planeY_[i] = 0.0;
+        planeZ_[i] = 0.0;
+        planeW_[i] = 1.0;
+    }
+}
+
+FrustumTest Frustum::test(const Bounds &bounds) const
+{
+    Vector3 centre = bounds.centre();
+    Vector3 extents = bounds.size() * 0.5;
+    
+    // For each plane, the distance to the centre of the box, plus or minus
+    // the projected extents gives the distance to the nearest and furthest corners.
+    // The box is outside if the furthest corner is behind any plane, and inside
+    // if the nearest corner is in front of every plane.
+    bool intersecting = false;
+
+#if defined(__SSE__)
+    __m128 cx = _mm_set1_ps(centre.x);
+    __m128 cy = _mm_set1_ps(centre.y);
+    __m128 cz = _mm_set1_ps(centre.z);
+    __m128 ex = _mm_set1_ps(extents.x);
+    __m128 ey = _mm_set1_ps(extents.y);
+    __m128 ez = _mm_set1_ps(extents.z);
+    __m128 zero = _mm_setzero_ps();
+    
+    for(int i = 0; i < 8; i += 4)
+    {
+        __m128 px = _mm_load_ps(&planeX_[i]);
+        __m128 py = _mm_load_ps(&planeY_[i]);
+        __m128 pz = _mm_load_ps(&planeZ_[i]);
+        __m128 pw = _mm_load_ps(&planeW_[i]);
+        
+        // Absolute values of the plane normal
+        __m128 ax = _mm_max_ps(px, _mm_sub_ps(zero, px));
+        __m128 ay = _mm_max_ps(py, _mm_sub_ps(zero, py));
+        __m128 az = _mm_max_ps(pz, _mm_sub_ps(zero, pz));
+        
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                                     _mm_add_ps(_mm_mul_ps(pz, cz), pw));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ex), _mm_mul_ps(ay, ey)), _mm_mul_ps(az, ez));
+        
+        if(_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)) != 0)
+        {
+            return FT_Outside;
+        }
+        
+        if(_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero)) != 0)
+        {
+            intersecting = true;
+        }
+    }
+#else
+    for(int i = 0; i < 6; ++i)
+    {
+        float distance = (planeX_[i] * centre.x) + (planeY_[i] * centre.y) + (planeZ_[i] * centre.z) + planeW_[i];
+        float radius = (fabs(planeX_[i]) * extents.x) + (fabs(planeY_[i]) * extents.y) + (fabs(planeZ_[i]) * extents.z);
+        
+        if(distance + radius < 0.0)
+        {
+            return FT_Outside;
+        }
+        
+        if(distance - radius < 0.0)
+        {
+            intersecting = true;
+        }
+    }
+#endif
+    
+    return intersecting ? FT_Intersecting : FT_Inside;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Bounds.hpp"
+#include "Matrix4x4.hpp"
+
+// The result of testing bounds against a frustum
+enum FrustumTest
+{
+    FT_Outside,
+    FT_Intersecting,
+    FT_Inside
+};
+
+// The 6 clipping planes of a camera, used for culling.
+// The planes are stored as separate x, y, z and w arrays
+// so 4 planes can be tested at once with SSE.
+class Frustum
+{
+public:
+    // Extracts the planes from a world to clip space matrix
+    Frustum(const Matrix4x4 &viewProjection);
+    
+    // Tests an axis aligned box against all the planes
+    FrustumTest test(const Bounds &bounds) const;
+    
+    // True if any part of the box is inside the frustum
+    bool intersects(const Bounds &bounds) const { return test(bounds) != FT_Outside; }
+
+private:
+    // 6 planes, padded to 8 with planes that contain everything.
+    // Aligned for SSE loads.
+    alignas(16) float planeX_[8];
+    alignas(16) float planeY_[8];
+    alignas(16) float planeZ_[8];
+    alignas(16) float planeW_[8];
+};
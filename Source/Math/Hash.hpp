@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The starting value of a hash
+const uint64_t HashSeed = 14695981039346656037ULL;
+
+// 64 bit FNV-1a hash of the bytes, continuing from the given hash.
+// Used to key the files in the shader, texture and voxel caches.
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = HashSeed);
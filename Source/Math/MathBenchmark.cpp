@@ -0,0 +1,180 @@
+#include "MathBenchmark.hpp"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <math.h>
+#include <vector>
+
+using namespace std;
+
+#include "Matrix4x4.hpp"
+#include "Vector3.hpp"
+#include "Vector4.hpp"
+
+// The scalar versions of the operations, as they were before using SIMD.
+// Elements are read directly, as get() can't be inlined from here.
+static inline float element(const Matrix4x4 &mat, int row, int column)
+{
+    return mat.elements[(column * 4) + row];
+}
+
+static Matrix4x4 scalarMultiply(const Matrix4x4 &a, const Matrix4x4 &b)
+{
+    Matrix4x4 result;
+    for(int i = 0; i < 4; ++i)
+        for(int j = 0; j < 4; ++j)
+            result.elements[(j * 4) + i] = element(a, i, 0) * element(b, 0, j)
+                                         + element(a, i, 1) * element(b, 1, j)
+                                         + element(a, i, 2) * element(b, 2, j)
+                                         + element(a, i, 3) * element(b, 3, j);
+    
+    return result;
+}
+
+static Vector4 scalarTransform(const Matrix4x4 &mat, const Vector4 &v)
+{
+    Vector4 result;
+    result.x = (element(mat, 0, 0) * v.x) + (element(mat, 0, 1) * v.y) + (element(mat, 0, 2) * v.z) + (element(mat, 0, 3) * v.w);
+    result.y = (element(mat, 1, 0) * v.x) + (element(mat, 1, 1) * v.y) + (element(mat, 1, 2) * v.z) + (element(mat, 1, 3) * v.w);
+    result.z = (element(mat, 2, 0) * v.x) + (element(mat, 2, 1) * v.y) + (element(mat, 2, 2) * v.z) + (element(mat, 2, 3) * v.w);
+    result.w = (element(mat, 3, 0) * v.x) + (element(mat, 3, 1) * v.y) + (element(mat, 3, 2) * v.z) + (element(mat, 3, 3) * v.w);
+    return result;
+}
+
+static void scalarTransformBounds(const Matrix4x4 &mat, const Vector3* points, int count, Vector3 &min, Vector3 &max)
+{
+    min = scalarTransform(mat, Vector4(points[0], 1.0)).vec3();
+    max = min;
+    for(int i = 1; i < count; ++i)
+    {
+        Vector3 p = scalarTransform(mat, Vector4(points[i], 1.0)).vec3();
+        min = Vector3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Vector3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+}
+
+static float randomValue()
+{
+    return ((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+}
+
+static float difference(const Vector3 &a, const Vector3 &b)
+{
+    return max(fabsf(a.x - b.x), max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+}
+
+static void printTime(const char* name, qint64 scalarNs, qint64 simdNs)
+{
+    printf("%-20s scalar %8.2f ms, simd %8.2f ms (%.2fx) \n", name,
+           scalarNs / 1000000.0, simdNs / 1000000.0, (double)scalarNs / (double)max(simdNs, (qint64)1));
+}
+
+bool MathBenchmark::run()
+{
+    srand(1);
+    
+    // A typical model to light transform
+    Quaternion rotation = Quaternion::rotation(30.0, Vector3(1.0, 2.0, 3.0).normalized());
+    Matrix4x4 transform = Matrix4x4::trs(Vector3(10.0, -5.0, 2.0), rotation, Vector3(2.0, 2.0, 2.0));
+    Matrix4x4 projection = Matrix4x4::perspective(60.0, 1.5, 0.1, 100.0);
+    
+    vector<Vector3> points(PointsCount);
+    for(int i = 0; i < PointsCount; ++i)
+    {
+        points[i] = Vector3(randomValue() * 100.0f, randomValue() * 100.0f, randomValue() * 100.0f);
+    }
+    
+    QElapsedTimer timer;
+    float maxError = 0.0;
+    
+    // Matrix * matrix, accumulating so the work can't be skipped.
+    // Rotations keep the values from growing.
+    Matrix4x4 rotationMatrix = Matrix4x4::rotation(rotation);
+    Matrix4x4 scalarResult = transform;
+    timer.start();
+    for(int i = 0; i < Iterations; ++i)
+    {
+        scalarResult = scalarMultiply(rotationMatrix, scalarResult);
+    }
+    qint64 scalarTime = timer.nsecsElapsed();
+    
+    Matrix4x4 simdResult = transform;
+    timer.start();
+    for(int i = 0; i < Iterations; ++i)
+    {
+        simdResult = rotationMatrix * simdResult;
+    }
+    qint64 simdTime = timer.nsecsElapsed();
+    printTime("matrix * matrix", scalarTime, simdTime);
+    
+    Matrix4x4 single = projection * transform;
+    Matrix4x4 singleScalar = scalarMultiply(projection, transform);
+    for(int i = 0; i < 16; ++i)
+    {
+        maxError = max(maxError, fabsf(single.elements[i] - singleScalar.elements[i]));
+    }
+    
+    // Matrix * vector, one point at a time
+    Vector4 scalarSum(0.0, 0.0, 0.0, 0.0);
+    timer.start();
+    for(int i = 0; i < PointsCount; ++i)
+    {
+        scalarSum = scalarSum + scalarTransform(transform, Vector4(points[i], 1.0));
+    }
+    scalarTime = timer.nsecsElapsed();
+    
+    Vector4 simdSum(0.0, 0.0, 0.0, 0.0);
+    timer.start();
+    for(int i = 0; i < PointsCount; ++i)
+    {
+        simdSum = simdSum + transform * Vector4(points[i], 1.0);
+    }
+    simdTime = timer.nsecsElapsed();
+    printTime("matrix * vector", scalarTime, simdTime);
+    
+    // Batched transforms
+    vector<Vector3> scalarPoints(PointsCount);
+    timer.start();
+    for(int i = 0; i < PointsCount; ++i)
+    {
+        scalarPoints[i] = scalarTransform(transform, Vector4(points[i], 1.0)).vec3();
+    }
+    scalarTime = timer.nsecsElapsed();
+    
+    vector<Vector3> simdPoints(PointsCount);
+    timer.start();
+    transform.transformPoints(&points[0], &simdPoints[0], PointsCount);
+    simdTime = timer.nsecsElapsed();
+    printTime("transform points", scalarTime, simdTime);
+    
+    for(int i = 0; i < PointsCount; ++i)
+    {
+        maxError = max(maxError, difference(scalarPoints[i], simdPoints[i]));
+    }
+    
+    // Batched transform and bounds
+    Vector3 scalarMin, scalarMax;
+    timer.start();
+    scalarTransformBounds(transform, &points[0], PointsCount, scalarMin, scalarMax);
+    scalarTime = timer.nsecsElapsed();
+    
+    Vector3 simdMin, simdMax;
+    timer.start();
+    transform.transformBounds(&points[0], PointsCount, simdMin, simdMax);
+    simdTime = timer.nsecsElapsed();
+    printTime("transform bounds", scalarTime, simdTime);
+    
+    maxError = max(maxError, max(difference(scalarMin, simdMin), difference(scalarMax, simdMax)));
+    
+    // Keep the accumulated results live
+    printf("Checksums %f %f %f \n", scalarResult.elements[0] - simdResult.elements[0],
+           scalarSum.x - simdSum.x, scalarSum.w - simdSum.w);
+    
+    // Only the order of the additions differs, so the results should be very close
+    bool matches = maxError < 0.001;
+    printf("Largest difference %g, %s \n", maxError, matches ? "results match" : "results differ");
+    return matches;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Times the SIMD matrix operations against plain scalar loops,
+// and checks that both give the same results.
+// Run with the -math-benchmark flag.
+class MathBenchmark
+{
+public:
+    // Prints the time of each operation.
+    // Returns false if the results differ.
+    static bool run();
+
+private:
+    // Repeats of each small operation, and points in each batch
+    const static int Iterations = 1000000;
+    const static int PointsCount = 1000000;
+};
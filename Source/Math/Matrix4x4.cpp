@@ -1,6 +1,51 @@
 #include "Matrix4x4.hpp"
 
 #include <math.h>
+#include <algorithm>
+#include <assert.h>
+
+// SSE is always available on x86-64, so the build doesn't need extra flags.
+// Other targets use the scalar code.
+#if defined(__SSE__)
+#include <xmmintrin.h>
+
+// Computes columns[0] * x + columns[1] * y + columns[2] * z + columns[3] * w
+static inline __m128 combineColumns(const __m128* columns, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], x), _mm_mul_ps(columns[1], y)),
+                      _mm_add_ps(_mm_mul_ps(columns[2], z), _mm_mul_ps(columns[3], w)));
+}
+
+static inline void loadColumns(const Matrix4x4 &mat, __m128* columns)
+{
+    for(int i = 0; i < 4; ++i)
+    {
+        columns[i] = _mm_loadu_ps(&mat.elements[i * 4]);
+    }
+}
+
+// Transforms a point with w = 1, keeping all 4 result components
+static inline __m128 transformPoint(const __m128* columns, const Vector3 &point)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(point.x)), _mm_mul_ps(columns[1], _mm_set1_ps(point.y))),
+                      _mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(point.z)), columns[3]));
+}
+
+// The smallest and largest of the 4 components
+static inline float minComponent(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float maxComponent(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+#endif
 
 Matrix4x4::Matrix4x4()
 {
@@ -176,6 +221,113 @@ Matrix4x4 Matrix4x4::perspectiveInverse(float fov, float aspect, float n, float
     return mat * toNDC;
 }
 
+void Matrix4x4::transformPoints(const Vector4* points, Vector4* result, int count) const
+{
+#if defined(__SSE__)
+    __m128 columns[4];
+    loadColumns(*this, columns);
+    
+    for(int i = 0; i < count; ++i)
+    {
+        const Vector4 &p = points[i];
+        __m128 transformed = combineColumns(columns, _mm_set1_ps(p.x), _mm_set1_ps(p.y), _mm_set1_ps(p.z), _mm_set1_ps(p.w));
+        _mm_storeu_ps(&result[i].x, transformed);
+    }
+#else
+    for(int i = 0; i < count; ++i)
+    {
+        result[i] = (*this) * points[i];
+    }
+#endif
+}
+
+void Matrix4x4::transformPoints(const Vector3* points, Vector3* result, int count) const
+{
+#if defined(__SSE__)
+    __m128 columns[4];
+    loadColumns(*this, columns);
+    
+    for(int i = 0; i < count; ++i)
+    {
+        // Vector3 is 12 bytes, so the 4th component can't be stored
+        float transformed[4];
+        _mm_storeu_ps(transformed, transformPoint(columns, points[i]));
+        result[i] = Vector3(transformed[0], transformed[1], transformed[2]);
+    }
+#else
+    for(int i = 0; i < count; ++i)
+    {
+        result[i] = ((*this) * Vector4(points[i], 1.0)).vec3();
+    }
+#endif
+}
+
+void Matrix4x4::transformBounds(const Vector3* points, int count, Vector3 &min, Vector3 &max) const
+{
+    assert(count > 0);
+    
+    Vector3 first = ((*this) * Vector4(points[0], 1.0)).vec3();
+    min = first;
+    max = first;
+    int i = 1;
+    
+#if defined(__SSE__)
+    static_assert(sizeof(Vector3) == 3 * sizeof(float), "Vector3 must be tightly packed");
+    
+    // Each row of the matrix, with every element broadcast
+    __m128 rows[3][4];
+    for(int row = 0; row < 3; ++row)
+    {
+        for(int col = 0; col < 4; ++col)
+        {
+            rows[row][col] = _mm_set1_ps(get(row, col));
+        }
+    }
+    
+    __m128 minX = _mm_set1_ps(first.x), minY = _mm_set1_ps(first.y), minZ = _mm_set1_ps(first.z);
+    __m128 maxX = minX, maxY = minY, maxZ = minZ;
+    __m128 one = _mm_set1_ps(1.0f);
+    
+    // Transform 4 points at a time, with a register per component
+    for(; i + 4 <= count; i += 4)
+    {
+        // Load x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+        const float* values = &points[i].x;
+        __m128 a = _mm_loadu_ps(values);
+        __m128 b = _mm_loadu_ps(values + 4);
+        __m128 c = _mm_loadu_ps(values + 8);
+        
+        // Rearrange into x0 x1 x2 x3 | y0 y1 y2 y3 | z0 z1 z2 z3
+        __m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                                  _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+        
+        __m128 transformedX = combineColumns(rows[0], x, y, z, one);
+        __m128 transformedY = combineColumns(rows[1], x, y, z, one);
+        __m128 transformedZ = combineColumns(rows[2], x, y, z, one);
+        
+        minX = _mm_min_ps(minX, transformedX);
+        minY = _mm_min_ps(minY, transformedY);
+        minZ = _mm_min_ps(minZ, transformedZ);
+        maxX = _mm_max_ps(maxX, transformedX);
+        maxY = _mm_max_ps(maxY, transformedY);
+        maxZ = _mm_max_ps(maxZ, transformedZ);
+    }
+    
+    min = Vector3(minComponent(minX), minComponent(minY), minComponent(minZ));
+    max = Vector3(maxComponent(maxX), maxComponent(maxY), maxComponent(maxZ));
+#endif
+    
+    // The remaining points
+    for(; i < count; ++i)
+    {
+        Vector3 transformed = ((*this) * Vector4(points[i], 1.0)).vec3();
+        min = Vector3(std::min(min.x, transformed.x), std::min(min.y, transformed.y), std::min(min.z, transformed.z));
+        max = Vector3(std::max(max.x, transformed.x), std::max(max.y, transformed.y), std::max(max.z, transformed.z));
+    }
+}
+
 Matrix4x4 operator * (const Matrix4x4 &mat, float scalar)
 {
     Matrix4x4 result;
@@ -195,12 +347,26 @@ Matrix4x4 operator * (const Matrix4x4 &a, const Matrix4x4 &b)
 {
     Matrix4x4 result;
 
+#if defined(__SSE__)
+    // Each result column is the columns of a weighted by a column of b
+    __m128 columns[4];
+    loadColumns(a, columns);
+    
+    for(int j = 0; j < 4; ++j)
+    {
+        const float* column = &b.elements[j * 4];
+        __m128 resultColumn = combineColumns(columns, _mm_set1_ps(column[0]), _mm_set1_ps(column[1]),
+                                             _mm_set1_ps(column[2]), _mm_set1_ps(column[3]));
+        _mm_storeu_ps(&result.elements[j * 4], resultColumn);
+    }
+#else
     for(int i = 0; i < 4; ++i)
         for(int j = 0; j < 4; ++j)
             result.set(i, j, a.get(i, 0) * b.get(0, j)
                            + a.get(i, 1) * b.get(1, j)
                            + a.get(i, 2) * b.get(2, j)
                            + a.get(i, 3) * b.get(3, j));
+#endif
 
     return result;
 }
@@ -228,10 +394,16 @@ Matrix4x4 operator - (const Matrix4x4 &a, const Matrix4x4 &b)
 Vector4 operator * (const Matrix4x4 &mat, const Vector4 &v)
 {
     Vector4 result;
+#if defined(__SSE__)
+    __m128 columns[4];
+    loadColumns(mat, columns);
+    _mm_storeu_ps(&result.x, combineColumns(columns, _mm_set1_ps(v.x), _mm_set1_ps(v.y), _mm_set1_ps(v.z), _mm_set1_ps(v.w)));
+#else
     result.x = (mat.get(0, 0) * v.x) + (mat.get(0, 1) * v.y) + (mat.get(0, 2) * v.z) + (mat.get(0, 3) * v.w);
     result.y = (mat.get(1, 0) * v.x) + (mat.get(1, 1) * v.y) + (mat.get(1, 2) * v.z) + (mat.get(1, 3) * v.w);
     result.z = (mat.get(2, 0) * v.x) + (mat.get(2, 1) * v.y) + (mat.get(2, 2) * v.z) + (mat.get(2, 3) * v.w);
     result.w = (mat.get(3, 0) * v.x) + (mat.get(3, 1) * v.y) + (mat.get(3, 2) * v.z) + (mat.get(3, 3) * v.w);
+#endif
     return result;
 }
 
@@ -44,6 +44,18 @@ public:
     // Constructs a matrix to transform from screen space
     // (with x,y,z in [0-1] range) to world space.
     static Matrix4x4 perspectiveInverse(float fov, float aspect, float n, float f);
+    
+    // Transforms many points at once, which is faster than a multiply per point.
+    // The results may be written over the input.
+    void transformPoints(const Vector4* points, Vector4* result, int count) const;
+    
+    // As above, for points with a w of 1. The result w is dropped, so the
+    // transform should be affine.
+    void transformPoints(const Vector3* points, Vector3* result, int count) const;
+    
+    // Finds the bounds of the transformed points (with a w of 1), without
+    // storing them. Count must be at least 1.
+    void transformBounds(const Vector3* points, int count, Vector3 &min, Vector3 &max) const;
 };
 
 // Matrix * scalar operations
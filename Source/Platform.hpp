@@ -7,6 +7,9 @@
     #define SCENES_DIRECTORY "Scenes/"
     #define SHADERS_DIRECTORY "Shaders/"
     #define TEXTURES_DIRECTORY "Textures/"
+    #define TEXTURE_CACHE_DIRECTORY "Textures/Cache/"
+    #define SHADER_CACHE_DIRECTORY "Shaders/Cache/"
+    #define VOXEL_CACHE_DIRECTORY "Scenes/Cache/"
     
 #elif defined(__APPLE__)
 
@@ -16,6 +19,9 @@
     #define SCENES_DIRECTORY "Scenes/"
     #define SHADERS_DIRECTORY "Shaders/"
     #define TEXTURES_DIRECTORY "Textures/"
+    #define TEXTURE_CACHE_DIRECTORY "Textures/Cache/"
+    #define SHADER_CACHE_DIRECTORY "Shaders/Cache/"
+    #define VOXEL_CACHE_DIRECTORY "Scenes/Cache/"
 
 #else
 #error Platform not supported
@@ -0,0 +1,361 @@
+#include "GLState.hpp"
+
+int GLState::issuedChanges_ = 0;
+int GLState::filteredChanges_ = 0;
+
+GLuint GLState::program_ = GLState::Unknown;
+GLuint GLState::activeTexture_ = GLState::Unknown;
+GLuint GLState::textures2D_[GLState::MaxTextureUnits];
+GLuint GLState::bufferTextures_[GLState::MaxTextureUnits];
+GLuint GLState::vertexArray_ = GLState::Unknown;
+GLuint GLState::drawFramebuffer_ = GLState::Unknown;
+GLuint GLState::readFramebuffer_ = GLState::Unknown;
+float GLState::viewport_[4];
+bool GLState::viewportKnown_ = false;
+GLuint GLState::capabilities_[GLState::CapabilitiesCount];
+GLuint GLState::depthMask_ = GLState::Unknown;
+GLuint GLState::depthFunc_ = GLState::Unknown;
+GLuint GLState::colorMask_ = GLState::Unknown;
+GLuint GLState::cullFace_ = GLState::Unknown;
+GLuint GLState::blendEquation_[2];
+GLuint GLState::blendFunc_[4];
+float GLState::polygonOffset_[2];
+bool GLState::polygonOffsetKnown_ = false;
+
+void GLState::reset()
+{
+    program_ = Unknown;
+    activeTexture_ = Unknown;
+    for(int i = 0; i < MaxTextureUnits; ++i)
+    {
+        textures2D_[i] = Unknown;
+        bufferTextures_[i] = Unknown;
+    }
+    
+    vertexArray_ = Unknown;
+    drawFramebuffer_ = Unknown;
+    readFramebuffer_ = Unknown;
+    viewportKnown_ = false;
+    for(int i = 0; i < CapabilitiesCount; ++i)
+    {
+        capabilities_[i] = Unknown;
+    }
+    
+    depthMask_ = Unknown;
+    depthFunc_ = Unknown;
+    colorMask_ = Unknown;
+    cullFace_ = Unknown;
+    blendEquation_[0] = blendEquation_[1] = Unknown;
+    blendFunc_[0] = blendFunc_[1] = blendFunc_[2] = blendFunc_[3] = Unknown;
+    polygonOffsetKnown_ = false;
+}
+
+void GLState::useProgram(GLuint program)
+{
+    if(change(&program_, program))
+    {
+        glUseProgram(program);
+    }
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+    GLuint* binding = textureBinding(target);
+    if(binding == NULL)
+    {
+        // Untracked units and targets are always sent
+        issuedChanges_ ++;
+        glBindTexture(target, texture);
+    }
+    else if(change(binding, texture))
+    {
+        glBindTexture(target, texture);
+    }
+}
+
+void GLState::bindTexture(GLenum unit, GLenum target, GLuint texture)
+{
+    if(change(&activeTexture_, unit))
+    {
+        glActiveTexture(unit);
+    }
+    
+    bindTexture(target, texture);
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+    if(change(&vertexArray_, vertexArray))
+    {
+        glBindVertexArray(vertexArray);
+    }
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    if(target == GL_FRAMEBUFFER)
+    {
+        if(drawFramebuffer_ == framebuffer && readFramebuffer_ == framebuffer)
+        {
+            filteredChanges_ ++;
+            return;
+        }
+        
+        drawFramebuffer_ = framebuffer;
+        readFramebuffer_ = framebuffer;
+        issuedChanges_ ++;
+        glBindFramebuffer(target, framebuffer);
+    }
+    else if(change(target == GL_READ_FRAMEBUFFER ? &readFramebuffer_ : &drawFramebuffer_, framebuffer))
+    {
+        glBindFramebuffer(target, framebuffer);
+    }
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if(viewportKnown_ && viewport_[0] == x && viewport_[1] == y && viewport_[2] == width && viewport_[3] == height)
+    {
+        filteredChanges_ ++;
+        return;
+    }
+    
+    viewport_[0] = x;
+    viewport_[1] = y;
+    viewport_[2] = width;
+    viewport_[3] = height;
+    viewportKnown_ = true;
+    issuedChanges_ ++;
+    glViewport(x, y, width, height);
+}
+
+void GLState::viewportIndexed(GLuint index, float x, float y, float width, float height)
+{
+#if defined(GL_VERSION_4_1)
+    if(index == 0)
+    {
+        if(viewportKnown_ && viewport_[0] == x && viewport_[1] == y && viewport_[2] == width && viewport_[3] == height)
+        {
+            filteredChanges_ ++;
+            return;
+        }
+        
+        viewport_[0] = x;
+        viewport_[1] = y;
+        viewport_[2] = width;
+        viewport_[3] = height;
+        viewportKnown_ = true;
+    }
+    
+    // Only the first viewport is tracked
+    issuedChanges_ ++;
+    glViewportIndexedf(index, x, y, width, height);
+#else
+    (void)index;
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+#endif
+}
+
+void GLState::enable(GLenum capability)
+{
+    int index = capabilityIndex(capability);
+    if(index < 0)
+    {
+        issuedChanges_ ++;
+        glEnable(capability);
+    }
+    else if(change(&capabilities_[index], GL_TRUE))
+    {
+        glEnable(capability);
+    }
+}
+
+void GLState::disable(GLenum capability)
+{
+    int index = capabilityIndex(capability);
+    if(index < 0)
+    {
+        issuedChanges_ ++;
+        glDisable(capability);
+    }
+    else if(change(&capabilities_[index], GL_FALSE))
+    {
+        glDisable(capability);
+    }
+}
+
+void GLState::depthMask(bool write)
+{
+    if(change(&depthMask_, write ? GL_TRUE : GL_FALSE))
+    {
+        glDepthMask(write);
+    }
+}
+
+void GLState::depthFunc(GLenum func)
+{
+    if(change(&depthFunc_, func))
+    {
+        glDepthFunc(func);
+    }
+}
+
+void GLState::colorMask(bool red, bool green, bool blue, bool alpha)
+{
+    // The mask is stored as 4 bits
+    GLuint mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+    if(change(&colorMask_, mask))
+    {
+        glColorMask(red, green, blue, alpha);
+    }
+}
+
+void GLState::cullFace(GLenum face)
+{
+    if(change(&cullFace_, face))
+    {
+        glCullFace(face);
+    }
+}
+
+void GLState::blendEquation(GLenum rgb, GLenum alpha)
+{
+    if(blendEquation_[0] == rgb && blendEquation_[1] == alpha)
+    {
+        filteredChanges_ ++;
+        return;
+    }
+    
+    blendEquation_[0] = rgb;
+    blendEquation_[1] = alpha;
+    issuedChanges_ ++;
+    glBlendEquationSeparate(rgb, alpha);
+}
+
+void GLState::blendFunc(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha)
+{
+    if(blendFunc_[0] == sourceRGB && blendFunc_[1] == destinationRGB
+       && blendFunc_[2] == sourceAlpha && blendFunc_[3] == destinationAlpha)
+    {
+        filteredChanges_ ++;
+        return;
+    }
+    
+    blendFunc_[0] = sourceRGB;
+    blendFunc_[1] = destinationRGB;
+    blendFunc_[2] = sourceAlpha;
+    blendFunc_[3] = destinationAlpha;
+    issuedChanges_ ++;
+    glBlendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha);
+}
+
+void GLState::polygonOffset(float factor, float units)
+{
+    if(polygonOffsetKnown_ && polygonOffset_[0] == factor && polygonOffset_[1] == units)
+    {
+        filteredChanges_ ++;
+        return;
+    }
+    
+    polygonOffset_[0] = factor;
+    polygonOffset_[1] = units;
+    polygonOffsetKnown_ = true;
+    issuedChanges_ ++;
+    glPolygonOffset(factor, units);
+}
+
+void GLState::textureDeleted(GLuint texture)
+{
+    for(int i = 0; i < MaxTextureUnits; ++i)
+    {
+        if(textures2D_[i] == texture)
+        {
+            textures2D_[i] = 0;
+        }
+        
+        if(bufferTextures_[i] == texture)
+        {
+            bufferTextures_[i] = 0;
+        }
+    }
+}
+
+void GLState::vertexArrayDeleted(GLuint vertexArray)
+{
+    if(vertexArray_ == vertexArray)
+    {
+        vertexArray_ = 0;
+    }
+}
+
+void GLState::framebufferDeleted(GLuint framebuffer)
+{
+    if(drawFramebuffer_ == framebuffer)
+    {
+        drawFramebuffer_ = 0;
+    }
+    
+    if(readFramebuffer_ == framebuffer)
+    {
+        readFramebuffer_ = 0;
+    }
+}
+
+void GLState::resetCounts()
+{
+    issuedChanges_ = 0;
+    filteredChanges_ = 0;
+}
+
+bool GLState::change(GLuint* current, GLuint value)
+{
+    if(*current == value)
+    {
+        filteredChanges_ ++;
+        return false;
+    }
+    
+    *current = value;
+    issuedChanges_ ++;
+    return true;
+}
+
+GLuint* GLState::textureBinding(GLenum target)
+{
+    // The active unit must be known to know what is bound to it
+    if(activeTexture_ == Unknown)
+    {
+        return NULL;
+    }
+    
+    GLuint unit = activeTexture_ - GL_TEXTURE0;
+    if(unit >= (GLuint)MaxTextureUnits)
+    {
+        return NULL;
+    }
+    
+    switch(target)
+    {
+        case GL_TEXTURE_2D: return &textures2D_[unit];
+        case GL_TEXTURE_BUFFER: return &bufferTextures_[unit];
+    }
+    
+    return NULL;
+}
+
+int GLState::capabilityIndex(GLenum capability)
+{
+    switch(capability)
+    {
+        case GL_DEPTH_TEST: return 0;
+        case GL_CULL_FACE: return 1;
+        case GL_BLEND: return 2;
+        case GL_SCISSOR_TEST: return 3;
+        case GL_POLYGON_OFFSET_FILL: return 4;
+    }
+    
+    return -1;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
+#include <QGLWidget> // Links OpenGL Headers
+
+// Tracks the OpenGL state set by the renderer, so only real changes reach
+// the driver. Programs, textures, vertex arrays, framebuffers, the viewport
+// and the depth, blend and cull state should all be set through here.
+// There is a single context, so the state is shared by everything.
+class GLState
+{
+public:
+    // Forgets the tracked state, so the next change of each is always sent.
+    // Used when code outside the renderer (eg Qt) may have changed it.
+    static void reset();
+    
+    // Shader program
+    static void useProgram(GLuint program);
+    
+    // Binds a texture to the active texture unit,
+    // or to the given unit (eg GL_TEXTURE2)
+    static void bindTexture(GLenum target, GLuint texture);
+    static void bindTexture(GLenum unit, GLenum target, GLuint texture);
+    
+    static void bindVertexArray(GLuint vertexArray);
+    
+    // GL_FRAMEBUFFER binds both the draw and read framebuffers
+    static void bindFramebuffer(GLenum target, GLuint framebuffer);
+    
+    // Viewport 0 is the one set by viewport
+    static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    static void viewportIndexed(GLuint index, float x, float y, float width, float height);
+    
+    // Capabilities, eg GL_DEPTH_TEST or GL_BLEND
+    static void enable(GLenum capability);
+    static void disable(GLenum capability);
+    
+    // Depth, colour, cull and blend state
+    static void depthMask(bool write);
+    static void depthFunc(GLenum func);
+    static void colorMask(bool red, bool green, bool blue, bool alpha);
+    static void cullFace(GLenum face);
+    static void blendEquation(GLenum rgb, GLenum alpha);
+    static void blendFunc(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha);
+    static void polygonOffset(float factor, float units);
+    
+    // Deleting a bound object unbinds it, so these must be called when deleting
+    static void textureDeleted(GLuint texture);
+    static void vertexArrayDeleted(GLuint vertexArray);
+    static void framebufferDeleted(GLuint framebuffer);
+    
+    // The state changes sent to the driver, and the redundant ones
+    // that were skipped, since the counts were last reset
+    static int issuedChanges() { return issuedChanges_; }
+    static int filteredChanges() { return filteredChanges_; }
+    static void resetCounts();
+
+private:
+    // Marks a binding or value that is not known
+    const static GLuint Unknown = 0xFFFFFFFF;
+    
+    // Texture units above this are not tracked
+    const static int MaxTextureUnits = 8;
+    
+    // The tracked capabilities
+    const static int CapabilitiesCount = 5;
+    
+    static int issuedChanges_;
+    static int filteredChanges_;
+    
+    static GLuint program_;
+    static GLuint activeTexture_;
+    static GLuint textures2D_[MaxTextureUnits];
+    static GLuint bufferTextures_[MaxTextureUnits];
+    static GLuint vertexArray_;
+    static GLuint drawFramebuffer_;
+    static GLuint readFramebuffer_;
+    static float viewport_[4];
+    static bool viewportKnown_;
+    static GLuint capabilities_[CapabilitiesCount];
+    static GLuint depthMask_;
+    static GLuint depthFunc_;
+    static GLuint colorMask_;
+    static GLuint cullFace_;
+    static GLuint blendEquation_[2];
+    static GLuint blendFunc_[4];
+    static float polygonOffset_[2];
+    static bool polygonOffsetKnown_;
+    
+    // Counts the change, returning true if it must be sent
+    static bool change(GLuint* current, GLuint value);
+    
+    // The tracked binding of a texture target on the active unit, or NULL
+    static GLuint* textureBinding(GLenum target);
+    
+    // The slot of a tracked capability, or -1
+    static int capabilityIndex(GLenum capability);
+};
@@ -0,0 +1,352 @@
+#include "HiZBuffer.hpp"
+
+#include <math.h>
+
+#include "GLState.hpp"
+
+const float HiZBuffer::MaxCameraMovement = 2.0;
+const float HiZBuffer::MinCameraDirectionDot = 0.985; // About 10 degrees
+
+HiZBuffer::HiZBuffer(UniformManager* uniformManager)
+    : nextReadback_(0),
+    levels_(),
+    minDepths_(),
+    clipPoints_(),
+    viewProjection_(Matrix4x4::identity()),
+    clipToWorld_(Matrix4x4::identity()),
+    cameraPosition_(Vector3::zero()),
+    cameraForward_(Vector3::zero())
+{
+    // Pass for reducing the scene depth
+    reducePass_ = new RenderPass("HiZReduce", uniformManager);
+    reducePass_->setSupportedFeatures(0);
+    
+    // Float texture for the reduced max and min depth
+    texture_ = Texture::twoChannelFloat(Width, Height);
+    texture_->setMinFilter(GL_NEAREST);
+    texture_->setMagFilter(GL_NEAREST);
+    
+    glGenFramebuffers(1, &framebuffer_);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_->id(), 0);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
+    
+    // Pixel buffers for reading the texture back asynchronously
+    for(int i = 0; i < ReadbackCount; ++i)
+    {
+        glGenBuffers(1, &readbacks_[i].pixelBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbacks_[i].pixelBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, Width * Height * 2 * sizeof(float), NULL, GL_STREAM_READ);
+        readbacks_[i].fence = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+HiZBuffer::~HiZBuffer()
+{
+    for(int i = 0; i < ReadbackCount; ++i)
+    {
+        if(readbacks_[i].fence != 0)
+        {
+            glDeleteSync(readbacks_[i].fence);
+        }
+        glDeleteBuffers(1, &readbacks_[i].pixelBuffer);
+    }
+    
+    GLState::framebufferDeleted(framebuffer_);
+    glDeleteFramebuffers(1, &framebuffer_);
+    delete texture_;
+    delete reducePass_;
+}
+
+void HiZBuffer::update(Texture* depthTexture, const Camera* camera)
+{
+    // Skip this frame if the GPU is still copying into the next buffer
+    Readback &readback = readbacks_[nextReadback_];
+    if(readback.fence != 0)
+    {
+        return;
+    }
+    
+    // Reduce the depth to the low resolution texture
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    GLState::viewport(0, 0, Width, Height);
+    GLState::disable(GL_DEPTH_TEST);
+    GLState::depthMask(false);
+    GLState::colorMask(true, true, true, true);
+    
+    depthTexture->bind(GL_TEXTURE0);
+    reducePass_->renderFullScreen();
+    
+    // Start copying it to the pixel buffer.
+    // This returns immediately, and the fence shows when it is done.
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pixelBuffer);
+    glReadPixels(0, 0, Width, Height, GL_RG, GL_FLOAT, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    
+    readback.viewProjection = camera->worldToCameraMatrix();
+    readback.clipToWorld = camera->cameraToWorldMatrix();
+    readback.cameraPosition = camera->position();
+    readback.cameraForward = camera->forward().vec3();
+    
+    nextReadback_ = (nextReadback_ + 1) % ReadbackCount;
+    
+    // Restore the state
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::depthMask(true);
+}
+
+int HiZBuffer::cull(const Camera* camera, vector<MeshInstance*>* instances)
+{
+    collectReadbacks();
+    
+    // Don't cull if the camera has moved or turned too far since the depth was
+    // rendered, as objects that have come into view would be missing for a frame.
+    if(!isDepthUsable(camera))
+    {
+        return 0;
+    }
+    
+    // Remove the hidden instances, keeping the order of the rest
+    unsigned int kept = 0;
+    for(unsigned int i = 0; i < instances->size(); ++i)
+    {
+        MeshInstance* instance = (*instances)[i];
+        
+        // Dynamic instances may have moved since the depth was rendered
+        if(instance->isStatic() && isOccluded(instance->bounds()))
+        {
+            continue;
+        }
+        
+        (*instances)[kept] = instance;
+        kept ++;
+    }
+    
+    int culled = (int)instances->size() - kept;
+    instances->resize(kept);
+    return culled;
+}
+
+bool HiZBuffer::getVisibleSurfaces(const Camera* camera, vector<Vector3>* points)
+{
+    points->clear();
+    collectReadbacks();
+    
+    // Surfaces that have come into view would be missing
+    if(!isDepthUsable(camera))
+    {
+        return false;
+    }
+    
+    clipPoints_.clear();
+    for(int y = 0; y < Height; ++y)
+    {
+        for(int x = 0; x < Width; ++x)
+        {
+            // Use the corners of the texel in clip space
+            float clipX[2] = { ((float)x / Width) * 2.0f - 1.0f, ((x + 1.0f) / Width) * 2.0f - 1.0f };
+            float clipY[2] = { ((float)y / Height) * 2.0f - 1.0f, ((y + 1.0f) / Height) * 2.0f - 1.0f };
+            float depths[2] = { minDepths_[y * Width + x], levels_[0][y * Width + x] };
+            
+            for(int i = 0; i < 2; ++i)
+            {
+                // Skip the background at the far plane, and a texel
+                // covered by a single depth the second time
+                if(depths[i] >= 1.0 || (i == 1 && depths[1] == depths[0]))
+                {
+                    continue;
+                }
+                
+                float clipZ = depths[i] * 2.0f - 1.0f;
+                for(int corner = 0; corner < 4; ++corner)
+                {
+                    clipPoints_.push_back(Vector4(clipX[corner & 1], clipY[corner >> 1], clipZ, 1.0));
+                }
+            }
+        }
+    }
+    
+    // Transform the points to world space together
+    int count = (int)clipPoints_.size();
+    if(count > 0)
+    {
+        clipToWorld_.transformPoints(&clipPoints_[0], &clipPoints_[0], count);
+    }
+    
+    for(int i = 0; i < count; ++i)
+    {
+        points->push_back(clipPoints_[i].vec3() / clipPoints_[i].w);
+    }
+    
+    return true;
+}
+
+int HiZBuffer::warmupShaders()
+{
+    return reducePass_->warmup();
+}
+
+void HiZBuffer::collectReadbacks()
+{
+    // Check the readbacks from oldest to newest so the newest completed one is used
+    for(int i = 0; i < ReadbackCount; ++i)
+    {
+        Readback &readback = readbacks_[(nextReadback_ + i) % ReadbackCount];
+        if(readback.fence == 0)
+        {
+            continue;
+        }
+        
+        // Don't wait for copies that haven't finished
+        GLenum result = glClientWaitSync(readback.fence, 0, 0);
+        if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+        {
+            continue;
+        }
+        
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+        
+        // Copy into the most detailed level, and the min depths
+        if(levels_.empty())
+        {
+            levels_.push_back(vector<float>(Width * Height));
+            minDepths_.resize(Width * Height);
+        }
+        
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pixelBuffer);
+        const float* map = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, Width * Height * 2 * sizeof(float), GL_MAP_READ_BIT);
+        for(int i = 0; i < Width * Height; ++i)
+        {
+            levels_[0][i] = map[i * 2];
+            minDepths_[i] = map[i * 2 + 1];
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        
+        viewProjection_ = readback.viewProjection;
+        clipToWorld_ = readback.clipToWorld;
+        cameraPosition_ = readback.cameraPosition;
+        cameraForward_ = readback.cameraForward;
+        buildLevels();
+    }
+}
+
+void HiZBuffer::buildLevels()
+{
+    levels_.resize(1);
+    
+    // Halve the resolution until a single texel is left,
+    // keeping the furthest depth of each 2x2 block
+    int width = Width;
+    int height = Height;
+    while(width > 1 || height > 1)
+    {
+        int newWidth = max(width / 2, 1);
+        int newHeight = max(height / 2, 1);
+        
+        const vector<float> &source = levels_.back();
+        vector<float> level(newWidth * newHeight);
+        for(int y = 0; y < newHeight; ++y)
+        {
+            for(int x = 0; x < newWidth; ++x)
+            {
+                int x0 = min(x * 2, width - 1);
+                int x1 = min(x * 2 + 1, width - 1);
+                int y0 = min(y * 2, height - 1);
+                int y1 = min(y * 2 + 1, height - 1);
+                
+                float depth = max(max(source[y0 * width + x0], source[y0 * width + x1]),
+                                  max(source[y1 * width + x0], source[y1 * width + x1]));
+                level[y * newWidth + x] = depth;
+            }
+        }
+        
+        levels_.push_back(level);
+        width = newWidth;
+        height = newHeight;
+    }
+}
+
+bool HiZBuffer::isDepthUsable(const Camera* camera) const
+{
+    // Nothing has been read back yet
+    if(levels_.empty())
+    {
+        return false;
+    }
+    
+    Vector3 movement = camera->position() - cameraPosition_;
+    float directionDot = Vector3::dot(camera->forward().vec3(), cameraForward_);
+    return movement.magnitude() <= MaxCameraMovement && directionDot >= MinCameraDirectionDot;
+}
+
+bool HiZBuffer::isOccluded(const Bounds &bounds) const
+{
+    Vector3 min = bounds.min();
+    Vector3 max = bounds.max();
+    
+    // Project the corners to find the screen rectangle and nearest depth
+    float minX = 1.0, minY = 1.0, maxX = -1.0, maxY = -1.0;
+    float minDepth = 1.0;
+    for(int i = 0; i < 8; ++i)
+    {
+        Vector4 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.0);
+        Vector4 clip = viewProjection_ * corner;
+        
+        // Bounds crossing the near plane can't be projected, so are always visible
+        if(clip.w <= 0.0 || clip.z < -clip.w)
+        {
+            return false;
+        }
+        
+        float x = clip.x / clip.w;
+        float y = clip.y / clip.w;
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+        minDepth = std::min(minDepth, (clip.z / clip.w) * 0.5f + 0.5f);
+    }
+    
+    // Bounds outside of the old view have no depth to test against
+    if(minX < -1.0 || minY < -1.0 || maxX > 1.0 || maxY > 1.0)
+    {
+        return false;
+    }
+    
+    // Convert to texels in the most detailed level
+    float left = (minX * 0.5f + 0.5f) * Width;
+    float right = (maxX * 0.5f + 0.5f) * Width;
+    float bottom = (minY * 0.5f + 0.5f) * Height;
+    float top = (maxY * 0.5f + 0.5f) * Height;
+    
+    // Use the level where the rectangle covers at most 2x2 texels
+    float size = std::max(right - left, top - bottom);
+    int level = (int)ceil(log2(std::max(size, 1.0f)));
+    level = std::min(level, (int)levels_.size() - 1);
+    
+    int levelWidth = std::max(Width >> level, 1);
+    int levelHeight = std::max(Height >> level, 1);
+    int x0 = std::min((int)left >> level, levelWidth - 1);
+    int x1 = std::min((int)right >> level, levelWidth - 1);
+    int y0 = std::min((int)bottom >> level, levelHeight - 1);
+    int y1 = std::min((int)top >> level, levelHeight - 1);
+    
+    // Find the furthest depth covered by the rectangle
+    const vector<float> &depths = levels_[level];
+    float maxDepth = 0.0;
+    for(int y = y0; y <= y1; ++y)
+    {
+        for(int x = x0; x <= x1; ++x)
+        {
+            maxDepth = std::max(maxDepth, depths[y * levelWidth + x]);
+        }
+    }
+    
+    // Hidden if the nearest point is behind all of it
+    return minDepth > maxDepth;
+}
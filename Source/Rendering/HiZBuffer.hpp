@@ -0,0 +1,106 @@
+#pragma once
+
+#define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
+#include <QGLWidget> // Links OpenGL Headers
+
+#include <vector>
+
+using namespace std;
+
+#include "Camera.hpp"
+#include "MeshInstance.hpp"
+#include "RenderPass.hpp"
+#include "Texture.hpp"
+#include "UniformManager.hpp"
+
+// A hierarchical depth buffer used for occlusion culling.
+// The scene depth is reduced to a low resolution on the GPU, read back
+// without stalling, then used to cull instances in later frames.
+// Each texel holds the furthest depth it covers, so an instance is only
+// culled if it is behind everything in its screen rectangle.
+// The nearest depth is also kept, to find the visible surfaces.
+class HiZBuffer
+{
+public:
+    // The resolution of the most detailed level
+    const static int Width = 256;
+    const static int Height = 128;
+    
+    // Camera movement that stops the depth being used, as the old
+    // depth may no longer cover what is visible
+    const static float MaxCameraMovement;
+    
+    HiZBuffer(UniformManager* uniformManager);
+    ~HiZBuffer();
+    
+    // Reduces the depth texture rendered by the camera and
+    // starts reading it back to the CPU.
+    // The depth should be of static instances only, as dynamic ones
+    // will have moved by the time it is used.
+    void update(Texture* depthTexture, const Camera* camera);
+    
+    // Removes static instances that were hidden in the most recent
+    // depth buffer that has been read back. Returns the number removed.
+    // Nothing is culled if the camera has moved too far since then.
+    int cull(const Camera* camera, vector<MeshInstance*>* instances);
+    
+    // Replaces the list with world space points on the corners of the nearest
+    // and furthest surfaces in each texel of the most recent depth that has been
+    // read back, so together they cover the whole area each texel sees.
+    // Returns false if there is none, or the camera has moved too far since then.
+    bool getVisibleSurfaces(const Camera* camera, vector<Vector3>* points);
+    
+    // Creates the reduction shader ahead of time.
+    // Returns the number of new variants.
+    int warmupShaders();
+
+private:
+    // Readbacks in flight at once
+    const static int ReadbackCount = 2;
+    
+    // Camera rotation that stops the depth being used
+    const static float MinCameraDirectionDot;
+    
+    // A depth buffer being copied to the CPU
+    struct Readback
+    {
+        GLuint pixelBuffer;
+        GLsync fence;
+        
+        // The camera the depth was rendered with
+        Matrix4x4 viewProjection;
+        Matrix4x4 clipToWorld;
+        Vector3 cameraPosition;
+        Vector3 cameraForward;
+    };
+    
+    RenderPass* reducePass_;
+    Texture* texture_;
+    GLuint framebuffer_;
+    
+    Readback readbacks_[ReadbackCount];
+    int nextReadback_;
+    
+    // The CPU copy of the depth, with each level half the size of
+    // the previous one. Empty until the first readback completes.
+    vector<vector<float> > levels_;
+    vector<float> minDepths_;
+    
+    // Scratch space for the visible surfaces in clip space
+    vector<Vector4> clipPoints_;
+    
+    Matrix4x4 viewProjection_;
+    Matrix4x4 clipToWorld_;
+    Vector3 cameraPosition_;
+    Vector3 cameraForward_;
+    
+    // Copies finished readbacks to the CPU levels
+    void collectReadbacks();
+    void buildLevels();
+    
+    // Checks the camera is close enough to where the depth was rendered from
+    bool isDepthUsable(const Camera* camera) const;
+    
+    // Tests bounds against the CPU levels
+    bool isOccluded(const Bounds &bounds) const;
+};
@@ -1,5 +1,7 @@
 #include "Overlay.hpp"
 
+#include "GLState.hpp"
+
 Overlay::Overlay(const string &name, const string &shaderName, ShaderFeatureList shaderFeatures)
     : name_(name),
     fullScreen_(true),
@@ -15,6 +17,11 @@ Overlay::~Overlay()
     delete mesh_;
 }
 
+void Overlay::warmupShader()
+{
+    shader_->finishLinking();
+}
+
 void Overlay::setFullScreen(bool fullscreen)
 {
     fullScreen_ = fullscreen;
@@ -35,25 +42,25 @@ void Overlay::draw(const Camera* camera)
     if(useBlending_)
     {
         // Use blending, if set
-        glEnable(GL_BLEND);
+        GLState::enable(GL_BLEND);
         
         // Blending controlled by overlay shader alpha
-        glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
-        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GLState::blendEquation(GL_FUNC_ADD, GL_FUNC_ADD);
+        GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     }
     
     // Write colour only to the default framebuffer.
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDepthMask(false);
-    glColorMask(true, true, true, true);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::depthMask(false);
+    GLState::colorMask(true, true, true, true);
     
     // Disable depth testing
-    glDisable(GL_DEPTH_TEST);
+    GLState::disable(GL_DEPTH_TEST);
     
     if(fullScreen_)
     {
         // Draw to the entire screen
-        glViewport(0, 0, camera->pixelWidth(), camera->pixelHeight());
+        GLState::viewport(0, 0, camera->pixelWidth(), camera->pixelHeight());
     }
     else
     {
@@ -81,7 +88,7 @@ void Overlay::draw(const Camera* camera)
         }
         
         // Draw to the overlay's section of the screen only
-        glViewport(camera->pixelWidth() - width - padding,
+        GLState::viewport(camera->pixelWidth() - width - padding,
                    camera->pixelHeight() - height - padding,
                    width, height);
     }
@@ -92,8 +99,8 @@ void Overlay::draw(const Camera* camera)
     texture_->bind(GL_TEXTURE0);
     
     // Draw the quad mesh
-    glDrawElements(GL_TRIANGLES, mesh_->elementsCount(), GL_UNSIGNED_SHORT, (void*)0);
+    glDrawElements(GL_TRIANGLES, mesh_->elementsCount(), mesh_->elementsType(), (void*)0);
     
     // Clean up blending changes
-    glDisable(GL_BLEND);
+    GLState::disable(GL_BLEND);
 }
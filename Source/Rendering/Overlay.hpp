@@ -33,6 +33,9 @@ public:
     // Draws the overlay to the current framebuffer
     void draw(const Camera* camera);
     
+    // Waits for the overlay shader to link, rather than when first drawn
+    void warmupShader();
+    
 private:
     string name_;
     Shader* shader_;
@@ -1,11 +1,17 @@
 #include "RenderPass.hpp"
 
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
 RenderPass::RenderPass(const string &name, UniformManager* uniformManager)
     : name_(name),
     clearFlags_(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT),
     clearColor_(PassClearColor(0.0, 0.0, 0.0, 1.0)),
     shaderCollection_(new ShaderCollection(name)),
-    uniformManager_(uniformManager)
+    uniformManager_(uniformManager),
+    stats_(NULL),
+    lodTolerance_(0.0)
 {
     fullScreenQuad_ = Mesh::fullScreenQuad();
 }
@@ -41,8 +47,21 @@ void RenderPass::setSupportedFeatures(ShaderFeatureList supportedFeatures)
     shaderCollection_->setSupportedFeatures(supportedFeatures);
 }
 
-void RenderPass::submit(Camera* camera, const vector<MeshInstance*>* instances, bool drawStatic, bool drawDynamic)
+void RenderPass::setStats(RendererStats* stats)
+{
+    stats_ = stats;
+}
+
+void RenderPass::setLODTolerance(float tolerance)
+{
+    lodTolerance_ = tolerance;
+}
+
+void RenderPass::submit(Camera* camera, const vector<MeshInstance*>* instances, bool drawStatic, bool drawDynamic,
+                        const vector<GLuint>* instanceMasks)
 {
+    assert(instanceMasks == NULL || instanceMasks->size() == instances->size());
+    
     // Setup the camera uniform buffer
     CameraUniformBuffer cub;
     cub.screenResolution = Vector4(camera->pixelWidth(), camera->pixelHeight(), 0.0, 0.0);
@@ -55,18 +74,10 @@ void RenderPass::submit(Camera* camera, const vector<MeshInstance*>* instances,
     glClearColor(clearColor_.x, clearColor_.y, clearColor_.z, clearColor_.w);
     glClear(clearFlags_);
     
-    // Remember the previously used state
-    // Used to skip needless state changes
-    ShaderFeatureList prevShaderFeatures = ~0;
-    Texture* prevTexture = NULL;
-    Texture* prevNormalMap = NULL;
-    Mesh* prevMesh = NULL;
-    
-    // Try to group instances into a single batch
-    PerObjectUniformBuffer instanceData;
-    int instanceCount = 0;
-    
     ShaderFeatureList enabledFeatures = shaderCollection_->enabledFeatures();
+    
+    // Find the instances to draw and the state they need
+    sortItems_.clear();
     for(unsigned int i = 0; i < instances->size(); ++i)
     {
         MeshInstance* instance = (*instances)[i];
@@ -78,59 +89,160 @@ void RenderPass::submit(Camera* camera, const vector<MeshInstance*>* instances,
             continue;
         }
         
+        ShaderFeatureList shaderFeatures = instance->shaderFeatures() & enabledFeatures;
+        
+        SortItem item;
+        item.lod = selectLOD(instance, shaderFeatures);
+        item.key = sortKey(shaderFeatures, instance->texture(), instance->normalMap(), instance->mesh(), item.lod);
+        item.index = i;
+        sortItems_.push_back(item);
+    }
+    
+    // Group instances with the same state together
+    radixSort(sortItems_, sortTemp_);
+    
+    // Remember the previously used state
+    // Used to skip needless state changes
+    ShaderFeatureList prevShaderFeatures = ~0;
+    Texture* prevTexture = NULL;
+    Texture* prevNormalMap = NULL;
+    Mesh* prevMesh = NULL;
+    int prevLOD = 0;
+    
+    int drawCalls = 0;
+    int stateChanges = 0;
+    
+    // Try to group instances into a single batch
+    batchTransforms_.clear();
+    batchMasks_.clear();
+    
+    for(unsigned int i = 0; i < sortItems_.size(); ++i)
+    {
+        MeshInstance* instance = (*instances)[sortItems_[i].index];
+        
         ShaderFeatureList shaderFeatures = instance->shaderFeatures() & enabledFeatures;
         Texture* texture = instance->texture();
         Texture* normalMap = instance->normalMap();
         Mesh* mesh = instance->mesh();
-        Matrix4x4 transform = instance->localToWorld();
+        int lod = sortItems_[i].lod;
         
         // Check if anything is different to the previous mesh
         if(shaderFeatures != prevShaderFeatures
            || texture != prevTexture
            || normalMap != prevNormalMap
-           || mesh != prevMesh)
+           || mesh != prevMesh
+           || lod != prevLOD)
         {
             // Send the queued instances
-            if(instanceCount > 0)
+            if(!batchTransforms_.empty())
             {
-                uniformManager_->updatePerObjectBuffer(instanceData);
-                glDrawElementsInstanced(GL_TRIANGLES, prevMesh->elementsCount(), GL_UNSIGNED_SHORT, (void*)0, instanceCount);
-                instanceCount = 0;
+                drawBatch(prevMesh, prevLOD);
+                drawCalls ++;
             }
             
             // Bind the correct shader
             if(shaderFeatures != prevShaderFeatures)
+            {
                 shaderCollection_->getVariant(shaderFeatures)->bind();
+                stateChanges ++;
+            }
             
             // Bind the correct main texture
             if(texture != prevTexture)
+            {
                 texture->bind(GL_TEXTURE0);
+                stateChanges ++;
+            }
             
             // Bind the correct normal map texture
             if(normalMap != prevNormalMap)
+            {
                 normalMap->bind(GL_TEXTURE1);
+                stateChanges ++;
+            }
                 
             // Bind the correct mesh
             if(mesh != prevMesh)
+            {
                 mesh->bind();
+                stateChanges ++;
+            }
+        }
+        
+        // Very large batches are split when they fill the instance buffer
+        if((int)batchTransforms_.size() == UniformManager::MaxInstancesPerDraw)
+        {
+            drawBatch(mesh, lod);
+            drawCalls ++;
         }
         
         // Add this mesh to the queue
-        instanceData.localToWorld[instanceCount] = transform;
-        instanceCount ++;
+        batchTransforms_.push_back(instance->localToWorld());
+        if(instanceMasks != NULL)
+        {
+            batchMasks_.push_back((*instanceMasks)[sortItems_[i].index]);
+        }
         
         prevShaderFeatures = shaderFeatures;
         prevTexture = texture;
         prevNormalMap = normalMap;
         prevMesh = mesh;
+        prevLOD = lod;
     }
     
     // Send any remaining queued instances
-    if(instanceCount > 0)
+    if(!batchTransforms_.empty())
+    {
+        drawBatch(prevMesh, prevLOD);
+        drawCalls ++;
+    }
+    
+    if(stats_ != NULL)
+    {
+        stats_->addDrawCalls(drawCalls, stateChanges);
+    }
+}
+
+void RenderPass::drawBatch(Mesh* mesh, int lod)
+{
+    // Write the transforms and read them as instance attributes
+    int instanceCount = (int)batchTransforms_.size();
+    GLuint instanceBuffer = uniformManager_->instanceBufferID();
+    if(batchMasks_.empty())
+    {
+        int offset = uniformManager_->updateInstanceBuffer(&batchTransforms_[0], instanceCount);
+        mesh->bindInstanceData(instanceBuffer, offset);
+    }
+    else
+    {
+        // The masks follow the transforms
+        int offset = uniformManager_->updateInstanceBuffer(&batchTransforms_[0], &batchMasks_[0], instanceCount);
+        mesh->bindInstanceData(instanceBuffer, offset);
+        mesh->bindInstanceMasks(instanceBuffer, offset + instanceCount * sizeof(Matrix4x4));
+    }
+    
+    size_t elementsOffset = mesh->lodElementsOffset(lod) * mesh->elementSize();
+    glDrawElementsInstanced(GL_TRIANGLES, mesh->lodElementsCount(lod), mesh->elementsType(), (void*)elementsOffset, instanceCount);
+    batchTransforms_.clear();
+    batchMasks_.clear();
+}
+
+int RenderPass::selectLOD(const MeshInstance* instance, ShaderFeatureList shaderFeatures) const
+{
+    if(lodTolerance_ <= 0.0 || (shaderFeatures & SF_Cutout) != 0)
+    {
+        return 0;
+    }
+    
+    // Convert the tolerance to object space using the largest scale
+    Vector3 scale = instance->scale();
+    float maxScale = max(fabs(scale.x), max(fabs(scale.y), fabs(scale.z)));
+    if(maxScale <= 0.0)
     {
-        uniformManager_->updatePerObjectBuffer(instanceData);
-        glDrawElementsInstanced(GL_TRIANGLES, prevMesh->elementsCount(), GL_UNSIGNED_SHORT, (void*)0, instanceCount);
+        return 0;
     }
+    
+    return instance->mesh()->selectLOD(lodTolerance_ / maxScale);
 }
 
 void RenderPass::renderFullScreen()
@@ -142,5 +254,90 @@ void RenderPass::renderFullScreen()
     fullScreenQuad_->bind();
 
     // Draw the quad
-    glDrawElements(GL_TRIANGLES, fullScreenQuad_->elementsCount(), GL_UNSIGNED_SHORT, (void*)0);
+    glDrawElements(GL_TRIANGLES, fullScreenQuad_->elementsCount(), fullScreenQuad_->elementsType(), (void*)0);
+}
+
+int RenderPass::warmup(const vector<MeshInstance*>* instances)
+{
+    vector<ShaderFeatureList> featureLists;
+    if(instances == NULL)
+    {
+        featureLists.push_back(~0);
+    }
+    else
+    {
+        // Most instances share a few feature lists
+        for(unsigned int i = 0; i < instances->size(); ++i)
+        {
+            ShaderFeatureList features = (*instances)[i]->shaderFeatures();
+            if(find(featureLists.begin(), featureLists.end(), features) == featureLists.end())
+            {
+                featureLists.push_back(features);
+            }
+        }
+    }
+    
+    return shaderCollection_->warmup(featureLists);
+}
+
+uint64_t RenderPass::sortKey(ShaderFeatureList shaderFeatures, const Texture* texture, const Texture* normalMap, const Mesh* mesh, int lod)
+{
+    // OpenGL object names are small integers, so the lowest 16 bits
+    // are enough to keep them apart. The mesh shares its bits with the
+    // level of detail, which is less than 8.
+    assert(shaderFeatures <= 0xFFFF);
+    assert(lod >= 0 && lod < 8);
+    uint64_t key = (uint64_t)shaderFeatures << 48;
+    key |= (uint64_t)(texture->id() & 0xFFFF) << 32;
+    key |= (uint64_t)(normalMap->id() & 0xFFFF) << 16;
+    key |= (uint64_t)(mesh->vertexArray() & 0x1FFF) << 3;
+    key |= (uint64_t)lod;
+    return key;
+}
+
+void RenderPass::radixSort(vector<SortItem> &items, vector<SortItem> &temp)
+{
+    const int Passes = sizeof(uint64_t);
+    
+    // Count the occurrences of each byte value for every pass at once
+    unsigned int counts[Passes][256] = {};
+    for(unsigned int i = 0; i < items.size(); ++i)
+    {
+        uint64_t key = items[i].key;
+        for(int pass = 0; pass < Passes; ++pass)
+        {
+            counts[pass][(key >> (pass * 8)) & 0xFF] ++;
+        }
+    }
+    
+    temp.resize(items.size());
+    for(int pass = 0; pass < Passes; ++pass)
+    {
+        // Skip bytes that are the same for every key.
+        // Most passes are skipped, as few bits of each field are used.
+        unsigned int* passCounts = counts[pass];
+        int byte = (items.empty() ? 0 : (items[0].key >> (pass * 8)) & 0xFF);
+        if(passCounts[byte] == items.size())
+        {
+            continue;
+        }
+        
+        // Find the start of each bucket
+        unsigned int offsets[256];
+        unsigned int total = 0;
+        for(int i = 0; i < 256; ++i)
+        {
+            offsets[i] = total;
+            total += passCounts[i];
+        }
+        
+        // Stable scatter into the buckets
+        for(unsigned int i = 0; i < items.size(); ++i)
+        {
+            int bucket = (items[i].key >> (pass * 8)) & 0xFF;
+            temp[offsets[bucket]++] = items[i];
+        }
+        
+        items.swap(temp);
+    }
 }
@@ -11,6 +11,7 @@ using namespace std;
 #include "ShaderCollection.hpp"
 #include "UniformManager.hpp"
 #include "MeshInstance.hpp"
+#include "RendererStats.hpp"
 
 typedef GLbitfield PassClearFlags;
 typedef Vector4 PassClearColor;
@@ -34,12 +35,31 @@ public:
     void disableFeature(ShaderFeature feature);
     void setSupportedFeatures(ShaderFeatureList supportedFeatures);
     
+    // Draw calls and state changes are added to the stats, if set
+    void setStats(RendererStats* stats);
+    
+    // Enables simplified meshes for depth only passes.
+    // Each instance uses the simplest level of detail that moves its surface
+    // by less than the world space tolerance. Cutout instances always use the
+    // full mesh, as the simplified meshes don't keep their texcoords.
+    // A tolerance of 0 disables simplified meshes.
+    void setLODTolerance(float tolerance);
+    
     // Sends draw commands to the graphics API.
     // The meshes can be filtered based on their static flag state.
-    void submit(Camera* camera, const vector<MeshInstance*>* instances, bool drawStatic = true, bool drawDynamic = true);
+    // Instances are sorted by their state so that each shader, texture
+    // and mesh is bound once, regardless of the order in the scene.
+    // If masks are given, each instance's mask is passed to the shader.
+    void submit(Camera* camera, const vector<MeshInstance*>* instances, bool drawStatic = true, bool drawDynamic = true,
+                const vector<GLuint>* instanceMasks = NULL);
     
     // Draws a full screen quad using all enabled shader features.
     void renderFullScreen();
+    
+    // Creates the shader variants needed to draw the instances, with any of the
+    // features enabled. Without instances, the variants for renderFullScreen are created.
+    // Returns the number of new variants.
+    int warmup(const vector<MeshInstance*>* instances = NULL);
                        
 private:
     string name_;
@@ -47,5 +67,38 @@ private:
     PassClearColor clearColor_;
     ShaderCollection* shaderCollection_;
     UniformManager* uniformManager_;
+    RendererStats* stats_;
     Mesh* fullScreenQuad_;
+    float lodTolerance_;
+    
+    // An instance index and the state it is drawn with
+    struct SortItem
+    {
+        uint64_t key;
+        int index;
+        int lod;
+    };
+    
+    // The visible instances in draw order, and space for sorting them.
+    // Kept between frames to avoid reallocating.
+    vector<SortItem> sortItems_;
+    vector<SortItem> sortTemp_;
+    
+    // The transforms of the instances in the current batch.
+    // Kept between frames to avoid reallocating.
+    vector<Matrix4x4> batchTransforms_;
+    vector<GLuint> batchMasks_;
+    
+    // Draws all instances in the current batch
+    void drawBatch(Mesh* mesh, int lod);
+    
+    // Finds the level of detail to draw the instance with
+    int selectLOD(const MeshInstance* instance, ShaderFeatureList shaderFeatures) const;
+    
+    // Creates a key that sorts by shader, then textures, then mesh and level of detail
+    static uint64_t sortKey(ShaderFeatureList shaderFeatures, const Texture* texture, const Texture* normalMap, const Mesh* mesh, int lod);
+    
+    // Sorts the items by key with an 8 bit LSD radix sort.
+    // The temp vector is used as a second buffer.
+    static void radixSort(vector<SortItem> &items, vector<SortItem> &temp);
 };
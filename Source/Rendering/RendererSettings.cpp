@@ -0,0 +1,32 @@
+#include "RendererSettings.hpp"
+
+RendererSettings::RendererSettings()
+    : sceneFile("scene.scene"),
+    compressTextures(true),
+    shaderCache(true),
+    shadowMethod(SMM_Combined),
+    shadowMapResolution(4096),
+    shadowMapCascades(2),
+    shadowDistance(150.0),
+    cascadeSplitLinearWeight(0.3),
+    staggerCascadeUpdates(true),
+    layeredCascades(true),
+    fitCascadesToSurfaces(true),
+    simplifiedCasters(true),
+    voxelPCFFilterSize(9),
+    enabledFeatures(SF_Texture | SF_NormalMap | SF_Specular | SF_Cutout | SF_Fog),
+    overlay(-1),
+    occlusionCulling(true),
+    treeResolution(32768),
+    maxTileResolution(4096),
+    concurrentTileBuilds(6),
+    precomputeTree(false),
+    treeBakeDistance(0.0),
+    treeCache(true),
+    treeDetailDistance(0.0),
+    minTileResolution(512),
+    treePoolSizeMB(256),
+    treeResidentDistance(0.0)
+{
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+#include "Shader.hpp"
+#include "ShadowMask.hpp"
+
+// The renderer and voxel tree construction settings used at startup.
+// Most can also be changed from the UI while running.
+struct RendererSettings
+{
+    RendererSettings();
+    
+    // The .scene file to load from the Scenes directory
+    string sceneFile;
+    
+    // Loads textures block compressed, using the compressed texture cache
+    bool compressTextures;
+    
+    // Saves linked shader programs, so later launches skip compiling
+    bool shaderCache;
+    
+    // Shadow method and cascaded shadow map settings
+    ShadowMaskMethod shadowMethod;
+    int shadowMapResolution;
+    int shadowMapCascades;
+    
+    // The distance covered by the cascades and the weight of
+    // linear (vs logarithmic) cascade split distances
+    float shadowDistance;
+    float cascadeSplitLinearWeight;
+    
+    // Updates the far cascades in turn rather than every frame
+    bool staggerCascadeUpdates;
+    
+    // Renders all cascades in a single pass when supported
+    bool layeredCascades;
+    
+    // Fits the cascade splits and sizes to the depth of earlier frames
+    bool fitCascadesToSurfaces;
+    
+    // Draws shadow casters with simplified meshes
+    bool simplifiedCasters;
+    
+    // Voxel PCF kernel size, 0 disables PCF
+    int voxelPCFFilterSize;
+    
+    // The user toggleable shader features that are enabled
+    ShaderFeatureList enabledFeatures;
+    
+    // The debug overlay index, -1 means no overlay
+    int overlay;
+    
+    // Culls instances hidden in the depth of earlier frames
+    bool occlusionCulling;
+    
+    // Voxel tree construction settings
+    int treeResolution;
+    int maxTileResolution;
+    int concurrentTileBuilds;
+    bool precomputeTree;
+    
+    // The distance to build tiles within, and if built tiles are cached
+    float treeBakeDistance;
+    bool treeCache;
+    
+    // The distance from the play area that tiles lose detail over, and the lowest resolution
+    float treeDetailDistance;
+    int minTileResolution;
+    
+    // The GPU memory for resident tiles, and the distance to keep them within
+    int treePoolSizeMB;
+    float treeResidentDistance;
+};
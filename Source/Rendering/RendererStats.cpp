@@ -1,15 +1,38 @@
 #include "RendererStats.hpp"
 
+#include <algorithm>
+
+#include "GLState.hpp"
+
+using namespace std;
+
 RendererStats::RendererStats()
     : timer_(),
+    frameStartTime_(0),
     avgFrameRate_(-1),
     avgFrameTime_(-1),
     avgShadowRenderingTime_(-1),
     avgShadowSamplingTime_(-1),
+    maxShadowRenderingTime_(-1),
+    lastFrameTime_(-1),
+    lastGPUFrameTime_(-1),
+    lastShadowRenderingTime_(-1),
+    lastShadowSamplingTime_(-1),
+    lastDrawCalls_(0),
+    lastStateChanges_(0),
+    lastIssuedGLStateChanges_(0),
+    lastFilteredGLStateChanges_(0),
+    lastVisibleInstances_(0),
+    lastOccludedInstances_(0),
     samplesCount_(0),
     sampleStartTime_(0),
     shadowRenderingTime_(0),
-    shadowSamplingTime_(0)
+    shadowSamplingTime_(0),
+    peakShadowRenderingTime_(0),
+    drawCalls_(0),
+    stateChanges_(0),
+    visibleInstances_(0),
+    occludedInstances_(0)
 {
     // Start the frame time timer
     timer_.start();
@@ -18,12 +41,12 @@ RendererStats::RendererStats()
     initializeOpenGLFunctions();
     
     // Create the query objects
-    glGenQueries(4, queries_);
+    glGenQueries(6, queries_);
 }
 
 RendererStats::~RendererStats()
 {
-    glDeleteQueries(4, queries_);
+    glDeleteQueries(6, queries_);
 }
 
 void RendererStats::frameStarted()
@@ -32,15 +55,42 @@ void RendererStats::frameStarted()
     samplesCount_ ++;
     
     // Get the times from the previous frame
-    uint64_t renderingStart, renderingEnd, samplingStart, samplingEnd;
+    uint64_t renderingStart, renderingEnd, samplingStart, samplingEnd, frameStart, frameEnd;
     glGetQueryObjectui64v(queries_[0], GL_QUERY_RESULT, &renderingStart);
     glGetQueryObjectui64v(queries_[1], GL_QUERY_RESULT, &renderingEnd);
     glGetQueryObjectui64v(queries_[2], GL_QUERY_RESULT, &samplingStart);
     glGetQueryObjectui64v(queries_[3], GL_QUERY_RESULT, &samplingEnd);
+    glGetQueryObjectui64v(queries_[4], GL_QUERY_RESULT, &frameStart);
+    glGetQueryObjectui64v(queries_[5], GL_QUERY_RESULT, &frameEnd);
+    
+    // Store the individual times of the previous frame in milliseconds
+    qint64 time = timer_.nsecsElapsed();
+    lastFrameTime_ = (time - frameStartTime_) / 1000000.0;
+    lastGPUFrameTime_ = (frameEnd - frameStart) / 1000000.0;
+    lastShadowRenderingTime_ = (renderingEnd - renderingStart) / 1000000.0;
+    lastShadowSamplingTime_ = (samplingEnd - samplingStart) / 1000000.0;
+    frameStartTime_ = time;
+    
+    // Store the draw counts of the previous frame
+    lastDrawCalls_ = drawCalls_;
+    lastStateChanges_ = stateChanges_;
+    drawCalls_ = 0;
+    stateChanges_ = 0;
+    
+    lastIssuedGLStateChanges_ = GLState::issuedChanges();
+    lastFilteredGLStateChanges_ = GLState::filteredChanges();
+    GLState::resetCounts();
+    
+    lastVisibleInstances_ = visibleInstances_;
+    lastOccludedInstances_ = occludedInstances_;
+    
+    // Request the GPU timestamp at the start of this frame
+    glQueryCounter(queries_[4], GL_TIMESTAMP);
     
     // Add the rendering / sampling times to the total
     shadowRenderingTime_ += (renderingEnd - renderingStart);
     shadowSamplingTime_ += (samplingEnd - samplingStart);
+    peakShadowRenderingTime_ = max(peakShadowRenderingTime_, (qint64)(renderingEnd - renderingStart));
     
     // Check if enough frames have been recorded to create new averages
     if(samplesCount_ > 200)
@@ -51,19 +101,28 @@ void RendererStats::frameStarted()
         avgFrameTime_ = time / (double)samplesCount_;
         avgShadowRenderingTime_ = shadowRenderingTime_ / (double)samplesCount_;
         avgShadowSamplingTime_ = shadowSamplingTime_ / (double)samplesCount_;
+        maxShadowRenderingTime_ = peakShadowRenderingTime_;
         
         // The rendering and sampling times are in nanoseconds
         avgShadowRenderingTime_ /= 1000000.0;
         avgShadowSamplingTime_ /= 1000000.0;
+        maxShadowRenderingTime_ /= 1000000.0;
         
         // Reset the samples
         samplesCount_ = 0;
         sampleStartTime_ = timer_.elapsed();
         shadowRenderingTime_ = 0;
         shadowSamplingTime_ = 0;
+        peakShadowRenderingTime_ = 0;
     }
 }
 
+void RendererStats::frameFinished()
+{
+    // Request the GPU timestamp at this point
+    glQueryCounter(queries_[5], GL_TIMESTAMP);
+}
+
 void RendererStats::shadowRenderingStarted()
 {
     // Request the GPU timestamp at this point
@@ -87,3 +146,15 @@ void RendererStats::shadowSamplingFinished()
     // Request the GPU timestamp at this point
     glQueryCounter(queries_[3], GL_TIMESTAMP);
 }
+
+void RendererStats::addDrawCalls(int drawCalls, int stateChanges)
+{
+    drawCalls_ += drawCalls;
+    stateChanges_ += stateChanges;
+}
+
+void RendererStats::setInstanceCounts(int visibleInstances, int occludedInstances)
+{
+    visibleInstances_ = visibleInstances;
+    occludedInstances_ = occludedInstances;
+}
@@ -18,20 +18,55 @@ public:
     double currentShadowRenderingTime() const { return avgShadowRenderingTime_; }
     double currentShadowSamplingTime() const { return avgShadowSamplingTime_; }
     
+    // The longest shadow rendering time in the last samples
+    double currentMaxShadowRenderingTime() const { return maxShadowRenderingTime_; }
+    
+    // Get the unaveraged results for the last frame with completed queries.
+    // All times are in milliseconds.
+    double lastFrameTime() const { return lastFrameTime_; }
+    double lastGPUFrameTime() const { return lastGPUFrameTime_; }
+    double lastShadowRenderingTime() const { return lastShadowRenderingTime_; }
+    double lastShadowSamplingTime() const { return lastShadowSamplingTime_; }
+    
+    // The draw calls and state changes (shader, texture and mesh binds)
+    // made by render passes in the last frame
+    int lastDrawCalls() const { return lastDrawCalls_; }
+    int lastStateChanges() const { return lastStateChanges_; }
+    
+    // The OpenGL state changes sent to the driver in the last frame,
+    // and the redundant ones filtered out by GLState
+    int lastIssuedGLStateChanges() const { return lastIssuedGLStateChanges_; }
+    int lastFilteredGLStateChanges() const { return lastFilteredGLStateChanges_; }
+    
+    // The instances drawn by the main camera in the last frame,
+    // and how many more were culled as hidden
+    int lastVisibleInstances() const { return lastVisibleInstances_; }
+    int lastOccludedInstances() const { return lastOccludedInstances_; }
+    
     // These methods are called at certain points in a frame by RendererWidget
     void frameStarted();
+    void frameFinished();
     void shadowRenderingStarted();
     void shadowRenderingFinished();
     void shadowSamplingStarted();
     void shadowSamplingFinished();
     
+    // Called by each RenderPass after submitting draw calls
+    void addDrawCalls(int drawCalls, int stateChanges);
+    
+    // Called by RendererWidget after culling the main camera
+    void setInstanceCounts(int visibleInstances, int occludedInstances);
+
 private:
     
     // The timer used for measuring rendering times
     QElapsedTimer timer_;
     
-    // The queries used for measuring shadow rendering and sampling times
-    GLuint queries_[4];
+    // The queries used for measuring shadow rendering, sampling and frame times
+    GLuint queries_[6];
+    
+    // The CPU time when the last frame started, in nanoseconds
+    qint64 frameStartTime_;
     
     // The last set of samples
     // These values are the ones currently displayed
@@ -39,10 +74,30 @@ private:
     double avgFrameTime_;
     double avgShadowRenderingTime_;
     double avgShadowSamplingTime_;
+    double maxShadowRenderingTime_;
+    
+    // The times for the last individual frame
+    double lastFrameTime_;
+    double lastGPUFrameTime_;
+    double lastShadowRenderingTime_;
+    double lastShadowSamplingTime_;
+    int lastDrawCalls_;
+    int lastStateChanges_;
+    int lastIssuedGLStateChanges_;
+    int lastFilteredGLStateChanges_;
+    int lastVisibleInstances_;
+    int lastOccludedInstances_;
     
     // The samples being gathered
     int samplesCount_;
     qint64 sampleStartTime_;
     qint64 shadowRenderingTime_;
     qint64 shadowSamplingTime_;
+    qint64 peakShadowRenderingTime_;
+    
+    // The counts for the current frame
+    int drawCalls_;
+    int stateChanges_;
+    int visibleInstances_;
+    int occludedInstances_;
 };
@@ -5,22 +5,34 @@
 
 #include <iostream>
 
-RendererWidget::RendererWidget(const QGLFormat &format, int voxelResolution)
+#include <QElapsedTimer>
+
+#include "GLState.hpp"
+#include "ShaderCache.hpp"
+
+RendererWidget::RendererWidget(const QGLFormat &format, const RendererSettings &settings)
     : QGLWidget(format),
+    visibleInstances_(),
+    visibleSurfaces_(),
     overlays_(),
     currentOverlay_(-1),
-    voxelResolution_(voxelResolution)
+    settings_(settings)
 {
     sceneDepthTexture_ = NULL;
 }
 
 RendererWidget::~RendererWidget()
 {
+    // The voxel tree finishes building from the scene before it is deleted
+    scene_->finishLoading();
+    delete voxelTree_;
+    
     delete stats_;
     delete scene_;
     delete uniformManager_;
     delete shadowMap_;
     delete shadowMask_;
+    delete hiZBuffer_;
     
     // Delete render passes
     delete sceneDepthPass_;
@@ -32,6 +44,7 @@ void RendererWidget::enableFeature(ShaderFeature feature)
     shadowMask_->enableFeature(feature);
     sceneDepthPass_->enableFeature(feature);
     forwardPass_->enableFeature(feature);
+    settings_.enabledFeatures |= feature;
 }
 
 void RendererWidget::disableFeature(ShaderFeature feature)
@@ -39,26 +52,31 @@ void RendererWidget::disableFeature(ShaderFeature feature)
     shadowMask_->disableFeature(feature);
     sceneDepthPass_->disableFeature(feature);
     forwardPass_->disableFeature(feature);
+    settings_.enabledFeatures &= ~feature;
 }
 
 void RendererWidget::setOverlay(int overlayIndex)
 {
     currentOverlay_ = overlayIndex;
+    settings_.overlay = overlayIndex;
 }
 
 void RendererWidget::setShadowRenderMethod(ShadowMaskMethod method)
 {
     shadowMask_->setMethod(method);
+    settings_.shadowMethod = method;
 }
 
 void RendererWidget::setShadowMapResolution(int resolution)
 {
     shadowMap_->setCascades(shadowMap_->cascadesCount(), resolution);
+    settings_.shadowMapResolution = resolution;
 }
 
 void RendererWidget::setShadowMapCascades(int cascades)
 {
     shadowMap_->setCascades(cascades, shadowMap_->resolution());
+    settings_.shadowMapCascades = cascades;
 }
 
 void RendererWidget::setVoxelPCFFilterSize(int kernelSize)
@@ -73,23 +91,67 @@ void RendererWidget::setVoxelPCFFilterSize(int kernelSize)
         enableFeature(SF_Shadow_PCF_Filter);
         voxelTree_->setPCFFilterSize(kernelSize);
     }
+    
+    settings_.voxelPCFFilterSize = kernelSize;
+}
+
+void RendererWidget::setOcclusionCulling(bool enabled)
+{
+    settings_.occlusionCulling = enabled;
+}
+
+void RendererWidget::setStaggeredCascadeUpdates(bool enabled)
+{
+    shadowMap_->setStaggeredUpdates(enabled);
+    settings_.staggerCascadeUpdates = enabled;
+}
+
+void RendererWidget::setLayeredCascades(bool enabled)
+{
+    shadowMap_->setLayeredRendering(enabled);
+    settings_.layeredCascades = enabled;
+}
+
+void RendererWidget::setFitCascadesToSurfaces(bool enabled)
+{
+    settings_.fitCascadesToSurfaces = enabled;
+}
+
+void RendererWidget::setSimplifiedCasters(bool enabled)
+{
+    shadowMap_->setSimplifiedCasters(enabled);
+    settings_.simplifiedCasters = enabled;
+}
+
+void RendererWidget::setTreeResolution(int resolution)
+{
+    delete voxelTree_;
+    createVoxelTree(resolution);
+    settings_.treeResolution = resolution;
 }
 
 void RendererWidget::precomputeTree()
 {
-    while(voxelTree_->completedTiles() < voxelTree_->totalTiles())
+    scene_->finishLoading();
+    while(voxelTree_->isBuilding())
     {
         voxelTree_->updateBuild();
     }
+    
+    voxelTree_->finishLoading();
 }
 
 void RendererWidget::initializeGL()
 {
     printf("Initializing OpenGL %s \n", glGetString(GL_VERSION));
 
+    // Shaders are created by most of the assets below
+    ShaderCache::initialize(settings_.shaderCache);
+    
     // Configure OpenGL state
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    GLState::reset();
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::enable(GL_CULL_FACE);
     
     // Load the scene
     createScene();
@@ -101,12 +163,16 @@ void RendererWidget::initializeGL()
     uniformManager_ = new UniformManager();
     
     // Create assets
-    shadowMap_ = new ShadowMap(scene_, uniformManager_, 2, 4096);
-    shadowMask_ = new ShadowMask(uniformManager_, SMM_Combined);
+    shadowMap_ = new ShadowMap(scene_, uniformManager_, settings_.shadowMapCascades, settings_.shadowMapResolution);
+    shadowMap_->setCascadeSplits(settings_.shadowDistance, settings_.cascadeSplitLinearWeight);
+    shadowMap_->setStaggeredUpdates(settings_.staggerCascadeUpdates);
+    shadowMap_->setLayeredRendering(settings_.layeredCascades);
+    shadowMap_->setSimplifiedCasters(settings_.simplifiedCasters);
+    shadowMap_->setStats(stats_);
+    shadowMask_ = new ShadowMask(uniformManager_, settings_.shadowMethod);
     
     // Create and build the voxel tree
-    voxelTree_ = new VoxelTree(uniformManager_, scene_, voxelResolution_);
-    shadowMask_->setVoxelTree(voxelTree_);
+    createVoxelTree(settings_.treeResolution);
     
     // Create RenderPass instances
     createRenderPasses();
@@ -118,12 +184,21 @@ void RendererWidget::initializeGL()
     sceneDepthTexture_->setMagFilter(GL_NEAREST);
     sceneDepthTexture_->setMinFilter(GL_NEAREST);
     
-    glBindFramebuffer(GL_FRAMEBUFFER, sceneDepthFBO_);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, sceneDepthFBO_);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepthTexture_->id(), 0);
     
+    // Create the occlusion culling depth buffer
+    hiZBuffer_ = new HiZBuffer(uniformManager_);
+    
     // Create debug overlays
     // This is done last so overlays can reference other assets
     createOverlays();
+    
+    // Compile shaders now, rather than when a feature is first used
+    warmupShaders();
+    
+    // Apply the remaining startup settings
+    applySettings();
 }
 
 void RendererWidget::resizeGL(int w, int h)
@@ -141,11 +216,26 @@ void RendererWidget::resizeGL(int w, int h)
 
 void RendererWidget::paintGL()
 {
+    // Qt can change the state between frames
+    GLState::reset();
+    
     stats_->frameStarted();
     
-    // Update animations
+    // Update animations and upload loaded assets
     scene_->update(1.0 / 60.0);
     
+    // Find the instances the main camera can see
+    Frustum frustum(camera()->worldToCameraMatrix());
+    scene_->cull(frustum, &visibleInstances_);
+    
+    // Remove those hidden behind the depth of earlier frames
+    int occludedInstances = 0;
+    if(settings_.occlusionCulling)
+    {
+        occludedInstances = hiZBuffer_->cull(camera(), &visibleInstances_);
+    }
+    stats_->setInstanceCounts((int)visibleInstances_.size(), occludedInstances);
+    
     // Update scene uniform buffer
     SceneUniformBuffer data;
     data.ambientLightColor = Vector4(scene_->mainLight()->ambient(), 1.0);
@@ -162,6 +252,7 @@ void RendererWidget::paintGL()
     voxelTree_->updateBuild();
     
     // Render scene depth to the main framebuffer.
+    // The depth is also read back for culling and fitting cascades in later frames.
     renderSceneDepth();
     
     // Render the screen space shadow mask
@@ -179,6 +270,11 @@ void RendererWidget::paintGL()
         overlays_[currentOverlay_]->draw(camera());
     }
     
+    stats_->frameFinished();
+    
+    // Following uniform updates use the next part of the ring buffer
+    uniformManager_->frameFinished();
+    
     // Schedule a redraw immediately
     update();
     
@@ -198,6 +294,7 @@ void RendererWidget::createRenderPasses()
     sceneDepthPass_ = new RenderPass(sceneDepthPassName, uniformManager_);
     sceneDepthPass_->setSupportedFeatures(SF_Cutout);
     sceneDepthPass_->setClearFlags(GL_DEPTH_BUFFER_BIT);
+    sceneDepthPass_->setStats(stats_);
     
     // Pass for rendering the final image.
     // Uses all features.
@@ -205,12 +302,14 @@ void RendererWidget::createRenderPasses()
     forwardPass_ = new RenderPass(forwardPassName, uniformManager_);
     forwardPass_->setSupportedFeatures(~0);
     forwardPass_->setClearColor(PassClearColor(136.0/256.0, 152.0/256.0, 176.0/256.0, 1.0));
+    forwardPass_->setStats(stats_);
 }
 
 void RendererWidget::createScene()
 {
     scene_ = new Scene();
-    scene_->loadFromFile("scene.scene");
+    scene_->setCompressTextures(settings_.compressTextures);
+    scene_->loadFromFile(settings_.sceneFile);
 }
 
 void RendererWidget::createOverlays()
@@ -251,6 +350,62 @@ void RendererWidget::createOverlays()
     overlays_.push_back(voxelTraverselDepthOverlay);
 }
 
+void RendererWidget::createVoxelTree(int resolution)
+{
+    voxelTree_ = new VoxelTree(uniformManager_, scene_, resolution, settings_.maxTileResolution, settings_.treePoolSizeMB);
+    voxelTree_->setConcurrentBuilds(settings_.concurrentTileBuilds);
+    voxelTree_->setBakeDistance(settings_.treeBakeDistance);
+    voxelTree_->setDetailDistance(settings_.treeDetailDistance, settings_.minTileResolution);
+    voxelTree_->setTileCacheEnabled(settings_.treeCache);
+    voxelTree_->setResidentDistance(settings_.treeResidentDistance);
+    shadowMask_->setVoxelTree(voxelTree_);
+    
+    // Keep the current PCF filter size
+    if(settings_.voxelPCFFilterSize != 0)
+    {
+        voxelTree_->setPCFFilterSize(settings_.voxelPCFFilterSize);
+    }
+}
+
+void RendererWidget::applySettings()
+{
+    // Disable shader features that are turned off
+    ShaderFeature toggleableFeatures[] = { SF_Texture, SF_NormalMap, SF_Specular, SF_Cutout, SF_Fog };
+    for(int i = 0; i < 5; ++i)
+    {
+        if((settings_.enabledFeatures & toggleableFeatures[i]) == 0)
+        {
+            disableFeature(toggleableFeatures[i]);
+        }
+    }
+    
+    setVoxelPCFFilterSize(settings_.voxelPCFFilterSize);
+    setOverlay(settings_.overlay);
+}
+
+void RendererWidget::warmupShaders()
+{
+    QElapsedTimer timer;
+    timer.start();
+    
+    // The instances are known once the scene file is read,
+    // even if their meshes are still loading
+    const vector<MeshInstance*>* instances = scene_->meshInstances();
+    int variants = sceneDepthPass_->warmup(instances);
+    variants += forwardPass_->warmup(instances);
+    variants += shadowMap_->warmupShaders();
+    variants += shadowMask_->warmupShaders();
+    variants += hiZBuffer_->warmupShaders();
+    
+    for(unsigned int i = 0; i < overlays_.size(); ++i)
+    {
+        overlays_[i]->warmupShader();
+    }
+    
+    printf("Warmed up %d shader variants in %lld ms (parallel compile %s, program cache %s) \n", variants, timer.elapsed(),
+           ShaderCache::parallelCompile() ? "on" : "off", ShaderCache::enabled() ? "on" : "off");
+}
+
 void RendererWidget::renderShadowMap()
 {
     // No shadow maps are needed for VoxelTree mode
@@ -259,16 +414,48 @@ void RendererWidget::renderShadowMap()
         return;
     }
     
+    // Fit the cascades to the surfaces visible in an earlier frame if they can be used,
+    // otherwise cover the whole view
+    const vector<Vector3>* visibleSurfaces = NULL;
+    if(settings_.fitCascadesToSurfaces && hiZBuffer_->getVisibleSurfaces(camera(), &visibleSurfaces_))
+    {
+        // The depth read back only has the static instances,
+        // so add the corners of the dynamic instances in view
+        for(unsigned int i = 0; i < visibleInstances_.size(); ++i)
+        {
+            if(visibleInstances_[i]->isStatic())
+            {
+                continue;
+            }
+            
+            Vector3 min = visibleInstances_[i]->bounds().min();
+            Vector3 max = visibleInstances_[i]->bounds().max();
+            for(int corner = 0; corner < 8; ++corner)
+            {
+                visibleSurfaces_.push_back(Vector3((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y,
+                                                   (corner & 4) ? max.z : min.z));
+            }
+        }
+        
+        visibleSurfaces = &visibleSurfaces_;
+    }
+    
     // Update shadow map position
-    shadowMap_->updatePosition(scene_->mainCamera());
+    shadowMap_->updatePosition(scene_->mainCamera(), visibleSurfaces);
     
     // Update the shadow uniform buffer
     shadowMap_->updateUniformBuffer();
     
-    // Render all cascades
-    bool renderStaticObjects = (shadowMask_->method() == SMM_ShadowMap);
-    bool renderDynamicObjects = true;
-    shadowMap_->renderCascades(renderStaticObjects, renderDynamicObjects);
+    // Render all cascades. Static objects are only needed in shadow map mode,
+    // where they are cached between frames.
+    if(shadowMask_->method() == SMM_ShadowMap)
+    {
+        shadowMap_->renderCachedCascades();
+    }
+    else
+    {
+        shadowMap_->renderCascades(false, true);
+    }
 }
 
 void RendererWidget::renderSceneDepth()
@@ -277,16 +464,33 @@ void RendererWidget::renderSceneDepth()
     scene_->mainCamera()->bind();
     
     // Write to the depth framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, sceneDepthFBO_);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, sceneDepthFBO_);
     
     // Write to the depth buffer only.
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glDepthMask(true);
-    glColorMask(false, false, false, false);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::depthFunc(GL_LESS);
+    GLState::depthMask(true);
+    GLState::colorMask(false, false, false, false);
+    
+    // Render the static instances first
+    sceneDepthPass_->submit(scene_->mainCamera(), &visibleInstances_, true, false);
+    
+    // Start reading back the static depth. Dynamic instances are left out,
+    // as they will have moved by the time it is used to cull static ones.
+    if(settings_.occlusionCulling || settings_.fitCascadesToSurfaces)
+    {
+        hiZBuffer_->update(sceneDepthTexture_, camera());
+        
+        scene_->mainCamera()->bind();
+        GLState::bindFramebuffer(GL_FRAMEBUFFER, sceneDepthFBO_);
+        GLState::colorMask(false, false, false, false);
+    }
     
-    // Render the scene depth map
-    sceneDepthPass_->submit(scene_->mainCamera(), scene_->meshInstances());
+    // Add the dynamic instances, without clearing the static depth
+    PassClearFlags clearFlags = sceneDepthPass_->clearFlags();
+    sceneDepthPass_->setClearFlags(0);
+    sceneDepthPass_->submit(scene_->mainCamera(), &visibleInstances_, false, true);
+    sceneDepthPass_->setClearFlags(clearFlags);
 }
 
 void RendererWidget::renderShadowMask()
@@ -307,14 +511,14 @@ void RendererWidget::renderForward()
     
     // Only render fragments that passed the earlier depth prepass.
     // Write to colour, but not depth.
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glDepthMask(true);
-    glColorMask(true, true, true, true);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::depthFunc(GL_LESS);
+    GLState::depthMask(true);
+    GLState::colorMask(true, true, true, true);
     
     // Use the main camera
     scene_->mainCamera()->bind();
         
     // Render the final image
-    forwardPass_->submit(scene_->mainCamera(), scene_->meshInstances());
+    forwardPass_->submit(scene_->mainCamera(), &visibleInstances_);
 }
@@ -3,6 +3,7 @@
 #define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
 #include <QGLWidget> // Links OpenGL Headers
 
+#include "RendererSettings.hpp"
 #include "RendererStats.hpp"
 #include "Scene.hpp"
 #include "RenderPass.hpp"
@@ -11,11 +12,12 @@
 #include "UniformManager.hpp"
 #include "Overlay.hpp"
 #include "VoxelTree.hpp"
+#include "HiZBuffer.hpp"
 
 class RendererWidget : public QGLWidget
 {
 public:
-    RendererWidget(const QGLFormat &format, int voxelResolution);
+    RendererWidget(const QGLFormat &format, const RendererSettings &settings);
     ~RendererWidget();
     
     Scene* scene() { return scene_; }
@@ -36,6 +38,9 @@ public:
     const ShadowMap* shadowMap() const { return shadowMap_; }
     const VoxelTree* voxelTree() const { return voxelTree_; }
     
+    // The current settings, starting with those given at startup
+    const RendererSettings &settings() const { return settings_; }
+    
     // Shader feature toggling
     void enableFeature(ShaderFeature feature);
     void disableFeature(ShaderFeature feature);
@@ -48,6 +53,17 @@ public:
     void setShadowMapResolution(int resolution);
     void setShadowMapCascades(int cascades);
     void setVoxelPCFFilterSize(int kernelSize);
+    void setStaggeredCascadeUpdates(bool enabled);
+    void setLayeredCascades(bool enabled);
+    void setFitCascadesToSurfaces(bool enabled);
+    void setSimplifiedCasters(bool enabled);
+    
+    // Toggles culling of instances hidden in earlier frames
+    void setOcclusionCulling(bool enabled);
+    
+    // Replaces the voxel tree with one of a different resolution.
+    // The new tree is built over the following frames.
+    void setTreeResolution(int resolution);
     
     // Forces the voxel tree to be completely built before
     // starting to render the scene. Used for profiling.
@@ -62,6 +78,7 @@ private:
     
     GLuint sceneDepthFBO_;
     Texture* sceneDepthTexture_;
+    HiZBuffer* hiZBuffer_;
     ShadowMap* shadowMap_;
     VoxelTree* voxelTree_;
     ShadowMask* shadowMask_;
@@ -69,10 +86,17 @@ private:
     RenderPass* sceneDepthPass_;
     RenderPass* forwardPass_;
     
+    // The instances inside the main camera frustum
+    vector<MeshInstance*> visibleInstances_;
+    
+    // Points on the static surfaces visible in an earlier frame,
+    // and the corners of the dynamic instances in view
+    vector<Vector3> visibleSurfaces_;
+    
     vector<Overlay*> overlays_;
     int currentOverlay_;
     
-    int voxelResolution_;
+    RendererSettings settings_;
 
     // QGLWidget override methods
     void initializeGL();
@@ -83,6 +107,11 @@ private:
     void createRenderPasses();
     void createScene();
     void createOverlays();
+    void createVoxelTree(int resolution);
+    void applySettings();
+    
+    // Compiles every shader variant the scene can use, so none are compiled while rendering
+    void warmupShaders();
     
     // Render passes
     void renderShadowMap();
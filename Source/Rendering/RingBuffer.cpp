@@ -0,0 +1,132 @@
+#include "RingBuffer.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <assert.h>
+
+RingBuffer::RingBuffer(GLenum target, int regionSize, int alignment, int padding)
+    : target_(target),
+    bufferID_(0),
+    regionSize_(regionSize),
+    alignment_(alignment),
+    map_(NULL),
+    currentRegion_(0),
+    currentOffset_(0)
+{
+    for(int i = 0; i < RegionCount; ++i)
+    {
+        fences_[i] = 0;
+    }
+    
+    int bufferSize = (regionSize_ * RegionCount) + padding;
+    
+    glGenBuffers(1, &bufferID_);
+    glBindBuffer(target_, bufferID_);
+    
+    // Use immutable storage that stays mapped if it is supported
+#if defined(GL_VERSION_4_4)
+    GLint majorVersion = 0;
+    GLint minorVersion = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+    
+    if(majorVersion > 4 || (majorVersion == 4 && minorVersion >= 4))
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target_, bufferSize, NULL, flags);
+        map_ = (GLubyte*)glMapBufferRange(target_, 0, bufferSize, flags);
+    }
+#endif
+    
+    // Otherwise each write maps the range it uses
+    if(map_ == NULL)
+    {
+        glBufferData(target_, bufferSize, NULL, GL_STREAM_DRAW);
+    }
+    
+    glBindBuffer(target_, 0);
+}
+
+RingBuffer::~RingBuffer()
+{
+    for(int i = 0; i < RegionCount; ++i)
+    {
+        if(fences_[i] != 0)
+        {
+            glDeleteSync(fences_[i]);
+        }
+    }
+    
+    if(map_ != NULL)
+    {
+        glBindBuffer(target_, bufferID_);
+        glUnmapBuffer(target_);
+        glBindBuffer(target_, 0);
+    }
+    
+    glDeleteBuffers(1, &bufferID_);
+}
+
+int RingBuffer::write(const void* data, int sizeBytes)
+{
+    assert(sizeBytes <= regionSize_);
+    
+    // Round up to the required alignment
+    int offset = ((currentOffset_ + alignment_ - 1) / alignment_) * alignment_;
+    if(offset + sizeBytes > regionSize_)
+    {
+        return -1;
+    }
+    
+    int bufferOffset = (currentRegion_ * regionSize_) + offset;
+    
+    if(map_ != NULL)
+    {
+        memcpy(map_ + bufferOffset, data, sizeBytes);
+    }
+    else
+    {
+        // The fences make sure the range is not in use,
+        // so the driver doesn't need to synchronize.
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+        glBindBuffer(target_, bufferID_);
+        GLvoid* map = glMapBufferRange(target_, bufferOffset, sizeBytes, flags);
+        memcpy(map, data, sizeBytes);
+        glUnmapBuffer(target_);
+    }
+    
+    currentOffset_ = offset + sizeBytes;
+    return bufferOffset;
+}
+
+void RingBuffer::nextRegion()
+{
+    // Mark the end of the commands using the current region
+    if(fences_[currentRegion_] != 0)
+    {
+        glDeleteSync(fences_[currentRegion_]);
+    }
+    fences_[currentRegion_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    
+    currentRegion_ = (currentRegion_ + 1) % RegionCount;
+    currentOffset_ = 0;
+    
+    // Wait for the GPU to finish with the next region
+    GLsync fence = fences_[currentRegion_];
+    if(fence != 0)
+    {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        while(result == GL_TIMEOUT_EXPIRED)
+        {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+        
+        if(result == GL_WAIT_FAILED)
+        {
+            printf("Failed to wait for ring buffer region \n");
+        }
+        
+        glDeleteSync(fence);
+        fences_[currentRegion_] = 0;
+    }
+}
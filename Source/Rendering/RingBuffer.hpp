@@ -0,0 +1,47 @@
+#pragma once
+
+#define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
+#include <QGLWidget> // Links OpenGL Headers
+
+// A GPU buffer split into regions that are written in turn.
+// Each region is fenced when it is finished with, and the CPU waits
+// for the fence before writing to it again, so writes never stall
+// on draw calls that are still reading earlier data.
+// The buffer is persistently mapped when OpenGL 4.4 is available.
+class RingBuffer
+{
+public:
+    // Every write is aligned to the given alignment. The padding is
+    // added after the last region, so ranges larger than the data
+    // written can be bound without going past the end of the buffer.
+    RingBuffer(GLenum target, int regionSize, int alignment, int padding = 0);
+    ~RingBuffer();
+    
+    GLuint id() const { return bufferID_; }
+    int currentRegion() const { return currentRegion_; }
+    bool isPersistent() const { return map_ != NULL; }
+    
+    // Copies the data to the current region, and returns its offset
+    // in the buffer. Returns -1 if there is not enough space left.
+    int write(const void* data, int sizeBytes);
+    
+    // Fences the current region and moves to the next one,
+    // waiting until the GPU has finished reading from it.
+    void nextRegion();
+
+private:
+    const static int RegionCount = 3;
+    
+    GLenum target_;
+    GLuint bufferID_;
+    int regionSize_;
+    int alignment_;
+    
+    // The persistently mapped buffer, or NULL when it is
+    // mapped for each write instead
+    GLubyte* map_;
+    
+    int currentRegion_;
+    int currentOffset_;
+    GLsync fences_[RegionCount];
+};
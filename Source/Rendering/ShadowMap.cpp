@@ -1,12 +1,30 @@
 #include "ShadowMap.hpp"
 
 #include <math.h>
+#include <cstdlib>
+#include <algorithm>
 #include <assert.h>
 
+#include "GLState.hpp"
+#include "HiZBuffer.hpp"
+
 ShadowMap::ShadowMap(const Scene* scene, UniformManager* uniformManager, int cascadesCount, int resolution)
     : scene_(scene),
     uniformManager_(uniformManager),
-    cascades_()
+    cascades_(),
+    shadowDistance_(150.0),
+    splitLinearWeight_(0.3),
+    staggeredUpdates_(false),
+    frameIndex_(0),
+    layeredRendering_(false),
+    simplifiedCasters_(true),
+    surfaceDistances_(),
+    surfaceBounds_(MaxCascades, Bounds(Vector3::zero(), Vector3::zero())),
+    staticCachesCreated_(false),
+    cacheLightDirection_(Vector3::zero()),
+    cacheSceneVersion_(-1),
+    depthCentre_(0.0),
+    depthExtent_(250.0)
 {
     assert(cascadesCount > 0 && cascadesCount <= 4);
     assert(resolution > 0);
@@ -18,6 +36,23 @@ ShadowMap::ShadowMap(const Scene* scene, UniformManager* uniformManager, int cas
     shadowCasterPass_->setSupportedFeatures(SF_Cutout);
     shadowCasterPass_->setClearFlags(GL_DEPTH_BUFFER_BIT);
     
+    // Create a pass for rendering all cascades at once.
+    // This needs viewport arrays, which were added in OpenGL 4.1.
+    layeredCasterPass_ = NULL;
+#if defined(GL_VERSION_4_1)
+    GLint majorVersion = 0;
+    GLint minorVersion = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+    
+    if(majorVersion > 4 || (majorVersion == 4 && minorVersion >= 1))
+    {
+        layeredCasterPass_ = new RenderPass("CascadeDepthPass", uniformManager_);
+        layeredCasterPass_->setSupportedFeatures(SF_Cutout);
+        layeredCasterPass_->setClearFlags(GL_NONE);
+    }
+#endif
+    
     // Create a depth texture for the shadow map with hardware bilinear PCF.
     texture_ = Texture::depth(resolution * cascadesCount, resolution);
     texture_->setCompareMode(GL_COMPARE_REF_TO_TEXTURE, GL_LEQUAL);
@@ -26,23 +61,35 @@ ShadowMap::ShadowMap(const Scene* scene, UniformManager* uniformManager, int cas
     
     // Create a framebuffer for the shadow map camera
     glGenFramebuffers(1, &framebuffer_);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture_->id(), 0);
 
+    // The static caches are only created if they are used
+    for(int i = 0; i < MaxCascades; ++i)
+    {
+        staticCaches_[i].textures[0] = NULL;
+        staticCaches_[i].textures[1] = NULL;
+    }
+    
     // Setup the correct cascade count and resolution
     setCascades(cascadesCount, resolution);
 }
 
 ShadowMap::~ShadowMap()
 {
+    // Delete the static caches
+    deleteStaticCaches();
+    
     // Delete the framebuffer
+    GLState::framebufferDeleted(framebuffer_);
     glDeleteFramebuffers(1, &framebuffer_);
     
     // Delete the shadow map texture
     delete texture_;
     
-    // Delete the render pass
+    // Delete the render passes
     delete shadowCasterPass_;
+    delete layeredCasterPass_;
 }
 
 void ShadowMap::setCascades(int cascadesCount, int resolution)
@@ -50,6 +97,9 @@ void ShadowMap::setCascades(int cascadesCount, int resolution)
     assert(cascadesCount > 0 && cascadesCount <= 4);
     assert(resolution > 0);
     
+    // The static caches are recreated at the new size when next used
+    deleteStaticCaches();
+    
     cascadesCount_ = cascadesCount;
     resolution_ = resolution;
     
@@ -57,13 +107,12 @@ void ShadowMap::setCascades(int cascadesCount, int resolution)
     // Place all cascade textures in a horizontal line
     texture_->setResolution(resolution_ * cascadesCount_, resolution_);
     
+    // Calculate the min and max distance of each cascade
+    setCascadeDistances(0.0, shadowDistance_);
+    
     // Set up each cascade
     for(int i = 0; i < cascadesCount_; ++i)
     {
-        // Calculate the min and max distance of the cascade
-        cascades_[i].minDistance = getCascadeMin(i, 150.0);
-        cascades_[i].maxDistance = getCascadeMax(i, 150.0);
-        
         // Adjust the camera viewport to match the texture atlas
         cascades_[i].camera.setPixelOffsetX(resolution_ * i);
         cascades_[i].camera.setPixelOffsetY(0);
@@ -80,6 +129,13 @@ void ShadowMap::setCascades(int cascadesCount, int resolution)
         
         // Use the framebuffer as the shadow camera render target
         cascades_[i].camera.setFramebuffer(framebuffer_);
+        
+        cascades_[i].texelX = 0;
+        cascades_[i].texelY = 0;
+        
+        // Render every cascade until they have been placed
+        cascades_[i].update = true;
+        cascades_[i].lastUpdateFrame = -1;
     }
     
     // Ensure unused cascades are not sampled
@@ -91,13 +147,29 @@ void ShadowMap::setCascades(int cascadesCount, int resolution)
     }
 }
 
-void ShadowMap::updatePosition(Camera* viewCamera)
+void ShadowMap::setCascadeSplits(float shadowDistance, float linearWeight)
 {
-    // Ensure each cascade is drawn from the correct direction
-    for(int i = 0; i < cascadesCount_; ++i)
-    {
-        cascades_[i].camera.setRotation(scene_->mainLight()->rotation());
-    }
+    assert(shadowDistance > 0.0);
+    assert(linearWeight >= 0.0 && linearWeight <= 1.0);
+    
+    shadowDistance_ = shadowDistance;
+    splitLinearWeight_ = linearWeight;
+    
+    // Recompute the cascade distances
+    setCascades(cascadesCount_, resolution_);
+}
+
+void ShadowMap::setStaggeredUpdates(bool enabled)
+{
+    staggeredUpdates_ = enabled;
+}
+
+void ShadowMap::updatePosition(Camera* viewCamera, const vector<Vector3>* visibleSurfaces)
+{
+    frameIndex_ ++;
+    
+    // The first cascade is always updated, so is always drawn from the light's direction
+    cascades_[0].camera.setRotation(scene_->mainLight()->rotation());
     
     // Get the world to light space transformation matrix (without translation)
     Matrix4x4 worldToLight = cascades_[0].camera.worldToLocal();
@@ -114,6 +186,28 @@ void ShadowMap::updatePosition(Camera* viewCamera)
     // Compute the view to light matrix
     Matrix4x4 viewToLight = worldToLight * viewCamera->localToWorld();
     
+    // Centre the cascades on the static scene along the light direction,
+    // rather than on the view, so the depth of a static caster doesn't change
+    // as the cascades move. At least the default 250 units are kept either side.
+    Bounds sceneBounds = scene_->staticBounds().transformed(worldToLight);
+    depthCentre_ = sceneBounds.centre().z;
+    depthExtent_ = max(sceneBounds.size().z / 2.0f + 1.0f, 250.0f);
+    
+    // Fit the cascades to the visible surfaces if there are any,
+    // otherwise cover the whole view up to the shadow distance.
+    bool fitToSurfaces = (visibleSurfaces != NULL) && fitToVisibleSurfaces(viewCamera, *visibleSurfaces, worldToLight);
+    if(!fitToSurfaces)
+    {
+        setCascadeDistances(0.0, shadowDistance_);
+    }
+    
+    // When staggered, the far cascades take turns to be updated
+    int scheduledCascade = 0;
+    if(cascadesCount_ > 1)
+    {
+        scheduledCascade = 1 + (frameIndex_ % (cascadesCount_ - 1));
+    }
+    
     // Set up each cascade camera size and centre
     for(int i = 0; i < cascadesCount_; ++i)
     {
@@ -126,16 +220,57 @@ void ShadowMap::updatePosition(Camera* viewCamera)
         // Compute in view space so the size doesn't change during camera rotation.
         Bounds viewSpaceBounds = Bounds::cover(corners, 8);
         Vector3 viewSpaceSize = viewSpaceBounds.size();
-        cascades_[i].camera.setOrthographicSize(viewSpaceSize.magnitude());
+        float size = viewSpaceSize.magnitude();
+        
+        // Find the area that must be covered in light space
+        viewToLight.transformPoints(corners, corners, 8);
+        Bounds region = Bounds::cover(corners, 8);
         
         // Calculate the shadow map centre in light space
         Vector4 viewSpaceCentre = Vector4(viewSpaceBounds.centre(), 1.0);
         Vector4 lightSpaceCentre = viewToLight * viewSpaceCentre;
         
+        // Cascades without surfaces in their range keep covering their frustum segment
+        if(fitToSurfaces && surfacesFound_[i])
+        {
+            // Cover only the surfaces inside the cascade. They were read back a
+            // frame or two ago, so a border of the camera movement allowed since
+            // then covers those that have come into view.
+            // A border is also kept for filtering, and the size is rounded up to
+            // a quarter power of two, so it stays the same over many frames and
+            // doesn't invalidate the static caches.
+            Vector3 padding(HiZBuffer::MaxCameraMovement, HiZBuffer::MaxCameraMovement, 0.0);
+            region = Bounds(surfaceBounds_[i].min() - padding, surfaceBounds_[i].max() + padding);
+            
+            Vector3 regionSize = region.size();
+            size = max(max(regionSize.x, regionSize.y) * 1.1f, 1.0f);
+            size = pow(2.0f, ceil(log2(size) * 4.0f) / 4.0f);
+            lightSpaceCentre = Vector4(region.centre(), 1.0);
+        }
+        
+        // Skip the cascade if it isn't scheduled and its
+        // previous position still covers the region
+        bool scheduled = !staggeredUpdates_ || i == 0 || i == scheduledCascade;
+        if(!scheduled && canSkipUpdate(i, region, size))
+        {
+            cascades_[i].update = false;
+            continue;
+        }
+        
+        cascades_[i].update = true;
+        cascades_[i].lastUpdateFrame = frameIndex_;
+        cascades_[i].camera.setRotation(scene_->mainLight()->rotation());
+        cascades_[i].camera.setOrthographicSize(size);
+        cascades_[i].camera.setNearPlane(-depthExtent_);
+        cascades_[i].camera.setFarPlane(depthExtent_);
+        
         // Snap the centre to the nearest texel in light space.
-        float texelSize = cascades_[i].camera.orthographicSize() / (float)resolution_;
-        lightSpaceCentre.x = roundf(lightSpaceCentre.x / texelSize) * texelSize;
-        lightSpaceCentre.y = roundf(lightSpaceCentre.y / texelSize) * texelSize;
+        float texelSize = size / (float)resolution_;
+        cascades_[i].texelX = (int)roundf(lightSpaceCentre.x / texelSize);
+        cascades_[i].texelY = (int)roundf(lightSpaceCentre.y / texelSize);
+        lightSpaceCentre.x = cascades_[i].texelX * texelSize;
+        lightSpaceCentre.y = cascades_[i].texelY * texelSize;
+        lightSpaceCentre.z = depthCentre_;
         
         // Compute the cascade centre in world space
         Vector4 centre = lightToWorld * lightSpaceCentre;
@@ -146,6 +281,105 @@ void ShadowMap::updatePosition(Camera* viewCamera)
     }
 }
 
+bool ShadowMap::fitToVisibleSurfaces(const Camera* viewCamera, const vector<Vector3> &surfaces, const Matrix4x4 &worldToLight)
+{
+    // Find the range of distances of the surfaces that can be shadowed.
+    // Distances are from the camera position, as used by the shader to pick cascades.
+    surfaceDistances_.resize(surfaces.size());
+    float minDistance = shadowDistance_;
+    float maxDistance = 0.0;
+    for(unsigned int i = 0; i < surfaces.size(); ++i)
+    {
+        float distance = (surfaces[i] - viewCamera->position()).magnitude();
+        surfaceDistances_[i] = distance;
+        
+        if(distance < shadowDistance_)
+        {
+            minDistance = min(minDistance, distance);
+            maxDistance = max(maxDistance, distance);
+        }
+    }
+    
+    if(maxDistance <= minDistance)
+    {
+        return false;
+    }
+    
+    // Split only the range that is visible, ending at the furthest surface.
+    // The range is padded by the camera movement allowed since the depth was
+    // rendered, for surfaces that have come into view since.
+    float padding = HiZBuffer::MaxCameraMovement;
+    setCascadeDistances(max(minDistance - padding, 0.0f), min(maxDistance + padding, shadowDistance_));
+    
+    // Sort the surfaces into the cascades that shadow them
+    for(int c = 0; c < cascadesCount_; ++c)
+    {
+        cascadeSurfaces_[c].clear();
+    }
+    
+    for(unsigned int i = 0; i < surfaces.size(); ++i)
+    {
+        float distance = surfaceDistances_[i];
+        if(distance > cascades_[cascadesCount_ - 1].maxDistance)
+        {
+            continue;
+        }
+        
+        // Cascades are sorted by distance, so use the last that starts before the surface
+        int c = cascadesCount_ - 1;
+        while(c > 0 && distance < cascades_[c].minDistance)
+        {
+            c --;
+        }
+        
+        cascadeSurfaces_[c].push_back(surfaces[i]);
+    }
+    
+    // Find the light space bounds of the surfaces in each cascade,
+    // transforming them together and keeping only their extent
+    for(int c = 0; c < cascadesCount_; ++c)
+    {
+        surfacesFound_[c] = !cascadeSurfaces_[c].empty();
+        if(surfacesFound_[c])
+        {
+            surfaceBounds_[c] = Bounds::cover(&cascadeSurfaces_[c][0], (int)cascadeSurfaces_[c].size(), worldToLight);
+        }
+    }
+    
+    return true;
+}
+
+bool ShadowMap::canSkipUpdate(int cascade, const Bounds &region, float size) const
+{
+    const ShadowCascade &shadowCascade = cascades_[cascade];
+    
+    // Cascades that have never been rendered, or were rendered
+    // with different settings, can't be reused
+    if(shadowCascade.lastUpdateFrame < 0
+       || shadowCascade.camera.orthographicSize() != size
+       || shadowCascade.camera.farPlane() != depthExtent_)
+    {
+        return false;
+    }
+    
+    // The light must not have turned
+    Vector3 lightDirection = scene_->mainLight()->forward().vec3();
+    if((shadowCascade.camera.forward().vec3() - lightDirection).magnitude() > 0.0)
+    {
+        return false;
+    }
+    
+    // The region must still be inside the cascade.
+    // A border of a few texels is kept for filtering.
+    float texelSize = size / (float)resolution_;
+    float halfSize = (size / 2.0) - (4.0 * texelSize);
+    float centreX = shadowCascade.texelX * texelSize;
+    float centreY = shadowCascade.texelY * texelSize;
+    
+    return region.min().x >= centreX - halfSize && region.max().x <= centreX + halfSize
+        && region.min().y >= centreY - halfSize && region.max().y <= centreY + halfSize;
+}
+
 void ShadowMap::setLightSpaceBounds(Bounds lightSpaceBounds)
 {
     // Only used for shadow maps with a single cascade
@@ -175,6 +409,7 @@ void ShadowMap::setLightSpaceBounds(Bounds lightSpaceBounds)
     // Set the near and far planes to cover the bounds
     cascades_[0].camera.setNearPlane(-size.z / 2.0);
     cascades_[0].camera.setFarPlane(size.z / 2.0);
+    cascades_[0].update = true;
 }
 
 void ShadowMap::updateUniformBuffer() const
@@ -190,45 +425,185 @@ void ShadowMap::updateUniformBuffer() const
         
         // Compute the world to shadow matrix
         shadowData.worldToShadow[i] = worldToShadowMatrix(i);
+        shadowData.cascadeViewProjection[i] = cascades_[i].camera.worldToCameraMatrix();
     }
     
     // Update the uniform block for all shaders
     uniformManager_->updateShadowBuffer(shadowData);
 }
 
+void ShadowMap::setStats(RendererStats* stats)
+{
+    shadowCasterPass_->setStats(stats);
+    
+    if(layeredCasterPass_ != NULL)
+    {
+        layeredCasterPass_->setStats(stats);
+    }
+}
+
+void ShadowMap::setLayeredRendering(bool enabled)
+{
+    layeredRendering_ = enabled;
+}
+
+void ShadowMap::setSimplifiedCasters(bool enabled)
+{
+    simplifiedCasters_ = enabled;
+}
+
+int ShadowMap::warmupShaders()
+{
+    int variants = shadowCasterPass_->warmup(scene_->meshInstances());
+    if(layeredCasterPass_ != NULL)
+    {
+        variants += layeredCasterPass_->warmup(scene_->meshInstances());
+    }
+    
+    return variants;
+}
+
 void ShadowMap::renderCascades(bool drawStatic, bool drawDynamic, bool depthBias)
 {
     // Enable depth biasing to prevent shadow acne
     if(depthBias)
     {
-        glPolygonOffset(2.5, 10.0);
-        glEnable(GL_POLYGON_OFFSET_FILL);
+        GLState::polygonOffset(2.5, 10.0);
+        GLState::enable(GL_POLYGON_OFFSET_FILL);
     }
     
     // Write to the depth buffer only.
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LESS);
-    glColorMask(false, false, false, false);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::depthMask(GL_TRUE);
+    GLState::depthFunc(GL_LESS);
+    GLState::colorMask(false, false, false, false);
     
-    // Render each shadow cascade
+    // Render each shadow cascade that needs updating
     for(int c = 0; c < cascadesCount_; ++c)
     {
+        if(!cascades_[c].update)
+        {
+            continue;
+        }
+        
         // Use the cascade camera
         cascades_[c].camera.bind();
         
-        // Only clear the shadow map if this is the first cascade being rendered
-        shadowCasterPass_->setClearFlags(c == 0 ? GL_DEPTH_BUFFER_BIT : GL_NONE);
+        // Only clear the cascade's part of the shadow map,
+        // so skipped cascades keep their contents
+        GLState::enable(GL_SCISSOR_TEST);
+        glScissor(resolution_ * c, 0, resolution_, resolution_);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        GLState::disable(GL_SCISSOR_TEST);
+        shadowCasterPass_->setClearFlags(GL_NONE);
+        
+        // Layered rendering draws all cascades once they are cleared
+        if(usesLayeredRendering())
+        {
+            continue;
+        }
+        
+        // Find the casters inside the cascade
+        Frustum frustum(cascades_[c].camera.worldToCameraMatrix());
+        scene_->cull(frustum, &visibleInstances_, drawStatic, drawDynamic);
         
         // Render the scene using the camera.
-        shadowCasterPass_->submit(&cascades_[c].camera, scene_->meshInstances(), drawStatic, drawDynamic);
+        setCasterLODTolerance(shadowCasterPass_, texelSize(c));
+        shadowCasterPass_->submit(&cascades_[c].camera, &visibleInstances_, drawStatic, drawDynamic);
+    }
+    
+    if(usesLayeredRendering())
+    {
+        renderLayered(drawStatic, drawDynamic);
+    }
+    
+    // Disable depth biasing
+    GLState::disable(GL_POLYGON_OFFSET_FILL);
+}
+
+void ShadowMap::renderCachedCascades(bool depthBias)
+{
+    if(!staticCachesCreated_)
+    {
+        createStaticCaches();
+    }
+    
+    // Everything is rerendered if the light or the static scene has changed
+    Vector3 lightDirection = scene_->mainLight()->forward().vec3();
+    if((lightDirection - cacheLightDirection_).magnitude() > 0.0
+       || scene_->staticVersion() != cacheSceneVersion_)
+    {
+        invalidateStaticCaches();
+        cacheLightDirection_ = lightDirection;
+        cacheSceneVersion_ = scene_->staticVersion();
+    }
+    
+    // Enable depth biasing to prevent shadow acne
+    if(depthBias)
+    {
+        GLState::polygonOffset(2.5, 10.0);
+        GLState::enable(GL_POLYGON_OFFSET_FILL);
+    }
+    
+    // Write to the depth buffer only.
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::depthMask(GL_TRUE);
+    GLState::depthFunc(GL_LESS);
+    GLState::colorMask(false, false, false, false);
+    
+    for(int c = 0; c < cascadesCount_; ++c)
+    {
+        // Skipped cascades keep their contents from an earlier frame
+        if(!cascades_[c].update)
+        {
+            continue;
+        }
+        
+        updateStaticCache(c);
+        
+        // Copy the static casters to the cascade's part of the atlas
+        const StaticCache &cache = staticCaches_[c];
+        GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, cache.framebuffers[cache.current]);
+        GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+        glBlitFramebuffer(0, 0, resolution_, resolution_,
+                          resolution_ * c, 0, resolution_ * (c + 1), resolution_,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        
+        // Draw the dynamic casters on top
+        if(usesLayeredRendering())
+        {
+            continue;
+        }
+        
+        cascades_[c].camera.bind();
+        shadowCasterPass_->setClearFlags(GL_NONE);
+        
+        Frustum frustum(cascades_[c].camera.worldToCameraMatrix());
+        scene_->cull(frustum, &visibleInstances_, false, true);
+        setCasterLODTolerance(shadowCasterPass_, texelSize(c));
+        shadowCasterPass_->submit(&cascades_[c].camera, &visibleInstances_, false, true);
+    }
+    
+    // Draw the dynamic casters of every cascade at once
+    if(usesLayeredRendering())
+    {
+        renderLayered(false, true);
     }
     
     // Disable depth biasing
-    glDisable(GL_POLYGON_OFFSET_FILL);
+    GLState::disable(GL_POLYGON_OFFSET_FILL);
 }
 
-float ShadowMap::getCascadeMin(int cascade, float farPlane) const
+void ShadowMap::setCascadeDistances(float nearDistance, float farDistance)
+{
+    for(int i = 0; i < cascadesCount_; ++i)
+    {
+        cascades_[i].minDistance = getCascadeMin(i, nearDistance, farDistance);
+        cascades_[i].maxDistance = getCascadeMax(i, nearDistance, farDistance);
+    }
+}
+
+float ShadowMap::getCascadeMin(int cascade, float nearPlane, float farPlane) const
 {
     // Ensure cascade 0 starts at distance 0
     if(cascade == 0)
@@ -243,22 +618,25 @@ float ShadowMap::getCascadeMin(int cascade, float farPlane) const
         return farPlane;
     }
     
-    // Compute the linear and logarithmic distances
-    float linearDistance = (farPlane / (float)cascadesCount_) * cascade;
-    float logarithmicDistance = pow(farPlane, (1.0 / (float)cascadesCount_) * cascade);
+    // Compute the linear and logarithmic distances.
+    // The logarithmic distances start from at least 1.
+    float fraction = (float)cascade / (float)cascadesCount_;
+    float linearDistance = nearPlane + ((farPlane - nearPlane) * fraction);
+    float logarithmicNear = max(nearPlane, 1.0f);
+    float logarithmicDistance = logarithmicNear * pow(max(farPlane / logarithmicNear, 1.0f), fraction);
     
     // Perform a weighted average of the 2 distances
-    const float linearWeight = 0.3;
+    const float linearWeight = splitLinearWeight_;
     const float logarithmicWeight = 1.0 - linearWeight;
     
     // Combine the 2 distances
     return (linearDistance * linearWeight) + (logarithmicDistance * logarithmicWeight);
 }
 
-float ShadowMap::getCascadeMax(int cascade, float farPlane) const
+float ShadowMap::getCascadeMax(int cascade, float nearPlane, float farPlane) const
 {
     // = min distance of next cascade
-    return getCascadeMin(cascade + 1, farPlane);
+    return getCascadeMin(cascade + 1, nearPlane, farPlane);
 }
 
 Matrix4x4 ShadowMap::worldToShadowMatrix(int cascade) const
@@ -278,3 +656,230 @@ Matrix4x4 ShadowMap::worldToShadowMatrix(int cascade) const
     // then to texture coordinates.
     return offsetMatrix * cascades_[cascade].camera.worldToCameraMatrix();
 }
+
+// Orders caster cascades by instance, so those for the same instance are together
+static bool compareCasterInstances(const pair<MeshInstance*, int> &a, const pair<MeshInstance*, int> &b)
+{
+    return less<MeshInstance*>()(a.first, b.first);
+}
+
+void ShadowMap::renderLayered(bool drawStatic, bool drawDynamic)
+{
+    // Find the cascades being updated that each caster is inside.
+    // A single level of detail is used for all of them, so it is picked
+    // for the smallest texels.
+    casterCascades_.clear();
+    float minTexelSize = -1.0;
+    for(int c = 0; c < cascadesCount_; ++c)
+    {
+        if(!cascades_[c].update)
+        {
+            continue;
+        }
+        
+        if(minTexelSize < 0.0 || texelSize(c) < minTexelSize)
+        {
+            minTexelSize = texelSize(c);
+        }
+        
+        Frustum frustum(cascades_[c].camera.worldToCameraMatrix());
+        scene_->cull(frustum, &visibleInstances_, drawStatic, drawDynamic);
+        for(unsigned int i = 0; i < visibleInstances_.size(); ++i)
+        {
+            casterCascades_.push_back(pair<MeshInstance*, int>(visibleInstances_[i], c));
+        }
+    }
+    
+    // Combine them into a single list of casters,
+    // with a bit set for each cascade the caster is inside
+    sort(casterCascades_.begin(), casterCascades_.end(), compareCasterInstances);
+    layeredInstances_.clear();
+    layeredMasks_.clear();
+    for(unsigned int i = 0; i < casterCascades_.size(); ++i)
+    {
+        if(layeredInstances_.empty() || layeredInstances_.back() != casterCascades_[i].first)
+        {
+            layeredInstances_.push_back(casterCascades_[i].first);
+            layeredMasks_.push_back(0);
+        }
+        
+        layeredMasks_.back() |= (1 << casterCascades_[i].second);
+    }
+    
+    // Give each cascade its own viewport in the atlas.
+    // The geometry shader picks the viewport for each triangle.
+#if defined(GL_VERSION_4_1)
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    for(int c = 0; c < cascadesCount_; ++c)
+    {
+        GLState::viewportIndexed(c, resolution_ * c, 0, resolution_, resolution_);
+    }
+#endif
+    
+    // The cascade matrices are read from the shadow uniform buffer,
+    // so the camera is only used for the camera uniform buffer
+    layeredCasterPass_->setClearFlags(GL_NONE);
+    setCasterLODTolerance(layeredCasterPass_, max(minTexelSize, 0.0f));
+    layeredCasterPass_->submit(&cascades_[0].camera, &layeredInstances_, drawStatic, drawDynamic, &layeredMasks_);
+}
+
+float ShadowMap::texelSize(int cascade) const
+{
+    // Cascades for tiles can be rectangular
+    const Camera &camera = cascades_[cascade].camera;
+    return max(camera.orthographicWidth(), camera.orthographicHeight()) / (float)resolution_;
+}
+
+void ShadowMap::setCasterLODTolerance(RenderPass* pass, float tolerance)
+{
+    pass->setLODTolerance(simplifiedCasters_ ? tolerance : 0.0f);
+}
+
+void ShadowMap::createStaticCaches()
+{
+    for(int c = 0; c < cascadesCount_; ++c)
+    {
+        StaticCache &cache = staticCaches_[c];
+        for(int i = 0; i < 2; ++i)
+        {
+            cache.textures[i] = Texture::depth(resolution_, resolution_);
+            
+            glGenFramebuffers(1, &cache.framebuffers[i]);
+            GLState::bindFramebuffer(GL_FRAMEBUFFER, cache.framebuffers[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, cache.textures[i]->id(), 0);
+        }
+        
+        cache.current = 0;
+        cache.valid = false;
+    }
+    
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
+    staticCachesCreated_ = true;
+}
+
+void ShadowMap::deleteStaticCaches()
+{
+    for(int c = 0; c < MaxCascades; ++c)
+    {
+        StaticCache &cache = staticCaches_[c];
+        for(int i = 0; i < 2; ++i)
+        {
+            if(cache.textures[i] != NULL)
+            {
+                GLState::framebufferDeleted(cache.framebuffers[i]);
+                glDeleteFramebuffers(1, &cache.framebuffers[i]);
+                delete cache.textures[i];
+                cache.textures[i] = NULL;
+            }
+        }
+    }
+    
+    staticCachesCreated_ = false;
+}
+
+void ShadowMap::invalidateStaticCaches()
+{
+    for(int c = 0; c < MaxCascades; ++c)
+    {
+        staticCaches_[c].valid = false;
+    }
+}
+
+void ShadowMap::updateStaticCache(int cascade)
+{
+    StaticCache &cache = staticCaches_[cascade];
+    const ShadowCascade &shadowCascade = cascades_[cascade];
+    float texelSize = shadowCascade.camera.orthographicSize() / (float)resolution_;
+    
+    // The number of texels the cascade has moved by
+    int moveX = shadowCascade.texelX - cache.texelX;
+    int moveY = shadowCascade.texelY - cache.texelY;
+    
+    // Rerender the whole cache if none of it can be reused
+    if(!cache.valid || cache.texelSize != texelSize
+       || abs(moveX) >= resolution_ || abs(moveY) >= resolution_)
+    {
+        renderStaticRegion(cascade, cache.framebuffers[cache.current], 0, 0, resolution_, resolution_);
+        
+        cache.valid = true;
+        cache.texelX = shadowCascade.texelX;
+        cache.texelY = shadowCascade.texelY;
+        cache.texelSize = texelSize;
+        return;
+    }
+    
+    if(moveX == 0 && moveY == 0)
+    {
+        return;
+    }
+    
+    // The contents move the opposite way to the cascade.
+    // Overlapping blits within a texture are undefined,
+    // so the part still covered is copied to the other texture.
+    int width = resolution_ - abs(moveX);
+    int height = resolution_ - abs(moveY);
+    int sourceX = max(moveX, 0);
+    int sourceY = max(moveY, 0);
+    int destX = max(-moveX, 0);
+    int destY = max(-moveY, 0);
+    
+    int next = 1 - cache.current;
+    GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, cache.framebuffers[cache.current]);
+    GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, cache.framebuffers[next]);
+    glBlitFramebuffer(sourceX, sourceY, sourceX + width, sourceY + height,
+                      destX, destY, destX + width, destY + height,
+                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    
+    // Render the columns and rows that have scrolled into the cascade.
+    // The columns cover the full height, so the rows skip them.
+    if(moveX != 0)
+    {
+        int columnX = (moveX > 0) ? width : 0;
+        renderStaticRegion(cascade, cache.framebuffers[next], columnX, 0, abs(moveX), resolution_);
+    }
+    
+    if(moveY != 0)
+    {
+        int rowY = (moveY > 0) ? height : 0;
+        renderStaticRegion(cascade, cache.framebuffers[next], destX, rowY, width, abs(moveY));
+    }
+    
+    cache.current = next;
+    cache.texelX = shadowCascade.texelX;
+    cache.texelY = shadowCascade.texelY;
+}
+
+void ShadowMap::renderStaticRegion(int cascade, GLuint framebuffer, int x, int y, int width, int height)
+{
+    Camera* camera = &cascades_[cascade].camera;
+    
+    // Render to the whole cache texture, but only change the region
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    GLState::viewport(0, 0, resolution_, resolution_);
+    GLState::enable(GL_SCISSOR_TEST);
+    glScissor(x, y, width, height);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    
+    // Find the casters inside the region using a crop matrix,
+    // which scales the region to fill the whole of clip space.
+    float left = ((float)x / resolution_) * 2.0 - 1.0;
+    float right = ((float)(x + width) / resolution_) * 2.0 - 1.0;
+    float bottom = ((float)y / resolution_) * 2.0 - 1.0;
+    float top = ((float)(y + height) / resolution_) * 2.0 - 1.0;
+    
+    Matrix4x4 crop = Matrix4x4::identity();
+    crop.set(0, 0, 2.0 / (right - left));
+    crop.set(0, 3, -(right + left) / (right - left));
+    crop.set(1, 1, 2.0 / (top - bottom));
+    crop.set(1, 3, -(top + bottom) / (top - bottom));
+    
+    Frustum frustum(crop * camera->worldToCameraMatrix());
+    scene_->cull(frustum, &visibleInstances_, true, false);
+    
+    // Render the static casters
+    shadowCasterPass_->setClearFlags(GL_NONE);
+    setCasterLODTolerance(shadowCasterPass_, texelSize(cascade));
+    shadowCasterPass_->submit(camera, &visibleInstances_, true, false);
+    
+    GLState::disable(GL_SCISSOR_TEST);
+}
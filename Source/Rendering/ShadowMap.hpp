@@ -10,6 +10,7 @@
 #include "Texture.hpp"
 #include "UniformManager.hpp"
 #include "Bounds.hpp"
+#include "Frustum.hpp"
 
 struct ShadowCascade
 {
@@ -19,6 +20,15 @@ struct ShadowCascade
     
     // Camera used to render the cascade
     Camera camera;
+    
+    // The texel the cascade is centred on in light space
+    int texelX;
+    int texelY;
+    
+    // Whether the cascade is rendered this frame. Skipped cascades
+    // keep their camera and contents from an earlier frame.
+    bool update;
+    int lastUpdateFrame;
 };
 
 class ShadowMap
@@ -45,8 +55,21 @@ public:
     // Sets the resolution of each cascade
     void setCascades(int cascadesCount, int resolution);
     
-    // Moves the shadow map to fit the current view
-    void updatePosition(Camera* viewCamera);
+    // Sets the view distance covered by the cascades and the weight
+    // of linear (vs logarithmic) split distances.
+    void setCascadeSplits(float shadowDistance, float linearWeight);
+    
+    // When enabled, the first cascade is updated every frame and the others
+    // take turns, so at most one far cascade is rendered per frame.
+    // Cascades that no longer cover the view are always updated.
+    void setStaggeredUpdates(bool enabled);
+    
+    // Moves the shadow map to fit the current view.
+    // If points on the visible surfaces are given, the cascade splits and
+    // bounds are fitted to them rather than to the whole view distance, and
+    // the last cascade ends at the furthest surface. Cascades with no surfaces
+    // in their range cover their segment of the view.
+    void updatePosition(Camera* viewCamera, const vector<Vector3>* visibleSurfaces = NULL);
     
     // Directly sets the shadow map bounds in light space.
     void setLightSpaceBounds(Bounds lightSpaceBounds);
@@ -54,9 +77,33 @@ public:
     // Updates the shadows uniform buffer
     void updateUniformBuffer() const;
     
-    // Rerenders all shadow map cascades
+    // Adds the draw calls of the shadow casters to the stats
+    void setStats(RendererStats* stats);
+    
+    // When enabled and supported, all cascades are rendered in a single pass,
+    // with a geometry shader sending each triangle to the viewport of each
+    // cascade its caster is inside. The cascade matrices are read from the
+    // shadow uniform buffer, so updateUniformBuffer must be called first.
+    void setLayeredRendering(bool enabled);
+    bool supportsLayeredRendering() const { return layeredCasterPass_ != NULL; }
+    
+    // When enabled, casters are drawn with simplified meshes whose surface
+    // moves by less than a texel of the cascade they are rendered into.
+    void setSimplifiedCasters(bool enabled);
+    
+    // Creates the caster shader variants for the scene ahead of time.
+    // Returns the number of new variants.
+    int warmupShaders();
+    
+    // Rerenders the shadow map cascades that are being updated
     void renderCascades(bool drawStatic = true, bool drawDynamic = true, bool depthBias = true);
     
+    // Renders all cascades, keeping the static casters between frames.
+    // Only the texels that scrolled into a cascade since the last frame are
+    // rerendered, then the dynamic casters are drawn on top.
+    // Requires updatePosition to be used to place the cascades.
+    void renderCachedCascades(bool depthBias = true);
+    
 private:
     const Scene* scene_;
     UniformManager* uniformManager_;
@@ -67,12 +114,104 @@ private:
     // Render pass for shadow cascades
     RenderPass* shadowCasterPass_;
     
+    // The casters inside the cascade being rendered
+    vector<MeshInstance*> visibleInstances_;
+    
+    // Render pass for all shadow cascades at once.
+    // NULL if viewport arrays are not supported.
+    RenderPass* layeredCasterPass_;
+    
+    // The casters inside any cascade, and a bit for each cascade they are in
+    vector<pair<MeshInstance*, int> > casterCascades_;
+    vector<MeshInstance*> layeredInstances_;
+    vector<GLuint> layeredMasks_;
+    
     int resolution_;
     int cascadesCount_;
     
+    // Cascade split settings
+    float shadowDistance_;
+    float splitLinearWeight_;
+    
+    // Update scheduling
+    bool staggeredUpdates_;
+    int frameIndex_;
+    
+    bool layeredRendering_;
+    bool simplifiedCasters_;
+    
+    // The visible surfaces inside each cascade, and their light space bounds,
+    // when fitting to them
+    vector<float> surfaceDistances_;
+    vector<Vector3> cascadeSurfaces_[MaxCascades];
+    vector<Bounds> surfaceBounds_;
+    bool surfacesFound_[MaxCascades];
+    
+    // The static casters of a cascade, kept between frames.
+    // The cache is scrolled by copying it to the other texture.
+    struct StaticCache
+    {
+        Texture* textures[2];
+        GLuint framebuffers[2];
+        int current;
+        
+        // The cascade position and size the cache was rendered at
+        bool valid;
+        int texelX;
+        int texelY;
+        float texelSize;
+    };
+    
+    // Created on first use
+    StaticCache staticCaches_[MaxCascades];
+    bool staticCachesCreated_;
+    
+    // The light and scene the caches were rendered with.
+    // Changing either of them invalidates every cache.
+    Vector3 cacheLightDirection_;
+    int cacheSceneVersion_;
+    
+    // The light space depth the cascades are centred on.
+    // Fixed for the scene so cached depths stay valid as the cascades move.
+    float depthCentre_;
+    float depthExtent_;
+    
+    // Splits the distances between the cascades
+    void setCascadeDistances(float nearDistance, float farDistance);
+    
     // Computes the start distance of a shadow cascade
-    float getCascadeMin(int cascade, float farPlane) const;
+    float getCascadeMin(int cascade, float nearPlane, float farPlane) const;
     
     // Computes the end distance of a shadow cascade
-    float getCascadeMax(int cascade, float farPlane) const;
+    float getCascadeMax(int cascade, float nearPlane, float farPlane) const;
+    
+    // Splits the cascades over the distances of the visible surfaces,
+    // and finds the light space bounds of those in each cascade.
+    // Returns false if no surfaces are within the shadow distance.
+    bool fitToVisibleSurfaces(const Camera* viewCamera, const vector<Vector3> &surfaces, const Matrix4x4 &worldToLight);
+    
+    // The world space size of a texel of a cascade
+    float texelSize(int cascade) const;
+    
+    // Sets how far simplified casters can move in the next submissions
+    void setCasterLODTolerance(RenderPass* pass, float tolerance);
+    
+    // Checks if a cascade can keep its previous position.
+    // The region that must be covered is given in light space.
+    bool canSkipUpdate(int cascade, const Bounds &region, float size) const;
+    
+    // Renders the casters of every cascade being updated in a single pass
+    bool usesLayeredRendering() const { return layeredRendering_ && layeredCasterPass_ != NULL; }
+    void renderLayered(bool drawStatic, bool drawDynamic);
+    
+    // Static cache management
+    void createStaticCaches();
+    void deleteStaticCaches();
+    void invalidateStaticCaches();
+    
+    // Brings the static cache of a cascade up to date with its position
+    void updateStaticCache(int cascade);
+    
+    // Renders the static casters inside a rectangle of a cascade's cache
+    void renderStaticRegion(int cascade, GLuint framebuffer, int x, int y, int width, int height);
 };
@@ -1,5 +1,6 @@
 #include "ShadowMask.hpp"
 
+#include "GLState.hpp"
 #include "UniformManager.hpp"
 
 ShadowMask::ShadowMask(UniformManager* uniformManager, ShadowMaskMethod method)
@@ -15,8 +16,7 @@ ShadowMask::ShadowMask(UniformManager* uniformManager, ShadowMaskMethod method)
     
     // Create a framebuffer for shadow mask rendering
     glGenFramebuffers(1, &frameBuffer_);
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_->id(), 0);
     
     // RenderPass for the ShadowMap method
@@ -31,6 +31,7 @@ ShadowMask::ShadowMask(UniformManager* uniformManager, ShadowMaskMethod method)
 ShadowMask::~ShadowMask()
 {
     // Delete the framebuffer
+    GLState::framebufferDeleted(frameBuffer_);
     glDeleteFramebuffers(1, &frameBuffer_);
     
     // Delete the texture
@@ -53,6 +54,11 @@ void ShadowMask::disableFeature(ShaderFeature feature)
     voxelTreePass_->disableFeature(feature);
 }
 
+int ShadowMask::warmupShaders()
+{
+    return shadowMapPass_->warmup() + voxelTreePass_->warmup();
+}
+
 void ShadowMask::setMethod(ShadowMaskMethod method)
 {
     method_ = method;
@@ -94,26 +100,25 @@ void ShadowMask::setVoxelTree(const VoxelTree* voxelTree)
 void ShadowMask::render()
 {
     // Bind the shadow mask framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
     
     // Dont depth test, and write to color only.
-    glDisable(GL_DEPTH_TEST);
-    glDepthMask(false);
-    glColorMask(true, true, true, true);
+    GLState::disable(GL_DEPTH_TEST);
+    GLState::depthMask(false);
+    GLState::colorMask(true, true, true, true);
     
     // Bind the input depth texture
     sceneDepthTexture_->bind(GL_TEXTURE0);
     
     // Draw in full screen
-    glViewport(0, 0, texture_->width(), texture_->height());
+    GLState::viewport(0, 0, texture_->width(), texture_->height());
     
     // Execute the voxel tree pass, unless we are
     // using the shadow map only.
     if(method_ != SMM_ShadowMap)
     {
         // Bind the input shadow tree
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_BUFFER, voxelTree_->treeBufferTexture());
+        GLState::bindTexture(GL_TEXTURE4, GL_TEXTURE_BUFFER, voxelTree_->treeBufferTexture());
         
         // Render using the voxel tree pass
         voxelTreePass_->renderFullScreen();
@@ -131,8 +136,8 @@ void ShadowMask::render()
         // with the earlier voxel tree sampling.
         if(method_ == SMM_Combined)
         {
-            glEnable(GL_BLEND);
-            glBlendEquation(GL_MIN);
+            GLState::enable(GL_BLEND);
+            GLState::blendEquation(GL_MIN, GL_MIN);
         }
         
         // Render using the shadow map pass
@@ -140,6 +145,6 @@ void ShadowMask::render()
         shadowMapPass_->renderFullScreen();
         
         // Disable blending
-        glDisable(GL_BLEND);
+        GLState::disable(GL_BLEND);
     }
 }
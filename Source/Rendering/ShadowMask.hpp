@@ -62,6 +62,10 @@ public:
     // Renders the shadow mask
     void render();
     
+    // Creates the shader variants of both methods ahead of time.
+    // Returns the number of new variants.
+    int warmupShaders();
+    
 private:
     ShadowMaskMethod method_;
     
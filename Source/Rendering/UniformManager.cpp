@@ -1,91 +1,133 @@
 #include "UniformManager.hpp"
 
+#include <cstring>
+#include <assert.h>
+
+// Leaves space for a mask per instance
+const int UniformManager::MaxInstancesPerDraw = UniformManager::InstanceRegionSize / (sizeof(Matrix4x4) + sizeof(GLuint));
+
 UniformManager::UniformManager()
 {
-    createBuffers();
+    // Blocks must start at a multiple of the offset alignment
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    ringBuffer_ = new RingBuffer(GL_UNIFORM_BUFFER, RegionSize, alignment);
+    
+    // Instance data is read as vertex attributes
+    instanceBuffer_ = new RingBuffer(GL_ARRAY_BUFFER, InstanceRegionSize, sizeof(Matrix4x4));
+    
+    for(int i = 0; i <= MaxBlockID; ++i)
+    {
+        blocks_[i].region = -1;
+    }
 }
 
 UniformManager::~UniformManager()
 {
-    glDeleteBuffers(1, &perObjectBlockID_);
-    glDeleteBuffers(1, &sceneBlockID_);
-    glDeleteBuffers(1, &cameraBlockID_);
-    glDeleteBuffers(1, &shadowBlockID_);
-    glDeleteBuffers(1, &voxelBlockID_);
+    delete ringBuffer_;
+    delete instanceBuffer_;
 }
 
-void UniformManager::updatePerObjectBuffer(const PerObjectUniformBuffer &buffer)
+int UniformManager::updateInstanceBuffer(const Matrix4x4* localToWorld, int instanceCount)
 {
-    glBindBuffer(GL_UNIFORM_BUFFER, perObjectBlockID_);
-    GLvoid* map = glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
-    memcpy(map, &buffer, sizeof(PerObjectUniformBuffer));
-    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    assert(instanceCount <= MaxInstancesPerDraw);
+    
+    // Instance data is only used by the next draw call,
+    // so nothing needs to be kept when moving to the next region
+    int sizeBytes = instanceCount * sizeof(Matrix4x4);
+    int offset = instanceBuffer_->write(localToWorld, sizeBytes);
+    if(offset == -1)
+    {
+        instanceBuffer_->nextRegion();
+        offset = instanceBuffer_->write(localToWorld, sizeBytes);
+    }
+    
+    return offset;
+}
+
+int UniformManager::updateInstanceBuffer(const Matrix4x4* localToWorld, const GLuint* masks, int instanceCount)
+{
+    assert(instanceCount <= MaxInstancesPerDraw);
+    
+    // Writes are aligned to the size of a matrix, so the masks
+    // always follow the transforms without a gap
+    int transformsSize = instanceCount * sizeof(Matrix4x4);
+    int masksSize = instanceCount * sizeof(GLuint);
+    int offset = instanceBuffer_->write(localToWorld, transformsSize);
+    int masksOffset = (offset == -1) ? -1 : instanceBuffer_->write(masks, masksSize);
+    
+    // Both must be in the same region, so write them again if either didn't fit
+    if(offset == -1 || masksOffset == -1)
+    {
+        instanceBuffer_->nextRegion();
+        offset = instanceBuffer_->write(localToWorld, transformsSize);
+        masksOffset = instanceBuffer_->write(masks, masksSize);
+    }
+    
+    assert(masksOffset == offset + transformsSize);
+    return offset;
 }
 
 void UniformManager::updateSceneBuffer(const SceneUniformBuffer &buffer)
 {
-    glBindBuffer(GL_UNIFORM_BUFFER, sceneBlockID_);
-    GLvoid* map = glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
-    memcpy(map, &buffer, sizeof(SceneUniformBuffer));
-    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    updateBlock(SceneUniformBuffer::BlockID, &buffer, sizeof(SceneUniformBuffer));
 }
 
 void UniformManager::updateCameraBuffer(const CameraUniformBuffer &buffer)
 {
-    glBindBuffer(GL_UNIFORM_BUFFER, cameraBlockID_);
-    GLvoid* map = glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
-    memcpy(map, &buffer, sizeof(CameraUniformBuffer));
-    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    updateBlock(CameraUniformBuffer::BlockID, &buffer, sizeof(CameraUniformBuffer));
 }
 
 void UniformManager::updateShadowBuffer(const ShadowUniformBuffer &buffer)
 {
-    glBindBuffer(GL_UNIFORM_BUFFER, shadowBlockID_);
-    GLvoid* map = glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
-    memcpy(map, &buffer, sizeof(ShadowUniformBuffer));
-    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    updateBlock(ShadowUniformBuffer::BlockID, &buffer, sizeof(ShadowUniformBuffer));
 }
 
 void UniformManager::updateVoxelBuffer(const void* data, int sizeBytes)
 {
-    glBindBuffer(GL_UNIFORM_BUFFER, voxelBlockID_);
-    GLvoid* map = glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
-    memcpy(map, data, sizeBytes);
-    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    updateBlock(VoxelsUniformBuffer::BlockID, data, sizeBytes);
 }
 
-void UniformManager::createBuffers()
+void UniformManager::frameFinished()
 {
-    // Per object buffer
-    glGenBuffers(1, &perObjectBlockID_);
-    glBindBuffer(GL_UNIFORM_BUFFER, perObjectBlockID_);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(PerObjectUniformBuffer), NULL, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, PerObjectUniformBuffer::BlockID, perObjectBlockID_);
-    
-    // Scene buffer
-    glGenBuffers(1, &sceneBlockID_);
-    glBindBuffer(GL_UNIFORM_BUFFER, sceneBlockID_);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(SceneUniformBuffer), NULL, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, SceneUniformBuffer::BlockID, sceneBlockID_);
+    nextRegion();
+    instanceBuffer_->nextRegion();
+}
+
+void UniformManager::updateBlock(int blockID, const void* data, int sizeBytes)
+{
+    UniformBlock &block = blocks_[blockID];
     
-    // Camera buffer
-    glGenBuffers(1, &cameraBlockID_);
-    glBindBuffer(GL_UNIFORM_BUFFER, cameraBlockID_);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniformBuffer), NULL, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, CameraUniformBuffer::BlockID, cameraBlockID_);
+    // Move to the next region when the current one is full
+    int offset = ringBuffer_->write(data, sizeBytes);
+    if(offset == -1)
+    {
+        nextRegion();
+        offset = ringBuffer_->write(data, sizeBytes);
+    }
     
-    // Shadow buffer
-    glGenBuffers(1, &shadowBlockID_);
-    glBindBuffer(GL_UNIFORM_BUFFER, shadowBlockID_);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowUniformBuffer), NULL, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, ShadowUniformBuffer::BlockID, shadowBlockID_);
+    // Point the shaders at the new data
+    glBindBufferRange(GL_UNIFORM_BUFFER, blockID, ringBuffer_->id(), offset, sizeBytes);
+    block.region = ringBuffer_->currentRegion();
     
-    // Voxel buffer
-    glGenBuffers(1, &voxelBlockID_);
-    glBindBuffer(GL_UNIFORM_BUFFER, voxelBlockID_);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(VoxelsUniformBuffer), NULL, GL_STATIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, VoxelsUniformBuffer::BlockID, voxelBlockID_);
+    const GLubyte* bytes = (const GLubyte*)data;
+    block.data.assign(bytes, bytes + sizeBytes);
+}
+
+void UniformManager::nextRegion()
+{
+    ringBuffer_->nextRegion();
     
-    // Unbind
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // Blocks in the new region are about to be overwritten,
+    // so write them again using the saved copy
+    int region = ringBuffer_->currentRegion();
+    for(int i = 0; i <= MaxBlockID; ++i)
+    {
+        UniformBlock &block = blocks_[i];
+        if(block.region == region)
+        {
+            vector<GLubyte> data = block.data;
+            updateBlock(i, &data[0], (int)data.size());
+        }
+    }
 }
@@ -3,18 +3,13 @@
 #define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
 #include <QGLWidget> // Links OpenGL Headers
 
-#include "Matrix4x4.hpp"
-#include "Vector4.hpp"
+#include <vector>
 
+using namespace std;
 
-// Uniform buffer for per-object data
-struct PerObjectUniformBuffer
-{
-    static const int BlockID = 0;
-    
-    // Up to 256 values to allow instancing
-    Matrix4x4 localToWorld[256];
-};
+#include "Matrix4x4.hpp"
+#include "Vector4.hpp"
+#include "RingBuffer.hpp"
 
 
 // Uniform buffer for global scene data
@@ -47,6 +42,9 @@ struct ShadowUniformBuffer
     
     float cascadeDistancesSqr[4];
     Matrix4x4 worldToShadow[4];
+    
+    // Used to render all cascades in a single pass
+    Matrix4x4 cascadeViewProjection[4];
 };
 
 // Uniform buffer for voxelized shadows
@@ -57,7 +55,8 @@ struct VoxelsUniformBuffer
     Matrix4x4 worldToVoxels;
     
     uint32_t voxelTreeHeight;
-    uint32_t tileSubdivisions;
+    uint32_t tileCountX;
+    uint32_t tileCountY;
     
     // The total number of voxels used in the PCF kernel
     uint32_t pcfSampleCount;
@@ -65,6 +64,9 @@ struct VoxelsUniformBuffer
     // The number of leaf nodes visited for each PCF kernel.
     uint32_t pcfLookups;
     
+    // std140 aligns the array below to 16 bytes
+    uint32_t unused[3];
+    
     struct PCFOffset
     {
         uint32_t xOffset;
@@ -78,24 +80,58 @@ struct VoxelsUniformBuffer
     PCFOffset pcfOffsets[64*9];
 };
 
+// Writes uniform blocks and per-instance data to ring buffers.
+// Every update is written to a new range of the buffer, so updates
+// never need to wait for earlier draw calls to finish.
 class UniformManager
 {
 public:
     UniformManager();
     ~UniformManager();
     
-    void updatePerObjectBuffer(const PerObjectUniformBuffer &buffer);
+    // The most instances that can be drawn with a single draw call
+    const static int MaxInstancesPerDraw;
+    
+    // Writes the instance transforms for a draw call, and returns
+    // their offset in the instance buffer.
+    // Read by the shaders as per-instance vertex attributes.
+    int updateInstanceBuffer(const Matrix4x4* localToWorld, int instanceCount);
+    
+    // Writes the instance transforms followed by a mask for each instance.
+    // The masks start directly after the last transform.
+    int updateInstanceBuffer(const Matrix4x4* localToWorld, const GLuint* masks, int instanceCount);
+    GLuint instanceBufferID() const { return instanceBuffer_->id(); }
+    
     void updateSceneBuffer(const SceneUniformBuffer &buffer);
     void updateCameraBuffer(const CameraUniformBuffer &buffer);
     void updateShadowBuffer(const ShadowUniformBuffer &buffer);
     void updateVoxelBuffer(const void* data, int sizeBytes);
     
+    // Called by RendererWidget at the end of each frame.
+    // Moves the following updates to the next region of the ring buffers.
+    void frameFinished();
+
 private:
-    GLuint perObjectBlockID_;
-    GLuint sceneBlockID_;
-    GLuint cameraBlockID_;
-    GLuint shadowBlockID_;
-    GLuint voxelBlockID_;
+    // Enough space for all the updates in a frame
+    const static int RegionSize = 256 * 1024;
+    const static int InstanceRegionSize = 4 * 1024 * 1024;
+    
+    const static int MaxBlockID = 4;
+    
+    // The last update of a block
+    struct UniformBlock
+    {
+        // A copy of the data, used to write the block again
+        // when the ring buffer region it is in is reused.
+        vector<GLubyte> data;
+        
+        int region;
+    };
+    
+    RingBuffer* ringBuffer_;
+    RingBuffer* instanceBuffer_;
+    UniformBlock blocks_[MaxBlockID + 1];
     
-    void createBuffers();
+    void updateBlock(int blockID, const void* data, int sizeBytes);
+    void nextRegion();
 };
@@ -0,0 +1,214 @@
+#include "AnimationSystem.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Wraps a rotation to within 360 degrees, keeping its sign like fmodf.
+// Truncating through an int rather than calling fmodf lets the loops below
+// use the same steps on 4 animations at a time.
+static inline float wrapRotation(float rotation)
+{
+    return rotation - (360.0f * (float)(int)(rotation / 360.0f));
+}
+
+void AnimationSystem::Vector3Array::push_back(const Vector3 &value)
+{
+    x.push_back(value.x);
+    y.push_back(value.y);
+    z.push_back(value.z);
+}
+
+AnimationSystem::AnimationSystem()
+    : workers_(NULL)
+{
+
+}
+
+AnimationSystem::~AnimationSystem()
+{
+    delete workers_;
+}
+
+void AnimationSystem::add(MeshInstance* meshInstance, float startTime, float resetInterval, Vector3 rotationSpeed, Vector3 translationSpeed)
+{
+    // Animated mesh instances are made non-static
+    meshInstance->makeNonStatic();
+    instances_.push_back(meshInstance);
+    
+    startTimes_.push_back(startTime);
+    initialStartTimes_.push_back(startTime);
+    resetIntervals_.push_back(resetInterval);
+    nextResetTimes_.push_back(resetInterval);
+    
+    rotationSpeeds_.push_back(rotationSpeed);
+    rotations_.push_back(Vector3::zero());
+    
+    // Get the axis in world space
+    xAxes_.push_back(meshInstance->right().vec3());
+    yAxes_.push_back(meshInstance->up().vec3());
+    zAxes_.push_back(meshInstance->forward().vec3());
+    originalRotations_.push_back(meshInstance->rotation());
+    
+    translationSpeeds_.push_back(translationSpeed);
+    positions_.push_back(meshInstance->position());
+    originalPositions_.push_back(meshInstance->position());
+    
+    started_.push_back(0);
+}
+
+void AnimationSystem::update(float deltaTime)
+{
+    int animationsCount = count();
+    
+    // Advance the timers, and find the animations that have started
+    int first = 0;
+#if defined(__SSE2__)
+    __m128 zero = _mm_setzero_ps();
+    __m128 delta = _mm_set1_ps(deltaTime);
+    for(; first + 4 <= animationsCount; first += 4)
+    {
+        __m128 startTime = _mm_sub_ps(_mm_loadu_ps(&startTimes_[first]), delta);
+        _mm_storeu_ps(&startTimes_[first], startTime);
+        
+        int startedMask = _mm_movemask_ps(_mm_cmple_ps(startTime, zero));
+        for(int j = 0; j < 4; ++j)
+        {
+            started_[first + j] = (startedMask >> j) & 1;
+        }
+    }
+#endif
+    for(int i = first; i < animationsCount; ++i)
+    {
+        startTimes_[i] -= deltaTime;
+        started_[i] = startTimes_[i] <= 0.0;
+    }
+    
+    // Return the started animations that are due a reset to their original state
+    for(int i = 0; i < animationsCount; ++i)
+    {
+        if(!started_[i])
+        {
+            continue;
+        }
+        
+        nextResetTimes_[i] -= deltaTime;
+        if(resetIntervals_[i] > 0.0 && nextResetTimes_[i] < 0.0)
+        {
+            rotations_.x[i] = 0.0;
+            rotations_.y[i] = 0.0;
+            rotations_.z[i] = 0.0;
+            positions_.x[i] = originalPositions_.x[i];
+            positions_.y[i] = originalPositions_.y[i];
+            positions_.z[i] = originalPositions_.z[i];
+            nextResetTimes_[i] = resetIntervals_[i];
+        }
+    }
+    
+    // Add the new rotation, wrapping around at 360 degrees, and the new translation.
+    // Animations that have not started move by 0.
+    first = 0;
+#if defined(__SSE2__)
+    __m128 fullTurn = _mm_set1_ps(360.0f);
+    float* rotations[3] = { rotations_.x.data(), rotations_.y.data(), rotations_.z.data() };
+    const float* rotationSpeeds[3] = { rotationSpeeds_.x.data(), rotationSpeeds_.y.data(), rotationSpeeds_.z.data() };
+    float* positions[3] = { positions_.x.data(), positions_.y.data(), positions_.z.data() };
+    const float* translationSpeeds[3] = { translationSpeeds_.x.data(), translationSpeeds_.y.data(), translationSpeeds_.z.data() };
+    for(; first + 4 <= animationsCount; first += 4)
+    {
+        // The started flags match the timers updated above
+        __m128 time = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&startTimes_[first]), zero), delta);
+        
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            __m128 rotation = _mm_add_ps(_mm_loadu_ps(&rotations[axis][first]),
+                                         _mm_mul_ps(_mm_loadu_ps(&rotationSpeeds[axis][first]), time));
+            __m128 turns = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(rotation, fullTurn)));
+            _mm_storeu_ps(&rotations[axis][first], _mm_sub_ps(rotation, _mm_mul_ps(turns, fullTurn)));
+            
+            __m128 position = _mm_add_ps(_mm_loadu_ps(&positions[axis][first]),
+                                         _mm_mul_ps(_mm_loadu_ps(&translationSpeeds[axis][first]), time));
+            _mm_storeu_ps(&positions[axis][first], position);
+        }
+    }
+#endif
+    for(int i = first; i < animationsCount; ++i)
+    {
+        float time = started_[i] ? deltaTime : 0.0f;
+        rotations_.x[i] = wrapRotation(rotations_.x[i] + (rotationSpeeds_.x[i] * time));
+        rotations_.y[i] = wrapRotation(rotations_.y[i] + (rotationSpeeds_.y[i] * time));
+        rotations_.z[i] = wrapRotation(rotations_.z[i] + (rotationSpeeds_.z[i] * time));
+        positions_.x[i] += translationSpeeds_.x[i] * time;
+        positions_.y[i] += translationSpeeds_.y[i] * time;
+        positions_.z[i] += translationSpeeds_.z[i] * time;
+    }
+    
+    // Update the instances, in a batch per thread when there are many
+    if(animationsCount < ParallelThreshold)
+    {
+        applyTransforms(0, animationsCount);
+        return;
+    }
+    
+    if(workers_ == NULL)
+    {
+        workers_ = new WorkerPool();
+    }
+    
+    int batchSize = (animationsCount + workers_->threadCount() - 1) / workers_->threadCount();
+    for(int begin = 0; begin < animationsCount; begin += batchSize)
+    {
+        int end = min(begin + batchSize, animationsCount);
+        workers_->run([this, begin, end]() { applyTransforms(begin, end); });
+    }
+    
+    workers_->wait();
+}
+
+void AnimationSystem::reset()
+{
+    for(int i = 0; i < count(); ++i)
+    {
+        // Restart the timers
+        startTimes_[i] = initialStartTimes_[i];
+        nextResetTimes_[i] = resetIntervals_[i];
+        started_[i] = 0;
+        
+        // Move the mesh instance back to where it was loaded
+        rotations_.x[i] = 0.0;
+        rotations_.y[i] = 0.0;
+        rotations_.z[i] = 0.0;
+        positions_.x[i] = originalPositions_.x[i];
+        positions_.y[i] = originalPositions_.y[i];
+        positions_.z[i] = originalPositions_.z[i];
+        instances_[i]->setTransform(originalPositions_.get(i), originalRotations_[i]);
+    }
+}
+
+void AnimationSystem::applyTransforms(int begin, int end)
+{
+    for(int i = begin; i < end; ++i)
+    {
+        if(!started_[i])
+        {
+            continue;
+        }
+        
+        // Rotate around each axis in turn, starting from the original rotation
+        Quaternion rotationX = Quaternion::rotation(rotations_.x[i], xAxes_.get(i));
+        Quaternion rotationY = Quaternion::rotation(rotations_.y[i], yAxes_.get(i));
+        Quaternion rotationZ = Quaternion::rotation(rotations_.z[i], zAxes_.get(i));
+        Quaternion rotation = rotationZ * (rotationY * (rotationX * originalRotations_[i]));
+        
+        MeshInstance* instance = instances_[i];
+        instance->setTransform(positions_.get(i), rotation);
+        
+        // Compute the matrices and bounds here, rather than when the
+        // instance is first culled or drawn on the render thread
+        instance->localToWorld();
+        instance->bounds();
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+
+using namespace std;
+
+#include "Vector3.hpp"
+#include "Quaternion.hpp"
+#include "MeshInstance.hpp"
+#include "WorkerPool.hpp"
+
+// Rotates and moves every animated mesh instance.
+// The animation state is stored as a structure of arrays, so each step of
+// the update is a single loop over contiguous values rather than a call per
+// object. The instance transforms, matrices and bounds are then updated in
+// one batch, split over worker threads when there are many instances.
+class AnimationSystem
+{
+public:
+    // Batches with at least this many instances are updated on worker threads
+    const static int ParallelThreshold = 2048;
+    
+    AnimationSystem();
+    ~AnimationSystem();
+    
+    // The number of animated instances
+    int count() const { return (int)instances_.size(); }
+    
+    // Animates the instance, making it non static.
+    // Rotation speeds are in local space degrees per second around each axis,
+    // and the translation speed is in world space units per second.
+    // The instance returns to its current transform every reset interval, if set.
+    void add(MeshInstance* meshInstance, float startTime, float resetInterval, Vector3 rotationSpeed, Vector3 translationSpeed);
+    
+    // Applies the animations for the given delta time
+    void update(float deltaTime);
+    
+    // Returns the mesh instances and timers to their initial state
+    void reset();
+
+private:
+    // A Vector3 per animation, stored as an array per component
+    struct Vector3Array
+    {
+        vector<float> x;
+        vector<float> y;
+        vector<float> z;
+        
+        void push_back(const Vector3 &value);
+        Vector3 get(int index) const { return Vector3(x[index], y[index], z[index]); }
+    };
+    
+    // The animation targets
+    vector<MeshInstance*> instances_;
+    
+    // The time until each animation starts, and its initial value
+    vector<float> startTimes_;
+    vector<float> initialStartTimes_;
+    
+    // The time between each reset, and until the next one
+    vector<float> resetIntervals_;
+    vector<float> nextResetTimes_;
+    
+    // The rotation rates in degrees per second, and the rotation so far
+    Vector3Array rotationSpeeds_;
+    Vector3Array rotations_;
+    
+    // The world space axes to rotate around, and the original rotation
+    Vector3Array xAxes_;
+    Vector3Array yAxes_;
+    Vector3Array zAxes_;
+    vector<Quaternion> originalRotations_;
+    
+    // The translation rates, current and original positions
+    Vector3Array translationSpeeds_;
+    Vector3Array positions_;
+    Vector3Array originalPositions_;
+    
+    // Non zero for the animations that have started, set by each update
+    vector<unsigned char> started_;
+    
+    // Created once there are enough instances to update in parallel
+    WorkerPool* workers_;
+    
+    // Sets the transforms of the started instances in the range,
+    // and brings their matrices and bounds up to date
+    void applyTransforms(int begin, int end);
+};
@@ -0,0 +1,146 @@
+#include "BoundingVolumeHierarchy.hpp"
+
+#include <algorithm>
+
+// Orders instances by the centre of their bounds along one axis
+struct CompareCentres
+{
+    int axis;
+    
+    bool operator () (const MeshInstance* a, const MeshInstance* b) const
+    {
+        return component(a->bounds().centre()) < component(b->bounds().centre());
+    }
+    
+    float component(const Vector3 &v) const
+    {
+        return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z);
+    }
+};
+
+BoundingVolumeHierarchy::Node::Node(const Bounds &bounds, int first, int count)
+    : bounds(bounds),
+    first(first),
+    count(count),
+    left(-1),
+    right(-1)
+{
+
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+    : nodes_(),
+    instances_()
+{
+
+}
+
+void BoundingVolumeHierarchy::build(const vector<MeshInstance*> &instances)
+{
+    nodes_.clear();
+    instances_ = instances;
+    
+    if(!instances_.empty())
+    {
+        buildNode(0, (int)instances_.size());
+    }
+}
+
+void BoundingVolumeHierarchy::cull(const Frustum &frustum, vector<MeshInstance*>* visible) const
+{
+    if(!nodes_.empty())
+    {
+        cullNode(0, frustum, visible);
+    }
+}
+
+Bounds BoundingVolumeHierarchy::bounds() const
+{
+    if(nodes_.empty())
+    {
+        return Bounds(Vector3::zero(), Vector3::zero());
+    }
+    
+    // The root node covers everything
+    return nodes_[0].bounds;
+}
+
+int BoundingVolumeHierarchy::buildNode(int first, int count)
+{
+    // Cover all the instances in the range
+    Bounds bounds = instances_[first]->bounds();
+    Bounds centreBounds(bounds.centre(), bounds.centre());
+    for(int i = first + 1; i < first + count; ++i)
+    {
+        bounds.expandToCover(instances_[i]->bounds());
+        centreBounds.expandToCover(instances_[i]->bounds().centre());
+    }
+    
+    int index = (int)nodes_.size();
+    nodes_.push_back(Node(bounds, first, count));
+    
+    if(count <= MaxLeafSize)
+    {
+        return index;
+    }
+    
+    // Split at the median centre along the axis the centres are most spread out on
+    Vector3 spread = centreBounds.size();
+    CompareCentres compare;
+    compare.axis = 0;
+    if(spread.y > spread.x && spread.y >= spread.z)
+    {
+        compare.axis = 1;
+    }
+    else if(spread.z > spread.x && spread.z > spread.y)
+    {
+        compare.axis = 2;
+    }
+    
+    int half = count / 2;
+    vector<MeshInstance*>::iterator start = instances_.begin() + first;
+    nth_element(start, start + half, start + count, compare);
+    
+    // Children are added after this node, so the index must be used
+    // rather than a reference
+    int left = buildNode(first, half);
+    int right = buildNode(first + half, count - half);
+    nodes_[index].left = left;
+    nodes_[index].right = right;
+    
+    return index;
+}
+
+void BoundingVolumeHierarchy::cullNode(int index, const Frustum &frustum, vector<MeshInstance*>* visible) const
+{
+    const Node &node = nodes_[index];
+    
+    FrustumTest result = frustum.test(node.bounds);
+    if(result == FT_Outside)
+    {
+        return;
+    }
+    
+    // Everything below is visible, so no more tests are needed
+    if(result == FT_Inside)
+    {
+        visible->insert(visible->end(), instances_.begin() + node.first, instances_.begin() + node.first + node.count);
+        return;
+    }
+    
+    // Test each instance in partially visible leaves
+    if(node.left == -1)
+    {
+        for(int i = node.first; i < node.first + node.count; ++i)
+        {
+            if(frustum.intersects(instances_[i]->bounds()))
+            {
+                visible->push_back(instances_[i]);
+            }
+        }
+        return;
+    }
+    
+    cullNode(node.left, frustum, visible);
+    cullNode(node.right, frustum, visible);
+}
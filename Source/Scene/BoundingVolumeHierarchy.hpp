@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+using namespace std;
+
+#include "Bounds.hpp"
+#include "Frustum.hpp"
+#include "MeshInstance.hpp"
+
+// A binary tree of bounding boxes over a set of mesh instances.
+// Used to cull static instances without testing each one.
+class BoundingVolumeHierarchy
+{
+public:
+    BoundingVolumeHierarchy();
+    
+    // Builds the tree over the instances.
+    // Their bounds must not change until the tree is rebuilt.
+    void build(const vector<MeshInstance*> &instances);
+    
+    // Adds the instances with bounds inside the frustum to the list
+    void cull(const Frustum &frustum, vector<MeshInstance*>* visible) const;
+    
+    // Covers every instance in the tree. Zero sized when empty.
+    Bounds bounds() const;
+
+private:
+    // Nodes with fewer instances are not split
+    const static int MaxLeafSize = 4;
+    
+    struct Node
+    {
+        Node(const Bounds &bounds, int first, int count);
+        
+        // Covers every instance below the node
+        Bounds bounds;
+        
+        // The instances below the node are stored contiguously
+        int first;
+        int count;
+        
+        // Child node indices, -1 for leaf nodes
+        int left;
+        int right;
+    };
+    
+    vector<Node> nodes_;
+    
+    // The instances, ordered so each node covers a continuous range
+    vector<MeshInstance*> instances_;
+    
+    // Creates the node covering the range, and its children.
+    // Returns the index of the node.
+    int buildNode(int first, int count);
+    
+    void cullNode(int index, const Frustum &frustum, vector<MeshInstance*>* visible) const;
+};
@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <math.h>
 
+#include "GLState.hpp"
+
 Camera::Camera()
     : framebuffer_(0),
     type_(CameraType::Perspective),
@@ -58,10 +60,10 @@ void Camera::getFrustumCorners(float distance, Vector4* corners) const
 void Camera::bind()
 {
     // Bind the correct framebuffer
-   glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
-   
-   // Update the viewport to match the camera width/height
-   glViewport(pixelOffsetX_, pixelOffsetY_, pixelWidth_, pixelHeight_);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    
+    // Update the viewport to match the camera width/height
+    GLState::viewport(pixelOffsetX_, pixelOffsetY_, pixelWidth_, pixelHeight_);
 }
 
 void Camera::setFramebuffer(GLuint framebuffer)
@@ -0,0 +1,168 @@
+#include "CameraPath.hpp"
+
+#include <fstream>
+#include <cstdio>
+#include <assert.h>
+
+CameraPath::CameraPath()
+    : keyframes_()
+{
+
+}
+
+float CameraPath::duration() const
+{
+    if(keyframes_.empty())
+    {
+        return 0.0;
+    }
+
+    return keyframes_.back().time;
+}
+
+void CameraPath::addKeyframe(float time, const Vector3 &position, const Quaternion &rotation)
+{
+    assert(keyframes_.empty() || time > keyframes_.back().time);
+
+    CameraKeyframe keyframe;
+    keyframe.time = time;
+    keyframe.position = position;
+    keyframe.rotation = rotation;
+    keyframes_.push_back(keyframe);
+}
+
+void CameraPath::apply(float time, Camera* camera) const
+{
+    if(keyframes_.empty())
+    {
+        return;
+    }
+
+    // Find the 4 control points around the segment.
+    // The end points are repeated at the start and end of the path.
+    int last = (int)keyframes_.size() - 1;
+    int i1 = findSegment(time);
+    int i0 = max(i1 - 1, 0);
+    int i2 = min(i1 + 1, last);
+    int i3 = min(i1 + 2, last);
+
+    const CameraKeyframe &k0 = keyframes_[i0];
+    const CameraKeyframe &k1 = keyframes_[i1];
+    const CameraKeyframe &k2 = keyframes_[i2];
+    const CameraKeyframe &k3 = keyframes_[i3];
+
+    // Position within the segment
+    float t = 0.0;
+    if(k2.time > k1.time)
+    {
+        t = (time - k1.time) / (k2.time - k1.time);
+        t = min(max(t, 0.0f), 1.0f);
+    }
+    float t2 = t * t;
+    float t3 = t2 * t;
+
+    // Catmull-Rom position
+    Vector3 position = 0.5 * ((2.0 * k1.position) +
+                              (k2.position - k0.position) * t +
+                              (2.0 * k0.position - 5.0 * k1.position + 4.0 * k2.position - k3.position) * t2 +
+                              (3.0 * k1.position - k0.position - 3.0 * k2.position + k3.position) * t3);
+
+    // Blend rotations along the shortest arc
+    Quaternion from = k1.rotation;
+    Quaternion to = k2.rotation;
+    if(Vector3::dot(from.v, to.v) + (from.w * to.w) < 0.0)
+    {
+        to = -1.0 * to;
+    }
+    Quaternion rotation = ((1.0 - t) * from) + (t * to);
+    rotation = (1.0 / rotation.norm()) * rotation;
+
+    camera->setPosition(position);
+    camera->setRotation(rotation);
+}
+
+bool CameraPath::loadFromFile(const string &fileName)
+{
+    keyframes_.clear();
+
+    ifstream file(fileName.c_str());
+    if(!file.is_open())
+    {
+        printf("Failed to open camera path %s \n", fileName.c_str());
+        return false;
+    }
+
+    // Each line is: keyframe time position rotation
+    string type;
+    while(file >> type)
+    {
+        if(type != "keyframe")
+        {
+            printf("Unknown camera path entry %s \n", type.c_str());
+            return false;
+        }
+
+        float time;
+        Vector3 position;
+        Quaternion rotation;
+        file >> time >> position >> rotation;
+
+        if(file.fail() || (!keyframes_.empty() && time <= keyframes_.back().time))
+        {
+            printf("Invalid keyframe in camera path %s \n", fileName.c_str());
+            return false;
+        }
+
+        addKeyframe(time, position, rotation);
+    }
+
+    if(keyframes_.empty())
+    {
+        printf("Camera path %s has no keyframes \n", fileName.c_str());
+        return false;
+    }
+
+    printf("Loaded camera path %s (%d keyframes) \n", fileName.c_str(), (int)keyframes_.size());
+    return true;
+}
+
+bool CameraPath::saveToFile(const string &fileName) const
+{
+    ofstream file(fileName.c_str());
+    if(!file.is_open())
+    {
+        printf("Failed to write camera path %s \n", fileName.c_str());
+        return false;
+    }
+
+    for(unsigned int i = 0; i < keyframes_.size(); ++i)
+    {
+        const CameraKeyframe &keyframe = keyframes_[i];
+        file << "keyframe " << keyframe.time << "   ";
+        file << keyframe.position.x << " " << keyframe.position.y << " " << keyframe.position.z << "   ";
+        file << keyframe.rotation.v.x << " " << keyframe.rotation.v.y << " " << keyframe.rotation.v.z << " " << keyframe.rotation.w << "\n";
+    }
+
+    return !file.fail();
+}
+
+int CameraPath::findSegment(float time) const
+{
+    // Binary search for the last keyframe at or before the time
+    int low = 0;
+    int high = (int)keyframes_.size() - 1;
+    while(low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if(keyframes_[middle].time <= time)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    return low;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+using namespace std;
+
+#include "Vector3.hpp"
+#include "Quaternion.hpp"
+#include "Camera.hpp"
+
+// A single point on a camera path
+struct CameraKeyframe
+{
+    float time;
+    Vector3 position;
+    Quaternion rotation;
+};
+
+// A camera spline used for repeatable flythroughs.
+// Positions are interpolated with a Catmull-Rom spline and
+// rotations are blended with a normalized lerp.
+class CameraPath
+{
+public:
+    CameraPath();
+
+    // The keyframes, sorted by time
+    const vector<CameraKeyframe>* keyframes() const { return &keyframes_; }
+
+    // The time of the final keyframe
+    float duration() const;
+
+    // Appends a keyframe. The time must be after the last keyframe.
+    void addKeyframe(float time, const Vector3 &position, const Quaternion &rotation);
+
+    // Moves the camera to the point on the path at the given time
+    void apply(float time, Camera* camera) const;
+
+    // Loads / saves the path from a .path file
+    bool loadFromFile(const string &fileName);
+    bool saveToFile(const string &fileName) const;
+
+private:
+    vector<CameraKeyframe> keyframes_;
+
+    // Finds the keyframe index at the start of the segment containing time
+    int findSegment(float time) const;
+};
@@ -5,7 +5,9 @@ MeshInstance::MeshInstance(Mesh* mesh, ShaderFeatureList shaderFeatures, Texture
     mesh_(mesh),
     shaderFeatures_(shaderFeatures),
     texture_(texture),
-    normalMap_(normalMap)
+    normalMap_(normalMap),
+    bounds_(mesh->bounds()),
+    boundsDirty_(true)
 {
     
 }
@@ -15,7 +17,28 @@ bool MeshInstance::isStatic() const
     return static_;
 }
 
+const Bounds &MeshInstance::bounds() const
+{
+    if(boundsDirty_)
+    {
+        bounds_ = mesh_->bounds().transformed(localToWorld());
+        boundsDirty_ = false;
+    }
+    
+    return bounds_;
+}
+
 void MeshInstance::makeNonStatic()
 {
     static_ = false;
 }
+
+void MeshInstance::meshChanged()
+{
+    boundsDirty_ = true;
+}
+
+void MeshInstance::transformChanged()
+{
+    boundsDirty_ = true;
+}
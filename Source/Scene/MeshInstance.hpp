@@ -21,6 +21,10 @@ public:
     // The mesh to be rendered
     Mesh* mesh() const { return mesh_; }
     
+    // World space bounds of the mesh.
+    // Recalculated when first used after the transform changes.
+    const Bounds &bounds() const;
+    
     // The textures used for shading
     Texture* texture() const { return texture_; }
     Texture* normalMap() const { return normalMap_; }
@@ -29,6 +33,9 @@ public:
     // This should be done for animated meshes
     void makeNonStatic();
     
+    // Recalculates the bounds after the mesh data is replaced
+    void meshChanged();
+    
 private:
     
     // True if static.
@@ -40,4 +47,10 @@ private:
     ShaderFeatureList shaderFeatures_;
     Texture* texture_;
     Texture* normalMap_;
+    
+    // Cached world space bounds
+    mutable Bounds bounds_;
+    mutable bool boundsDirty_;
+    
+    void transformChanged();
 };
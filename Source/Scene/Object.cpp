@@ -5,11 +5,37 @@ Object::Object()
     rotation_(Quaternion::identity()),
     scale_(Vector3::one()),
     worldToLocal_(Matrix4x4::identity()),
-    localToWorld_(Matrix4x4::identity())
+    localToWorld_(Matrix4x4::identity()),
+    transformDirty_(false)
 {
     
 }
 
+Object::~Object()
+{
+    
+}
+
+const Matrix4x4 &Object::worldToLocal() const
+{
+    if(transformDirty_)
+    {
+        recreateTransformation();
+    }
+    
+    return worldToLocal_;
+}
+
+const Matrix4x4 &Object::localToWorld() const
+{
+    if(transformDirty_)
+    {
+        recreateTransformation();
+    }
+    
+    return localToWorld_;
+}
+
 Vector4 Object::forward() const
 {
     return Matrix4x4::rotation(rotation_) * Vector4(0.0, 0.0, 1.0, 0.0);
@@ -34,19 +60,26 @@ Vector3 Object::localToWorldVector(const Vector3 &v) const
 void Object::setPosition(const Vector3 &pos)
 {
     position_ = pos;
-    recreateTransformation();
+    invalidateTransformation();
 }
 
 void Object::setRotation(const Quaternion &rot)
 {
     rotation_ = rot;
-    recreateTransformation();
+    invalidateTransformation();
 }
 
 void Object::setScale(const Vector3 &scale)
 {
     scale_ = scale;
-    recreateTransformation();
+    invalidateTransformation();
+}
+
+void Object::setTransform(const Vector3 &pos, const Quaternion &rot)
+{
+    position_ = pos;
+    rotation_ = rot;
+    invalidateTransformation();
 }
 
 void Object::translate(const Vector3 &translation)
@@ -66,8 +99,20 @@ void Object::rotate(float angle, const Vector3 &axis)
     setRotation(newRotation);
 }
 
-void Object::recreateTransformation()
+void Object::invalidateTransformation()
+{
+    transformDirty_ = true;
+    transformChanged();
+}
+
+void Object::recreateTransformation() const
 {
     localToWorld_ = Matrix4x4::trs(position_, rotation_, scale_);
     worldToLocal_ = Matrix4x4::trsInverse(position_, rotation_, scale_);
+    transformDirty_ = false;
+}
+
+void Object::transformChanged()
+{
+
 }
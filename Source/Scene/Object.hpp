@@ -8,15 +8,18 @@ class Object
 {
 public:
     Object();
+    virtual ~Object();
     
     // Transformation settings
     Vector3 position() const { return position_; }
     Quaternion rotation() const { return rotation_; }
     Vector3 scale() const { return scale_; }
     
-    // Transformation matrices
-    Matrix4x4 worldToLocal() const { return worldToLocal_; }
-    Matrix4x4 localToWorld() const { return localToWorld_; }
+    // Transformation matrices.
+    // Recomputed when first used after the transformation changes,
+    // so setting several parts of it only computes them once.
+    const Matrix4x4 &worldToLocal() const;
+    const Matrix4x4 &localToWorld() const;
     
     // Object axis in world space
     Vector4 forward() const;
@@ -31,6 +34,9 @@ public:
     void setRotation(const Quaternion &rot);
     void setScale(const Vector3 &scale);
     
+    // Sets the position and rotation together
+    void setTransform(const Vector3 &pos, const Quaternion &rot);
+    
     // Translates the object by the given world space vector
     void translate(const Vector3 &translation);
     
@@ -46,8 +52,16 @@ private:
     Vector3 scale_;
     
     // Cached transformation matrices
-    Matrix4x4 worldToLocal_;
-    Matrix4x4 localToWorld_;
+    mutable Matrix4x4 worldToLocal_;
+    mutable Matrix4x4 localToWorld_;
+    mutable bool transformDirty_;
     
-    void recreateTransformation();
+    // Marks the matrices as out of date
+    void invalidateTransformation();
+    void recreateTransformation() const;
+
+protected:
+    // Called after the transformation changes.
+    // The matrices are not recomputed until they are next used.
+    virtual void transformChanged();
 };
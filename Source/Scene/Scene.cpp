@@ -8,9 +8,14 @@
 Scene::Scene()
     : cameras_(),
     lights_(),
+    playArea_(Vector3::zero()),
     meshInstances_(),
+    staticInstances_(),
+    dynamicInstances_(),
+    staticVersion_(0),
     meshes_(),
-    textures_()
+    textures_(),
+    assetLoader_()
 {
     
 }
@@ -22,40 +27,65 @@ Scene::~Scene()
     {
         delete meshInstances_[i];
     }
-    
-    // Delete all animatiions
-    for(unsigned int i = 0; i < animations_.size(); ++i)
-    {
-        delete animations_[i];
-    }
 }
 
 void Scene::update(float deltaTime)
 {
+    // Upload a few of the loaded assets, so frames stay short while loading
+    if(assetLoader_.isLoading() && assetLoader_.update(AssetUploadMilliseconds))
+    {
+        meshesLoaded();
+    }
+    
     // Update all animations
-    for(unsigned int i = 0; i < animations_.size(); ++i)
+    animations_.update(deltaTime);
+}
+
+void Scene::finishLoading()
+{
+    if(assetLoader_.finish())
     {
-        animations_[i]->update(deltaTime);
+        meshesLoaded();
     }
 }
 
+void Scene::resetAnimations()
+{
+    animations_.reset();
+}
+
 bool Scene::loadFromFile(const string &fileName)
 {
     string fullPath = SCENES_DIRECTORY + fileName;
     
-    ifstream file(fullPath.c_str());
-    while(file.is_open() && !file.fail() && !file.eof())
+    // Packs are read in place, so they need no parsing
+    string packExtension = ".pack";
+    bool isPack = fileName.size() >= packExtension.size()
+        && fileName.compare(fileName.size() - packExtension.size(), packExtension.size(), packExtension) == 0;
+    
+    bool loaded = false;
+    if(isPack)
     {
-        if(!loadObject(file))
+        AssetPack pack;
+        loaded = pack.open(fullPath);
+        if(loaded)
         {
-            printf("Failed to load object from scene %s \n", fileName.c_str());
-            return false;
+            createObjects(pack.records(), &pack);
         }
     }
+    else
+    {
+        // Objects loaded before an error are still rendered
+        SceneFile sceneFile;
+        loaded = sceneFile.load(fullPath);
+        createObjects(sceneFile.records(), NULL);
+    }
     
-    if(file.fail())
+    buildCullingData();
+    
+    if(!loaded)
     {
-        printf("Failed to read scene file %s \n", fileName.c_str());
+        printf("Failed to load scene %s \n", fileName.c_str());
         return false;
     }
     
@@ -63,129 +93,134 @@ bool Scene::loadFromFile(const string &fileName)
     return true;
 }
 
-bool Scene::loadObject(ifstream &file)
+void Scene::cull(const Frustum &frustum, vector<MeshInstance*>* visible, bool includeStatic, bool includeDynamic) const
 {
-    string objectType;
-    file >> objectType;
+    visible->clear();
     
-    if(objectType == "camera")
+    if(includeStatic)
     {
-        return loadCamera(file);
+        staticInstances_.cull(frustum, visible);
     }
-    else if(objectType == "light")
+    
+    // Dynamic instances move, so they are not stored in the BVH
+    if(includeDynamic)
     {
-        return loadLight(file);
+        for(unsigned int i = 0; i < dynamicInstances_.size(); ++i)
+        {
+            if(frustum.intersects(dynamicInstances_[i]->bounds()))
+            {
+                visible->push_back(dynamicInstances_[i]);
+            }
+        }
     }
-    else if(objectType == "mesh")
+}
+
+void Scene::createObjects(const SceneRecords &records, const AssetPack* pack)
+{
+    for(int i = 0; i < records.camerasCount; ++i)
     {
-        return loadMeshInstance(file);
+        const CameraRecord &record = records.cameras[i];
+        
+        Camera camera;
+        camera.setType(CameraType::Perspective);
+        camera.setFov(record.fov);
+        camera.setNearPlane(record.nearPlane);
+        camera.setFarPlane(record.farPlane);
+        setObjectTransform(record.transform, &camera);
+        cameras_.push_back(camera);
     }
-    else if(objectType == "animation")
+    
+    if(!cameras_.empty())
     {
-        return loadAnimation(file);
+        playArea_ = cameras_[0].position();
     }
     
-    printf("Object type %s not known. \n", objectType.c_str());
-    return false;
+    for(int i = 0; i < records.lightsCount; ++i)
+    {
+        const LightRecord &record = records.lights[i];
+        
+        Light light(record.color, record.ambient);
+        setObjectTransform(record.transform, &light);
+        lights_.push_back(light);
+    }
+    
+    vector<MeshInstance*> instances(records.meshInstancesCount, (MeshInstance*)NULL);
+    for(int i = 0; i < records.meshInstancesCount; ++i)
+    {
+        const MeshInstanceRecord &record = records.meshInstances[i];
+        string meshName = records.strings + record.meshName;
+        string textureName = records.strings + record.textureName;
+        string normalMapName = records.strings + record.normalMapName;
+        
+        // Get or start loading the mesh and textures.
+        // Assets that fail to load keep their placeholders.
+        Mesh* mesh = getMesh(meshName, pack);
+        Texture* texture = getTexture(textureName, false);
+        Texture* normalMap = getTexture(normalMapName, true);
+        
+        // Create the instance
+        MeshInstance* instance = new MeshInstance(mesh, record.shaderFeatures, texture, normalMap);
+        setObjectTransform(record.transform, instance);
+        meshInstances_.push_back(instance);
+        instances[i] = instance;
+    }
+    
+    for(int i = 0; i < records.animationsCount; ++i)
+    {
+        const AnimationRecord &record = records.animations[i];
+        assert((int)record.meshInstance < records.meshInstancesCount);
+        
+        animations_.add(instances[record.meshInstance], record.startTime, record.resetInterval,
+                        record.rotationSpeed, record.translationSpeed);
+    }
 }
 
-void Scene::loadObjectTransform(ifstream &file, Object* object)
+void Scene::setObjectTransform(const TransformRecord &transform, Object* object)
 {
-    // Transform params are stored sequentially
-    Vector3 position, eulerAngles, scale;
-    file >> position >> eulerAngles >> scale;
-    
     // Convert the rotation to a quaternion
+    Vector3 eulerAngles = transform.eulerAngles;
     Quaternion rotation = Quaternion::euler(eulerAngles);
     
     // Set the object transform params
-    object->setPosition(position);
+    object->setPosition(transform.position);
     object->setRotation(rotation);
-    object->setScale(scale);
+    object->setScale(transform.scale);
 }
 
-bool Scene::loadCamera(ifstream &file)
+void Scene::buildCullingData()
 {
-    // Fov, nearplane and farplane are stored sequentially
-    float fov, nearPlane, farPlane;
-    file >> fov >> nearPlane >> farPlane;
-    
-    // Create a new camera
-    Camera camera;
-    camera.setType(CameraType::Perspective);
-    camera.setFov(fov);
-    camera.setNearPlane(nearPlane);
-    camera.setFarPlane(farPlane);
-    loadObjectTransform(file, &camera);
-    
-    // Add to the cameras list
-    cameras_.push_back(camera);
-    
-    return true;
-}
-
-bool Scene::loadLight(ifstream &file)
-{
-    // Color and ambient color are stored sequentially
-    Vector3 color, ambient;
-    file >> color >> ambient;
-    
-    // Create a light
-    Light light(color, ambient);
-    loadObjectTransform(file, &light);
-    
-    // Add to the lights list
-    lights_.push_back(light);
+    // Animations make their instances non static while loading,
+    // so static instances can be separated once everything is loaded.
+    vector<MeshInstance*> staticInstances;
+    dynamicInstances_.clear();
+    for(unsigned int i = 0; i < meshInstances_.size(); ++i)
+    {
+        if(meshInstances_[i]->isStatic())
+        {
+            staticInstances.push_back(meshInstances_[i]);
+        }
+        else
+        {
+            dynamicInstances_.push_back(meshInstances_[i]);
+        }
+    }
     
-    return true;
+    staticInstances_.build(staticInstances);
+    staticVersion_ ++;
 }
 
-bool Scene::loadMeshInstance(ifstream &file)
+void Scene::meshesLoaded()
 {
-    // Mesh name, shader features and textures are stored sequentially.
-    string meshName, textureName, normalMapName;
-    ShaderFeatureList shaderFeatures;
-    file >> meshName >> shaderFeatures >> textureName >> normalMapName;
-    
-    // Get or create the mesh and texture
-    Mesh* mesh = getMesh(meshName);
-    Texture* texture = getTexture(textureName);
-    Texture* normalMap = getTexture(normalMapName);
-    
-    // Check for errors
-    if(mesh == NULL || texture == NULL)
+    for(unsigned int i = 0; i < meshInstances_.size(); ++i)
     {
-        printf("Error loading mesh %s or texture %s \n", meshName.c_str(), textureName.c_str());
-        return false;
+        meshInstances_[i]->meshChanged();
     }
     
-    // Create the instance
-    MeshInstance* instance = new MeshInstance(mesh, shaderFeatures, texture, normalMap);
-    loadObjectTransform(file, instance);
-    meshInstances_.push_back(instance);
-    return true;
+    // The BVH is rebuilt with the new bounds
+    buildCullingData();
 }
 
-bool Scene::loadAnimation(ifstream &file)
-{
-    // Settings are stored sequentially
-    float startTime;
-    float resetInterval;
-    Vector3 rotationSpeed;
-    Vector3 translationSpeed;
-    file >> startTime >> resetInterval >> rotationSpeed >> translationSpeed;
-    
-    // The animation component affects the mesh instance
-    // most recently found in the file
-    assert(!meshInstances_.empty());
-    MeshInstance* meshInstance = meshInstances_.back();
-    
-    // Create the animation instance
-    animations_.push_back(new Animation(meshInstance, startTime, resetInterval,  rotationSpeed, translationSpeed));
-    return true;
-}
-
-Mesh* Scene::getMesh(const string &name)
+Mesh* Scene::getMesh(const string &name, const AssetPack* pack)
 {
     // Use a cached mesh if possible.
     auto existing = meshes_.find(name);
@@ -194,14 +229,19 @@ Mesh* Scene::getMesh(const string &name)
         return existing->second;
     }
     
-    // Load the mesh.
-    string fullPath = MESHES_DIRECTORY + name;
-    Mesh* mesh = Mesh::load(fullPath.c_str());
+    // Pack meshes are uploaded straight from the mapped file,
+    // others are loaded in the background
+    Mesh* mesh = (pack != NULL) ? pack->createMesh(name) : NULL;
+    if(mesh == NULL)
+    {
+        string fullPath = MESHES_DIRECTORY + name;
+        mesh = assetLoader_.loadMesh(fullPath);
+    }
     meshes_.insert(pair<string, Mesh*>(name, mesh));
     return mesh;
 }
 
-Texture* Scene::getTexture(const string &name)
+Texture* Scene::getTexture(const string &name, bool normalMap)
 {
     // Use a cached texture if possible.
     auto existing = textures_.find(name);
@@ -211,7 +251,7 @@ Texture* Scene::getTexture(const string &name)
     }
     
     string fullPath = TEXTURES_DIRECTORY + name;
-    Texture* texture = Texture::load(fullPath.c_str());
+    Texture* texture = assetLoader_.loadTexture(fullPath, normalMap);
     textures_.insert(pair<string, Texture*>(name, texture));
     return texture;
 }
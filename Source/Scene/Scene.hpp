@@ -1,21 +1,26 @@
 #pragma once
 
 #include <vector>
-#include <fstream>
-#include <iostream>
 #include <map>
 
 using namespace std;
 
+#include "AssetLoader.hpp"
+#include "AssetPack.hpp"
 #include "Camera.hpp"
 #include "Light.hpp"
 #include "MeshInstance.hpp"
 #include "Object.hpp"
 #include "Texture.hpp"
-#include "Animation.hpp"
+#include "AnimationSystem.hpp"
+#include "BoundingVolumeHierarchy.hpp"
+#include "Frustum.hpp"
 
 class Scene
 {
+    // Time each frame can spend uploading loaded assets
+    const static int AssetUploadMilliseconds = 4;
+    
 public:
     Scene();
     ~Scene();
@@ -27,12 +32,44 @@ public:
     // The shadow casting light
     const Light* mainLight() const { return &lights_[0]; }
     
+    // Where the main camera starts, as loaded from the scene file.
+    // Unlike the camera, it doesn't move, so it can be used to focus detail.
+    Vector3 playArea() const { return playArea_; }
+    
     // The mesh instances to be rendered
     const vector<MeshInstance*>* meshInstances() const { return &meshInstances_; }
     
+    // Replaces the list with the mesh instances inside the frustum.
+    // Static instances are found using a BVH, dynamic ones are tested individually.
+    void cull(const Frustum &frustum, vector<MeshInstance*>* visible, bool includeStatic = true, bool includeDynamic = true) const;
+    
+    // Covers all static instances
+    Bounds staticBounds() const { return staticInstances_.bounds(); }
+    
+    // Changes whenever the static instances change,
+    // so data cached from them can be refreshed.
+    int staticVersion() const { return staticVersion_; }
+    
+    // Updates animations and uploads assets that have finished loading
     void update(float deltaTime);
     
-    // Loads scene objects from the given .scene file
+    // True while meshes or textures are still loading.
+    // Until then meshes are empty and textures are placeholders.
+    bool isLoading() const { return assetLoader_.isLoading(); }
+    
+    // Waits for every asset to load
+    void finishLoading();
+    
+    // Returns all animated objects to their initial state
+    void resetAnimations();
+    
+    // Loads textures block compressed, from the compressed texture cache.
+    // Must be set before loading.
+    void setCompressTextures(bool compress) { assetLoader_.setCompressTextures(compress); }
+    
+    // Loads scene objects from the given file.
+    // Asset packs (.pack) are mapped, other files are parsed as text scenes.
+    // Meshes and textures not in a pack are loaded in the background.
     bool loadFromFile(const string &fileName);
     
 private:
@@ -40,22 +77,32 @@ private:
     // Scene objects
     vector<Camera> cameras_;
     vector<Light> lights_;
+    Vector3 playArea_;
     vector<MeshInstance*> meshInstances_;
-    vector<Animation*> animations_;
+    AnimationSystem animations_;
+    
+    // Culling structures
+    BoundingVolumeHierarchy staticInstances_;
+    vector<MeshInstance*> dynamicInstances_;
+    int staticVersion_;
     
     // Assets
     map<string, Mesh*> meshes_;
     map<string, Texture*> textures_;
+    AssetLoader assetLoader_;
+    
+    // Creates the objects of the records.
+    // Meshes are taken from the pack when it has them.
+    void createObjects(const SceneRecords &records, const AssetPack* pack);
+    void setObjectTransform(const TransformRecord &transform, Object* object);
+    
+    // Creates the culling structures once all objects are loaded
+    void buildCullingData();
     
-    // Scene loading
-    bool loadObject(ifstream &file);
-    void loadObjectTransform(ifstream &file, Object* object);
-    bool loadCamera(ifstream &file);
-    bool loadLight(ifstream &file);
-    bool loadMeshInstance(ifstream &file);
-    bool loadAnimation(ifstream &file);
+    // Refreshes the bounds of every instance after meshes are uploaded
+    void meshesLoaded();
     
     // Asset loading
-    Mesh* getMesh(const string &name);
-    Texture* getTexture(const string &name);
+    Mesh* getMesh(const string &name, const AssetPack* pack);
+    Texture* getTexture(const string &name, bool normalMap);
 };
@@ -0,0 +1,200 @@
+#include "SceneFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+SceneFile::SceneFile()
+    : strings_(),
+    stringOffsets_(),
+    cameras_(),
+    lights_(),
+    meshInstances_(),
+    animations_()
+{
+
+}
+
+bool SceneFile::load(const string &fileName)
+{
+    ifstream file(fileName.c_str());
+    if(!file.is_open())
+    {
+        printf("Failed to open scene file %s \n", fileName.c_str());
+        return false;
+    }
+    
+    while(!file.fail() && !file.eof())
+    {
+        if(!loadObject(file))
+        {
+            printf("Failed to load object from scene %s \n", fileName.c_str());
+            return false;
+        }
+    }
+    
+    if(file.fail())
+    {
+        printf("Failed to read scene file %s \n", fileName.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+SceneRecords SceneFile::records() const
+{
+    SceneRecords records;
+    records.strings = strings_.empty() ? NULL : &strings_[0];
+    records.stringsSize = (int)strings_.size();
+    records.cameras = cameras_.empty() ? NULL : &cameras_[0];
+    records.camerasCount = (int)cameras_.size();
+    records.lights = lights_.empty() ? NULL : &lights_[0];
+    records.lightsCount = (int)lights_.size();
+    records.meshInstances = meshInstances_.empty() ? NULL : &meshInstances_[0];
+    records.meshInstancesCount = (int)meshInstances_.size();
+    records.animations = animations_.empty() ? NULL : &animations_[0];
+    records.animationsCount = (int)animations_.size();
+    return records;
+}
+
+vector<string> SceneFile::meshNames() const
+{
+    vector<string> names;
+    for(unsigned int i = 0; i < meshInstances_.size(); ++i)
+    {
+        string name(&strings_[meshInstances_[i].meshName]);
+        if(find(names.begin(), names.end(), name) == names.end())
+        {
+            names.push_back(name);
+        }
+    }
+    
+    return names;
+}
+
+vector<string> SceneFile::textureNames(bool normalMaps) const
+{
+    vector<string> names;
+    for(unsigned int i = 0; i < meshInstances_.size(); ++i)
+    {
+        uint32_t offset = normalMaps ? meshInstances_[i].normalMapName : meshInstances_[i].textureName;
+        string name(&strings_[offset]);
+        if(find(names.begin(), names.end(), name) == names.end())
+        {
+            names.push_back(name);
+        }
+    }
+    
+    return names;
+}
+
+uint32_t SceneFile::addString(const string &value)
+{
+    // Names used more than once are only stored once
+    auto existing = stringOffsets_.find(value);
+    if(existing != stringOffsets_.end())
+    {
+        return existing->second;
+    }
+    
+    uint32_t offset = (uint32_t)strings_.size();
+    strings_.insert(strings_.end(), value.begin(), value.end());
+    strings_.push_back('\0');
+    stringOffsets_.insert(pair<string, uint32_t>(value, offset));
+    return offset;
+}
+
+bool SceneFile::loadObject(ifstream &file)
+{
+    string objectType;
+    file >> objectType;
+    
+    // Trailing whitespace at the end of the file
+    if(objectType.empty() && file.eof())
+    {
+        file.clear(ios::eofbit);
+        return true;
+    }
+    
+    if(objectType == "camera")
+    {
+        return loadCamera(file);
+    }
+    else if(objectType == "light")
+    {
+        return loadLight(file);
+    }
+    else if(objectType == "mesh")
+    {
+        return loadMeshInstance(file);
+    }
+    else if(objectType == "animation")
+    {
+        return loadAnimation(file);
+    }
+    
+    printf("Object type %s not known. \n", objectType.c_str());
+    return false;
+}
+
+void SceneFile::loadTransform(ifstream &file, TransformRecord* transform)
+{
+    // Transform params are stored sequentially
+    file >> transform->position >> transform->eulerAngles >> transform->scale;
+}
+
+bool SceneFile::loadCamera(ifstream &file)
+{
+    // Fov, nearplane and farplane are stored sequentially
+    CameraRecord camera;
+    file >> camera.fov >> camera.nearPlane >> camera.farPlane;
+    loadTransform(file, &camera.transform);
+    
+    cameras_.push_back(camera);
+    return true;
+}
+
+bool SceneFile::loadLight(ifstream &file)
+{
+    // Color and ambient color are stored sequentially
+    LightRecord light;
+    file >> light.color >> light.ambient;
+    loadTransform(file, &light.transform);
+    
+    lights_.push_back(light);
+    return true;
+}
+
+bool SceneFile::loadMeshInstance(ifstream &file)
+{
+    // Mesh name, shader features and textures are stored sequentially.
+    string meshName, textureName, normalMapName;
+    MeshInstanceRecord instance;
+    file >> meshName >> instance.shaderFeatures >> textureName >> normalMapName;
+    loadTransform(file, &instance.transform);
+    
+    instance.meshName = addString(meshName);
+    instance.textureName = addString(textureName);
+    instance.normalMapName = addString(normalMapName);
+    meshInstances_.push_back(instance);
+    return true;
+}
+
+bool SceneFile::loadAnimation(ifstream &file)
+{
+    // Settings are stored sequentially
+    AnimationRecord animation;
+    file >> animation.startTime >> animation.resetInterval >> animation.rotationSpeed >> animation.translationSpeed;
+    
+    // The animation component affects the mesh instance
+    // most recently found in the file
+    if(meshInstances_.empty())
+    {
+        printf("Animation found before any mesh \n");
+        return false;
+    }
+    
+    animation.meshInstance = (uint32_t)meshInstances_.size() - 1;
+    animations_.push_back(animation);
+    return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "Vector3.hpp"
+
+// The objects of a scene are stored as flat tables of records.
+// Names are offsets into a block of null terminated strings.
+// The same records are used by text scenes and asset packs, so they
+// only hold plain values.
+
+struct TransformRecord
+{
+    Vector3 position;
+    Vector3 eulerAngles;
+    Vector3 scale;
+};
+
+struct CameraRecord
+{
+    float fov;
+    float nearPlane;
+    float farPlane;
+    TransformRecord transform;
+};
+
+struct LightRecord
+{
+    Vector3 color;
+    Vector3 ambient;
+    TransformRecord transform;
+};
+
+struct MeshInstanceRecord
+{
+    uint32_t meshName;
+    uint32_t shaderFeatures;
+    uint32_t textureName;
+    uint32_t normalMapName;
+    TransformRecord transform;
+};
+
+struct AnimationRecord
+{
+    // The index of the mesh instance record that is animated
+    uint32_t meshInstance;
+    float startTime;
+    float resetInterval;
+    Vector3 rotationSpeed;
+    Vector3 translationSpeed;
+};
+
+// The tables of a scene, wherever they are stored
+struct SceneRecords
+{
+    const char* strings;
+    int stringsSize;
+    const CameraRecord* cameras;
+    int camerasCount;
+    const LightRecord* lights;
+    int lightsCount;
+    const MeshInstanceRecord* meshInstances;
+    int meshInstancesCount;
+    const AnimationRecord* animations;
+    int animationsCount;
+};
+
+// Parses the records from a text .scene file
+class SceneFile
+{
+public:
+    SceneFile();
+    
+    // Records read before any error are kept
+    bool load(const string &fileName);
+    
+    // Points to the tables of this file
+    SceneRecords records() const;
+    
+    // The names of the meshes used by the mesh instances, without duplicates
+    vector<string> meshNames() const;
+    
+    // The names of the textures or normal maps used by the mesh instances, without duplicates
+    vector<string> textureNames(bool normalMaps) const;
+
+private:
+    vector<char> strings_;
+    map<string, uint32_t> stringOffsets_;
+    vector<CameraRecord> cameras_;
+    vector<LightRecord> lights_;
+    vector<MeshInstanceRecord> meshInstances_;
+    vector<AnimationRecord> animations_;
+    
+    // Adds a name to the strings, returning its offset
+    uint32_t addString(const string &value);
+    
+    bool loadObject(ifstream &file);
+    void loadTransform(ifstream &file, TransformRecord* transform);
+    bool loadCamera(ifstream &file);
+    bool loadLight(ifstream &file);
+    bool loadMeshInstance(ifstream &file);
+    bool loadAnimation(ifstream &file);
+};
@@ -4,12 +4,14 @@
 #include <cstdio>
 #include <cstring>
 
-VoxelBuilder::VoxelBuilder(int tileIndex, int resolution, float* entryDepths, float* exitDepths)
+VoxelBuilder::VoxelBuilder(int tileIndex, int resolution, float* entryDepths, float* exitDepths,
+                           const std::function<void()> &finished)
     : tileIndex_(tileIndex),
     resolution_(resolution),
     entryDepths_(entryDepths),
     exitDepths_(exitDepths),
     buildState_(VoxelBuilderState::Building),
+    finished_(finished),
     depthMap_(NULL),
     writer_(NULL),
     leafCache_(NULL)
@@ -74,6 +76,7 @@ void VoxelBuilder::build()
     
     // Update the build state
     buildState_ = VoxelBuilderState::Done;
+    finished_();
 }
 
 void VoxelBuilder::createDepthMap()
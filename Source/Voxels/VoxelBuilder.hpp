@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <thread>
 
 #include "VoxelDepthMap.hpp"
@@ -33,12 +34,18 @@ enum class VoxelBuilderState
 class VoxelBuilder
 {
 public:
-    VoxelBuilder(int tileIndex, int resolution, float* entryDepths, float* exitDepths);
+    // Building starts immediately on a background thread,
+    // which calls finished once the state is Done
+    VoxelBuilder(int tileIndex, int resolution, float* entryDepths, float* exitDepths,
+                 const std::function<void()> &finished);
     ~VoxelBuilder();
     
     // The index of the tile being built
     int tileIndex() const { return tileIndex_; }
     
+    // The resolution of the tile
+    int resolution() const { return resolution_; }
+    
     // The current build state
     VoxelBuilderState buildState() const { return buildState_; }
     
@@ -63,6 +70,7 @@ private:
     // The thread used for building and current state
     std::thread buildThread_;
     VoxelBuilderState buildState_;
+    std::function<void()> finished_;
     
     // Objects used during building
     VoxelDepthMap* depthMap_;
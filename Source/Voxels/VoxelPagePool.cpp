@@ -0,0 +1,340 @@
+#include "VoxelPagePool.hpp"
+
+#include <assert.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "GLState.hpp"
+
+VoxelPagePool::VoxelPagePool(int tileCount, int sizeMB)
+    : tiles_(tileCount),
+    pageOwners_(),
+    residentTiles_(0),
+    residentPages_(0)
+{
+    tableWords_ = pagesNeeded(tileCount * TableEntryWords) * PageSizeWords;
+    
+    // Texture buffers are limited in size, so the pool may be smaller than asked
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    int64_t requestedPages = ((int64_t)sizeMB * 1024 * 1024 / 4) / PageSizeWords;
+    int64_t maxPages = ((int64_t)maxTexels - tableWords_) / PageSizeWords;
+    int pages = (int)max((int64_t)1, min(requestedPages, maxPages));
+    if(pages < requestedPages)
+    {
+        printf("Voxel page pool reduced to %d MB, the largest buffer texture supported \n",
+               (int)(((int64_t)pages * PageSizeWords * 4) / (1024 * 1024)));
+    }
+    
+    pageOwners_.assign(pages, -1);
+    
+    // Tiles start unshadowed, until a version of them is built.
+    // Empty tiles stay unshadowed.
+    for(int i = 0; i < tileCount; ++i)
+    {
+        tiles_[i].firstPage = -1;
+        tiles_[i].pagesCount = 0;
+        tiles_[i].lastUsedFrame = -1;
+        tiles_[i].coarseState = 21845; // = 0101010101010101 = 8 Unshadowed children, so the height is not needed
+    }
+    
+    // Create the buffer, with every tile non resident
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+    glBufferData(GL_TEXTURE_BUFFER, sizeBytes(), NULL, GL_DYNAMIC_DRAW);
+    
+    // and its depth the same as the scene's until it is fitted
+    float offset = 0.0f;
+    float scale = 1.0f;
+    vector<uint32_t> table(tableWords_, 0);
+    for(int i = 0; i < tileCount; ++i)
+    {
+        table[i * TableEntryWords] = NonResidentFlag | tiles_[i].coarseState;
+        memcpy(&table[i * TableEntryWords + 1], &offset, sizeof(float));
+        memcpy(&table[i * TableEntryWords + 2], &scale, sizeof(float));
+    }
+    
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, table.size() * sizeof(uint32_t), &table[0]);
+    
+    glGenTextures(1, &bufferTexture_);
+    GLState::bindTexture(GL_TEXTURE_BUFFER, bufferTexture_);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, buffer_);
+}
+
+VoxelPagePool::~VoxelPagePool()
+{
+    GLState::textureDeleted(bufferTexture_);
+    glDeleteTextures(1, &bufferTexture_);
+    glDeleteBuffers(1, &buffer_);
+}
+
+size_t VoxelPagePool::sizeBytes() const
+{
+    return ((size_t)tableWords_ + (size_t)pagesCount() * PageSizeWords) * 4;
+}
+
+void VoxelPagePool::setCoarseState(int tile, uint32_t coarseState)
+{
+    assert(coarseState < NonResidentFlag);
+    tiles_[tile].coarseState = coarseState;
+    if(!isResident(tile))
+    {
+        writeTableEntry(tile);
+    }
+}
+
+void VoxelPagePool::setDepthTransform(int tile, float offset, float scale)
+{
+    assert(scale > 0.0f);
+    
+    float transform[2] = { offset, scale };
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+    glBufferSubData(GL_TEXTURE_BUFFER, (tile * TableEntryWords + 1) * sizeof(uint32_t), sizeof(transform), transform);
+}
+
+void VoxelPagePool::touch(int tile, int frame)
+{
+    tiles_[tile].lastUsedFrame = frame;
+}
+
+int VoxelPagePool::findRun(int sizeWords, int frame) const
+{
+    int needed = pagesNeeded(sizeWords);
+    int bestRun = -1;
+    int bestEvictedPages = 0;
+    int bestLastUsedFrame = 0;
+    
+    for(int start = 0; start + needed <= pagesCount(); ++start)
+    {
+        // Count the pages the run would evict, and when their tiles were last used
+        int evictedPages = 0;
+        int lastUsedFrame = -1;
+        int end = start;
+        for(; end < start + needed; ++end)
+        {
+            int owner = pageOwners_[end];
+            if(owner < 0)
+            {
+                continue;
+            }
+            
+            if(tiles_[owner].lastUsedFrame >= frame)
+            {
+                break;
+            }
+            
+            evictedPages ++;
+            lastUsedFrame = max(lastUsedFrame, tiles_[owner].lastUsedFrame);
+        }
+        
+        // No run can include a page used in the frame
+        if(end < start + needed)
+        {
+            start = end;
+            continue;
+        }
+        
+        if(bestRun < 0 || evictedPages < bestEvictedPages
+           || (evictedPages == bestEvictedPages && lastUsedFrame < bestLastUsedFrame))
+        {
+            bestRun = start;
+            bestEvictedPages = evictedPages;
+            bestLastUsedFrame = lastUsedFrame;
+            
+            if(evictedPages == 0)
+            {
+                break;
+            }
+        }
+    }
+    
+    return bestRun;
+}
+
+bool VoxelPagePool::canPlace(int sizeWords, int frame) const
+{
+    return findRun(sizeWords, frame) >= 0 || availablePages(frame) >= pagesNeeded(sizeWords);
+}
+
+bool VoxelPagePool::place(int tile, const vector<uint32_t> &words, int frame)
+{
+    assert(!isResident(tile));
+    assert(!words.empty());
+    
+    int needed = pagesNeeded((int)words.size());
+    int firstPage = findRun((int)words.size(), frame);
+    if(firstPage < 0)
+    {
+        if(availablePages(frame) < needed)
+        {
+            return false;
+        }
+        
+        // The pages are split between the tiles used in the frame,
+        // so free enough of them and move the rest together
+        while(pagesCount() - residentPages_ < needed)
+        {
+            int evicted = leastRecentlyUsed(frame);
+            assert(evicted >= 0);
+            evict(evicted);
+        }
+        
+        compact();
+        firstPage = pagesCount() - needed;
+    }
+    
+    // Evict the tiles in the run
+    for(int page = firstPage; page < firstPage + needed; ++page)
+    {
+        if(pageOwners_[page] >= 0)
+        {
+            evict(pageOwners_[page]);
+        }
+    }
+    
+    for(int page = firstPage; page < firstPage + needed; ++page)
+    {
+        pageOwners_[page] = tile;
+    }
+    
+    TileSlot &slot = tiles_[tile];
+    slot.firstPage = firstPage;
+    slot.pagesCount = needed;
+    slot.lastUsedFrame = frame;
+    residentTiles_ ++;
+    residentPages_ += needed;
+    
+    // Upload the subtree, then point the table at it
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+    glBufferSubData(GL_TEXTURE_BUFFER, pageOffsetBytes(firstPage), words.size() * sizeof(uint32_t), &words[0]);
+    writeTableEntry(tile);
+    
+    return true;
+}
+
+void VoxelPagePool::evict(int tile)
+{
+    TileSlot &slot = tiles_[tile];
+    if(slot.firstPage < 0)
+    {
+        return;
+    }
+    
+    for(int page = slot.firstPage; page < slot.firstPage + slot.pagesCount; ++page)
+    {
+        pageOwners_[page] = -1;
+    }
+    
+    residentTiles_ --;
+    residentPages_ -= slot.pagesCount;
+    slot.firstPage = -1;
+    slot.pagesCount = 0;
+    writeTableEntry(tile);
+}
+
+int VoxelPagePool::pagesNeeded(int sizeWords)
+{
+    return (sizeWords + PageSizeWords - 1) / PageSizeWords;
+}
+
+int VoxelPagePool::availablePages(int frame) const
+{
+    int pages = pagesCount() - residentPages_;
+    for(int tile = 0; tile < (int)tiles_.size(); ++tile)
+    {
+        const TileSlot &slot = tiles_[tile];
+        if(slot.firstPage >= 0 && slot.lastUsedFrame < frame)
+        {
+            pages += slot.pagesCount;
+        }
+    }
+    
+    return pages;
+}
+
+int VoxelPagePool::leastRecentlyUsed(int frame) const
+{
+    int oldest = -1;
+    for(int tile = 0; tile < (int)tiles_.size(); ++tile)
+    {
+        const TileSlot &slot = tiles_[tile];
+        if(slot.firstPage >= 0 && slot.lastUsedFrame < frame
+           && (oldest < 0 || slot.lastUsedFrame < tiles_[oldest].lastUsedFrame))
+        {
+            oldest = tile;
+        }
+    }
+    
+    return oldest;
+}
+
+void VoxelPagePool::compact()
+{
+    // Move each resident tile down to the first free page, in page order
+    int nextPage = 0;
+    int page = 0;
+    while(page < pagesCount())
+    {
+        int tile = pageOwners_[page];
+        if(tile < 0)
+        {
+            page ++;
+            continue;
+        }
+        
+        page = tiles_[tile].firstPage + tiles_[tile].pagesCount;
+        if(tiles_[tile].firstPage > nextPage)
+        {
+            moveTile(tile, nextPage);
+        }
+        
+        nextPage += tiles_[tile].pagesCount;
+    }
+}
+
+void VoxelPagePool::moveTile(int tile, int firstPage)
+{
+    TileSlot &slot = tiles_[tile];
+    assert(firstPage < slot.firstPage);
+    
+    // The ranges may overlap, so copy in steps no longer than the distance moved.
+    // Each step only overwrites pages that have already been copied.
+    int distance = slot.firstPage - firstPage;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    for(int page = 0; page < slot.pagesCount; page += distance)
+    {
+        int pages = min(distance, slot.pagesCount - page);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, pageOffsetBytes(slot.firstPage + page),
+                            pageOffsetBytes(firstPage + page), (size_t)pages * PageSizeWords * 4);
+    }
+    
+    for(int page = slot.firstPage; page < slot.firstPage + slot.pagesCount; ++page)
+    {
+        pageOwners_[page] = -1;
+    }
+    
+    for(int page = firstPage; page < firstPage + slot.pagesCount; ++page)
+    {
+        pageOwners_[page] = tile;
+    }
+    
+    // Point the table at the new position
+    slot.firstPage = firstPage;
+    writeTableEntry(tile);
+}
+
+void VoxelPagePool::writeTableEntry(int tile)
+{
+    // Resident tiles store the word position of their subtree
+    const TileSlot &slot = tiles_[tile];
+    uint32_t entry = NonResidentFlag | slot.coarseState;
+    if(slot.firstPage >= 0)
+    {
+        entry = (uint32_t)(tableWords_ + slot.firstPage * PageSizeWords);
+    }
+    
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+    glBufferSubData(GL_TEXTURE_BUFFER, tile * TableEntryWords * sizeof(uint32_t), sizeof(uint32_t), &entry);
+}
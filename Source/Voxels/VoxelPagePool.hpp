@@ -0,0 +1,123 @@
+#pragma once
+
+#define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
+#include <QGLWidget> // Links OpenGL Headers
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// A fixed size GPU buffer holding the subtrees of the resident tiles.
+// The buffer starts with a table of three words per tile, followed by pages
+// that are given out in contiguous runs, one run per resident tile.
+// A resident tile's table entry is the position of its subtree, and other
+// tiles store NonResidentFlag with the child mask of their root node and
+// their height, so the shader can still give a coarse result for them.
+// The other two words map the scene's voxel depth to the tile's.
+// Space is made by evicting the tiles in the cheapest run of pages,
+// or by compacting the pool when no run is long enough.
+class VoxelPagePool
+{
+public:
+    // The unit of allocation, 64KB
+    const static int PageSizeWords = 16384;
+    
+    // Marks the table entry of a tile that is not resident
+    const static uint32_t NonResidentFlag = 0x80000000;
+    
+    // The entry, depth offset and depth scale of each tile
+    const static int TableEntryWords = 3;
+    
+    // The pool is sized to hold the table, plus as many pages as fit in the size
+    VoxelPagePool(int tileCount, int sizeMB);
+    ~VoxelPagePool();
+    
+    // The buffer texture bound for sampling
+    GLuint bufferTexture() const { return bufferTexture_; }
+    
+    // The capacity and usage of the pool
+    int pagesCount() const { return (int)pageOwners_.size(); }
+    size_t sizeBytes() const;
+    int residentTiles() const { return residentTiles_; }
+    size_t residentSizeBytes() const { return (size_t)residentPages_ * PageSizeWords * 4; }
+    
+    bool isResident(int tile) const { return tiles_[tile].firstPage >= 0; }
+    
+    // The number of pages used by a tile of the size
+    static int pagesNeeded(int sizeWords);
+    
+    // Sets the state used by the shader while the tile is not resident,
+    // as given by VoxelWriter::tileCoarseState
+    void setCoarseState(int tile, uint32_t coarseState);
+    
+    // Sets the tile's voxel depth as (depth - offset) * scale of the scene's
+    void setDepthTransform(int tile, float offset, float scale);
+    
+    // Marks the tile as used in the frame, so it is not evicted during it
+    void touch(int tile, int frame);
+    
+    // The first page of a run that could hold a tile of the size, evicting only
+    // tiles not used in the frame, or -1 if there is none.
+    // Runs of free pages are preferred, then those evicting the fewest pages,
+    // then those whose tiles were used least recently.
+    int findRun(int sizeWords, int frame) const;
+    
+    // True if a tile of the size could be placed, either in a run
+    // or after evicting tiles not used in the frame and compacting the pool
+    bool canPlace(int sizeWords, int frame) const;
+    
+    // Uploads a tile's subtree, as written by VoxelWriter::writeTile.
+    // Evicts the tiles in the run found by findRun. If there is no run but
+    // enough pages could be freed, the least recently used tiles are evicted
+    // and the rest moved together to make one. Tiles used in the frame are
+    // never evicted. Returns false if there is not enough space.
+    bool place(int tile, const vector<uint32_t> &words, int frame);
+    
+    // Frees the tile's pages. The shader uses the coarse state again.
+    void evict(int tile);
+
+private:
+    struct TileSlot
+    {
+        // The pages used by the tile. firstPage is -1 when not resident.
+        int firstPage;
+        int pagesCount;
+        
+        int lastUsedFrame;
+        uint32_t coarseState;
+    };
+    
+    GLuint buffer_;
+    GLuint bufferTexture_;
+    
+    // The table size, rounded up to a whole page so pages stay aligned
+    int tableWords_;
+    
+    vector<TileSlot> tiles_;
+    
+    // The tile using each page, or -1 if free
+    vector<int> pageOwners_;
+    
+    int residentTiles_;
+    int residentPages_;
+    
+    // The pages that are free or used by tiles not used in the frame
+    int availablePages(int frame) const;
+    
+    // The resident tile not used in the frame that was used least recently, or -1
+    int leastRecentlyUsed(int frame) const;
+    
+    // Moves the resident tiles to the start of the pool,
+    // so the free pages form a single run at the end
+    void compact();
+    
+    // Copies a resident tile's pages to start at the given page
+    void moveTile(int tile, int firstPage);
+    
+    // The position of a page in the buffer
+    size_t pageOffsetBytes(int page) const { return ((size_t)tableWords_ + (size_t)page * PageSizeWords) * 4; }
+    
+    // Uploads the tile's table entry
+    void writeTableEntry(int tile);
+};
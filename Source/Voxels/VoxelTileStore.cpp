@@ -0,0 +1,235 @@
+#include "VoxelTileStore.hpp"
+
+#include <assert.h>
+#include <cstring>
+#include <sys/types.h>
+#include <unistd.h>
+
+static const char FileMagic[4] = { 'V', 'S', 'V', 'T' };
+
+VoxelTileStore::VoxelTileStore()
+    : file_(NULL),
+    entries_(),
+    sizeBytes_(0),
+    mutex_()
+{
+
+}
+
+VoxelTileStore::~VoxelTileStore()
+{
+    if(file_ != NULL)
+    {
+        fclose(file_);
+    }
+}
+
+bool VoxelTileStore::open(const string &fileName, int tileCount)
+{
+    lock_guard<mutex> lock(mutex_);
+    assert(file_ == NULL);
+    
+    // No tiles are written yet
+    entries_.resize(tileCount);
+    for(int i = 0; i < tileCount; ++i)
+    {
+        entries_[i].offset = -1;
+        entries_[i].sizeWords = 0;
+        entries_[i].coarseState = 0;
+    }
+    
+    bool existingFile = false;
+    if(fileName.empty())
+    {
+        file_ = tmpfile();
+    }
+    else
+    {
+        // Keep the tiles already in the file
+        file_ = fopen(fileName.c_str(), "r+b");
+        existingFile = (file_ != NULL) && readRecords(tileCount);
+        if(file_ != NULL && !existingFile)
+        {
+            printf("Voxel tile file %s is out of date, building it again \n", fileName.c_str());
+            fclose(file_);
+            file_ = NULL;
+        }
+        
+        if(file_ == NULL)
+        {
+            file_ = fopen(fileName.c_str(), "w+b");
+        }
+    }
+    
+    if(file_ != NULL && !existingFile && !writeHeader(tileCount))
+    {
+        fclose(file_);
+        file_ = NULL;
+    }
+    
+    if(file_ == NULL)
+    {
+        printf("Failed to create the voxel tile file, keeping tiles in memory \n");
+        return false;
+    }
+    
+    return true;
+}
+
+bool VoxelTileStore::contains(int tile) const
+{
+    lock_guard<mutex> lock(mutex_);
+    return entries_[tile].offset >= 0;
+}
+
+int VoxelTileStore::sizeWords(int tile) const
+{
+    lock_guard<mutex> lock(mutex_);
+    return entries_[tile].sizeWords;
+}
+
+uint32_t VoxelTileStore::coarseState(int tile) const
+{
+    lock_guard<mutex> lock(mutex_);
+    return entries_[tile].coarseState;
+}
+
+size_t VoxelTileStore::sizeBytes() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return sizeBytes_;
+}
+
+bool VoxelTileStore::write(int tile, const vector<uint32_t> &words, uint32_t coarseState)
+{
+    assert(!words.empty());
+    lock_guard<mutex> lock(mutex_);
+    
+    Entry &entry = entries_[tile];
+    assert(entry.offset < 0);
+    
+    if(file_ == NULL)
+    {
+        entry.words = words;
+        entry.offset = 0;
+    }
+    else
+    {
+        // Tiles are appended to the end of the file
+        if(fseeko(file_, 0, SEEK_END) != 0)
+        {
+            printf("Failed to write voxel tile %d \n", tile);
+            return false;
+        }
+        
+        // Flushed straight away, so the tile is kept if the program stops
+        uint32_t record[RecordHeaderWords] = { (uint32_t)tile, (uint32_t)words.size(), coarseState };
+        int64_t offset = ftello(file_);
+        if(offset < 0
+           || fwrite(record, sizeof(uint32_t), RecordHeaderWords, file_) != (size_t)RecordHeaderWords
+           || fwrite(&words[0], sizeof(uint32_t), words.size(), file_) != words.size()
+           || fflush(file_) != 0)
+        {
+            printf("Failed to write voxel tile %d \n", tile);
+            return false;
+        }
+        
+        entry.offset = offset + RecordHeaderWords * sizeof(uint32_t);
+    }
+    
+    entry.sizeWords = (int)words.size();
+    entry.coarseState = coarseState;
+    sizeBytes_ += words.size() * sizeof(uint32_t);
+    return true;
+}
+
+bool VoxelTileStore::read(int tile, vector<uint32_t>* words) const
+{
+    lock_guard<mutex> lock(mutex_);
+    
+    const Entry &entry = entries_[tile];
+    if(entry.offset < 0)
+    {
+        return false;
+    }
+    
+    if(file_ == NULL)
+    {
+        *words = entry.words;
+        return true;
+    }
+    
+    words->resize(entry.sizeWords);
+    if(fseeko(file_, entry.offset, SEEK_SET) != 0
+       || fread(&(*words)[0], sizeof(uint32_t), entry.sizeWords, file_) != (size_t)entry.sizeWords)
+    {
+        printf("Failed to read voxel tile %d \n", tile);
+        return false;
+    }
+    
+    return true;
+}
+
+bool VoxelTileStore::readRecords(int tileCount)
+{
+    // Find the size of the file
+    if(fseeko(file_, 0, SEEK_END) != 0)
+    {
+        return false;
+    }
+    
+    int64_t fileSize = ftello(file_);
+    rewind(file_);
+    
+    // Check the file is for the same version and number of tiles
+    char magic[4];
+    uint32_t header[2];
+    if(fread(magic, 1, sizeof(magic), file_) != sizeof(magic) || memcmp(magic, FileMagic, sizeof(magic)) != 0
+       || fread(header, sizeof(uint32_t), 2, file_) != 2 || header[0] != Version || header[1] != (uint32_t)tileCount)
+    {
+        return false;
+    }
+    
+    // Find each tile, stopping at a record that is not complete
+    int64_t end = ftello(file_);
+    uint32_t record[RecordHeaderWords];
+    while(fread(record, sizeof(uint32_t), RecordHeaderWords, file_) == (size_t)RecordHeaderWords)
+    {
+        int64_t offset = end + RecordHeaderWords * sizeof(uint32_t);
+        int64_t recordEnd = offset + (int64_t)record[1] * sizeof(uint32_t);
+        if(record[0] >= (uint32_t)tileCount || record[1] == 0 || recordEnd > fileSize
+           || entries_[record[0]].offset >= 0 || fseeko(file_, recordEnd, SEEK_SET) != 0)
+        {
+            break;
+        }
+        
+        Entry &entry = entries_[record[0]];
+        entry.offset = offset;
+        entry.sizeWords = (int)record[1];
+        entry.coarseState = record[2];
+        sizeBytes_ += record[1] * sizeof(uint32_t);
+        end = recordEnd;
+    }
+    
+    // Remove anything after the last complete tile, so new tiles follow it
+    if(end < fileSize && ftruncate(fileno(file_), end) != 0)
+    {
+        for(unsigned int i = 0; i < entries_.size(); ++i)
+        {
+            entries_[i].offset = -1;
+        }
+        
+        sizeBytes_ = 0;
+        return false;
+    }
+    
+    return true;
+}
+
+bool VoxelTileStore::writeHeader(int tileCount)
+{
+    uint32_t header[2] = { Version, (uint32_t)tileCount };
+    return fwrite(FileMagic, 1, sizeof(FileMagic), file_) == sizeof(FileMagic)
+        && fwrite(header, sizeof(uint32_t), 2, file_) == 2
+        && fflush(file_) == 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Holds the subtree of every built tile in a file, so only the tiles that
+// are resident on the GPU need to be in memory at once.
+// A named file is kept between runs as a cache of the built tiles. Each tile
+// is appended as a record, so a file that was cut short loses only its last tile.
+// Tiles are written by the merging thread and read by the loading thread,
+// so every method is thread safe.
+class VoxelTileStore
+{
+public:
+    VoxelTileStore();
+    ~VoxelTileStore();
+    
+    // Opens the named file, reading the tiles already in it, or creates it.
+    // An empty name creates a temporary file, which is deleted with the store.
+    // If no file can be used, tiles are kept in memory instead.
+    bool open(const string &fileName, int tileCount);
+    
+    // True once the tile has been written
+    bool contains(int tile) const;
+    
+    // The size of a written tile
+    int sizeWords(int tile) const;
+    
+    // The coarse state of a written tile, from VoxelWriter::tileCoarseState
+    uint32_t coarseState(int tile) const;
+    
+    // The size of every written tile
+    size_t sizeBytes() const;
+    
+    // Stores a tile's subtree, as written by VoxelWriter::writeTile
+    bool write(int tile, const vector<uint32_t> &words, uint32_t coarseState);
+    
+    // Reads back a written tile's subtree
+    bool read(int tile, vector<uint32_t>* words) const;
+
+private:
+    // Changing the file layout must change the version,
+    // so older files are not used
+    const static uint32_t Version = 2;
+    
+    // The words before each tile: its index, size and coarse state
+    const static int RecordHeaderWords = 3;
+    
+    struct Entry
+    {
+        // The position of the words in the file, or -1 if not written
+        int64_t offset;
+        int sizeWords;
+        uint32_t coarseState;
+        
+        // The words, when there is no file
+        vector<uint32_t> words;
+    };
+    
+    FILE* file_;
+    vector<Entry> entries_;
+    size_t sizeBytes_;
+    mutable mutex mutex_;
+    
+    // Reads the tile records of an existing file.
+    // Returns false if the file is not a tile file for this many tiles.
+    bool readRecords(int tileCount);
+    
+    // Starts a new file with just the header
+    bool writeHeader(int tileCount);
+};
@@ -2,68 +2,140 @@
 
 #include <assert.h>
 #include <math.h>
+#include <cfloat>
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
 
 #include <QElapsedTimer>
 
-VoxelTree::VoxelTree(UniformManager* uniformManager, const Scene* scene, int resolution)
+#include "GLState.hpp"
+#include "Hash.hpp"
+#include "Platform.hpp"
+#include "WorkerPool.hpp"
+
+// Bounds covering nothing, which any covered point replaces
+static Bounds emptyBounds()
+{
+    return Bounds(Vector3(FLT_MAX, FLT_MAX, FLT_MAX), Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+}
+
+static bool isEmpty(const Bounds &bounds)
+{
+    return bounds.min().x > bounds.max().x;
+}
+
+// The number of tiles needed to cover the voxels, at least 1
+static int tilesCovering(float voxels, int tileResolution)
+{
+    return max((int)ceilf(voxels / tileResolution), 1);
+}
+
+static uint64_t hashMatrix(const Matrix4x4 &matrix, uint64_t hash)
+{
+    for(int row = 0; row < 4; ++row)
+    {
+        for(int column = 0; column < 4; ++column)
+        {
+            float value = matrix.get(row, column);
+            hash = hashBytes(&value, sizeof(value), hash);
+        }
+    }
+    
+    return hash;
+}
+
+static uint64_t hashBounds(const Bounds &bounds, uint64_t hash)
+{
+    float values[6] = { bounds.min().x, bounds.min().y, bounds.min().z, bounds.max().x, bounds.max().y, bounds.max().z };
+    return hashBytes(values, sizeof(values), hash);
+}
+
+VoxelTree::VoxelTree(UniformManager* uniformManager, const Scene* scene, int resolution, int maxTileResolution,
+                     int poolSizeMB)
     : uniformManager_(uniformManager),
     scene_(scene),
-    sceneBoundsLightSpace_(computeSceneBoundsLightSpace()),
+    sceneBoundsLightSpace_(Vector3::zero(), Vector3::zero()),
+    sceneLoaded_(!scene->isLoading()),
+    buildStarted_(false),
     buildTimer_(),
     pcfKernelSize_(9),
+    concurrentBuilds_(6),
+    bakeDistance_(0.0),
+    detailDistance_(0.0),
+    minTileResolution_(8),
+    playAreaLightSpace_(positionLightSpace(scene->playArea())),
+    tileCacheEnabled_(true),
     startedTiles_(0),
     mergedTiles_(0),
     uploadedTiles_(0),
+    coarseTiles_(0),
+    cachedTiles_(0),
+    emptyTiles_(0),
     treeResolution_(resolution),
+    maxTileResolution_(maxTileResolution),
+    tileResolution_(8),
+    tilesX_(1),
+    tilesY_(1),
+    tileMinZ_(),
+    tileMaxZ_(),
     shadowMap_(scene, uniformManager, 1, 4),
-    voxelWriter_(),
+    tileWriter_(),
+    tileStore_(),
+    coarseTileStore_(),
+    pagePool_(NULL),
     activeTiles_(),
-    activeTilesMutex_()
+    activeTilesMutex_(),
+    builderFinished_(),
+    mergedTilesQueue_(),
+    mergedTilesMutex_(),
+    residentDistance_(0.0),
+    residencyFrame_(0),
+    loadsInFlight_(0),
+    storedTiles_(),
+    loadingTiles_(),
+    loadedTiles_(),
+    loadedTilesMutex_(),
+    stopMerging_(false),
+    loader_(1)
 {
     buildTimer_.start();
     
-    // Make each tile as small as possible.
-    tileResolution_ = std::min(resolution, 4096);
-    while(totalTiles() > MaxTileCount)
-    {
-        // Double the resolution until under the tile count limit.
-        tileResolution_ *= 2;
-    }
+    // Fit the tiles to the scene so far. They are fitted again once it has loaded.
+    fitTileGrid();
     
-    // Each tile must be at least 8x8 so that leaf masks can be used
-    // and no more than 16K (maximum texture resolution)
-    assert(tileResolution_ >= 8);
-    assert(tileResolution_ <= 16384);
-    
-    // Set the correct shadow map resolution
-    shadowMap_.setCascades(1, tileResolution_);
-    
-    // Create the root pointers in the buffer
-    voxelWriter_.reserveRootNodePointerSpace(totalTiles());
-    
-    // Create the buffer to hold the tree
-    glGenBuffers(1, &buffer_);
-    glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
-    glGenTextures(1, &bufferTexture_);
-    glBindTexture(GL_TEXTURE_BUFFER, bufferTexture_);
-    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, buffer_);
+    // Built tiles are kept in the store, and the closest are copied to the pool.
+    // The store is opened once the scene bounds are known.
+    pagePool_ = new VoxelPagePool(MaxTileCount, poolSizeMB);
     
     // Set the initial buffer values
-    updateBuffers();
+    updateUniformBuffer();
     
     // Start the tile merging thread
     mergingThread_ = thread(&VoxelTree::mergeTiles, this);
-    
-    // Add every tile to the list of tiles to build
-    for(int tile = 0; tile < totalTiles(); ++tile)
+}
+
+VoxelTree::~VoxelTree()
+{
+    // Builders can't be stopped, so wait for the started tiles to be merged
+    while(mergedTiles_ < startedTiles_)
     {
-        notStartedTiles_.push_back(tile);
+        this_thread::sleep_for(chrono::milliseconds(1));
     }
+    
+    activeTilesMutex_.lock();
+    stopMerging_ = true;
+    builderFinished_.notify_one();
+    activeTilesMutex_.unlock();
+    mergingThread_.join();
+    loader_.wait();
+    
+    delete pagePool_;
 }
 
 size_t VoxelTree::sizeBytes() const
 {
-    return voxelWriter_.dataSizeBytes();
+    return tileStore_.sizeBytes();
 }
 
 size_t VoxelTree::sizeMB() const
@@ -71,10 +143,15 @@ size_t VoxelTree::sizeMB() const
     return sizeBytes() / (1024 * 1024);
 }
 
+size_t VoxelTree::residentSizeMB() const
+{
+    return pagePool_->residentSizeBytes() / (1024 * 1024);
+}
+
 size_t VoxelTree::originalSizeBytes() const
 {
     // Using 3 bytes -> 24 bits per pixel
-    return (size_t)treeResolution_ * (size_t)treeResolution_ * 3;
+    return (size_t)resolutionX() * (size_t)resolutionY() * 3;
 }
 
 size_t VoxelTree::originalSizeMB() const
@@ -93,32 +170,221 @@ void VoxelTree::setPCFFilterSize(int kernelSize)
     updateUniformBuffer();
 }
 
+void VoxelTree::setConcurrentBuilds(int concurrentBuilds)
+{
+    assert(concurrentBuilds > 0);
+    concurrentBuilds_ = concurrentBuilds;
+}
+
+void VoxelTree::setBakeDistance(float distance)
+{
+    assert(distance >= 0.0);
+    bakeDistance_ = distance;
+}
+
+void VoxelTree::setDetailDistance(float distance, int minTileResolution)
+{
+    assert(!buildStarted_);
+    assert(distance >= 0.0);
+    assert(minTileResolution >= 8);
+    detailDistance_ = distance;
+    minTileResolution_ = minTileResolution;
+}
+
+void VoxelTree::setTileCacheEnabled(bool enabled)
+{
+    assert(!buildStarted_);
+    tileCacheEnabled_ = enabled;
+}
+
+void VoxelTree::setResidentDistance(float distance)
+{
+    assert(distance >= 0.0);
+    residentDistance_ = distance;
+}
+
 void VoxelTree::updateBuild()
 {
+    // The tiles can't be placed until every mesh is loaded
+    if(!sceneLoaded_)
+    {
+        if(scene_->isLoading())
+        {
+            return;
+        }
+        
+        fitTileGrid();
+        sceneLoaded_ = true;
+        updateUniformBuffer();
+    }
+    
+    if(!buildStarted_)
+    {
+        startBuild();
+    }
+    
     // Start another tile build if the limit is not currently met
     int activeTiles = startedTiles_ - mergedTiles_;
-    if(activeTiles < ConcurrentBuilds && startedTiles_ < totalTiles())
+    if(activeTiles < concurrentBuilds_ && (!notStartedCoarseTiles_.empty() || !notStartedTiles_.empty()))
     {
         startTileBuild();
     }
     
-    // Reupload the tree to the gpu if more tiles have finished
-    if(uploadedTiles_ < mergedTiles_)
+    // Show the tiles that have finished, and load those near the camera
+    collectMergedTiles();
+    updateResidency();
+}
+
+bool VoxelTree::isBuilding() const
+{
+    return !buildStarted_ || uploadedTiles_ + coarseTiles_ < cachedTiles_ + emptyTiles_ + startedTiles_
+        || !notStartedCoarseTiles_.empty() || closestTileToStart() >= 0;
+}
+
+void VoxelTree::finishLoading()
+{
+    // Each update starts more loads while any tiles are still wanted
+    updateResidency();
+    while(loadsInFlight_ > 0)
+    {
+        loader_.wait();
+        updateResidency();
+    }
+}
+
+void VoxelTree::startBuild()
+{
+    buildStarted_ = true;
+    buildTimer_.start();
+    
+    printf("Voxel tree fitted to %d x %d tiles of %d (%d x %d) \n", tilesX_, tilesY_, tileResolution_, resolutionX(), resolutionY());
+    
+    // Without the cache, the stores use temporary files
+    string fileName;
+    string coarseFileName;
+    if(tileCacheEnabled_)
+    {
+        mkdir(VOXEL_CACHE_DIRECTORY, 0755);
+        fileName = tileCacheFileName("vxt");
+        coarseFileName = tileCacheFileName("vxc");
+    }
+    
+    tileStore_.open(fileName, totalTiles());
+    coarseTileStore_.open(coarseFileName, totalTiles());
+    
+    // Show the tiles that were built before, and queue the others.
+    // Empty tiles are left unshadowed.
+    mergedTilesMutex_.lock();
+    for(int tile = 0; tile < totalTiles(); ++tile)
     {
-        updateBuffers();
+        if(tileMinZ_[tile] > tileMaxZ_[tile])
+        {
+            emptyTiles_ ++;
+            uploadedTiles_ ++;
+            continue;
+        }
+        
+        float depthOffset;
+        float depthScale;
+        tileDepthTransform(tile, &depthOffset, &depthScale);
+        pagePool_->setDepthTransform(tile, depthOffset, depthScale);
+        
+        if(tileStore_.contains(tile))
+        {
+            mergedTilesQueue_.push_back(make_pair(tile, false));
+            cachedTiles_ ++;
+            continue;
+        }
+        
+        // Tiles at the minimum resolution are built with the coarse versions,
+        // as they cost as little
+        if(tileResolution(tile) <= minTileResolution_)
+        {
+            notStartedCoarseTiles_.push_back(tile);
+            continue;
+        }
         
-        // Output build stats if now finished
-        if(uploadedTiles_ == totalTiles())
+        // Others show their coarse version until they are built
+        if(coarseTileStore_.contains(tile))
         {
-            auto time = buildTimer_.elapsed();
-            printf("Tree construction finished in %lld ms \n", time);
+            storedTiles_[tile] = StoredCoarse;
+            pagePool_->setCoarseState(tile, coarseTileStore_.coarseState(tile));
         }
+        else
+        {
+            notStartedCoarseTiles_.push_back(tile);
+        }
+        
+        notStartedTiles_.push_back(tile);
     }
+    mergedTilesMutex_.unlock();
+    
+    // Build the coarse versions closest to the camera first
+    Vector3 cameraPosLight = cameraPositionLightSpace();
+    sort(notStartedCoarseTiles_.begin(), notStartedCoarseTiles_.end(), [this, cameraPosLight](int a, int b)
+    {
+        return tileDistance(a, cameraPosLight) > tileDistance(b, cameraPosLight);
+    });
+    
+    if(cachedTiles_ > 0)
+    {
+        printf("Found %d of %d voxel tree tiles in the cache \n", cachedTiles_, totalTiles());
+    }
+}
+
+string VoxelTree::tileCacheFileName(const char* extension) const
+{
+    // Tiles depend on the resolutions, the detail area, the light
+    // direction and the static instances in the scene bounds.
+    // The shape of each mesh is hashed, including its simplified levels of
+    // detail, so editing or simplifying a mesh differently builds the tiles again.
+    int resolutions[5] = { tilesX_, tilesY_, tileResolution_, treeResolution_, minTileResolution_ };
+    float detailArea[4] = { detailDistance_, playAreaLightSpace_.x, playAreaLightSpace_.y, playAreaLightSpace_.z };
+    uint64_t key = hashBytes(resolutions, sizeof(resolutions));
+    key = hashBytes(detailArea, sizeof(detailArea), key);
+    key = hashMatrix(scene_->mainLight()->worldToLocal(), key);
+    key = hashBounds(sceneBoundsLightSpace_, key);
+    
+    const vector<MeshInstance*>* instances = scene_->meshInstances();
+    for(unsigned int i = 0; i < instances->size(); ++i)
+    {
+        MeshInstance* instance = (*instances)[i];
+        if(instance->isStatic())
+        {
+            uint64_t meshHash = instance->mesh()->contentHash();
+            key = hashBytes(&meshHash, sizeof(meshHash), key);
+            key = hashMatrix(instance->localToWorld(), key);
+        }
+    }
+    
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.%s", (unsigned long long)key, extension);
+    return string(VOXEL_CACHE_DIRECTORY) + name;
 }
 
 void VoxelTree::startTileBuild()
 {
-    int tileIndex = getNextTileToStart();
+    // The coarse versions are built first, whatever their distance.
+    // Nothing else is started if no tile is within the bake distance.
+    int tileIndex;
+    int resolution;
+    if(!notStartedCoarseTiles_.empty())
+    {
+        tileIndex = notStartedCoarseTiles_.back();
+        notStartedCoarseTiles_.pop_back();
+        resolution = minTileResolution_;
+    }
+    else
+    {
+        tileIndex = getNextTileToStart();
+        if(tileIndex < 0)
+        {
+            return;
+        }
+        
+        resolution = tileResolution(tileIndex);
+    }
+    
     startedTiles_ ++;
     
     // Compute the light space bounds of the tile
@@ -128,14 +394,20 @@ void VoxelTree::startTileBuild()
     // a dual shadow map.
     float* entryDepths;
     float* exitDepths;
-    computeDualShadowMaps(bounds, &entryDepths, &exitDepths);
+    computeDualShadowMaps(bounds, resolution, &entryDepths, &exitDepths);
     
-    // Create the builder.
-    VoxelBuilder* builder = new VoxelBuilder(tileIndex, tileResolution_, entryDepths, exitDepths);
+    // Create the builder. It wakes the merging thread when it is done.
+    VoxelBuilder* builder = new VoxelBuilder(tileIndex, resolution, entryDepths, exitDepths, [this]()
+    {
+        lock_guard<mutex> lock(activeTilesMutex_);
+        builderFinished_.notify_one();
+    });
     
-    // Add to the active tiles list
+    // Add to the active tiles list.
+    // The builder may have finished already, so the merging thread is woken.
     activeTilesMutex_.lock();
     activeTiles_.push_back(builder);
+    builderFinished_.notify_one();
     activeTilesMutex_.unlock();
 }
 
@@ -144,26 +416,43 @@ int VoxelTree::getNextTileToStart()
     // Check there are tiles waiting to be started
     assert(notStartedTiles_.empty() == false);
     
-    // Get the world to light space transformation matrix (without translation)
-    Matrix4x4 worldToLight = scene_->mainLight()->worldToLocal();
-    worldToLight.set(0, 3, 0.0);
-    worldToLight.set(1, 3, 0.0);
-    worldToLight.set(2, 3, 0.0);
+    int closestTile = closestTileToStart();
+    if(closestTile < 0)
+    {
+        return -1;
+    }
     
+    // Remove the tile from the queue + return it
+    int tileIndex = notStartedTiles_[closestTile];
+    std::swap(notStartedTiles_[closestTile], notStartedTiles_.back());
+    notStartedTiles_.pop_back();
+    return tileIndex;
+}
+
+int VoxelTree::closestTileToStart() const
+{
     // Get the camera position in light space
-    Vector4 cameraPosWorld = Vector4(scene_->mainCamera()->position(), 1.0);
-    Vector3 cameraPosLight = (worldToLight * cameraPosWorld).vec3();
+    Vector3 cameraPosLight = cameraPositionLightSpace();
     
     // Keep track of the best tile
     float closestDistance = 1000000000000.0;
-    int highestTileIndex = 0;
+    int closestTile = -1;
     
     // Check each tile
     for(unsigned int i = 0; i < notStartedTiles_.size(); ++i)
     {
-        // Get the tile centre in light space
-        Bounds tileBounds = tileBoundsLightSpace(notStartedTiles_[i]);
+        // Skip tiles outside the bake distance
+        int tile = notStartedTiles_[i];
+        if(bakeDistance_ > 0.0 && tileDistance(tile, cameraPosLight) > bakeDistance_)
+        {
+            continue;
+        }
+        
+        // Get the tile centre in light space.
+        // Tiles are fitted to different depths, so only x and y are compared.
+        Bounds tileBounds = tileBoundsLightSpace(tile);
         Vector3 tileCentre = tileBounds.centre();
+        tileCentre.z = cameraPosLight.z;
         
         // Get the camera to tile centre sqr distance
         float distance = (cameraPosLight - tileCentre).sqrMagnitude();
@@ -172,26 +461,29 @@ int VoxelTree::getNextTileToStart()
         if(distance < closestDistance)
         {
             closestDistance = distance;
-            highestTileIndex = i;
+            closestTile = i;
         }
     }
     
-    // Remove the tile from the queue + return it
-    int tileIndex = notStartedTiles_[highestTileIndex];
-    std::swap(notStartedTiles_[highestTileIndex], notStartedTiles_.back());
-    notStartedTiles_.pop_back();
-    return tileIndex;
+    return closestTile;
 }
 
 void VoxelTree::mergeTiles()
 {
-    // Keep looking for tiles to merge until finished
-    while(mergedTiles_ < totalTiles())
+    // Keep looking for tiles to merge until the tree is deleted
+    while(!stopMerging_)
     {
-        // Look for a finished builder
-        activeTilesMutex_.lock();
-        VoxelBuilder* builder = findFinishedBuilder();
-        activeTilesMutex_.unlock();
+        // Wait for a finished builder
+        VoxelBuilder* builder = NULL;
+        {
+            unique_lock<mutex> lock(activeTilesMutex_);
+            builder = findFinishedBuilder();
+            while(builder == NULL && !stopMerging_)
+            {
+                builderFinished_.wait(lock);
+                builder = findFinishedBuilder();
+            }
+        }
         
         if(builder == NULL)
         {
@@ -203,18 +495,208 @@ void VoxelTree::mergeTiles()
         uint32_t* subtree = (uint32_t*)builder->tree();
         VoxelPointer subtreeRoot = builder->rootAddress();
 
-        // Write the tree to the combined tree and store the root node location
-        VoxelPointer ptr = voxelWriter_.writeTree(subtree, subtreeRoot, tileResolution_);
-        voxelWriter_.setRootNodePointer(tile, ptr);
+        // Write the tile's subtree to the store, so it can be loaded when needed.
+        // Builds below the tile's own resolution are its coarse version.
+        bool coarse = builder->resolution() < tileResolution(tile);
+        VoxelTileStore &store = coarse ? coarseTileStore_ : tileStore_;
+        tileWriter_.writeTile(subtree, subtreeRoot, builder->resolution());
+        store.write(tile, tileWriter_.words(), tileWriter_.tileCoarseState());
         
         // The builder is no longer needed
         delete builder;
         
+        mergedTilesMutex_.lock();
+        mergedTilesQueue_.push_back(make_pair(tile, coarse));
+        mergedTilesMutex_.unlock();
+        
         // Update the merged tiles count
         mergedTiles_ ++;
     }
 }
 
+void VoxelTree::collectMergedTiles()
+{
+    mergedTilesMutex_.lock();
+    vector<pair<int, bool> > mergedTiles;
+    mergedTiles.swap(mergedTilesQueue_);
+    mergedTilesMutex_.unlock();
+    
+    // Show the coarse state until the tile is loaded
+    for(unsigned int i = 0; i < mergedTiles.size(); ++i)
+    {
+        int tile = mergedTiles[i].first;
+        if(mergedTiles[i].second)
+        {
+            // A coarse version merged after the full tile isn't needed
+            coarseTiles_ ++;
+            if(storedTiles_[tile] != StoredFull)
+            {
+                storedTiles_[tile] = StoredCoarse;
+                pagePool_->setCoarseState(tile, coarseTileStore_.coarseState(tile));
+            }
+        }
+        else
+        {
+            // The coarse version is replaced on the GPU too, so the full tile is loaded
+            if(storedTiles_[tile] == StoredCoarse && pagePool_->isResident(tile))
+            {
+                pagePool_->evict(tile);
+            }
+            
+            storedTiles_[tile] = StoredFull;
+            pagePool_->setCoarseState(tile, tileStore_.coarseState(tile));
+            uploadedTiles_ ++;
+        }
+    }
+    
+    // Output build stats if every tile within the bake distance is finished
+    if(!mergedTiles.empty() && !isBuilding())
+    {
+        auto time = buildTimer_.elapsed();
+        printf("Tree construction finished in %lld ms, %d of %d tiles, %d MB \n", time, uploadedTiles_, totalTiles(), (int)sizeMB());
+    }
+}
+
+void VoxelTree::updateResidency()
+{
+    residencyFrame_ ++;
+    
+    // Find the stored tiles within the resident distance
+    Vector3 cameraPosLight = cameraPositionLightSpace();
+    vector<pair<float, int> > wantedTiles;
+    for(int tile = 0; tile < totalTiles(); ++tile)
+    {
+        float distance = tileDistance(tile, cameraPosLight);
+        if(storedTiles_[tile] != NotStored && (residentDistance_ <= 0.0 || distance <= residentDistance_))
+        {
+            wantedTiles.push_back(make_pair(distance, tile));
+        }
+    }
+    
+    // Keep the closest tiles that fit in the pool from being evicted.
+    // Further tiles are evicted for them when the space is needed.
+    sort(wantedTiles.begin(), wantedTiles.end());
+    int wantedPages = 0;
+    unsigned int wantedCount = 0;
+    for(; wantedCount < wantedTiles.size(); ++wantedCount)
+    {
+        int tile = wantedTiles[wantedCount].second;
+        wantedPages += VoxelPagePool::pagesNeeded(shownTileStore(tile).sizeWords(tile));
+        if(wantedPages > pagePool_->pagesCount())
+        {
+            break;
+        }
+        
+        pagePool_->touch(tile, residencyFrame_);
+    }
+    
+    // Upload the tiles that have been read
+    collectLoadedTiles();
+    
+    // Load the closest wanted tiles first, when there is space for them
+    for(unsigned int i = 0; i < wantedCount && loadsInFlight_ < MaxLoadsInFlight; ++i)
+    {
+        int tile = wantedTiles[i].second;
+        if(!pagePool_->isResident(tile) && !loadingTiles_[tile]
+           && pagePool_->canPlace(shownTileStore(tile).sizeWords(tile), residencyFrame_))
+        {
+            loadTile(tile);
+        }
+    }
+}
+
+void VoxelTree::collectLoadedTiles()
+{
+    loadedTilesMutex_.lock();
+    vector<LoadedTile> loadedTiles;
+    loadedTiles.swap(loadedTiles_);
+    loadedTilesMutex_.unlock();
+    
+    for(unsigned int i = 0; i < loadedTiles.size(); ++i)
+    {
+        const LoadedTile &loaded = loadedTiles[i];
+        loadingTiles_[loaded.tile] = 0;
+        loadsInFlight_ --;
+        
+        // The space may have been taken since the load started, in which
+        // case the tile stays coarse until it is loaded again.
+        // A coarse version read before the full tile was shown is dropped.
+        if(loaded.valid && !(loaded.coarse && storedTiles_[loaded.tile] == StoredFull))
+        {
+            pagePool_->place(loaded.tile, loaded.words, residencyFrame_);
+        }
+    }
+}
+
+void VoxelTree::loadTile(int tile)
+{
+    loadingTiles_[tile] = 1;
+    loadsInFlight_ ++;
+    
+    // The stores are thread safe, and the shown version is read
+    bool coarse = storedTiles_[tile] == StoredCoarse;
+    const VoxelTileStore* store = &shownTileStore(tile);
+    loader_.run([this, tile, coarse, store]()
+    {
+        LoadedTile loaded;
+        loaded.tile = tile;
+        loaded.coarse = coarse;
+        loaded.valid = store->read(tile, &loaded.words);
+        
+        loadedTilesMutex_.lock();
+        loadedTiles_.push_back(loaded);
+        loadedTilesMutex_.unlock();
+    });
+}
+
+const VoxelTileStore &VoxelTree::shownTileStore(int tile) const
+{
+    return storedTiles_[tile] == StoredCoarse ? coarseTileStore_ : tileStore_;
+}
+
+Vector3 VoxelTree::cameraPositionLightSpace() const
+{
+    return positionLightSpace(scene_->mainCamera()->position());
+}
+
+Vector3 VoxelTree::positionLightSpace(const Vector3 &position) const
+{
+    // Get the world to light space transformation matrix (without translation)
+    Matrix4x4 worldToLight = scene_->mainLight()->worldToLocal();
+    worldToLight.set(0, 3, 0.0);
+    worldToLight.set(1, 3, 0.0);
+    worldToLight.set(2, 3, 0.0);
+    
+    return (worldToLight * Vector4(position, 1.0)).vec3();
+}
+
+float VoxelTree::tileDistance(int index, const Vector3 &lightSpacePoint) const
+{
+    // Distance to the closest point of the tile's rectangle
+    Bounds tileBounds = tileBoundsLightSpace(index);
+    float dx = max(max(tileBounds.min().x - lightSpacePoint.x, lightSpacePoint.x - tileBounds.max().x), 0.0f);
+    float dy = max(max(tileBounds.min().y - lightSpacePoint.y, lightSpacePoint.y - tileBounds.max().y), 0.0f);
+    return sqrtf(dx * dx + dy * dy);
+}
+
+int VoxelTree::tileResolution(int index) const
+{
+    if(detailDistance_ <= 0.0)
+    {
+        return tileResolution_;
+    }
+    
+    // Halve the resolution for each multiple of the detail distance
+    int levels = (int)(tileDistance(index, playAreaLightSpace_) / detailDistance_);
+    int resolution = tileResolution_;
+    for(int i = 0; i < levels && resolution / 2 >= minTileResolution_; ++i)
+    {
+        resolution /= 2;
+    }
+    
+    return resolution;
+}
+
 VoxelBuilder* VoxelTree::findFinishedBuilder()
 {
     // Look for a builder that has finished
@@ -238,12 +720,6 @@ VoxelBuilder* VoxelTree::findFinishedBuilder()
     return NULL;
 }
 
-void VoxelTree::updateBuffers()
-{
-    updateUniformBuffer();
-    updateTreeBuffer();
-}
-
 void VoxelTree::updateUniformBuffer()
 {
     // Cover the scene witht the shadowmap and get the world to shadow matrix
@@ -252,8 +728,8 @@ void VoxelTree::updateUniformBuffer()
     
     // Scale the world to shadow matrix by the total voxel resolution
     Vector3 scale;
-    scale.x = treeResolution_;
-    scale.y = treeResolution_;
+    scale.x = resolutionX();
+    scale.y = resolutionY();
     scale.z = tileResolution_; // The trees are only tiled in x and y
     worldToShadow = Matrix4x4::scale(scale) * worldToShadow;
     
@@ -261,7 +737,8 @@ void VoxelTree::updateUniformBuffer()
     VoxelsUniformBuffer buffer;
     buffer.worldToVoxels = worldToShadow;
     buffer.voxelTreeHeight = log2(tileResolution_);
-    buffer.tileSubdivisions = tileSubdivisions();
+    buffer.tileCountX = tilesX_;
+    buffer.tileCountY = tilesY_;
     buffer.pcfSampleCount = pcfKernelSize_ * pcfKernelSize_;
     buffer.pcfLookups = ((pcfKernelSize_ + 7) / 8) * ((pcfKernelSize_ + 7) / 8);
     
@@ -325,20 +802,7 @@ uint64_t VoxelTree::pcfBitmask(int kernelX, int kernelY) const
     return bitmask;
 }
 
-void VoxelTree::updateTreeBuffer()
-{
-    // Update the uploaded tiles count
-    uploadedTiles_ = mergedTiles_;
-    
-    // Get the current tree data
-    const void* treeData = voxelWriter_.data();
-    size_t treeSizeBytes = voxelWriter_.dataSizeBytes();
-    
-    // Create the buffer to hold the tree
-    glBufferData(GL_TEXTURE_BUFFER, treeSizeBytes, treeData, GL_STATIC_DRAW);
-}
-
-Bounds VoxelTree::computeSceneBoundsLightSpace() const
+Bounds VoxelTree::computeSceneBoundsLightSpace(vector<Bounds>* instanceBounds) const
 {
     // Get the world to light space transformation matrix (without translation)
     Matrix4x4 worldToLight = scene_->mainLight()->worldToLocal();
@@ -346,12 +810,70 @@ Bounds VoxelTree::computeSceneBoundsLightSpace() const
     worldToLight.set(1, 3, 0.0);
     worldToLight.set(2, 3, 0.0);
     
-    // Create a Bounds containing the origin only.
-    Bounds bounds = Bounds(Vector3::zero(), Vector3::zero());
+    int instancesCount = (int)scene_->meshInstances()->size();
+    instanceBounds->assign(instancesCount, emptyBounds());
+    
+    Bounds bounds = emptyBounds();
+    if(instancesCount < ParallelBoundsThreshold)
+    {
+        bounds = instancesBoundsLightSpace(worldToLight, 0, instancesCount, instanceBounds);
+    }
+    else
+    {
+        // Cover a batch of instances on each thread
+        WorkerPool workers;
+        int batchSize = (instancesCount + workers.threadCount() - 1) / workers.threadCount();
+        int batchesCount = (instancesCount + batchSize - 1) / batchSize;
+        vector<Bounds> batchBounds(batchesCount, emptyBounds());
+        for(int batch = 0; batch < batchesCount; ++batch)
+        {
+            int begin = batch * batchSize;
+            int end = min(begin + batchSize, instancesCount);
+            workers.run([this, &worldToLight, &batchBounds, instanceBounds, batch, begin, end]()
+            {
+                batchBounds[batch] = instancesBoundsLightSpace(worldToLight, begin, end, instanceBounds);
+            });
+        }
+        
+        workers.wait();
+        
+        // Combine the batches that cover any instances
+        for(int batch = 0; batch < batchesCount; ++batch)
+        {
+            if(isEmpty(batchBounds[batch]))
+            {
+                continue;
+            }
+            
+            if(isEmpty(bounds))
+            {
+                bounds = batchBounds[batch];
+            }
+            else
+            {
+                bounds.expandToCover(batchBounds[batch]);
+            }
+        }
+    }
+    
+    // A scene without static objects is covered by bounds at the origin
+    if(isEmpty(bounds))
+    {
+        return Bounds(Vector3::zero(), Vector3::zero());
+    }
+    
+    return bounds;
+}
+
+Bounds VoxelTree::instancesBoundsLightSpace(const Matrix4x4 &worldToLight, int begin, int end, vector<Bounds>* instanceBounds) const
+{
+    // Start with bounds covering nothing, rather than the origin,
+    // so the tiles are not stretched over empty space
+    Bounds bounds = emptyBounds();
     
     // Expand the scene bounds to cover each mesh
     const vector<MeshInstance*>* instances = scene_->meshInstances();
-    for(unsigned int i = 0; i < instances->size(); ++i)
+    for(int i = begin; i < end; ++i)
     {
         // Get the mesh instance
         MeshInstance* instance = (*instances)[i];
@@ -362,49 +884,171 @@ Bounds VoxelTree::computeSceneBoundsLightSpace() const
             continue;
         }
         
-        // Get the model to light transformation
+        // Transform the corners of the mesh bounds to light space.
+        // This may cover slightly more than the vertices, but is much faster.
         Matrix4x4 modelToLight = worldToLight * instance->localToWorld();
+        Bounds meshBounds = instance->mesh()->bounds().transformed(modelToLight);
+        (*instanceBounds)[i] = meshBounds;
         
-        Mesh* mesh = instance->mesh();
-        for(int v = 0; v < mesh->verticesCount(); ++v)
+        if(isEmpty(bounds))
         {
-            // Convert each point to light space
-            Vector4 modelPos = Vector4(mesh->vertices()[v], 1.0);
-            Vector4 lightPos = modelToLight * modelPos;
-            
-            // Ensure the bounds cover the vertex
-            bounds.expandToCover(lightPos.vec3());
+            bounds = meshBounds;
+        }
+        else
+        {
+            bounds.expandToCover(meshBounds);
         }
     }
     
-    // Return the final bounds
     return bounds;
 }
 
+void VoxelTree::fitTileGrid()
+{
+    // Cover the static geometry, keeping the bounds of each instance
+    vector<Bounds> instanceBounds;
+    Bounds bounds = computeSceneBoundsLightSpace(&instanceBounds);
+    Vector3 size = bounds.size();
+    
+    // Make each tile as small as possible.
+    // Tiles must be a power of 2 in size.
+    tileResolution_ = 8;
+    while(tileResolution_ < treeResolution_ && tileResolution_ < maxTileResolution_)
+    {
+        tileResolution_ *= 2;
+    }
+    
+    // The requested resolution covers the longer side. Voxels are square,
+    // so the shorter side needs fewer tiles. A scene without static
+    // objects is given a small area, so the voxels have a size.
+    float longSide = max(max(size.x, size.y), 1.0f);
+    float sideVoxelsX = (size.x / longSide) * treeResolution_;
+    float sideVoxelsY = (size.y / longSide) * treeResolution_;
+    tilesX_ = tilesCovering(sideVoxelsX, tileResolution_);
+    tilesY_ = tilesCovering(sideVoxelsY, tileResolution_);
+    while(totalTiles() > MaxTileCount)
+    {
+        // Double the resolution until under the tile count limit.
+        tileResolution_ *= 2;
+        tilesX_ = tilesCovering(sideVoxelsX, tileResolution_);
+        tilesY_ = tilesCovering(sideVoxelsY, tileResolution_);
+    }
+    
+    // Each tile must be at least 8x8 so that leaf masks can be used
+    // and no more than 16K (maximum texture resolution)
+    assert(tileResolution_ >= 8);
+    assert(tileResolution_ <= 16384);
+    
+    // Grow the bounds to whole tiles around the geometry.
+    // The depth must cover at least a voxel for the shadow map to render.
+    float voxelSize = longSide / treeResolution_;
+    float tileSize = voxelSize * tileResolution_;
+    Vector3 centre = bounds.centre();
+    float depth = max(size.z, voxelSize);
+    Vector3 gridMin(centre.x - tilesX_ * tileSize / 2.0f, centre.y - tilesY_ * tileSize / 2.0f, centre.z - depth / 2.0f);
+    Vector3 gridMax(centre.x + tilesX_ * tileSize / 2.0f, centre.y + tilesY_ * tileSize / 2.0f, centre.z + depth / 2.0f);
+    sceneBoundsLightSpace_ = Bounds(gridMin, gridMax);
+    
+    // Fit each tile's depth to the instances over it.
+    // Tiles with none are left empty.
+    tileMinZ_.assign(totalTiles(), FLT_MAX);
+    tileMaxZ_.assign(totalTiles(), -FLT_MAX);
+    for(unsigned int i = 0; i < instanceBounds.size(); ++i)
+    {
+        const Bounds &b = instanceBounds[i];
+        if(isEmpty(b))
+        {
+            continue;
+        }
+        
+        // The tiles the instance overlaps
+        int minX = max(min((int)((b.min().x - gridMin.x) / tileSize), tilesX_ - 1), 0);
+        int maxX = max(min((int)((b.max().x - gridMin.x) / tileSize), tilesX_ - 1), 0);
+        int minY = max(min((int)((b.min().y - gridMin.y) / tileSize), tilesY_ - 1), 0);
+        int maxY = max(min((int)((b.max().y - gridMin.y) / tileSize), tilesY_ - 1), 0);
+        for(int x = minX; x <= maxX; ++x)
+        {
+            for(int y = minY; y <= maxY; ++y)
+            {
+                int tile = x * tilesY_ + y;
+                tileMinZ_[tile] = min(tileMinZ_[tile], b.min().z);
+                tileMaxZ_[tile] = max(tileMaxZ_[tile], b.max().z);
+            }
+        }
+    }
+    
+    // Keep the tile depths within the scene, and at least a voxel deep
+    float depthVoxel = depth / tileResolution_;
+    for(int tile = 0; tile < totalTiles(); ++tile)
+    {
+        if(tileMinZ_[tile] > tileMaxZ_[tile])
+        {
+            continue;
+        }
+        
+        tileMinZ_[tile] = max(tileMinZ_[tile], gridMin.z);
+        tileMaxZ_[tile] = min(max(tileMaxZ_[tile], tileMinZ_[tile] + depthVoxel), gridMax.z);
+        tileMinZ_[tile] = min(tileMinZ_[tile], tileMaxZ_[tile] - depthVoxel);
+    }
+    
+    // Set the correct shadow map resolution
+    shadowMap_.setCascades(1, tileResolution_);
+    
+    storedTiles_.assign(totalTiles(), NotStored);
+    loadingTiles_.assign(totalTiles(), 0);
+}
+
 Bounds VoxelTree::tileBoundsLightSpace(int index) const
 {
     // Get the bounds of the entire scene in light space
     Bounds sceneBounds = sceneBoundsLightSpace_;
     
     // Compute the light space size of each tile
-    float tileSizeX = sceneBounds.size().x / tileSubdivisions();
-    float tileSizeY = sceneBounds.size().y / tileSubdivisions();
+    float tileSizeX = sceneBounds.size().x / tilesX_;
+    float tileSizeY = sceneBounds.size().y / tilesY_;
     
     // Get the x and y position of the tile
-    int x = index / tileSubdivisions();
-    int y = index % tileSubdivisions();
+    int x = index / tilesY_;
+    int y = index % tilesY_;
+    
+    // Use the depth of the geometry over the tile, or the scene's for empty tiles
+    float minZ = sceneBounds.min().z;
+    float maxZ = sceneBounds.max().z;
+    if(tileMinZ_[index] <= tileMaxZ_[index])
+    {
+        minZ = tileMinZ_[index];
+        maxZ = tileMaxZ_[index];
+    }
     
     // Determine the light space bounds of the tile
     float posX = sceneBounds.min().x + (tileSizeX * x);
     float posY = sceneBounds.min().y + (tileSizeY * y);
-    Vector3 boundsMin(posX, posY, sceneBounds.min().z);
-    Vector3 boundsMax(posX + tileSizeX, posY + tileSizeY, sceneBounds.max().z);
+    Vector3 boundsMin(posX, posY, minZ);
+    Vector3 boundsMax(posX + tileSizeX, posY + tileSizeY, maxZ);
 
     return Bounds(boundsMin, boundsMax);
 }
 
-void VoxelTree::computeDualShadowMaps(const Bounds &bounds, float** entryDepths, float** exitDepths)
+void VoxelTree::tileDepthTransform(int index, float* offset, float* scale) const
+{
+    // Shadow map depth runs from the near to the far side of the bounds,
+    // and the voxels are that depth times the tile resolution
+    Bounds sceneBounds = sceneBoundsLightSpace_;
+    Bounds tileBounds = tileBoundsLightSpace(index);
+    float sceneDepth = sceneBounds.size().z;
+    
+    *scale = sceneDepth / tileBounds.size().z;
+    *offset = ((tileBounds.min().z - sceneBounds.min().z) / sceneDepth) * tileResolution_;
+}
+
+void VoxelTree::computeDualShadowMaps(const Bounds &bounds, int resolution, float** entryDepths, float** exitDepths)
 {
+    // Tiles with less detail are rendered at their own resolution
+    if(shadowMap_.resolution() != resolution)
+    {
+        shadowMap_.setCascades(1, resolution);
+    }
+    
     // Set the shadow map to cover the correct area
     shadowMap_.setLightSpaceBounds(bounds);
     
@@ -413,15 +1057,15 @@ void VoxelTree::computeDualShadowMaps(const Bounds &bounds, float** entryDepths,
     shadowMap_.renderCascades(true, false, false);
     
     // Store the depths as the shadow entry depths
-    *entryDepths = new float[tileResolution_ * tileResolution_];
-    glReadPixels(0, 0, tileResolution_, tileResolution_, GL_DEPTH_COMPONENT, GL_FLOAT, *entryDepths);
+    *entryDepths = new float[resolution * resolution];
+    glReadPixels(0, 0, resolution, resolution, GL_DEPTH_COMPONENT, GL_FLOAT, *entryDepths);
     
     // Render the shadow map back faces
-    glCullFace(GL_FRONT);
+    GLState::cullFace(GL_FRONT);
     shadowMap_.renderCascades(true, false, false); // Static objects only
-    glCullFace(GL_BACK);
+    GLState::cullFace(GL_BACK);
     
     // Store the depths as the shadow exit depths
-    *exitDepths = new float[tileResolution_ * tileResolution_];
-    glReadPixels(0, 0, tileResolution_, tileResolution_, GL_DEPTH_COMPONENT, GL_FLOAT, *exitDepths);
+    *exitDepths = new float[resolution * resolution];
+    glReadPixels(0, 0, resolution, resolution, GL_DEPTH_COMPONENT, GL_FLOAT, *exitDepths);
 }
@@ -3,10 +3,13 @@
 #define GL_GLEXT_PROTOTYPES 1 // Enables OpenGL 3 Features
 #include <QGLWidget> // Links OpenGL Headers
 
+#include <atomic>
 #include <queue>
+#include <string>
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 
 #include <QElapsedTimer>
 
@@ -19,35 +22,50 @@ using namespace std;
 #include "ShadowMap.hpp"
 #include "UniformManager.hpp"
 #include "VoxelBuilder.hpp"
+#include "VoxelPagePool.hpp"
+#include "VoxelTileStore.hpp"
+#include "WorkerPool.hpp"
 
 class VoxelTree
 {
     // The maximum tile count. Each tile is up to 16K.
     const static int MaxTileCount = 64*64;
     
-    // The maximum number of tiles that are built simultaneously.
-    const static int ConcurrentBuilds = 6;
-    
 public:
-    VoxelTree(UniformManager* uniformManager, const Scene* scene, int resolution);
+    // Any resolution can be used. It is the resolution of the longer side of
+    // the static geometry's light space bounds, and the other side has as many
+    // tiles as it needs for square voxels. Each side is rounded up to a whole
+    // number of power of 2 sized tiles, no larger than maxTileResolution where possible.
+    // The tiles on the GPU are limited to poolSizeMB, with the rest kept on disk.
+    VoxelTree(UniformManager* uniformManager, const Scene* scene, int resolution, int maxTileResolution = 4096,
+              int poolSizeMB = 256);
+    ~VoxelTree();
 
     // The size of the PCF filter kernel.
     // Either 9 or 17.
     int pcfFilterSize() const { return pcfKernelSize_; }
     
-    // The total resolution of the tree
-    int resolution() const { return treeResolution_; }
+    // The total resolution of the tree in x and y
+    int resolutionX() const { return tilesX_ * tileResolution_; }
+    int resolutionY() const { return tilesY_ * tileResolution_; }
     
-    // The number of subdivisions in each axis (x, y)
-    int tileSubdivisions() const { return treeResolution_ / tileResolution_; }
+    // The number of tiles in each axis.
+    // Known once the scene has loaded, until then the tree is a single tile.
+    int tilesX() const { return tilesX_; }
+    int tilesY() const { return tilesY_; }
     
-    // The number of tiles in different states
-    int totalTiles() const { return tileSubdivisions() * tileSubdivisions(); }
+    // The number of tiles in different states.
+    // Tiles with no static geometry over them are empty, and count as completed.
+    int totalTiles() const { return tilesX_ * tilesY_; }
     int completedTiles() const { return uploadedTiles_; }
+    int cachedTiles() const { return cachedTiles_; }
+    int emptyTiles() const { return emptyTiles_; }
+    int residentTiles() const { return pagePool_->residentTiles(); }
     
-    // The size of the tree
+    // The size of the tree, and of the tiles resident on the GPU
     size_t sizeBytes() const;
     size_t sizeMB() const;
+    size_t residentSizeMB() const;
     
     // The size of an equivalent shadow map in bytes
     // This assumes the shadow map uses 24 bits per pixel.
@@ -55,83 +73,257 @@ public:
     size_t originalSizeMB() const;
     
     // The voxels buffer texture id
-    GLuint treeBufferTexture() const { return bufferTexture_; }
+    GLuint treeBufferTexture() const { return pagePool_->bufferTexture(); }
     
     // Sets the size of the PCF filter kernel.
     // Must be either 1, 9 or 17.
     void setPCFFilterSize(int kernelSize);
     
+    // Sets the maximum number of tiles that are built simultaneously.
+    void setConcurrentBuilds(int concurrentBuilds);
+    
+    // Sets the light space distance from the camera within which tiles are
+    // built. Every tile is first built at the minimum tile resolution, and
+    // further tiles show that version until the camera comes within the distance.
+    // 0 builds every tile.
+    void setBakeDistance(float distance);
+    
+    // Builds tiles further than the distance from the play area at a lower
+    // resolution, halving it for each multiple of the distance, down to
+    // minTileResolution. The play area is where the scene's camera starts,
+    // so it doesn't move when the tree is recreated. 0 builds every tile at full resolution.
+    // Must be set before the first update.
+    void setDetailDistance(float distance, int minTileResolution);
+    
+    // Keeps built tiles in VOXEL_CACHE_DIRECTORY, so later runs with the same
+    // scene, light and resolution load them rather than building them again.
+    // Must be set before the first update.
+    void setTileCacheEnabled(bool enabled);
+    
+    // Sets the light space distance from the camera within which tiles are
+    // kept resident. Further tiles are evicted when the space is needed.
+    // 0 loads every tile that fits.
+    void setResidentDistance(float distance);
+    
     // Carrys out the tree construction process using time slicing.
     // Most of the work is carried out via background threads, but
     // some work (eg openGL rendering) occurs on the main thread
     // inside this function.
+    // The build starts once the scene has finished loading its assets.
     void updateBuild();
     
+    // True until every tile within the bake distance is built and shown
+    bool isBuilding() const;
+    
+    // Loads every tile within the resident distance that fits in the pool,
+    // rather than a few each frame
+    void finishLoading();
+    
 private:
+    // Scenes with at least this many instances find their bounds on worker threads
+    const static int ParallelBoundsThreshold = 4096;
+    
+    // The most tiles read from the store at once
+    const static int MaxLoadsInFlight = 4;
+    
     UniformManager* uniformManager_;
     const Scene* scene_;
+    
+    // The light space bounds of the static geometry,
+    // grown in x and y to cover whole tiles
     Bounds sceneBoundsLightSpace_;
     
+    // True once the scene bounds cover every loaded mesh,
+    // and once the tiles have been queued after that
+    bool sceneLoaded_;
+    bool buildStarted_;
+    
     // A timer used for construction time measurements
     QElapsedTimer buildTimer_;
     
     // The size of the PCF filter kernel
     int pcfKernelSize_;
     
-    // The building status
+    // The maximum number of tiles that are built simultaneously.
+    int concurrentBuilds_;
+    
+    // Only tiles within this distance of the camera are built, if set
+    float bakeDistance_;
+    
+    // Tiles further than this from the play area have fewer levels, if set
+    float detailDistance_;
+    int minTileResolution_;
+    Vector3 playAreaLightSpace_;
+    
+    // True if built tiles are kept in the cache directory
+    bool tileCacheEnabled_;
+    
+    // The building status.
+    // Coarse tiles are the builds at the minimum resolution that have been shown.
     int startedTiles_;
     int mergedTiles_;
     int uploadedTiles_;
+    int coarseTiles_;
+    int cachedTiles_;
+    int emptyTiles_;
     
-    // Resolution of the entire tree and an individual tile
+    // The requested resolution of the longer side and the largest tile resolution
     int treeResolution_;
+    int maxTileResolution_;
+    
+    // The resolution of an individual tile at full detail, and the tile counts
     int tileResolution_;
+    int tilesX_;
+    int tilesY_;
     
-    // The voxel buffer and containing buffer texture.
-    GLuint buffer_;
-    GLuint bufferTexture_;
+    // The light space depth range of the static geometry over each tile.
+    // The minimum is above the maximum for empty tiles.
+    vector<float> tileMinZ_;
+    vector<float> tileMaxZ_;
     
     // A shadow map with 1 cascade. Used for creating dual shadow maps.
     ShadowMap shadowMap_;
     
-    // The VoxelWriter containing the entire tree.
-    VoxelWriter voxelWriter_;
+    // Writes each finished tile as a relocatable subtree. Used by the merging thread.
+    VoxelWriter tileWriter_;
+    
+    // The subtree of every merged tile
+    VoxelTileStore tileStore_;
+    
+    // The subtree of every tile built at minTileResolution_, shown until the
+    // tile is built at its own resolution. Tiles whose own resolution is
+    // minTileResolution_ are only kept in tileStore_.
+    VoxelTileStore coarseTileStore_;
     
-    // The tiles that are not started yet and those being built
+    // The GPU buffer holding the resident tiles
+    VoxelPagePool* pagePool_;
+    
+    // The tiles that are not started yet and those being built.
+    // The coarse versions are built first, closest to the camera last in the queue.
+    vector<int> notStartedCoarseTiles_;
     vector<int> notStartedTiles_;
     vector<VoxelBuilder*> activeTiles_;
     mutex activeTilesMutex_;
     
-    // The thread that merges finished tiles into voxelWriter_
+    // Wakes the merging thread when a builder finishes or merging is stopped
+    condition_variable builderFinished_;
+    
+    // Tiles merged since the last update, waiting to be shown,
+    // and whether each is a coarse version
+    vector<pair<int, bool> > mergedTilesQueue_;
+    mutex mergedTilesMutex_;
+    
+    // The version of a tile that is shown and loaded from the stores
+    enum StoredVersion
+    {
+        NotStored = 0,
+        StoredCoarse,
+        StoredFull
+    };
+    
+    // Residency state, used on the main thread.
+    // storedTiles_ is the StoredVersion of each tile, and loadingTiles_
+    // is non zero for the tiles being read from a store.
+    float residentDistance_;
+    int residencyFrame_;
+    int loadsInFlight_;
+    vector<unsigned char> storedTiles_;
+    vector<unsigned char> loadingTiles_;
+    
+    // Tiles read from the store, waiting to be uploaded
+    struct LoadedTile
+    {
+        int tile;
+        bool coarse;
+        bool valid;
+        vector<uint32_t> words;
+    };
+    
+    vector<LoadedTile> loadedTiles_;
+    mutex loadedTilesMutex_;
+    
+    // The thread that merges finished tiles into the store, until stopped.
+    // It sleeps while no builder has finished.
+    atomic<bool> stopMerging_;
     thread mergingThread_;
     
+    // Reads tiles from the store. Declared last, so its jobs finish
+    // before anything they use is destroyed.
+    WorkerPool loader_;
+    
+    // Fits the tile grid to the static geometry, and each tile's depth range
+    // to the geometry over it
+    void fitTileGrid();
+    
+    // Opens the tile stores, showing the tiles that are already in them
+    // and queueing the others to be built
+    void startBuild();
+    
+    // The file the tiles are cached in, named by a hash of the
+    // resolutions, the light and the static instances
+    string tileCacheFileName(const char* extension) const;
+    
     // Starts the processing of the next queued tile.
     // Renders the tile's depth maps and starts a builder thread.
     void startTileBuild();
     int getNextTileToStart();
     
+    // The position in the queue of the closest tile within the bake distance,
+    // or -1 if there is none
+    int closestTileToStart() const;
+    
     // Runs on the merging thread.
-    // Merges finished builders into the
+    // Writes finished builders into the tile store.
     void mergeTiles();
     
+    // Shows the coarse state of newly merged tiles
+    void collectMergedTiles();
+    
+    // Uploads the tiles that have been read, and reads the closest
+    // tiles that are wanted and not resident
+    void updateResidency();
+    void collectLoadedTiles();
+    void loadTile(int tile);
+    
+    // The store holding the version of the tile that is shown
+    const VoxelTileStore &shownTileStore(int tile) const;
+    
+    // The position of the main camera in light space (without translation)
+    Vector3 cameraPositionLightSpace() const;
+    
+    // A world space position in light space (without translation)
+    Vector3 positionLightSpace(const Vector3 &position) const;
+    
+    // The light space distance from the point to the tile, in x and y
+    float tileDistance(int index, const Vector3 &lightSpacePoint) const;
+    
+    // The resolution the tile is built at, from its distance to the play area
+    int tileResolution(int index) const;
+    
     // Looks for a builder that has finished and is ready
     // to be merged. Removes it from the active tiles vector.
     VoxelBuilder* findFinishedBuilder();
     
-    // Updates the uniform buffer and tree texture buffer
-    void updateBuffers();
+    // Updates the uniform buffer
     void updateUniformBuffer();
-    void updateTreeBuffer();
     
     // Computes the bitmask to use on a leaf for the with
     // the specified PCF kernel centre coordinates
     uint64_t pcfBitmask(int kernelX, int kernelY) const;
     
     // Computes bounds of the scene in light space.
-    // The bounds includes *static* objects only.
-    Bounds computeSceneBoundsLightSpace() const;
+    // The bounds includes *static* objects only, and is stored for each of
+    // them in instanceBounds. Other instances have empty bounds.
+    Bounds computeSceneBoundsLightSpace(vector<Bounds>* instanceBounds) const;
     Bounds tileBoundsLightSpace(int index) const;
     
+    // Covers the static instances in the range, using the corners of their mesh bounds
+    Bounds instancesBoundsLightSpace(const Matrix4x4 &worldToLight, int begin, int end, vector<Bounds>* instanceBounds) const;
+    
+    // The tile's shadow map depth as a scale and offset of the scene's,
+    // in voxels. Used by the shader to find a position's depth within the tile.
+    void tileDepthTransform(int index, float* offset, float* scale) const;
+    
     // Renders dual shadow maps for the scene.
-    void computeDualShadowMaps(const Bounds &bounds, float** entryDepths, float** exitDepths);
+    void computeDualShadowMaps(const Bounds &bounds, int resolution, float** entryDepths, float** exitDepths);
 };
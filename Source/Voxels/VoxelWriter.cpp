@@ -5,50 +5,23 @@
 #include <cmath>
 
 VoxelWriter::VoxelWriter()
-    : innerNodeLocations_(),
+    : data_(),
+    innerNodeLocations_(),
     leafLocations_()
 {
-    // Define the max buffer size
-    const uint32_t bufferSizeMB = 128;
-    const uint32_t bufferSizeB = bufferSizeMB * 1024 * 1024;
-    maxSizeWords_ = bufferSizeB / 4;
-    
-    // Allocate the buffer
-    data_ = new uint32_t[maxSizeWords_];
-    sizeWords_ = 0;
+
 }
 
 VoxelWriter::~VoxelWriter()
 {
-    delete[] data_;
-}
 
-void VoxelWriter::reserveRootNodePointerSpace(int pointerCount)
-{
-    // Must be an empty buffer with enough space
-    assert(sizeWords_ == 0);
-    assert(pointerCount < (int)maxSizeWords_);
-    
-    // Each pointer occupies 1 word.
-    sizeWords_ = pointerCount;
-    
-    // Create a dummy 100% unshadowed node for the root nodes
-    // to point at until the tiles are properly created
-    VoxelInnerNode node;
-    node.childMask = 21845; // = 0101010101010101 = 8 Unshadowed children
-    VoxelPointer nodePtr = writeNode(node, 0, 0);
-    
-    // Set each of the new pointers to the new address
-    for(int i = 0; i < pointerCount; ++i)
-    {
-        setRootNodePointer(i, nodePtr);
-    }
 }
 
-void VoxelWriter::setRootNodePointer(int index, VoxelPointer value)
+void VoxelWriter::clear()
 {
-    // The pointers are stored in the words at the start of the buffer.
-    data_[index] = value;
+    data_.clear();
+    innerNodeLocations_.clear();
+    leafLocations_.clear();
 }
 
 VoxelPointer VoxelWriter::writeNode(const VoxelInnerNode &node, int expandedChildCount, VoxelNodeHash hash)
@@ -103,6 +76,25 @@ VoxelPointer VoxelWriter::writeTree(const uint32_t* tree, VoxelPointer root, int
     return writeSubtree(tree, root, height, &hash);
 }
 
+void VoxelWriter::writeTile(const uint32_t* tree, VoxelPointer root, int resolution)
+{
+    clear();
+    
+    // Reserve the first word for the root position, followed by the height.
+    // Nodes are written from position 0, so every pointer is relative to it.
+    uint32_t header[TileHeaderWords] = { 0, (uint32_t)log2(resolution) };
+    writeWords(header, TileHeaderWords);
+    VoxelPointer rootPosition = writeTree(tree, root, resolution);
+    data_[0] = rootPosition;
+}
+
+uint32_t VoxelWriter::tileCoarseState() const
+{
+    // The child mask is the high half of the node's first word
+    assert(data_.size() > TileHeaderWords);
+    return (data_[data_[0]] >> 16) | (data_[1] << 16);
+}
+
 VoxelPointer VoxelWriter::writeSubtree(const uint32_t* tree, uint32_t nodeLocation, int height, uint64_t* hash)
 {
     // Check the height is valid
@@ -113,7 +105,8 @@ VoxelPointer VoxelWriter::writeSubtree(const uint32_t* tree, uint32_t nodeLocati
     if(height == 1)
     {
         // Get the leaf node
-        VoxelLeafNode leafNode = *(const VoxelLeafNode*)(tree + nodeLocation);
+        VoxelLeafNode leafNode;
+        memcpy(&leafNode, tree + nodeLocation, sizeof(VoxelLeafNode));
         
         // The hash is the leaf mask
         *hash = leafNode.leafMask;
@@ -123,7 +116,15 @@ VoxelPointer VoxelWriter::writeSubtree(const uint32_t* tree, uint32_t nodeLocati
     }
     
     // Otherwise, it is an inner node.
-    VoxelInnerNode innerNode = *(const VoxelInnerNode*)(tree + nodeLocation);
+    // Only the words of the expanded children are stored, so copy no more than those.
+    VoxelInnerNode innerNode;
+    memcpy(&innerNode, tree + nodeLocation, sizeof(uint32_t));
+    int expandedChildCount = 0;
+    for(int i = 0; i < 8; ++i)
+    {
+        expandedChildCount += innerNode.isChildExpanded(i) ? 1 : 0;
+    }
+    memcpy(innerNode.childPositions, tree + nodeLocation + 1, expandedChildCount * sizeof(uint32_t));
     
     // Keep track of child hashes
     uint64_t childHashes[8];
@@ -160,16 +161,15 @@ VoxelPointer VoxelWriter::writeSubtree(const uint32_t* tree, uint32_t nodeLocati
 
 VoxelPointer VoxelWriter::writeWords(const void* words, int wordCount)
 {
-    // Check the word count is valid and not too big
+    // Check the word count is valid
     assert(wordCount > 0);
-    assert(sizeWords_ + wordCount <= maxSizeWords_);
     
     // Remember the start position
-    uint32_t startPos = sizeWords_;
+    uint32_t startPos = (uint32_t)data_.size();
     
     // Write to the buffer
-    memcpy(data_ + sizeWords_, words, wordCount * 4);
-    sizeWords_ += wordCount;
+    const uint32_t* source = (const uint32_t*)words;
+    data_.insert(data_.end(), source, source + wordCount);
     
     // Return the location
     return startPos;
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <unordered_map>
+#include <vector>
 
 #include "VoxelNode.hpp"
 
@@ -11,22 +12,22 @@
 class VoxelWriter
 {
 public:
+    // The words before the nodes of a tile written by writeTile
+    const static int TileHeaderWords = 2;
+    
     VoxelWriter();
     ~VoxelWriter();
     
     // The serialized tree data
-    const void* data() const { return data_; }
+    const void* data() const { return data_.empty() ? NULL : &data_[0]; }
+    const std::vector<uint32_t> &words() const { return data_; }
     
     // The size of the written data
-    size_t dataSizeBytes() const { return sizeWords_ * 4; }
-    size_t dataSizeWords() const { return sizeWords_; }
-    
-    // Reserves space for the specified number of root node
-    // pointers at the start of the buffer.
-    void reserveRootNodePointerSpace(int pointerCount);
+    size_t dataSizeBytes() const { return data_.size() * 4; }
+    size_t dataSizeWords() const { return data_.size(); }
     
-    // Sets a root node pointer to the specified index.
-    void setRootNodePointer(int index, VoxelPointer value);
+    // Removes the written data and forgets the written nodes
+    void clear();
     
     // Writes an inner node to the buffer.
     // Returns its position pointer.
@@ -40,10 +41,18 @@ public:
     // Returns a pointer to the root node.
     VoxelPointer writeTree(const uint32_t* tree, VoxelPointer root, int resolution);
     
+    // Replaces the data with a tile's subtree that can be copied anywhere.
+    // The first word is the position of the root node, and it and every
+    // child pointer are relative to the start of the data.
+    // The second word is the height of the tile, log2 of its resolution.
+    void writeTile(const uint32_t* tree, VoxelPointer root, int resolution);
+    
+    // The state shown for the tile written by writeTile while it is not loaded.
+    // The low 16 bits are the child mask of the root node, and the tile height is above them.
+    uint32_t tileCoarseState() const;
+    
 private:
-    uint32_t* data_;
-    uint32_t sizeWords_;
-    uint32_t maxSizeWords_;
+    std::vector<uint32_t> data_;
     
     // Cache of leaf and inner node locations, stored based on hash
     std::unordered_map<VoxelNodeHash, VoxelPointer> innerNodeLocations_;
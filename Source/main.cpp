@@ -2,61 +2,73 @@
 
 #include <string>
 
+#include "AssetPack.hpp"
 #include "MainWindow.hpp"
 #include "MainWindowController.hpp"
+#include "CameraPath.hpp"
+#include "MathBenchmark.hpp"
+#include "Settings.hpp"
 
-bool flagSet(std::string flag, int argc, char* argv[])
+int main(int argc, char* argv[])
 {
-    for(int i = 0; i < argc; ++i)
+    QApplication app(argc, argv);
+
+    // Read settings from the config file and command line
+    Settings settings;
+    if(!settings.parseArguments(argc, argv))
     {
-        // Check if the flag exists
-        std::string actualValue(argv[i]);
-        if(actualValue == flag)
-        {
-            return true;
-        }
+        return 1;
     }
-    
-    // No flag set.
-    return false;
-}
+    RendererSettings rendererSettings = settings.rendererSettings();
 
-int getTreeResolution(int argc, char* argv[])
-{
-    // Look for a resolution flag
-    if(flagSet("2k", argc, argv)) return 2048;
-    if(flagSet("4k", argc, argv)) return 4096;
-    if(flagSet("8k", argc, argv)) return 8192;
-    if(flagSet("16k", argc, argv)) return 16384;
-    if(flagSet("32k", argc, argv)) return 32768;
-    if(flagSet("64k", argc, argv)) return 65536;
-    if(flagSet("128k", argc, argv)) return 131072;
-    if(flagSet("256k", argc, argv)) return 262144;
-    if(flagSet("512k", argc, argv)) return 524288;
-    
-    // No flag set, use 32K as the default
-    return 32768;
-}
+    // Convert the scene to an asset pack instead of running, if specified
+    std::string packFile = settings.getString("scene.pack_output", "");
+    if(!packFile.empty())
+    {
+        return AssetPack::convert(rendererSettings.sceneFile, packFile) ? 0 : 1;
+    }
+
+    // Time the math operations instead of running, if specified
+    if(settings.getBool("benchmark.math", false))
+    {
+        return MathBenchmark::run() ? 0 : 1;
+    }
 
-int main(int argc, char* argv[])
-{
-    QApplication app(argc, argv);
-    
     // Specify OpenGL 4.0 Core Profile
     QGLFormat format = QGLFormat::defaultFormat();
     format.setVersion(4, 0);
     format.setProfile(QGLFormat::CoreProfile);
     
+    // Load the benchmark camera path, if specified
+    CameraPath* benchmarkPath = NULL;
+    std::string benchmarkFile = settings.getString("benchmark.path", "");
+    if(!benchmarkFile.empty())
+    {
+        benchmarkPath = new CameraPath();
+        if(!benchmarkPath->loadFromFile(benchmarkFile))
+        {
+            return 1;
+        }
+    }
+
+    // A sweep without a path measures a still camera
+    bool benchmarking = (benchmarkPath != NULL) || settings.containsSection("sweep");
+    if(benchmarking)
+    {
+        // Don't limit the frame rate while measuring
+        format.setSwapInterval(0);
+    }
+    
     // Create the window and controller
-    bool fullScreen = flagSet("-fullscreen", argc, argv);
-    MainWindow* window = new MainWindow(fullScreen, format, getTreeResolution(argc, argv));
+    bool fullScreen = settings.getBool("window.fullscreen", false);
+    MainWindow* window = new MainWindow(fullScreen, format, rendererSettings);
     MainWindowController* controller = new MainWindowController(window);
 
     // Pass all events to the controller
     app.installEventFilter(controller);
 
     // Show the window
-    window->resize(1350, 850);
+    window->resize(settings.getInt("window.width", 1350), settings.getInt("window.height", 850));
     window->setWindowTitle("Shadow Rendering");
     
     if(fullScreen)
@@ -71,11 +83,28 @@ int main(int argc, char* argv[])
         window->show();
     }
     
-    // Precompute the voxel tree, if specified
-    if(flagSet("-precompute", argc, argv))
+    // Precompute the voxel tree, if specified.
+    // Benchmarks always use the complete tree.
+    if(rendererSettings.precomputeTree || benchmarking)
     {
         window->rendererWidget()->precomputeTree();
     }
     
+    // Start the benchmark, if specified
+    if(benchmarking)
+    {
+        std::string outputFile = settings.getString("benchmark.output", "benchmark.csv");
+        std::string summaryFile = settings.getString("benchmark.summary", "benchmark-summary.csv");
+        vector<BenchmarkConfiguration> configurations = Benchmark::createConfigurations(settings, rendererSettings);
+        controller->startBenchmark(benchmarkPath, configurations, outputFile, summaryFile);
+    }
+    
+    // Record a camera path for benchmarking, if specified
+    std::string recordFile = settings.getString("benchmark.record", "");
+    if(!recordFile.empty())
+    {
+        controller->startRecording(recordFile);
+    }
+    
     return app.exec();
 }